@@ -0,0 +1,377 @@
+#pragma once
+
+#include "util.h"
+#include "values.h"
+#include "exception.h"
+#include "threading.h"
+#include "kernels/elementwise.h"
+
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Augmentation
+    {
+        /*!
+         * A counter based random number generator (SplitMix64). Every sample owns an independent stream that only
+         * depends on the augmentation seed and the id of the sample. Hence, the drawn parameters do not depend on the
+         * order in which samples are processed or on the number of threads.
+         */
+        class SampleRandom
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <SampleRandom> class.
+             *
+             * @param seed The global augmentation seed
+             * @param sampleId The id of the sample
+             */
+            SampleRandom(uint64_t seed, uint64_t sampleId) : state(seed)
+            {
+                state ^= mix(sampleId + 0x9E3779B97F4A7C15ull);
+            }
+
+            /*!
+             * Returns the next 64 random bits.
+             */
+            uint64_t next()
+            {
+                state += 0x9E3779B97F4A7C15ull;
+                return mix(state);
+            }
+
+            /*!
+             * Returns a uniformly distributed number in [0, 1).
+             */
+            double uniform()
+            {
+                return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+            }
+
+            /*!
+             * Returns a uniformly distributed number in [a, b).
+             */
+            double uniform(double a, double b)
+            {
+                return a + (b - a) * uniform();
+            }
+
+        private:
+            /*!
+             * The SplitMix64 finalizer.
+             */
+            static uint64_t mix(uint64_t z)
+            {
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                return z ^ (z >> 31);
+            }
+
+            /*!
+             * The generator state.
+             */
+            uint64_t state;
+        };
+
+        /*!
+         * The augmentation parameters that have been drawn for a single sample.
+         */
+        struct SampleParameters
+        {
+            /*!
+             * The position of the crop window in the input image.
+             */
+            double offsetX, offsetY;
+            /*!
+             * The size of the crop window relative to the output size.
+             */
+            double scale;
+            /*!
+             * Whether or not the sample is flipped horizontally (along the first axis).
+             */
+            bool flip;
+            /*!
+             * Additive brightness offset.
+             */
+            float brightness;
+            /*!
+             * Multiplicative contrast factor.
+             */
+            float contrast;
+        };
+
+        /*!
+         * This class performs on-the-fly data augmentation on a batch of images in the CNTK tensor layout
+         * (width, height, channels, sequence, batch). Random cropping, random scaling, horizontal flipping,
+         * brightness/contrast jitter and mean/std normalization are fused into a single pass over the output memory:
+         * All color operations collapse into one affine transformation per channel.
+         */
+        class Augmenter
+        {
+        public:
+            typedef Augmenter Self;
+
+            /*!
+             * The size (width, height) of the output images.
+             */
+            Values::ArrayValue<uint64_t, 2> _cropSize;
+            /*!
+             * Whether the crop position is random. If not, the crop is centered.
+             */
+            bool _randomCrop;
+            /*!
+             * The range [min, max] of the crop window size relative to the output size. Values larger than 1 zoom
+             * out, values smaller than 1 zoom in.
+             */
+            Values::ArrayValue<double, 2> _scale;
+            /*!
+             * The probability of flipping an image horizontally.
+             */
+            double _flipProbability;
+            /*!
+             * The maximum absolute brightness offset.
+             */
+            float _brightness;
+            /*!
+             * The maximum relative contrast change. The contrast is changed around the normalization mean of the channel
+             * (see <_mean>), i.e. around 0 if no mean is set. Using a fixed pivot keeps the jitter a single affine
+             * transform per channel, whereas the mean of every image would require an extra pass.
+             */
+            float _contrast;
+            /*!
+             * The per-channel mean that is subtracted. Leave empty to skip normalization.
+             */
+            std::vector<float> _mean;
+            /*!
+             * The per-channel standard deviation by which the data is divided. Leave empty to skip normalization.
+             */
+            std::vector<float> _std;
+            /*!
+             * The global seed.
+             */
+            uint64_t _seed;
+            /*!
+             * The number of threads that process the batch.
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <Augmenter> class.
+             */
+            Augmenter() :
+                    _cropSize{224, 224},
+                    _randomCrop(true),
+                    _scale{1.0, 1.0},
+                    _flipProbability(0.5),
+                    _brightness(0.0f),
+                    _contrast(0.0f),
+                    _seed(0),
+                    _numThreads(Threading::defaultNumThreads())
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(cropSize, _cropSize)
+            MAKE_SETTER(cropSize, _cropSize)
+
+            MAKE_GETTER(randomCrop, _randomCrop)
+            MAKE_SETTER(randomCrop, _randomCrop)
+
+            MAKE_GETTER(scale, _scale)
+            MAKE_SETTER(scale, _scale)
+
+            MAKE_GETTER(flipProbability, _flipProbability)
+            MAKE_SETTER(flipProbability, _flipProbability)
+
+            MAKE_GETTER(brightness, _brightness)
+            MAKE_SETTER(brightness, _brightness)
+
+            MAKE_GETTER(contrast, _contrast)
+            MAKE_SETTER(contrast, _contrast)
+
+            MAKE_GETTER(mean, _mean)
+            MAKE_SETTER(mean, _mean)
+
+            MAKE_GETTER(std, _std)
+            MAKE_SETTER(std, _std)
+
+            MAKE_GETTER(seed, _seed)
+            MAKE_SETTER(seed, _seed)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Draws the augmentation parameters of a sample.
+             *
+             * @param sampleId The global id of the sample (e.g. epoch * datasetSize + index)
+             * @param width The width of the input image
+             * @param height The height of the input image
+             * @return The augmentation parameters
+             */
+            SampleParameters sample(uint64_t sampleId, size_t width, size_t height) const
+            {
+                SampleRandom random(this->_seed, sampleId);
+                SampleParameters p;
+
+                // The draws always happen in the same order such that the streams stay aligned
+                const double u = random.uniform();
+                const double ux = random.uniform();
+                const double uy = random.uniform();
+                p.flip = random.uniform() < this->_flipProbability;
+                p.brightness = static_cast<float>(random.uniform(-this->_brightness, this->_brightness));
+                p.contrast = static_cast<float>(random.uniform(1.0 - this->_contrast, 1.0 + this->_contrast));
+
+                // The crop window must fit into the image
+                const double maxScale = std::min(
+                        static_cast<double>(width) / this->_cropSize[0],
+                        static_cast<double>(height) / this->_cropSize[1]);
+                p.scale = std::min(this->_scale[0] + (this->_scale[1] - this->_scale[0]) * u, maxScale);
+
+                const double freeX = width - p.scale * this->_cropSize[0];
+                const double freeY = height - p.scale * this->_cropSize[1];
+
+                if (p.scale == 1.0)
+                {
+                    // Stay on the pixel grid such that no interpolation is required
+                    p.offsetX = std::floor((this->_randomCrop ? ux : 0.5) * (freeX + 1.0 - 1e-9));
+                    p.offsetY = std::floor((this->_randomCrop ? uy : 0.5) * (freeY + 1.0 - 1e-9));
+                }
+                else
+                {
+                    p.offsetX = (this->_randomCrop ? ux : 0.5) * freeX;
+                    p.offsetY = (this->_randomCrop ? uy : 0.5) * freeY;
+                }
+
+                return p;
+            }
+
+            /*!
+             * Augments a batch of images.
+             *
+             * @param input The input images. Shape: (width, height, channels, sequence, batch)
+             * @param output The output images. Shape: (cropWidth, cropHeight, channels, sequence, batch)
+             * @param firstSampleId The global id of the first sample in the batch. The i-th image in the batch uses the
+             * id firstSampleId + i.
+             */
+            void apply(const Eigen::Tensor<float, 5> & input, Eigen::Tensor<float, 5> & output, uint64_t firstSampleId = 0) const
+            {
+                const size_t width = static_cast<size_t>(input.dimension(0));
+                const size_t height = static_cast<size_t>(input.dimension(1));
+                const size_t numChannels = static_cast<size_t>(input.dimension(2));
+                const size_t numSamples = static_cast<size_t>(input.dimension(3) * input.dimension(4));
+                const size_t cropWidth = this->_cropSize[0];
+                const size_t cropHeight = this->_cropSize[1];
+
+                Exception::assertArgument(cropWidth <= width && cropHeight <= height, "The crop size must not exceed the input size.");
+                Exception::assertArgument(static_cast<size_t>(output.dimension(0)) == cropWidth, "Output width must match the crop size.");
+                Exception::assertArgument(static_cast<size_t>(output.dimension(1)) == cropHeight, "Output height must match the crop size.");
+                Exception::assertArgument(output.dimension(2) == input.dimension(2), "Input and output must have the same number of channels.");
+                Exception::assertArgument(output.dimension(3) * output.dimension(4) == input.dimension(3) * input.dimension(4), "Input and output must have the same number of samples.");
+                Exception::assertArgument(this->_mean.empty() || this->_mean.size() == numChannels, "There must be one mean per channel.");
+                Exception::assertArgument(this->_std.empty() || this->_std.size() == numChannels, "There must be one standard deviation per channel.");
+                Exception::assertArgument(this->_scale[0] > 0 && this->_scale[0] <= this->_scale[1], "Invalid scale range.");
+
+                const float* src = input.data();
+                float* dst = output.data();
+
+                // The rows of a pure crop are transformed by the dispatched kernels
+                static const Kernels::AffineRowKernel affineRow = Kernels::affineRowKernels().select();
+                static const Kernels::AffineRowKernel reversedAffineRow = Kernels::reversedAffineRowKernels().select();
+
+                // Each work item is one channel of one image
+                Threading::parallelFor(numSamples * numChannels, this->_numThreads, [&](size_t begin, size_t end) {
+                    std::vector<size_t> x0, x1, y0, y1;
+                    std::vector<float> wx, wy;
+
+                    for (size_t item = begin; item < end; item++)
+                    {
+                        const size_t n = item / numChannels;
+                        const size_t c = item % numChannels;
+                        const SampleParameters p = this->sample(firstSampleId + n, width, height);
+
+                        // Collapse contrast, brightness and normalization into out = alpha * in + beta
+                        const float channelMean = this->_mean.empty() ? 0.0f : this->_mean[c];
+                        const float channelStd = this->_std.empty() ? 1.0f : this->_std[c];
+                        const float alpha = p.contrast / channelStd;
+                        const float beta = (p.brightness - channelMean * p.contrast) / channelStd;
+
+                        const float* plane = src + item * width * height;
+                        float* out = dst + item * cropWidth * cropHeight;
+
+                        if (p.scale == 1.0)
+                        {
+                            // Pure crop: Contiguous rows, mirrored for a flip
+                            const size_t offsetX = static_cast<size_t>(p.offsetX);
+                            const size_t offsetY = static_cast<size_t>(p.offsetY);
+                            const Kernels::AffineRowKernel transform = p.flip ? reversedAffineRow : affineRow;
+
+                            for (size_t y = 0; y < cropHeight; y++)
+                            {
+                                transform(plane + (offsetY + y) * width + offsetX, alpha, beta, out + y * cropWidth, cropWidth);
+                            }
+                        }
+                        else
+                        {
+                            // Scaled crop: Bilinear sampling with precomputed source positions
+                            samplingPositions(p.offsetX, p.scale, cropWidth, width, p.flip, x0, x1, wx);
+                            samplingPositions(p.offsetY, p.scale, cropHeight, height, false, y0, y1, wy);
+
+                            for (size_t y = 0; y < cropHeight; y++)
+                            {
+                                const float* row0 = plane + y0[y] * width;
+                                const float* row1 = plane + y1[y] * width;
+                                const float v = wy[y];
+                                float* outRow = out + y * cropWidth;
+
+                                for (size_t x = 0; x < cropWidth; x++)
+                                {
+                                    const float top = row0[x0[x]] + wx[x] * (row0[x1[x]] - row0[x0[x]]);
+                                    const float bottom = row1[x0[x]] + wx[x] * (row1[x1[x]] - row1[x0[x]]);
+                                    outRow[x] = alpha * (top + v * (bottom - top)) + beta;
+                                }
+                            }
+                        }
+                    }
+                });
+            }
+
+        private:
+            /*!
+             * Computes the source positions and interpolation weights of bilinear sampling along one axis.
+             *
+             * @param offset The position of the crop window
+             * @param scale The size of the crop window relative to the output size
+             * @param outputSize The number of output pixels
+             * @param inputSize The number of input pixels
+             * @param flip Whether or not the axis is mirrored
+             * @param i0 The lower source indices
+             * @param i1 The upper source indices
+             * @param w The interpolation weights of the upper source indices
+             */
+            static void samplingPositions(double offset, double scale, size_t outputSize, size_t inputSize, bool flip, std::vector<size_t> & i0, std::vector<size_t> & i1, std::vector<float> & w)
+            {
+                i0.resize(outputSize);
+                i1.resize(outputSize);
+                w.resize(outputSize);
+
+                for (size_t i = 0; i < outputSize; i++)
+                {
+                    const size_t o = flip ? outputSize - 1 - i : i;
+                    double s = offset + (o + 0.5) * scale - 0.5;
+                    s = std::min(std::max(s, 0.0), static_cast<double>(inputSize - 1));
+
+                    i0[i] = static_cast<size_t>(s);
+                    i1[i] = std::min(i0[i] + 1, inputSize - 1);
+                    w[i] = static_cast<float>(s - i0[i]);
+                }
+            }
+        };
+    }
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "exception.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Autotune
+    {
+        /*!
+         * Returns the CPU model of the machine. Tuning results are only valid for the CPU they have been measured on.
+         *
+         * @return The model name as reported by /proc/cpuinfo or "unknown"
+         */
+        inline std::string cpuModel()
+        {
+            static const std::string model = []() {
+                std::ifstream cpuinfo("/proc/cpuinfo");
+                std::string line;
+                while (std::getline(cpuinfo, line))
+                {
+                    if (line.compare(0, 10, "model name") == 0)
+                    {
+                        const size_t colon = line.find(':');
+                        if (colon != std::string::npos && colon + 2 <= line.size())
+                        {
+                            return line.substr(colon + 2);
+                        }
+                    }
+                }
+                return std::string("unknown");
+            }();
+            return model;
+        }
+
+        /*!
+         * The algorithm that has been selected for an operation.
+         */
+        struct Selection
+        {
+            /*!
+             * A human readable description of the operation.
+             */
+            std::string label;
+            /*!
+             * The selected algorithm.
+             */
+            std::string algorithm;
+            /*!
+             * The measured run time in microseconds. It is 0 if the selection has been loaded from the cache.
+             */
+            double microseconds;
+            /*!
+             * Whether the selection has been loaded from the cache.
+             */
+            bool cached;
+        };
+
+        /*!
+         * Selects the fastest algorithm for an operation by timing all candidates. The selections are keyed by the
+         * operation and the CPU model and persisted in a tab-separated cache file, so subsequent processes skip the
+         * measurements.
+         *
+         * All methods are thread-safe.
+         */
+        class Autotuner
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Autotuner> class.
+             *
+             * @param path The path of the cache file. If empty, nothing is persisted.
+             * @param numRepetitions The number of timed runs per candidate. The fastest run counts.
+             */
+            explicit Autotuner(const std::string & path, size_t numRepetitions = 3) :
+                    path(path),
+                    numRepetitions(std::max<size_t>(1, numRepetitions))
+            {
+                if (this->path.empty())
+                {
+                    return;
+                }
+
+                std::ifstream file(this->path);
+                std::string line;
+                while (std::getline(file, line))
+                {
+                    const size_t tab = line.rfind('\t');
+                    if (tab != std::string::npos)
+                    {
+                        this->cache[line.substr(0, tab)] = line.substr(tab + 1);
+                    }
+                }
+            }
+
+            /*!
+             * Returns the autotuner that is shared by all layers. Its cache file is taken from the environment
+             * variable CHIANTI_AUTOTUNE_CACHE and defaults to "chianti-autotune.tsv" in the working directory.
+             */
+            static Autotuner & global()
+            {
+                static Autotuner autotuner([]() {
+                    const char * path = std::getenv("CHIANTI_AUTOTUNE_CACHE");
+                    return std::string(path != nullptr ? path : "chianti-autotune.tsv");
+                }());
+                return autotuner;
+            }
+
+            /*!
+             * Selects an algorithm for an operation.
+             *
+             * @param label A human readable description of the operation for the report
+             * @param key Uniquely identifies the operation (shape, batch size, etc.)
+             * @param candidates The names of all applicable algorithms
+             * @param run Runs the operation once with the given algorithm
+             * @return The name of the fastest algorithm
+             */
+            std::string select(const std::string & label, const std::string & key, const std::vector<std::string> & candidates, const std::function<void(const std::string &)> & run)
+            {
+                Exception::assertArgument(!candidates.empty(), "There must be at least one candidate algorithm.");
+
+                std::lock_guard<std::mutex> lock(this->mutex);
+                const std::string fullKey = cpuModel() + "\t" + key;
+
+                // Reuse an earlier selection if the algorithm is still applicable
+                auto it = this->cache.find(fullKey);
+                if (it != this->cache.end() && std::find(candidates.begin(), candidates.end(), it->second) != candidates.end())
+                {
+                    this->selections.push_back({label, it->second, 0.0, true});
+                    return it->second;
+                }
+
+                std::string best = candidates.front();
+                double bestTime = std::numeric_limits<double>::infinity();
+
+                for (const auto & candidate : candidates)
+                {
+                    // The first run warms up caches and lazily allocated buffers
+                    run(candidate);
+
+                    double time = std::numeric_limits<double>::infinity();
+                    for (size_t r = 0; r < this->numRepetitions; r++)
+                    {
+                        const auto start = std::chrono::steady_clock::now();
+                        run(candidate);
+                        const auto stop = std::chrono::steady_clock::now();
+                        time = std::min(time, std::chrono::duration<double, std::micro>(stop - start).count());
+                    }
+
+                    if (time < bestTime)
+                    {
+                        bestTime = time;
+                        best = candidate;
+                    }
+                }
+
+                this->cache[fullKey] = best;
+                this->selections.push_back({label, best, bestTime, false});
+
+                if (!this->path.empty())
+                {
+                    std::ofstream file(this->path, std::ios::app);
+                    file << fullKey << "\t" << best << "\n";
+                }
+
+                return best;
+            }
+
+            /*!
+             * Returns all selections that have been made by this process in the order they were made.
+             */
+            std::vector<Selection> report() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->selections;
+            }
+
+            /*!
+             * Prints the selections as a table.
+             *
+             * @param stream The target stream
+             */
+            void printReport(std::ostream & stream) const
+            {
+                for (const auto & selection : this->report())
+                {
+                    stream << std::left << std::setw(12) << selection.algorithm;
+                    if (selection.cached)
+                    {
+                        stream << std::setw(14) << "(cached)";
+                    }
+                    else
+                    {
+                        std::ostringstream time;
+                        time << std::fixed << std::setprecision(1) << selection.microseconds << " us";
+                        stream << std::setw(14) << time.str();
+                    }
+                    stream << selection.label << "\n";
+                }
+            }
+
+        private:
+            /*!
+             * The path of the cache file.
+             */
+            std::string path;
+            /*!
+             * The number of timed runs per candidate.
+             */
+            size_t numRepetitions;
+            /*!
+             * The selections by key.
+             */
+            std::map<std::string, std::string> cache;
+            /*!
+             * The selections of this process.
+             */
+            std::vector<Selection> selections;
+            /*!
+             * Guards the tuner.
+             */
+            mutable std::mutex mutex;
+        };
+    }
+}
@@ -0,0 +1,401 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "util.h"
+#include "values.h"
+#include "exception.h"
+#include "threading.h"
+#include "kernels/elementwise.h"
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Conversion
+    {
+        /*!
+         * Precomputed bilinear sampling positions along one axis.
+         */
+        struct SamplingAxis
+        {
+            /*!
+             * The lower and upper source indices.
+             */
+            std::vector<int> i0, i1;
+            /*!
+             * The interpolation weights of the upper source indices.
+             */
+            std::vector<float> w;
+
+            /*!
+             * Computes the sampling positions for resizing an axis with half-pixel centers (like cv::INTER_LINEAR).
+             *
+             * @param inputSize The number of source pixels
+             * @param outputSize The number of target pixels
+             */
+            SamplingAxis(int inputSize, int outputSize) : i0(outputSize), i1(outputSize), w(outputSize)
+            {
+                const double scale = static_cast<double>(inputSize) / outputSize;
+
+                for (int i = 0; i < outputSize; i++)
+                {
+                    double s = (i + 0.5) * scale - 0.5;
+                    s = std::min(std::max(s, 0.0), static_cast<double>(inputSize - 1));
+
+                    i0[i] = static_cast<int>(s);
+                    i1[i] = std::min(i0[i] + 1, inputSize - 1);
+                    w[i] = static_cast<float>(s - i0[i]);
+                }
+            }
+        };
+
+        /*!
+         * Converts OpenCV images into the planar, column-major float layout (width, height, channels) that CNTK
+         * expects. Type conversion, channel reordering, the transposition from interleaved to planar storage, resizing
+         * and scaling are fused into a single pass over the target memory. Rows are distributed over several threads.
+         * The image is resized (bilinearly) whenever its size differs from the target size.
+         */
+        class ImageConverter
+        {
+        public:
+            typedef ImageConverter Self;
+
+            /*!
+             * Whether the first and the third channel are swapped (BGR <-> RGB).
+             */
+            bool _swapRB;
+            /*!
+             * The factor by which all values are multiplied (e.g. 1/255 to map uint8 images to [0, 1]).
+             */
+            float _scale;
+            /*!
+             * The number of threads.
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <ImageConverter> class.
+             */
+            ImageConverter() :
+                    _swapRB(false),
+                    _scale(1.0f),
+                    _numThreads(Threading::defaultNumThreads())
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(swapRB, _swapRB)
+            MAKE_SETTER(swapRB, _swapRB)
+
+            MAKE_GETTER(scale, _scale)
+            MAKE_SETTER(scale, _scale)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Converts an image into planar float storage.
+             *
+             * @param image The image. Supported depths: CV_8U, CV_16U, CV_32F.
+             * @param target The target buffer. It must hold width * height * channels values.
+             * @param width The width of the target
+             * @param height The height of the target
+             */
+            void toBuffer(const cv::Mat & image, float* target, size_t width, size_t height) const
+            {
+                switch (image.depth())
+                {
+                    case CV_8U:
+                        this->convert<uint8_t>(image, target, static_cast<int>(width), static_cast<int>(height));
+                        break;
+                    case CV_16U:
+                        this->convert<uint16_t>(image, target, static_cast<int>(width), static_cast<int>(height));
+                        break;
+                    case CV_32F:
+                        this->convert<float>(image, target, static_cast<int>(width), static_cast<int>(height));
+                        break;
+                    default:
+                        throw Exception::IllegalArgumentException("Unsupported image depth.");
+                }
+            }
+
+            /*!
+             * Converts an image and writes it into a batch slot of a preallocated CPU value.
+             *
+             * @param image The image
+             * @param value The value. Shape: (width, height, channels, ...)
+             * @param slot The index of the sample in the value
+             */
+            void toValue(const cv::Mat & image, const CNTK::ValuePtr & value, size_t slot) const
+            {
+                const CNTK::NDShape & shape = value->Shape();
+                Exception::assertArgument(shape.Rank() >= 3, "The value must have at least rank 3.");
+                Exception::assertArgument(value->Device().Type() == CNTK::DeviceKind::CPU, "The value must reside on the CPU.");
+                Exception::assertArgument(shape[2] == static_cast<size_t>(image.channels()), "The number of channels does not match.");
+
+                const size_t sampleSize = shape[0] * shape[1] * shape[2];
+                Exception::assertArgument((slot + 1) * sampleSize <= shape.TotalSize(), "The slot is out of range.");
+
+                float* data = value->Data()->WritableDataBuffer<float>();
+                this->toBuffer(image, data + slot * sampleSize, shape[0], shape[1]);
+            }
+
+            /*!
+             * Converts a batch of images and writes them into consecutive slots of a preallocated CPU value.
+             *
+             * @param images The images
+             * @param value The value. Shape: (width, height, channels, ...)
+             */
+            void toValue(const std::vector<cv::Mat> & images, const CNTK::ValuePtr & value) const
+            {
+                for (size_t n = 0; n < images.size(); n++)
+                {
+                    this->toValue(images[n], value, n);
+                }
+            }
+
+        private:
+            /*!
+             * Returns the channel of the image that is written to target channel c.
+             */
+            int sourceChannel(int c, int numChannels) const
+            {
+                if (this->_swapRB && numChannels >= 3 && c < 3)
+                {
+                    return 2 - c;
+                }
+                return c;
+            }
+
+            /*!
+             * Splits a row of interleaved pixels into scaled planes.
+             *
+             * @param row The pixels of the row
+             * @param numChannels The number of channels
+             * @param width The number of pixels
+             * @param planes The target row of every channel of the image
+             */
+            template <typename T>
+            void convertRow(const T* row, int numChannels, int width, float* const* planes) const
+            {
+                const float scale = this->_scale;
+                for (int c = 0; c < numChannels; c++)
+                {
+                    float* out = planes[c];
+                    for (int x = 0; x < width; x++)
+                    {
+                        out[x] = scale * static_cast<float>(row[x * numChannels + c]);
+                    }
+                }
+            }
+
+            /*!
+             * Splits a row of 8 bit pixels with the dispatched kernel, see <convertRow>.
+             */
+            void convertRow(const uint8_t* row, int numChannels, int width, float* const* planes) const
+            {
+                static const Kernels::DeinterleaveKernel deinterleave = Kernels::deinterleaveKernels().select();
+                deinterleave(row, static_cast<size_t>(numChannels), this->_scale, planes, static_cast<size_t>(width));
+            }
+
+            /*!
+             * Converts an image with a specific pixel type.
+             */
+            template <typename T>
+            void convert(const cv::Mat & image, float* target, int width, int height) const
+            {
+                const int numChannels = image.channels();
+                const bool resize = width != image.cols || height != image.rows;
+                const float scale = this->_scale;
+
+                if (!resize)
+                {
+                    Threading::parallelFor(static_cast<size_t>(height), this->_numThreads, [&](size_t begin, size_t end) {
+                        // The target rows indexed by the channel of the image
+                        std::vector<float*> planes(numChannels);
+
+                        for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+                        {
+                            for (int c = 0; c < numChannels; c++)
+                            {
+                                planes[this->sourceChannel(c, numChannels)] = target + (static_cast<size_t>(c) * height + y) * width;
+                            }
+                            this->convertRow(image.ptr<T>(y), numChannels, width, planes.data());
+                        }
+                    });
+                }
+                else
+                {
+                    const SamplingAxis xAxis(image.cols, width);
+                    const SamplingAxis yAxis(image.rows, height);
+
+                    Threading::parallelFor(static_cast<size_t>(height), this->_numThreads, [&](size_t begin, size_t end) {
+                        for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
+                        {
+                            const T* row0 = image.ptr<T>(yAxis.i0[y]);
+                            const T* row1 = image.ptr<T>(yAxis.i1[y]);
+                            const float v = yAxis.w[y];
+
+                            for (int c = 0; c < numChannels; c++)
+                            {
+                                const int sc = this->sourceChannel(c, numChannels);
+                                float* out = target + (static_cast<size_t>(c) * height + y) * width;
+
+                                for (int x = 0; x < width; x++)
+                                {
+                                    const int a = xAxis.i0[x] * numChannels + sc;
+                                    const int b = xAxis.i1[x] * numChannels + sc;
+                                    const float top = row0[a] + xAxis.w[x] * (static_cast<float>(row0[b]) - row0[a]);
+                                    const float bottom = row1[a] + xAxis.w[x] * (static_cast<float>(row1[b]) - row1[a]);
+                                    out[x] = scale * (top + v * (bottom - top));
+                                }
+                            }
+                        }
+                    });
+                }
+            }
+        };
+
+        /*!
+         * Converts planar float storage (width, height, channels) into an interleaved OpenCV image.
+         *
+         * @tparam T The pixel type of the image
+         * @param source The planar data
+         * @param image The preallocated image
+         * @param scale The factor by which all values are multiplied before they are converted
+         * @param swapRB Whether the first and the third channel are swapped (RGB <-> BGR)
+         */
+        template <typename T>
+        inline void fromBuffer(const float* source, cv::Mat & image, float scale, bool swapRB)
+        {
+            const int width = image.cols;
+            const int height = image.rows;
+            const int numChannels = image.channels();
+
+            for (int y = 0; y < height; y++)
+            {
+                T* row = image.ptr<T>(y);
+
+                for (int c = 0; c < numChannels; c++)
+                {
+                    const int tc = swapRB && numChannels >= 3 && c < 3 ? 2 - c : c;
+                    const float* in = source + (static_cast<size_t>(c) * height + y) * width;
+
+                    for (int x = 0; x < width; x++)
+                    {
+                        row[x * numChannels + tc] = cv::saturate_cast<T>(scale * in[x]);
+                    }
+                }
+            }
+        }
+
+        /*!
+         * Converts a sample of a network output into an OpenCV image.
+         *
+         * @param value The value. Shape: (width, height, channels, ...)
+         * @param slot The index of the sample in the value
+         * @param depth The depth of the image (CV_8U, CV_16U or CV_32F). Values are saturated.
+         * @param scale The factor by which all values are multiplied before they are converted
+         * @param swapRB Whether the first and the third channel are swapped (RGB <-> BGR)
+         * @return The image
+         */
+        inline cv::Mat toMat(const CNTK::ValuePtr & value, size_t slot, int depth = CV_32F, float scale = 1.0f, bool swapRB = false)
+        {
+            const CNTK::NDShape & shape = value->Shape();
+            Exception::assertArgument(shape.Rank() >= 3, "The value must have at least rank 3.");
+            Exception::assertArgument(value->Device().Type() == CNTK::DeviceKind::CPU, "The value must reside on the CPU.");
+
+            const int width = static_cast<int>(shape[0]);
+            const int height = static_cast<int>(shape[1]);
+            const int numChannels = static_cast<int>(shape[2]);
+            const size_t sampleSize = shape[0] * shape[1] * shape[2];
+            Exception::assertArgument((slot + 1) * sampleSize <= shape.TotalSize(), "The slot is out of range.");
+
+            const float* data = value->Data()->DataBuffer<float>() + slot * sampleSize;
+            cv::Mat image(height, width, CV_MAKETYPE(depth, numChannels));
+
+            switch (depth)
+            {
+                case CV_8U:
+                    fromBuffer<uint8_t>(data, image, scale, swapRB);
+                    break;
+                case CV_16U:
+                    fromBuffer<uint16_t>(data, image, scale, swapRB);
+                    break;
+                case CV_32F:
+                    fromBuffer<float>(data, image, scale, swapRB);
+                    break;
+                default:
+                    throw Exception::IllegalArgumentException("Unsupported image depth.");
+            }
+
+            return image;
+        }
+
+        /*!
+         * Converts a sample of a segmentation network output into a label image by taking the arg-max over the
+         * channels of every pixel.
+         *
+         * @param value The value. Shape: (width, height, numClasses, ...)
+         * @param slot The index of the sample in the value
+         * @return A CV_8UC1 image if there are at most 256 classes, a CV_16UC1 image otherwise.
+         */
+        inline cv::Mat toLabelMat(const CNTK::ValuePtr & value, size_t slot)
+        {
+            const CNTK::NDShape & shape = value->Shape();
+            Exception::assertArgument(shape.Rank() >= 3, "The value must have at least rank 3.");
+            Exception::assertArgument(value->Device().Type() == CNTK::DeviceKind::CPU, "The value must reside on the CPU.");
+
+            const int width = static_cast<int>(shape[0]);
+            const int height = static_cast<int>(shape[1]);
+            const int numClasses = static_cast<int>(shape[2]);
+            const size_t planeSize = shape[0] * shape[1];
+            Exception::assertArgument((slot + 1) * planeSize * numClasses <= shape.TotalSize(), "The slot is out of range.");
+            Exception::assertArgument(numClasses <= 65536, "Too many classes for a label image.");
+
+            const float* data = value->Data()->DataBuffer<float>() + slot * planeSize * numClasses;
+            const bool compact = numClasses <= 256;
+            cv::Mat labels(height, width, compact ? CV_8UC1 : CV_16UC1);
+
+            // Keep the running maximum of one row in memory and sweep over the class planes
+            std::vector<float> best(width);
+            std::vector<uint16_t> bestClass(width);
+
+            for (int y = 0; y < height; y++)
+            {
+                const float* first = data + static_cast<size_t>(y) * width;
+                std::copy(first, first + width, best.begin());
+                std::fill(bestClass.begin(), bestClass.end(), 0);
+
+                for (int c = 1; c < numClasses; c++)
+                {
+                    const float* in = data + c * planeSize + static_cast<size_t>(y) * width;
+                    for (int x = 0; x < width; x++)
+                    {
+                        const bool larger = in[x] > best[x];
+                        best[x] = larger ? in[x] : best[x];
+                        bestClass[x] = larger ? static_cast<uint16_t>(c) : bestClass[x];
+                    }
+                }
+
+                for (int x = 0; x < width; x++)
+                {
+                    if (compact)
+                    {
+                        labels.ptr<uint8_t>(y)[x] = static_cast<uint8_t>(bestClass[x]);
+                    }
+                    else
+                    {
+                        labels.ptr<uint16_t>(y)[x] = bestClass[x];
+                    }
+                }
+            }
+
+            return labels;
+        }
+    }
+}
@@ -0,0 +1,2196 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "exception.h"
+#include "nonlinearities.h"
+#include "autotune.h"
+#include "kernels/activation.h"
+#include "kernels/conv1d.h"
+#include "kernels/conv2d.h"
+#include "kernels/conv3d.h"
+#include "kernels/dense.h"
+#include "kernels/embedding.h"
+#include "kernels/pool2d.h"
+#include "kernels/pool3d.h"
+#include "kernels/recurrent.h"
+#include "kernels/sampling.h"
+#include "kernels/softmax.h"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Functions
+    {
+        namespace Internal
+        {
+            /*!
+             * Returns a view of an array that resides in main memory. Arrays on other devices are copied.
+             */
+            inline CNTK::NDArrayViewPtr cpuView(const CNTK::NDArrayViewPtr & view)
+            {
+                if (view->Device().Type() == CNTK::DeviceKind::CPU)
+                {
+                    return view;
+                }
+                return view->DeepClone(CNTK::DeviceDescriptor::CPUDevice(), true);
+            }
+
+            /*!
+             * Allocates the result of a CPU kernel and hands it over to CNTK on the requested device.
+             *
+             * @param output The output value as passed to Forward. It is created if it is empty.
+             * @param result The result of the kernel
+             * @param mask The mask of the input value
+             * @param device The device CNTK computes on
+             */
+            inline void publishOutput(CNTK::ValuePtr & output, const CNTK::NDArrayViewPtr & result, const CNTK::NDMaskPtr & mask, const CNTK::DeviceDescriptor & device)
+            {
+                if (output)
+                {
+                    output->Data()->CopyFrom(*result);
+                }
+                else if (device.Type() == CNTK::DeviceKind::CPU)
+                {
+                    output = CNTK::MakeSharedObject<CNTK::Value>(result, mask);
+                }
+                else
+                {
+                    output = CNTK::MakeSharedObject<CNTK::Value>(result->DeepClone(device), mask);
+                }
+            }
+
+            /*!
+             * Creates the kernel of a CPU function for the static shape of its operand. Functions keep the factory, such
+             * that clones with an operand of another shape (e.g. the variants of an <Inference::ShapeCache>) run a
+             * kernel of the matching geometry.
+             */
+            template<typename Kernel>
+            using KernelFactory = std::function<std::shared_ptr<Kernel>(const CNTK::NDShape &)>;
+
+            /*!
+             * Returns the kernel for the operand of a clone. The kernel (and the plans it has cached) is shared if the
+             * operand keeps its shape.
+             *
+             * @param kernel The kernel of the original function
+             * @param factory The factory of the original function
+             * @param operand The operand of the original function
+             * @param clonedOperand The operand of the clone
+             * @return The kernel of the clone
+             */
+            template<typename Kernel>
+            inline std::shared_ptr<Kernel> cloneKernel(const std::shared_ptr<Kernel> & kernel, const KernelFactory<Kernel> & factory, const CNTK::Variable & operand, const CNTK::Variable & clonedOperand)
+            {
+                if (clonedOperand.Shape() == operand.Shape())
+                {
+                    return kernel;
+                }
+                return factory(clonedOperand.Shape());
+            }
+
+            /*!
+             * Verifies that an operand has the static shape that a kernel has been created for.
+             */
+            inline void assertOperandShape(const CNTK::Variable & operand, const CNTK::NDShape & expected)
+            {
+                Exception::assertArgument(operand.Shape() == expected, "The operand does not match the geometry of the CPU kernel.");
+            }
+
+            /*!
+             * Returns the number of samples of a value. The trailing dimensions of the value are the dynamic axes, hence,
+             * its size must be a multiple of the sample size.
+             *
+             * @param shape The shape of the value
+             * @param sampleSize The number of values per sample
+             * @return The number of samples
+             */
+            inline size_t numSamples(const CNTK::NDShape & shape, size_t sampleSize)
+            {
+                Exception::assertArgument(sampleSize > 0 && shape.TotalSize() % sampleSize == 0, "The value does not match the geometry of the CPU kernel.");
+                return shape.TotalSize() / sampleSize;
+            }
+
+            /*!
+             * Caches the plans of a CPU kernel per weight buffers. Plans bake in the weights, so every set of weight
+             * buffers (e.g. of deep clones) gets its own plan, hence, the weights must not change once the network is
+             * used for inference. An entry keeps its buffers alive, such that their addresses cannot be reused by other
+             * weights.
+             *
+             * All methods are thread-safe.
+             */
+            template<typename Plan, size_t NumWeights = 1>
+            class PlanCache
+            {
+            public:
+                typedef std::array<CNTK::NDArrayViewPtr, NumWeights> Weights;
+
+                /*!
+                 * Returns the plan of a set of weights. It is created on first use.
+                 *
+                 * @param weights The weights on any device
+                 * @param create Creates the plan from the weights in main memory
+                 * @return The plan
+                 */
+                template<typename Factory>
+                std::shared_ptr<Plan> get(const Weights & weights, const Factory & create)
+                {
+                    std::array<const float *, NumWeights> key;
+                    for (size_t i = 0; i < NumWeights; i++)
+                    {
+                        const CNTK::NDArrayViewPtr & view = weights[i];
+                        key[i] = view->DataBuffer<float>();
+                    }
+
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    auto & entry = this->entries[key];
+                    if (!entry.second)
+                    {
+                        Weights cpuWeights;
+                        for (size_t i = 0; i < NumWeights; i++)
+                        {
+                            cpuWeights[i] = cpuView(weights[i]);
+                        }
+                        entry.first = weights;
+                        entry.second = create(cpuWeights);
+                    }
+                    return entry.second;
+                }
+
+            private:
+                /*!
+                 * The weights and their plan by weight buffers.
+                 */
+                std::map<std::array<const float *, NumWeights>, std::pair<Weights, std::shared_ptr<Plan>>> entries;
+                /*!
+                 * Guards the plans.
+                 */
+                std::mutex mutex;
+            };
+
+            /*!
+             * Verifies that no sequence of a streamed chunk is padded. The state after a padded chunk would belong to
+             * the padding.
+             */
+            inline void assertUnpadded(const CNTK::NDMaskPtr & mask)
+            {
+                Exception::assertArgument(!mask || mask->MaskedCount() == 0, "All sequences of a streamed chunk must have the same length.");
+            }
+        }
+
+        /*!
+         * A function that carries state across evaluations, such that streams can be processed in chunks. Every clone
+         * of a function starts with a fresh state.
+         */
+        class StatefulFunction
+        {
+        public:
+            virtual ~StatefulFunction() {}
+
+            /*!
+             * Starts new streams.
+             */
+            virtual void resetState() = 0;
+        };
+
+        /*!
+         * The base of the functions that run the CPU kernels. The kernels only support the forward pass.
+         */
+        class InferenceFunction : public CNTK::Function
+        {
+        public:
+            void Backward(const CNTK::BackPropStatePtr &, const std::unordered_map<CNTK::Variable, CNTK::ValuePtr> &, std::unordered_map<CNTK::Variable, CNTK::ValuePtr> &) override
+            {
+                throw Exception::IllegalArgumentException("The Chianti CPU kernels only support inference. Use the cntk algorithm for training.");
+            }
+
+        protected:
+            InferenceFunction(const std::vector<CNTK::Variable> & inputs, const std::wstring & name) :
+                    CNTK::Function(inputs, name)
+            {}
+        };
+
+        /*!
+         * Runs a CPU kernel whose plans are created lazily per weight buffer and shared by all clones of a function,
+         * see <Internal::PlanCache>. A plan is created from the geometry and the weights and runs a batch of samples.
+         *
+         * All methods are thread-safe.
+         */
+        template<typename Config, typename Plan>
+        class PlanExecutor
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <PlanExecutor> class.
+             *
+             * @param config The geometry of the kernel
+             */
+            explicit PlanExecutor(const Config & config) :
+                    config(config)
+            {}
+
+            /*!
+             * Returns the geometry of the kernel.
+             */
+            const Config & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Runs the kernel.
+             *
+             * @param input The input samples
+             * @param weights The weights on any device
+             * @param bias The bias per output channel or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, const CNTK::NDArrayViewPtr & weights, const float * bias, float * output, size_t numSamples)
+            {
+                const auto plan = this->plans.get({{weights}}, [this](const std::array<CNTK::NDArrayViewPtr, 1> & cpuWeights) {
+                    return std::make_shared<Plan>(this->config, cpuWeights[0]->DataBuffer<float>());
+                });
+                plan->run(input, bias, output, numSamples);
+            }
+
+        private:
+            /*!
+             * The geometry of the kernel.
+             */
+            Config config;
+            /*!
+             * The plans by weight buffer.
+             */
+            Internal::PlanCache<Plan> plans;
+        };
+
+        /*!
+         * Determines whether a non-linearity can be fused into the epilogue of a CPU kernel. All parameter-free
+         * non-linearities of <Nonlinearities> can be fused, the leaky and parametric ReLUs run as CNTK nodes.
+         *
+         * @param nonLinearity The non-linearity of a layer
+         * @param activation The matching kernel activation
+         * @return True if the non-linearity can be fused
+         */
+        inline bool fusedActivation(const std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> & nonLinearity, Kernels::Activation & activation)
+        {
+            typedef CNTK::FunctionPtr (*NonLinearityPointer)(CNTK::FunctionPtr);
+            const NonLinearityPointer * pointer = nonLinearity.target<NonLinearityPointer>();
+
+            if (pointer == nullptr)
+            {
+                return false;
+            }
+
+            const std::vector<std::pair<NonLinearityPointer, Kernels::Activation>> fusable = {
+                    {&Nonlinearities::linear, Kernels::Activation::Identity},
+                    {&Nonlinearities::rectify, Kernels::Activation::ReLU},
+                    {&Nonlinearities::sigmoid, Kernels::Activation::Sigmoid},
+                    {&Nonlinearities::tanh, Kernels::Activation::Tanh},
+                    {&Nonlinearities::elu, Kernels::Activation::ELU},
+                    {&Nonlinearities::gelu, Kernels::Activation::GELU},
+                    {&Nonlinearities::swish, Kernels::Activation::Swish}
+            };
+
+            for (const auto & candidate : fusable)
+            {
+                if (*pointer == candidate.first)
+                {
+                    activation = candidate.second;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /*!
+         * Runs a convolution with the CPU kernels. The plans are created lazily per weight buffer and shared by all
+         * clones of a function, see <Internal::PlanCache>. If the algorithm is "auto", the fastest algorithm is
+         * selected per batch size by the global autotuner.
+         *
+         * All methods are thread-safe.
+         */
+        class Conv2DExecutor
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Conv2DExecutor> class.
+             *
+             * @param config The geometry of the convolution
+             * @param algorithm The name of the algorithm or "auto"
+             * @param denseWeights Whether the weights of a 1x1 convolution are stored as (filters, channels) like the
+             *                     weights of a <DenseLayer>
+             */
+            Conv2DExecutor(const Kernels::Conv2DConfig & config, const std::string & algorithm, bool denseWeights = false) :
+                    config(config),
+                    algorithm(algorithm),
+                    denseWeights(denseWeights)
+            {
+                Exception::assertArgument(!denseWeights || (config.filterWidth == 1 && config.filterHeight == 1), "Dense weights require a 1x1 convolution.");
+
+                if (algorithm != "auto")
+                {
+                    const auto * entry = Kernels::findConv2DAlgorithm(algorithm);
+                    Exception::assertArgument(entry != nullptr, "Unknown convolution algorithm.");
+                    Exception::assertArgument(entry->supports(config), "The convolution algorithm does not support the layer configuration.");
+                }
+            }
+
+            /*!
+             * Returns the geometry of the convolution.
+             */
+            const Kernels::Conv2DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input samples
+             * @param weights The weights on any device
+             * @param bias The bias per filter or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, const CNTK::NDArrayViewPtr & weights, const float * bias, float * output, size_t numSamples)
+            {
+                const auto entry = this->entries.get({{weights}}, [this](const std::array<CNTK::NDArrayViewPtr, 1> & cpuWeights) {
+                    auto result = std::make_shared<WeightEntry>();
+                    result->cpuWeights = cpuWeights[0];
+
+                    if (this->denseWeights)
+                    {
+                        // Transpose the (filters, channels) matrix into the convolution layout once
+                        const size_t C = this->config.inputChannels;
+                        const size_t F = this->config.numFilters;
+                        const float * dense = cpuWeights[0]->DataBuffer<float>();
+                        auto transposed = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, CNTK::NDShape({1, 1, C, F}), CNTK::DeviceDescriptor::CPUDevice());
+                        float * target = transposed->WritableDataBuffer<float>();
+                        for (size_t f = 0; f < F; f++)
+                        {
+                            for (size_t c = 0; c < C; c++)
+                            {
+                                target[c + C * f] = dense[f + F * c];
+                            }
+                        }
+                        result->cpuWeights = transposed;
+                    }
+                    return result;
+                });
+
+                std::shared_ptr<Kernels::Conv2DPlan> plan;
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    plan = this->plan(*entry, this->select(*entry, input, bias, output, numSamples));
+                }
+
+                plan->run(input, bias, output, numSamples);
+            }
+
+        private:
+            /*!
+             * The weights in the layout of the convolution and their plans by algorithm.
+             */
+            struct WeightEntry
+            {
+                CNTK::NDArrayViewPtr cpuWeights;
+                std::map<std::string, std::shared_ptr<Kernels::Conv2DPlan>> plans;
+            };
+
+            /*!
+             * Returns the plan of an algorithm. The caller must hold the lock.
+             */
+            std::shared_ptr<Kernels::Conv2DPlan> plan(WeightEntry & entry, const std::string & name)
+            {
+                auto & plan = entry.plans[name];
+                if (!plan)
+                {
+                    plan = Kernels::findConv2DAlgorithm(name)->create(this->config, entry.cpuWeights->DataBuffer<float>());
+                }
+                return plan;
+            }
+
+            /*!
+             * Returns the algorithm for a batch size. The caller must hold the lock.
+             */
+            std::string select(WeightEntry & entry, const float * input, const float * bias, float * output, size_t numSamples)
+            {
+                if (this->algorithm != "auto")
+                {
+                    return this->algorithm;
+                }
+
+                auto it = this->selections.find(numSamples);
+                if (it != this->selections.end())
+                {
+                    return it->second;
+                }
+
+                std::vector<std::string> candidates;
+                for (const auto & algorithm : Kernels::conv2DAlgorithms())
+                {
+                    if (algorithm.supports(this->config))
+                    {
+                        candidates.push_back(algorithm.name);
+                    }
+                }
+
+                std::ostringstream key;
+                key << this->config.key() << " batch=" << numSamples;
+
+                std::ostringstream label;
+                label << this->config.filterWidth << "x" << this->config.filterHeight << " conv, "
+                      << this->config.inputChannels << " -> " << this->config.numFilters << " channels, "
+                      << this->config.inputWidth << "x" << this->config.inputHeight << " input, stride "
+                      << this->config.strideX << "x" << this->config.strideY << ", batch " << numSamples;
+
+                // Time the candidates on the actual data
+                const std::string selection = Autotune::Autotuner::global().select(label.str(), key.str(), candidates, [&](const std::string & name) {
+                    this->plan(entry, name)->run(input, bias, output, numSamples);
+                });
+
+                this->selections[numSamples] = selection;
+                return selection;
+            }
+
+            /*!
+             * The geometry of the convolution.
+             */
+            Kernels::Conv2DConfig config;
+            /*!
+             * The name of the algorithm or "auto".
+             */
+            std::string algorithm;
+            /*!
+             * Whether the weights are stored as (filters, channels).
+             */
+            bool denseWeights;
+            /*!
+             * The plans by weight buffer.
+             */
+            Internal::PlanCache<WeightEntry> entries;
+            /*!
+             * The selected algorithms by batch size.
+             */
+            std::map<size_t, std::string> selections;
+            /*!
+             * Guards the plans of the entries and the selections.
+             */
+            std::mutex mutex;
+        };
+
+        /*!
+         * A CNTK function that computes a convolution (plus bias and activation) with the Chianti CPU kernels. The
+         * inputs are the operand of shape (width, height, channels), the filters in the layout expected by the executor
+         * and optionally the bias with one value per filter. A global pooling can be fused into the function, in that
+         * case every sample is reduced while its feature maps are still in the cache and the feature maps are never
+         * handed to CNTK. Only the forward pass is supported.
+         */
+        class Conv2DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new convolution function.
+             *
+             * @param inputs The operand, the filters and optionally the bias
+             * @param factory Creates the executor for the shape of the operand
+             * @param pooling The global pooling of the feature maps or nullptr
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(
+                    const std::vector<CNTK::Variable> & inputs,
+                    const Internal::KernelFactory<Conv2DExecutor> & factory,
+                    const std::shared_ptr<Kernels::GlobalPool2DPlan> & pooling = nullptr)
+            {
+                Exception::assertArgument(inputs.size() == 2 || inputs.size() == 3, "A convolution needs an operand, filters and an optional bias.");
+                return create(inputs, factory(inputs[0].Shape()), factory, pooling);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 2 ? Internal::cpuView(inputValues[2]->Data()) : CNTK::NDArrayViewPtr();
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->executor->geometry().inputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(3));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                if (this->pooling)
+                {
+                    // Pool every sample right after its convolution
+                    const auto & c = this->executor->geometry();
+                    std::vector<float> features(c.outputSize());
+                    for (size_t n = 0; n < numSamples; n++)
+                    {
+                        this->executor->run(
+                                input->DataBuffer<float>() + n * c.inputSize(),
+                                inputValues[1]->Data(),
+                                bias ? bias->DataBuffer<float>() : nullptr,
+                                features.data(),
+                                1);
+                        this->pooling->run(features.data(), result->WritableDataBuffer<float>() + n * c.numFilters, 1);
+                    }
+                }
+                else
+                {
+                    this->executor->run(
+                            input->DataBuffer<float>(),
+                            inputValues[1]->Data(),
+                            bias ? bias->DataBuffer<float>() : nullptr,
+                            result->WritableDataBuffer<float>(),
+                            numSamples);
+                }
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiConv2D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & c = this->executor->geometry();
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {c.inputWidth, c.inputHeight, c.inputChannels});
+                if (this->pooling)
+                {
+                    outputs.push_back(CNTK::OutputVariable({1, 1, c.numFilters}, CNTK::DataType::Float, operand.DynamicAxes()));
+                }
+                else
+                {
+                    outputs.push_back(CNTK::OutputVariable({c.outputWidth, c.outputHeight, c.numFilters}, CNTK::DataType::Float, operand.DynamicAxes()));
+                }
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                auto executor = Internal::cloneKernel(this->executor, this->factory, this->Inputs()[0], clonedInputs[0]);
+                auto pooling = this->pooling;
+                if (pooling && executor != this->executor)
+                {
+                    // The fused pooling reduces feature maps of the new size
+                    const auto & c = executor->geometry();
+                    pooling = std::make_shared<Kernels::GlobalPool2DPlan>(Kernels::makeGlobalPool2DConfig(c.outputWidth, c.outputHeight, c.numFilters), pooling->reduction());
+                }
+                return create(clonedInputs, executor, this->factory, pooling);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(
+                    const std::vector<CNTK::Variable> & inputs,
+                    const std::shared_ptr<Conv2DExecutor> & executor,
+                    const Internal::KernelFactory<Conv2DExecutor> & factory,
+                    const std::shared_ptr<Kernels::GlobalPool2DPlan> & pooling)
+            {
+                return CNTK::AsComposite(std::shared_ptr<Conv2DFunction>(new Conv2DFunction(inputs, executor, factory, pooling)));
+            }
+
+            Conv2DFunction(
+                    const std::vector<CNTK::Variable> & inputs,
+                    const std::shared_ptr<Conv2DExecutor> & executor,
+                    const Internal::KernelFactory<Conv2DExecutor> & factory,
+                    const std::shared_ptr<Kernels::GlobalPool2DPlan> & pooling) :
+                    InferenceFunction(inputs, L"ChiantiConv2D"),
+                    executor(executor),
+                    factory(factory),
+                    pooling(pooling)
+            {}
+
+            /*!
+             * Runs the convolution. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Conv2DExecutor> executor;
+            /*!
+             * Creates the executors of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Conv2DExecutor> factory;
+            /*!
+             * The fused global pooling or nullptr.
+             */
+            std::shared_ptr<Kernels::GlobalPool2DPlan> pooling;
+        };
+
+        /*!
+         * Runs a 1D convolution with the CPU kernel, see <PlanExecutor>.
+         */
+        typedef PlanExecutor<Kernels::Conv1DConfig, Kernels::Conv1DPlan> Conv1DExecutor;
+
+        /*!
+         * A CNTK function that computes a 1D convolution over the first axis of a (length, channels) operand (plus
+         * bias and activation) with the CPU kernel. The inputs are the operand, the (filterSize, channels, filters)
+         * weights and optionally the bias. Only the forward pass is supported.
+         */
+        class Conv1DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new convolution function.
+             *
+             * @param inputs The operand, the weights and optionally the bias
+             * @param factory Creates the executor for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const Internal::KernelFactory<Conv1DExecutor> & factory)
+            {
+                Exception::assertArgument(inputs.size() == 2 || inputs.size() == 3, "A convolution needs an operand, weights and an optional bias.");
+                return create(inputs, factory(inputs[0].Shape()), factory);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 2 ? Internal::cpuView(inputValues[2]->Data()) : CNTK::NDArrayViewPtr();
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->executor->geometry().inputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(2));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->executor->run(
+                        input->DataBuffer<float>(),
+                        inputValues[1]->Data(),
+                        bias ? bias->DataBuffer<float>() : nullptr,
+                        result->WritableDataBuffer<float>(),
+                        numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiConv1D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & c = this->executor->geometry();
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {c.inputLength, c.channels});
+                outputs.push_back(CNTK::OutputVariable({c.outputLength, c.numFilters}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs, Internal::cloneKernel(this->executor, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Conv1DExecutor> & executor, const Internal::KernelFactory<Conv1DExecutor> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<Conv1DFunction>(new Conv1DFunction(inputs, executor, factory)));
+            }
+
+            Conv1DFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Conv1DExecutor> & executor, const Internal::KernelFactory<Conv1DExecutor> & factory) :
+                    InferenceFunction(inputs, L"ChiantiConv1D"),
+                    executor(executor),
+                    factory(factory)
+            {}
+
+            /*!
+             * Runs the convolution. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Conv1DExecutor> executor;
+            /*!
+             * Creates the executors of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Conv1DExecutor> factory;
+        };
+
+        /*!
+         * Runs a 3D convolution with the CPU kernel, see <PlanExecutor>.
+         */
+        typedef PlanExecutor<Kernels::Conv3DConfig, Kernels::Conv3DPlan> Conv3DExecutor;
+
+        /*!
+         * A CNTK function that computes a 3D convolution of a (width, height, depth, channels) operand (plus bias and
+         * activation) with the CPU kernel. The inputs are the operand, the (width, height, depth, channels, filters)
+         * filters and optionally the bias. Only the forward pass is supported.
+         */
+        class Conv3DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new convolution function.
+             *
+             * @param inputs The operand, the filters and optionally the bias
+             * @param factory Creates the executor for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const Internal::KernelFactory<Conv3DExecutor> & factory)
+            {
+                Exception::assertArgument(inputs.size() == 2 || inputs.size() == 3, "A convolution needs an operand, filters and an optional bias.");
+                return create(inputs, factory(inputs[0].Shape()), factory);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 2 ? Internal::cpuView(inputValues[2]->Data()) : CNTK::NDArrayViewPtr();
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->executor->geometry().inputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(4));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->executor->run(
+                        input->DataBuffer<float>(),
+                        inputValues[1]->Data(),
+                        bias ? bias->DataBuffer<float>() : nullptr,
+                        result->WritableDataBuffer<float>(),
+                        numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiConv3D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & c = this->executor->geometry();
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {c.inputWidth, c.inputHeight, c.inputDepth, c.inputChannels});
+                outputs.push_back(CNTK::OutputVariable({c.outputWidth, c.outputHeight, c.outputDepth, c.numFilters}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs, Internal::cloneKernel(this->executor, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Conv3DExecutor> & executor, const Internal::KernelFactory<Conv3DExecutor> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<Conv3DFunction>(new Conv3DFunction(inputs, executor, factory)));
+            }
+
+            Conv3DFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Conv3DExecutor> & executor, const Internal::KernelFactory<Conv3DExecutor> & factory) :
+                    InferenceFunction(inputs, L"ChiantiConv3D"),
+                    executor(executor),
+                    factory(factory)
+            {}
+
+            /*!
+             * Runs the convolution. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Conv3DExecutor> executor;
+            /*!
+             * Creates the executors of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Conv3DExecutor> factory;
+        };
+
+        /*!
+         * Runs a fully connected layer with the packed CPU kernel, see <PlanExecutor>. The weights are packed once per
+         * weight buffer.
+         */
+        typedef PlanExecutor<Kernels::DenseConfig, Kernels::PackedDensePlan> DenseExecutor;
+
+        /*!
+         * A CNTK function that computes a fully connected layer (plus bias and activation) with the packed CPU kernel.
+         * The inputs are the operand vector, the (units x inputs) weights and optionally the bias with one value per
+         * unit. Only the forward pass is supported.
+         */
+        class DenseFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new fully connected function.
+             *
+             * @param inputs The operand, the weights and optionally the bias
+             * @param factory Creates the executor for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const Internal::KernelFactory<DenseExecutor> & factory)
+            {
+                Exception::assertArgument(inputs.size() == 2 || inputs.size() == 3, "A dense layer needs an operand, weights and an optional bias.");
+                return create(inputs, factory(inputs[0].Shape()), factory);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 2 ? Internal::cpuView(inputValues[2]->Data()) : CNTK::NDArrayViewPtr();
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->executor->geometry().inputSize);
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(1));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->executor->run(
+                        input->DataBuffer<float>(),
+                        inputValues[1]->Data(),
+                        bias ? bias->DataBuffer<float>() : nullptr,
+                        result->WritableDataBuffer<float>(),
+                        numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiDense";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {this->executor->geometry().inputSize});
+                outputs.push_back(CNTK::OutputVariable({this->executor->geometry().numUnits}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs, Internal::cloneKernel(this->executor, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<DenseExecutor> & executor, const Internal::KernelFactory<DenseExecutor> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<DenseFunction>(new DenseFunction(inputs, executor, factory)));
+            }
+
+            DenseFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<DenseExecutor> & executor, const Internal::KernelFactory<DenseExecutor> & factory) :
+                    InferenceFunction(inputs, L"ChiantiDense"),
+                    executor(executor),
+                    factory(factory)
+            {}
+
+            /*!
+             * Runs the layer. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<DenseExecutor> executor;
+            /*!
+             * Creates the executors of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<DenseExecutor> factory;
+        };
+
+        /*!
+         * A CNTK function that looks up rows of a table with the gather kernel. The inputs are the indices of shape
+         * (count) and the (units x rows) table, which must reside in main memory. The output has the shape
+         * (units, count) or (units) for a single index.
+         *
+         * The backward pass computes the gradient of the touched rows only. If the function has an updater, the
+         * gradient is applied to the table right away and the table must not be trained by a CNTK learner. CNTK still
+         * receives a dense gradient of the table if it asks for one, such that the table can be trained by a learner
+         * instead.
+         *
+         * CNTK only runs the backward pass of a function if the gradient of one of its inputs is requested. Hence, a
+         * function with an updater has a third input, the update trigger (see <updateTrigger>). Its gradient is always
+         * zero, and requesting it instead of the gradient of the table applies the update without a dense gradient.
+         */
+        class EmbeddingFunction : public CNTK::Function
+        {
+        public:
+            /*!
+             * Creates a new lookup function.
+             *
+             * @param indices The indices of shape (count)
+             * @param table The table of shape (units, rows)
+             * @param updater The updater of the table or nullptr
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & indices, const CNTK::Variable & table, const std::shared_ptr<Kernels::SparseRowUpdater> & updater)
+            {
+                Exception::assertArgument(indices.Shape().Rank() == 1, "The indices must have the shape (count).");
+                Exception::assertArgument(table.Shape().Rank() == 2, "The table must have the shape (units, rows).");
+                Exception::assertArgument(table.Shape()[1] <= (1 << 24), "The rows must be exactly representable as floats.");
+                Exception::assertArgument(!updater || (table.IsParameter() && updater->geometry().numRows == table.Shape()[1] && updater->geometry().numUnits == table.Shape()[0]), "The updater must match the table parameter.");
+
+                std::vector<CNTK::Variable> inputs = {indices, table};
+                if (updater)
+                {
+                    inputs.push_back(CNTK::Parameter({1}, 0.0f, CNTK::DeviceDescriptor::CPUDevice(), L"EmbeddingUpdate"));
+                }
+                return create(inputs, updater);
+            }
+
+            /*!
+             * Returns the update trigger of a lookup function with an updater. The trigger is a parameter of shape (1)
+             * that does not affect the output. Requesting its gradient, e.g. by passing it to a learner in place of the
+             * table, runs the backward pass and thereby the update of the table.
+             *
+             * @param function The lookup function
+             * @return The update trigger
+             */
+            static CNTK::Parameter updateTrigger(const CNTK::FunctionPtr & function)
+            {
+                const auto embedding = std::dynamic_pointer_cast<EmbeddingFunction>(function->RootFunction());
+                Exception::assertArgument(embedding && embedding->updater, "The function must be a lookup function with an updater.");
+                return CNTK::Parameter(embedding->Inputs()[2]);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> & outputsToRetainBackwardStateFor) override
+            {
+                const auto indices = Internal::cpuView(inputValues[0]->Data());
+                const auto & table = inputValues[1]->Data();
+                Exception::assertArgument(table->Device().Type() == CNTK::DeviceKind::CPU, "The gather kernel requires the table in main memory.");
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto config = this->geometry();
+                const size_t count = indices->Shape().TotalSize();
+                const auto outputShape = this->Output().Shape().AppendShape(indices->Shape().SubShape(1));
+
+                auto rows = Kernels::embeddingRows(config, indices->DataBuffer<float>(), count);
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                Kernels::gatherRows(config, table->DataBuffer<float>(), rows.data(), result->WritableDataBuffer<float>(), count);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+
+                if (outputsToRetainBackwardStateFor.empty())
+                {
+                    return nullptr;
+                }
+                return std::make_shared<LookupState>(this->shared_from_this(), computeDevice, std::move(rows), indices->Shape(), inputValues[0]->Mask());
+            }
+
+            void Backward(
+                    const CNTK::BackPropStatePtr & state,
+                    const std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & rootGradientValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & backPropagatedGradientValuesForInputs) override
+            {
+                const auto lookups = std::dynamic_pointer_cast<LookupState>(state);
+                const auto config = this->geometry();
+                const auto rootGradient = Internal::cpuView(rootGradientValues.at(this->Output())->Data());
+
+                Kernels::SparseRowGradient gradient;
+                Kernels::accumulateRowGradients(config, lookups->rows.data(), rootGradient->DataBuffer<float>(), lookups->rows.size(), gradient);
+
+                if (this->updater)
+                {
+                    auto table = CNTK::Parameter(this->Inputs()[1]).Value();
+                    Exception::assertArgument(table->Device().Type() == CNTK::DeviceKind::CPU, "The sparse updater requires the table in main memory.");
+                    this->updater->apply(table->WritableDataBuffer<float>(), gradient);
+                }
+
+                for (auto & entry : backPropagatedGradientValuesForInputs)
+                {
+                    if (this->updater && entry.first == this->Inputs()[2])
+                    {
+                        // The trigger does not affect the output
+                        auto zero = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, entry.first.Shape(), CNTK::DeviceDescriptor::CPUDevice());
+                        zero->SetValue(0.0f);
+                        Internal::publishOutput(entry.second, zero, nullptr, CNTK::DeviceDescriptor::CPUDevice());
+                    }
+                    else if (entry.first == this->Inputs()[1])
+                    {
+                        auto dense = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, entry.first.Shape(), CNTK::DeviceDescriptor::CPUDevice());
+                        dense->SetValue(0.0f);
+                        Kernels::scatterRowGradients(config, gradient, dense->WritableDataBuffer<float>());
+                        Internal::publishOutput(entry.second, dense, nullptr, CNTK::DeviceDescriptor::CPUDevice());
+                    }
+                    else
+                    {
+                        // The output is piecewise constant in the indices
+                        auto zeros = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, lookups->shape, CNTK::DeviceDescriptor::CPUDevice());
+                        zeros->SetValue(0.0f);
+                        Internal::publishOutput(entry.second, zeros, lookups->mask, lookups->device);
+                    }
+                }
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiEmbedding";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                const size_t numUnits = this->Inputs()[1].Shape()[0];
+                const size_t count = operand.Shape()[0];
+                outputs.push_back(CNTK::OutputVariable(count == 1 ? CNTK::NDShape({numUnits}) : CNTK::NDShape({numUnits, count}), CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                // A copied table starts its own optimizer state, the AdaGrad accumulators belong to the original rows
+                const bool sharedTable = clonedInputs[1] == this->Inputs()[1];
+                return create(clonedInputs, this->updater && !sharedTable ? this->updater->withFreshState() : this->updater);
+            }
+
+        private:
+            /*!
+             * Creates a new lookup function.
+             *
+             * @param inputs The indices, the table and, if there is an updater, the update trigger
+             * @param updater The updater of the table or nullptr
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Kernels::SparseRowUpdater> & updater)
+            {
+                return CNTK::AsComposite(std::shared_ptr<EmbeddingFunction>(new EmbeddingFunction(inputs, updater)));
+            }
+
+            /*!
+             * The rows that have been looked up by a forward pass.
+             */
+            class LookupState : public CNTK::BackPropState
+            {
+            public:
+                LookupState(const CNTK::FunctionPtr & function, const CNTK::DeviceDescriptor & device, std::vector<size_t> && rows, const CNTK::NDShape & shape, const CNTK::NDMaskPtr & mask) :
+                        CNTK::BackPropState(function, device),
+                        rows(std::move(rows)),
+                        shape(shape),
+                        mask(mask),
+                        device(device)
+                {}
+
+                std::vector<size_t> rows;
+                /*!
+                 * The shape and the mask of the indices.
+                 */
+                CNTK::NDShape shape;
+                CNTK::NDMaskPtr mask;
+                CNTK::DeviceDescriptor device;
+            };
+
+            EmbeddingFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Kernels::SparseRowUpdater> & updater) :
+                    CNTK::Function(inputs, L"ChiantiEmbedding"),
+                    updater(updater)
+            {}
+
+            /*!
+             * Returns the geometry of the table.
+             */
+            Kernels::EmbeddingConfig geometry() const
+            {
+                const auto & shape = this->Inputs()[1].Shape();
+                return { shape[1], shape[0] };
+            }
+
+            /*!
+             * Updates the table in the backward pass. It is shared by the clones that share the table.
+             */
+            std::shared_ptr<Kernels::SparseRowUpdater> updater;
+        };
+
+        /*!
+         * Runs recurrent layers with plans that are cached per weight buffers, see <Internal::PlanCache>.
+         */
+        class RecurrentExecutor
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <RecurrentExecutor> class.
+             *
+             * @param config The geometry of the layer
+             */
+            explicit RecurrentExecutor(const Kernels::RecurrentConfig & config) :
+                    config(config)
+            {}
+
+            /*!
+             * Returns the geometry of the layer.
+             */
+            const Kernels::RecurrentConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Runs the layer.
+             *
+             * @param input The input sequences
+             * @param inputWeights The input weights on any device
+             * @param recurrentWeights The recurrent weights on any device
+             * @param bias The bias per gate and unit or nullptr
+             * @param output The hidden states of all time steps
+             * @param length The number of time steps per sequence
+             * @param numSequences The number of sequences
+             * @param state The states to continue from and to update or nullptr
+             */
+            void run(
+                    const float * input,
+                    const CNTK::NDArrayViewPtr & inputWeights,
+                    const CNTK::NDArrayViewPtr & recurrentWeights,
+                    const float * bias,
+                    float * output,
+                    size_t length,
+                    size_t numSequences,
+                    Kernels::RecurrentState * state)
+            {
+                const auto plan = this->plans.get({{inputWeights, recurrentWeights}}, [this](const std::array<CNTK::NDArrayViewPtr, 2> & cpuWeights) {
+                    return std::make_shared<Kernels::RecurrentPlan>(this->config, cpuWeights[0]->DataBuffer<float>(), cpuWeights[1]->DataBuffer<float>());
+                });
+                plan->run(input, bias, output, length, numSequences, state);
+            }
+
+        private:
+            /*!
+             * The geometry of the layer.
+             */
+            Kernels::RecurrentConfig config;
+            /*!
+             * The plans by input and recurrent weight buffers.
+             */
+            Internal::PlanCache<Kernels::RecurrentPlan, 2> plans;
+        };
+
+        /*!
+         * A CNTK function that computes a recurrent layer with the fused CPU kernel. The inputs are the operand
+         * sequence, the input weights, the recurrent weights and optionally the bias, see <Kernels::RecurrentConfig>
+         * for their layout. The output is the sequence of hidden states. A streaming function continues every
+         * sequence from the states at the end of the previous evaluation. Only the forward pass is supported.
+         */
+        class RecurrentFunction : public InferenceFunction, public StatefulFunction
+        {
+        public:
+            /*!
+             * Creates a new recurrent function.
+             *
+             * @param inputs The operand, the input weights, the recurrent weights and optionally the bias
+             * @param executor The executor that runs the layer
+             * @param streaming Whether the states are carried across evaluations
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<RecurrentExecutor> & executor, bool streaming = false)
+            {
+                Exception::assertArgument(inputs.size() == 3 || inputs.size() == 4, "A recurrent layer needs an operand, input weights, recurrent weights and an optional bias.");
+                Exception::assertArgument(inputs[0].DynamicAxes().size() == 2, "A recurrent layer needs an operand with a sequence axis.");
+                return CNTK::AsComposite(std::shared_ptr<RecurrentFunction>(new RecurrentFunction(inputs, executor, streaming)));
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 3 ? Internal::cpuView(inputValues[3]->Data()) : CNTK::NDArrayViewPtr();
+                if (this->streaming)
+                {
+                    Internal::assertUnpadded(inputValues[0]->Mask());
+                }
+
+                // The value has the shape (inputs, time steps, sequences). Shorter sequences are padded at the end,
+                // which does not change the earlier time steps, and masked by CNTK.
+                const auto & inputShape = input->Shape();
+                const size_t length = inputShape[1];
+                const size_t numSequences = inputShape.TotalSize() / (this->executor->geometry().inputSize * length);
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(1));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->executor->run(
+                        input->DataBuffer<float>(),
+                        inputValues[1]->Data(),
+                        inputValues[2]->Data(),
+                        bias ? bias->DataBuffer<float>() : nullptr,
+                        result->WritableDataBuffer<float>(),
+                        length,
+                        numSequences,
+                        this->streaming ? &this->state : nullptr);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiRecurrent";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                outputs.push_back(CNTK::OutputVariable({this->executor->geometry().numUnits}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs, this->executor, this->streaming);
+            }
+
+            void resetState() override
+            {
+                this->state = Kernels::RecurrentState();
+            }
+
+        private:
+            RecurrentFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<RecurrentExecutor> & executor, bool streaming) :
+                    InferenceFunction(inputs, L"ChiantiRecurrent"),
+                    executor(executor),
+                    streaming(streaming)
+            {}
+
+            /*!
+             * Runs the layer. It is shared by all clones.
+             */
+            std::shared_ptr<RecurrentExecutor> executor;
+            /*!
+             * Whether the states are carried across evaluations.
+             */
+            bool streaming;
+            /*!
+             * The states at the end of the previous evaluation.
+             */
+            Kernels::RecurrentState state;
+        };
+
+        /*!
+         * Runs causal 1D convolutions with plans that are cached per weight buffer, see <Internal::PlanCache>.
+         */
+        class CausalConv1DExecutor
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <CausalConv1DExecutor> class.
+             *
+             * @param config The geometry of the convolution
+             */
+            explicit CausalConv1DExecutor(const Kernels::CausalConv1DConfig & config) :
+                    config(config)
+            {}
+
+            /*!
+             * Returns the geometry of the convolution.
+             */
+            const Kernels::CausalConv1DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input sequences
+             * @param weights The weights on any device
+             * @param bias The bias per filter or nullptr
+             * @param output The output sequences
+             * @param length The number of frames per sequence
+             * @param numSequences The number of sequences
+             * @param state The past frames to continue from and to update or nullptr
+             */
+            void run(
+                    const float * input,
+                    const CNTK::NDArrayViewPtr & weights,
+                    const float * bias,
+                    float * output,
+                    size_t length,
+                    size_t numSequences,
+                    Kernels::CausalConv1DState * state)
+            {
+                const auto plan = this->plans.get({{weights}}, [this](const std::array<CNTK::NDArrayViewPtr, 1> & cpuWeights) {
+                    return std::make_shared<Kernels::CausalConv1DPlan>(this->config, cpuWeights[0]->DataBuffer<float>());
+                });
+                plan->run(input, bias, output, length, numSequences, state);
+            }
+
+        private:
+            /*!
+             * The geometry of the convolution.
+             */
+            Kernels::CausalConv1DConfig config;
+            /*!
+             * The plans by weight buffer.
+             */
+            Internal::PlanCache<Kernels::CausalConv1DPlan> plans;
+        };
+
+        /*!
+         * A CNTK function that computes a causal 1D convolution over the sequence axis (plus bias and activation) with
+         * the CPU kernel. The inputs are the operand sequence, the (filters x channels x filterSize) weights and
+         * optionally the bias with one value per filter. A streaming function continues every sequence after the
+         * frames of the previous evaluation. Only the forward pass is supported.
+         */
+        class CausalConv1DFunction : public InferenceFunction, public StatefulFunction
+        {
+        public:
+            /*!
+             * Creates a new causal convolution function.
+             *
+             * @param inputs The operand, the weights and optionally the bias
+             * @param executor The executor that runs the convolution
+             * @param streaming Whether the past frames are carried across evaluations
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<CausalConv1DExecutor> & executor, bool streaming = false)
+            {
+                Exception::assertArgument(inputs.size() == 2 || inputs.size() == 3, "A convolution needs an operand, weights and an optional bias.");
+                Exception::assertArgument(inputs[0].DynamicAxes().size() == 2, "A causal convolution needs an operand with a sequence axis.");
+                return CNTK::AsComposite(std::shared_ptr<CausalConv1DFunction>(new CausalConv1DFunction(inputs, executor, streaming)));
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto bias = inputValues.size() > 2 ? Internal::cpuView(inputValues[2]->Data()) : CNTK::NDArrayViewPtr();
+                if (this->streaming)
+                {
+                    Internal::assertUnpadded(inputValues[0]->Mask());
+                }
+
+                // The value has the shape (channels, frames, sequences)
+                const auto & inputShape = input->Shape();
+                const size_t length = inputShape[1];
+                const size_t numSequences = inputShape.TotalSize() / (this->executor->geometry().channels * length);
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(1));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->executor->run(
+                        input->DataBuffer<float>(),
+                        inputValues[1]->Data(),
+                        bias ? bias->DataBuffer<float>() : nullptr,
+                        result->WritableDataBuffer<float>(),
+                        length,
+                        numSequences,
+                        this->streaming ? &this->state : nullptr);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiCausalConv1D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                outputs.push_back(CNTK::OutputVariable({this->executor->geometry().numFilters}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs, this->executor, this->streaming);
+            }
+
+            void resetState() override
+            {
+                this->state = Kernels::CausalConv1DState();
+            }
+
+        private:
+            CausalConv1DFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<CausalConv1DExecutor> & executor, bool streaming) :
+                    InferenceFunction(inputs, L"ChiantiCausalConv1D"),
+                    executor(executor),
+                    streaming(streaming)
+            {}
+
+            /*!
+             * Runs the convolution. It is shared by all clones.
+             */
+            std::shared_ptr<CausalConv1DExecutor> executor;
+            /*!
+             * Whether the past frames are carried across evaluations.
+             */
+            bool streaming;
+            /*!
+             * The last input frames of the previous evaluation.
+             */
+            Kernels::CausalConv1DState state;
+        };
+
+        /*!
+         * A CNTK function that computes a 2D pooling with a CPU kernel. The plan is shared by all clones of the
+         * function whose operand has the same shape. Only the forward pass is supported.
+         */
+        class Pool2DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new pooling function.
+             *
+             * @param input The operand with the shape (width, height, channels)
+             * @param factory Creates the plan for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const Internal::KernelFactory<Kernels::Pool2DPlan> & factory)
+            {
+                return create(input, factory(input.Shape()), factory);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->plan->geometry().inputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(3));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->plan->run(input->DataBuffer<float>(), result->WritableDataBuffer<float>(), numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiPool2D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                const auto & c = this->plan->geometry();
+                Internal::assertOperandShape(operand, {c.inputWidth, c.inputHeight, c.channels});
+                outputs.push_back(CNTK::OutputVariable(
+                        {c.outputWidth, c.outputHeight, c.channels},
+                        CNTK::DataType::Float,
+                        operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], Internal::cloneKernel(this->plan, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const std::shared_ptr<Kernels::Pool2DPlan> & plan, const Internal::KernelFactory<Kernels::Pool2DPlan> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<Pool2DFunction>(new Pool2DFunction(input, plan, factory)));
+            }
+
+            Pool2DFunction(const CNTK::Variable & input, const std::shared_ptr<Kernels::Pool2DPlan> & plan, const Internal::KernelFactory<Kernels::Pool2DPlan> & factory) :
+                    InferenceFunction({input}, L"ChiantiPool2D"),
+                    plan(plan),
+                    factory(factory)
+            {}
+
+            /*!
+             * Computes the pooling. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Kernels::Pool2DPlan> plan;
+            /*!
+             * Creates the plans of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Kernels::Pool2DPlan> factory;
+        };
+
+        /*!
+         * A CNTK function that computes a 3D pooling with a CPU kernel. The plan is shared by all clones of the
+         * function whose operand has the same shape. Only the forward pass is supported.
+         */
+        class Pool3DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new pooling function.
+             *
+             * @param input The operand with the shape (width, height, depth, channels)
+             * @param factory Creates the plan for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const Internal::KernelFactory<Kernels::Pool3DPlan> & factory)
+            {
+                return create(input, factory(input.Shape()), factory);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->plan->geometry().inputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(4));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->plan->run(input->DataBuffer<float>(), result->WritableDataBuffer<float>(), numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiPool3D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                const auto & c = this->plan->geometry();
+                Internal::assertOperandShape(operand, {c.inputWidth, c.inputHeight, c.inputDepth, c.channels});
+                outputs.push_back(CNTK::OutputVariable(
+                        {c.outputWidth, c.outputHeight, c.outputDepth, c.channels},
+                        CNTK::DataType::Float,
+                        operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], Internal::cloneKernel(this->plan, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const std::shared_ptr<Kernels::Pool3DPlan> & plan, const Internal::KernelFactory<Kernels::Pool3DPlan> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<Pool3DFunction>(new Pool3DFunction(input, plan, factory)));
+            }
+
+            Pool3DFunction(const CNTK::Variable & input, const std::shared_ptr<Kernels::Pool3DPlan> & plan, const Internal::KernelFactory<Kernels::Pool3DPlan> & factory) :
+                    InferenceFunction({input}, L"ChiantiPool3D"),
+                    plan(plan),
+                    factory(factory)
+            {}
+
+            /*!
+             * Computes the pooling. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Kernels::Pool3DPlan> plan;
+            /*!
+             * Creates the plans of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Kernels::Pool3DPlan> factory;
+        };
+
+        /*!
+         * A CNTK function that computes a max pooling with the CPU kernel and also returns the positions of the
+         * maxima. The first output holds the pooled values, the second one the packed positions as described by
+         * <Kernels::ArgMaxPool2DPlan>, which are only meaningful to <MaxUnpool2DFunction>. Only the forward pass is
+         * supported.
+         */
+        class ArgMaxPool2DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new pooling function.
+             *
+             * @param input The operand with the shape (width, height, channels)
+             * @param factory Creates the plan for the shape of the operand
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const Internal::KernelFactory<Kernels::ArgMaxPool2DPlan> & factory)
+            {
+                return create(input, factory(input.Shape()), factory);
+            }
+
+            /*!
+             * Returns the plan that computes the pooling.
+             */
+            const std::shared_ptr<Kernels::ArgMaxPool2DPlan> & pooling() const
+            {
+                return this->plan;
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->plan->geometry().inputSize());
+                const auto outputShape = this->Outputs()[0].Shape().AppendShape(inputShape.SubShape(3));
+                const auto indexShape = this->Outputs()[1].Shape().AppendShape(inputShape.SubShape(3));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                auto indices = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, indexShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->plan->run(input->DataBuffer<float>(), result->WritableDataBuffer<float>(), indices->WritableDataBuffer<float>(), numSamples);
+
+                Internal::publishOutput(outputs[this->Outputs()[0]], result, inputValues[0]->Mask(), computeDevice);
+                Internal::publishOutput(outputs[this->Outputs()[1]], indices, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiArgMaxPool2D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & c = this->plan->geometry();
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {c.inputWidth, c.inputHeight, c.channels});
+                outputs.push_back(CNTK::OutputVariable({c.outputWidth, c.outputHeight, c.channels}, CNTK::DataType::Float, operand.DynamicAxes()));
+                outputs.push_back(CNTK::OutputVariable({this->plan->indexSize()}, CNTK::DataType::Float, operand.DynamicAxes(), false));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], Internal::cloneKernel(this->plan, this->factory, this->Inputs()[0], clonedInputs[0]), this->factory);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const std::shared_ptr<Kernels::ArgMaxPool2DPlan> & plan, const Internal::KernelFactory<Kernels::ArgMaxPool2DPlan> & factory)
+            {
+                return CNTK::AsComposite(std::shared_ptr<ArgMaxPool2DFunction>(new ArgMaxPool2DFunction(input, plan, factory)));
+            }
+
+            ArgMaxPool2DFunction(const CNTK::Variable & input, const std::shared_ptr<Kernels::ArgMaxPool2DPlan> & plan, const Internal::KernelFactory<Kernels::ArgMaxPool2DPlan> & factory) :
+                    InferenceFunction({input}, L"ChiantiArgMaxPool2D"),
+                    plan(plan),
+                    factory(factory)
+            {}
+
+            /*!
+             * Computes the pooling. It is shared by all clones with an operand of the same shape.
+             */
+            std::shared_ptr<Kernels::ArgMaxPool2DPlan> plan;
+            /*!
+             * Creates the plans of clones with an operand of another shape.
+             */
+            Internal::KernelFactory<Kernels::ArgMaxPool2DPlan> factory;
+        };
+
+        /*!
+         * A CNTK function that scatters values to the positions of the maxima of an <ArgMaxPool2DFunction>. The inputs
+         * are the values with the shape of the pooled output and the packed positions. Only the forward pass is
+         * supported.
+         */
+        class MaxUnpool2DFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new unpooling function.
+             *
+             * @param input The values with the shape (output width, output height, channels) of the pooling
+             * @param indices The packed positions, i.e. the second output of the pooling
+             * @param plan The plan of the pooling. Clones use the plan of the cloned pooling instead.
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const CNTK::Variable & indices, const std::shared_ptr<Kernels::ArgMaxPool2DPlan> & plan)
+            {
+                return CNTK::AsComposite(std::shared_ptr<MaxUnpool2DFunction>(new MaxUnpool2DFunction({input, indices}, plan)));
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                const auto indices = Internal::cpuView(inputValues[1]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numSamples = Internal::numSamples(inputShape, this->plan->geometry().outputSize());
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(3));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                this->plan->unpool(input->DataBuffer<float>(), indices->DataBuffer<float>(), result->WritableDataBuffer<float>(), numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiMaxUnpool2D";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & c = this->plan->geometry();
+                const auto & operand = this->Inputs()[0];
+                Internal::assertOperandShape(operand, {c.outputWidth, c.outputHeight, c.channels});
+                Internal::assertOperandShape(this->Inputs()[1], {this->plan->indexSize()});
+                outputs.push_back(CNTK::OutputVariable({c.inputWidth, c.inputHeight, c.channels}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                // The positions are only meaningful to the plan of the pooling that computed them
+                auto plan = this->plan;
+                const auto pooling = std::dynamic_pointer_cast<ArgMaxPool2DFunction>(clonedInputs[1].Owner());
+                if (pooling)
+                {
+                    plan = pooling->pooling();
+                }
+                return create(clonedInputs[0], clonedInputs[1], plan);
+            }
+
+        private:
+            MaxUnpool2DFunction(const std::vector<CNTK::Variable> & inputs, const std::shared_ptr<Kernels::ArgMaxPool2DPlan> & plan) :
+                    InferenceFunction(inputs, L"ChiantiMaxUnpool2D"),
+                    plan(plan)
+            {}
+
+            /*!
+             * The plan of the pooling. It is shared with the pooling function.
+             */
+            std::shared_ptr<Kernels::ArgMaxPool2DPlan> plan;
+        };
+
+        /*!
+         * Reduces the spatial axes of an operand of shape (width, height, channels) to their average or maximum. The
+         * result has the shape (1, 1, channels).
+         *
+         * @param input The operand
+         * @param pooling The reduction
+         * @param algorithm "cntk" for CNTK's reductions, "reduce" or "auto" for the CPU kernel
+         * @return The function
+         */
+        inline CNTK::FunctionPtr globalPool2D(const CNTK::Variable & input, Kernels::GlobalPooling pooling, const std::string & algorithm)
+        {
+            Exception::assertArgument(input.Shape().Rank() == 3, "Global pooling requires an input of shape (width, height, channels).");
+
+            if (algorithm == "cntk")
+            {
+                if (pooling == Kernels::GlobalPooling::Average)
+                {
+                    return CNTK::ReduceMean(CNTK::ReduceMean(input, CNTK::Axis(0)), CNTK::Axis(1));
+                }
+                return CNTK::ReduceMax(CNTK::ReduceMax(input, CNTK::Axis(0)), CNTK::Axis(1));
+            }
+
+            Exception::assertArgument(algorithm == "reduce" || algorithm == "auto", "Unknown global pooling algorithm. Must be cntk, reduce or auto.");
+            return Pool2DFunction::create(input, [=](const CNTK::NDShape & shape) {
+                return std::make_shared<Kernels::GlobalPool2DPlan>(Kernels::makeGlobalPool2DConfig(shape[0], shape[1], shape[2]), pooling);
+            });
+        }
+
+        /*!
+         * A CNTK function that computes the softmax of a vector with the CPU kernel. If k is positive, the function
+         * returns the k classes with the highest scores in descending order instead, which does not require the
+         * softmax at all. Only the forward pass is supported.
+         */
+        class SoftmaxFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new softmax function.
+             *
+             * @param input The scores of shape (classes)
+             * @param k The number of classes to return or 0 for the probabilities
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, size_t k)
+            {
+                Exception::assertArgument(input.Shape().Rank() == 1, "The softmax requires an input of shape (classes).");
+                Exception::assertArgument(k <= input.Shape()[0], "k must not exceed the number of classes.");
+                Exception::assertArgument(k == 0 || input.Shape()[0] <= (1 << 24), "The classes must be exactly representable as floats.");
+                return CNTK::AsComposite(std::shared_ptr<SoftmaxFunction>(new SoftmaxFunction(input, k)));
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numClasses = inputShape[0];
+                const size_t numSamples = inputShape.TotalSize() / numClasses;
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(1));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                float * output = result->WritableDataBuffer<float>();
+                if (this->k == 0)
+                {
+                    Kernels::softmax(input->DataBuffer<float>(), output, numClasses, numSamples);
+                }
+                else
+                {
+                    std::vector<size_t> classes(this->k * numSamples);
+                    Kernels::topK(input->DataBuffer<float>(), classes.data(), numClasses, this->k, numSamples);
+                    std::copy(classes.begin(), classes.end(), output);
+                }
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiSoftmax";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                const size_t size = this->k == 0 ? operand.Shape()[0] : this->k;
+                outputs.push_back(CNTK::OutputVariable({size}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], this->k);
+            }
+
+        private:
+            SoftmaxFunction(const CNTK::Variable & input, size_t k) :
+                    InferenceFunction({input}, L"ChiantiSoftmax"),
+                    k(k)
+            {}
+
+            /*!
+             * The number of classes to return or 0 for the probabilities.
+             */
+            size_t k;
+        };
+
+        /*!
+         * A CNTK function that computes the cross entropy between labels and the softmax of scores with the fused CPU
+         * kernel. The inputs are the scores and the labels, both of shape (classes). The labels may be sparse. The
+         * output is the loss of every sample. Only the forward pass is supported.
+         */
+        class SoftmaxCrossEntropyFunction : public InferenceFunction
+        {
+        public:
+            /*!
+             * Creates a new cross entropy function.
+             *
+             * @param input The scores of shape (classes)
+             * @param labels The labels of shape (classes)
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & input, const CNTK::Variable & labels)
+            {
+                Exception::assertArgument(input.Shape().Rank() == 1, "The cross entropy requires scores of shape (classes).");
+                Exception::assertArgument(input.Shape() == labels.Shape(), "The labels must have the shape of the scores.");
+                return CNTK::AsComposite(std::shared_ptr<SoftmaxCrossEntropyFunction>(new SoftmaxCrossEntropyFunction({input, labels})));
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto input = Internal::cpuView(inputValues[0]->Data());
+                auto labels = inputValues[1]->Data();
+                if (labels->IsSparse())
+                {
+                    // The kernel reads dense labels
+                    auto dense = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, labels->Shape(), CNTK::DeviceDescriptor::CPUDevice());
+                    dense->CopyFrom(*labels);
+                    labels = dense;
+                }
+                labels = Internal::cpuView(labels);
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & inputShape = input->Shape();
+                const size_t numClasses = inputShape[0];
+                const size_t numSamples = inputShape.TotalSize() / numClasses;
+                const auto outputShape = this->Output().Shape().AppendShape(inputShape.SubShape(1));
+
+                auto result = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, outputShape, CNTK::DeviceDescriptor::CPUDevice());
+                Kernels::softmaxCrossEntropy(input->DataBuffer<float>(), labels->DataBuffer<float>(), result->WritableDataBuffer<float>(), numClasses, numSamples);
+
+                Internal::publishOutput(outputs[this->Output()], result, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiSoftmaxCrossEntropy";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                outputs.push_back(CNTK::OutputVariable({1}, CNTK::DataType::Float, operand.DynamicAxes()));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], clonedInputs[1]);
+            }
+
+        private:
+            explicit SoftmaxCrossEntropyFunction(const std::vector<CNTK::Variable> & inputs) :
+                    InferenceFunction(inputs, L"ChiantiSoftmaxCrossEntropy")
+            {}
+        };
+
+        /*!
+         * A CNTK function that draws the candidate classes of a sampled softmax. The input are the one-hot labels of
+         * shape (classes), which may be sparse. The function has four outputs:
+         * 1. The sampled classes of shape (samples). They are drawn with replacement once per minibatch and have no
+         *    dynamic axes.
+         * 2. The correction of the sampled scores of shape (samples) per sample, i.e. -log(samples * q(c)) where q is
+         *    the sampling distribution. Samples that hit a label are additionally pushed to -1e30.
+         * 3. The correction of the label score of shape (1) per sample, i.e. -sum(labels * log(samples * q)).
+         * 4. The class of the label of shape (1) per sample, such that the score of the label can be computed from a
+         *    single row of the weights.
+         * None of the outputs depends on a parameter, hence, the function can be part of a trained network.
+         */
+        class SampleClassesFunction : public CNTK::Function
+        {
+        public:
+            /*!
+             * Creates a new sampling function.
+             *
+             * @param labels The labels of shape (classes)
+             * @param sampler The sampling distribution. Every class must have a positive probability.
+             * @param numSampled The number of classes that are drawn per minibatch
+             * @param seed The seed of the random number generator
+             * @return The function
+             */
+            static CNTK::FunctionPtr create(const CNTK::Variable & labels, const std::shared_ptr<Kernels::AliasSampler> & sampler, size_t numSampled, uint64_t seed)
+            {
+                // A label of a class that cannot be drawn would need the correction log(0)
+                for (size_t c = 0; c < sampler->size(); c++)
+                {
+                    Exception::assertArgument(sampler->probability(c) > 0, "Every class must have a positive sampling probability.");
+                }
+                return create(labels, sampler, numSampled, seed, std::make_shared<std::atomic<uint64_t>>(0), 0);
+            }
+
+            CNTK::BackPropStatePtr Forward(
+                    const std::vector<CNTK::ValuePtr> & inputValues,
+                    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> & outputs,
+                    const CNTK::DeviceDescriptor & computeDevice,
+                    const std::unordered_set<CNTK::Variable> &) override
+            {
+                const auto labels = Internal::cpuView(inputValues[0]->Data());
+
+                // The trailing dimensions of the value are the dynamic axes
+                const auto & labelShape = labels->Shape();
+                const size_t numClasses = this->sampler->size();
+                const size_t numSamples = labelShape.TotalSize() / numClasses;
+
+                auto classes = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, this->Outputs()[0].Shape(), CNTK::DeviceDescriptor::CPUDevice());
+                auto sampledCorrection = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, this->Outputs()[1].Shape().AppendShape(labelShape.SubShape(1)), CNTK::DeviceDescriptor::CPUDevice());
+                auto labelCorrection = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, this->Outputs()[2].Shape().AppendShape(labelShape.SubShape(1)), CNTK::DeviceDescriptor::CPUDevice());
+                auto labelClasses = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, this->Outputs()[3].Shape().AppendShape(labelShape.SubShape(1)), CNTK::DeviceDescriptor::CPUDevice());
+
+                std::vector<size_t> sampled(this->numSampled);
+                std::vector<float> logExpected(this->numSampled);
+                float * classData = classes->WritableDataBuffer<float>();
+                for (size_t s = 0; s < this->numSampled; s++)
+                {
+                    sampled[s] = (*this->sampler)(this->generator);
+                    classData[s] = static_cast<float>(sampled[s]);
+                    logExpected[s] = this->logExpectedCount(sampled[s]);
+                }
+
+                // Collect the non-zero labels of every sample
+                std::vector<std::vector<std::pair<size_t, float>>> targets(numSamples);
+                if (labels->IsSparse())
+                {
+                    const auto buffers = labels->SparseCSCDataBuffers<float>();
+                    const float * values = std::get<0>(buffers);
+                    const CNTK::SparseIndexType * columnStarts = std::get<1>(buffers);
+                    const CNTK::SparseIndexType * rows = std::get<2>(buffers);
+                    for (size_t n = 0; n < numSamples; n++)
+                    {
+                        for (auto i = columnStarts[n]; i < columnStarts[n + 1]; i++)
+                        {
+                            targets[n].push_back(std::make_pair(static_cast<size_t>(rows[i]), values[i]));
+                        }
+                    }
+                }
+                else
+                {
+                    const float * values = labels->DataBuffer<float>();
+                    for (size_t n = 0; n < numSamples; n++)
+                    {
+                        for (size_t c = 0; c < numClasses; c++)
+                        {
+                            if (values[n * numClasses + c] != 0.0f)
+                            {
+                                targets[n].push_back(std::make_pair(c, values[n * numClasses + c]));
+                            }
+                        }
+                    }
+                }
+
+                float * sampledData = sampledCorrection->WritableDataBuffer<float>();
+                float * labelData = labelCorrection->WritableDataBuffer<float>();
+                float * labelClassData = labelClasses->WritableDataBuffer<float>();
+                for (size_t n = 0; n < numSamples; n++)
+                {
+                    // Masked samples may have no label at all, their class is irrelevant
+                    Exception::assertArgument(targets[n].size() <= 1, "The sampled softmax requires one-hot labels.");
+                    labelClassData[n] = targets[n].empty() ? 0.0f : static_cast<float>(targets[n].front().first);
+
+                    labelData[n] = 0.0f;
+                    for (const auto & target : targets[n])
+                    {
+                        labelData[n] -= target.second * this->logExpectedCount(target.first);
+                    }
+
+                    for (size_t s = 0; s < this->numSampled; s++)
+                    {
+                        sampledData[n * this->numSampled + s] = -logExpected[s];
+                        for (const auto & target : targets[n])
+                        {
+                            if (target.first == sampled[s])
+                            {
+                                sampledData[n * this->numSampled + s] = -1e30f;
+                            }
+                        }
+                    }
+                }
+
+                Internal::publishOutput(outputs[this->Outputs()[0]], classes, nullptr, computeDevice);
+                Internal::publishOutput(outputs[this->Outputs()[1]], sampledCorrection, inputValues[0]->Mask(), computeDevice);
+                Internal::publishOutput(outputs[this->Outputs()[2]], labelCorrection, inputValues[0]->Mask(), computeDevice);
+                Internal::publishOutput(outputs[this->Outputs()[3]], labelClasses, inputValues[0]->Mask(), computeDevice);
+                return nullptr;
+            }
+
+            void Backward(const CNTK::BackPropStatePtr &, const std::unordered_map<CNTK::Variable, CNTK::ValuePtr> &, std::unordered_map<CNTK::Variable, CNTK::ValuePtr> &) override
+            {
+                // The outputs are constants with respect to the parameters
+            }
+
+            const std::wstring & OpName() const override
+            {
+                static const std::wstring name = L"ChiantiSampleClasses";
+                return name;
+            }
+
+            void InferOutputs(std::vector<CNTK::Variable> & outputs) override
+            {
+                const auto & operand = this->Inputs()[0];
+                outputs.push_back(CNTK::OutputVariable({this->numSampled}, CNTK::DataType::Float, {}, false));
+                outputs.push_back(CNTK::OutputVariable({this->numSampled}, CNTK::DataType::Float, operand.DynamicAxes(), false));
+                outputs.push_back(CNTK::OutputVariable({1}, CNTK::DataType::Float, operand.DynamicAxes(), false));
+                outputs.push_back(CNTK::OutputVariable({1}, CNTK::DataType::Float, operand.DynamicAxes(), false));
+            }
+
+            CNTK::FunctionPtr Clone(const std::vector<CNTK::Variable> & clonedInputs) override
+            {
+                return create(clonedInputs[0], this->sampler, this->numSampled, this->seed, this->numClones, ++*this->numClones);
+            }
+
+        private:
+            static CNTK::FunctionPtr create(
+                    const CNTK::Variable & labels,
+                    const std::shared_ptr<Kernels::AliasSampler> & sampler,
+                    size_t numSampled,
+                    uint64_t seed,
+                    const std::shared_ptr<std::atomic<uint64_t>> & numClones,
+                    uint64_t cloneIndex)
+            {
+                Exception::assertArgument(labels.Shape().Rank() == 1 && labels.Shape()[0] == sampler->size(), "The labels must have the shape (classes).");
+                Exception::assertArgument(sampler->size() <= (1 << 24), "The classes must be exactly representable as floats.");
+                Exception::assertArgument(numSampled > 0, "At least one class must be sampled.");
+                return CNTK::AsComposite(std::shared_ptr<SampleClassesFunction>(new SampleClassesFunction(labels, sampler, numSampled, seed, numClones, cloneIndex)));
+            }
+
+            SampleClassesFunction(
+                    const CNTK::Variable & labels,
+                    const std::shared_ptr<Kernels::AliasSampler> & sampler,
+                    size_t numSampled,
+                    uint64_t seed,
+                    const std::shared_ptr<std::atomic<uint64_t>> & numClones,
+                    uint64_t cloneIndex) :
+                    CNTK::Function({labels}, L"ChiantiSampleClasses"),
+                    sampler(sampler),
+                    numSampled(numSampled),
+                    seed(seed),
+                    numClones(numClones),
+                    generator(seed)
+            {
+                // Clones draw from streams of their own, which are derived from the seed and the order of cloning
+                if (cloneIndex > 0)
+                {
+                    std::seed_seq sequence = {
+                            static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                            static_cast<uint32_t>(cloneIndex), static_cast<uint32_t>(cloneIndex >> 32)
+                    };
+                    this->generator.seed(sequence);
+                }
+            }
+
+            /*!
+             * Returns the logarithm of the expected number of draws of a class.
+             */
+            float logExpectedCount(size_t c) const
+            {
+                return static_cast<float>(std::log(this->numSampled * this->sampler->probability(c)));
+            }
+
+            /*!
+             * The sampling distribution. It is shared by all clones.
+             */
+            std::shared_ptr<Kernels::AliasSampler> sampler;
+            /*!
+             * The number of classes that are drawn per minibatch.
+             */
+            size_t numSampled;
+            /*!
+             * The seed of the original function.
+             */
+            uint64_t seed;
+            /*!
+             * The number of clones of the original function. It is shared by all clones, such that every clone gets
+             * a different stream.
+             */
+            std::shared_ptr<std::atomic<uint64_t>> numClones;
+            /*!
+             * The random number generator of this instance. Clones do not share it, they may run concurrently.
+             */
+            std::mt19937_64 generator;
+        };
+    }
+}
@@ -0,0 +1,531 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "util.h"
+#include "exception.h"
+#include "threading.h"
+#include "functions.h"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unsupported/Eigen/CXX11/Tensor>
+
+namespace Chianti
+{
+    namespace Inference
+    {
+        /*!
+         * Visits every primitive function of a network once.
+         *
+         * @param network The network
+         * @param callback Called for every function
+         */
+        inline void forEachFunction(const CNTK::FunctionPtr & network, const std::function<void(const CNTK::FunctionPtr &)> & callback)
+        {
+            std::unordered_set<CNTK::Function*> visited;
+            std::vector<CNTK::FunctionPtr> stack = {network->RootFunction()};
+
+            while (!stack.empty())
+            {
+                CNTK::FunctionPtr function = stack.back();
+                stack.pop_back();
+
+                if (!visited.insert(function.get()).second)
+                {
+                    continue;
+                }
+
+                callback(function);
+
+                for (const auto & input : function->Inputs())
+                {
+                    if (input.IsOutput())
+                    {
+                        stack.push_back(input.Owner());
+                    }
+                }
+            }
+        }
+
+        /*!
+         * Estimates the activation memory of a network for a single sample by summing up the sizes of all function
+         * outputs in the graph. Parameters and constants are not counted.
+         *
+         * @param network The network
+         * @return The estimated number of bytes per sample
+         */
+        inline size_t estimateActivationBytes(const CNTK::FunctionPtr & network)
+        {
+            size_t bytes = 0;
+            forEachFunction(network, [&](const CNTK::FunctionPtr & function) {
+                for (const auto & output : function->Outputs())
+                {
+                    bytes += output.Shape().TotalSize() * sizeof(float);
+                }
+            });
+            return bytes;
+        }
+
+        /*!
+         * A network that has been instantiated for a specific input shape.
+         */
+        struct ShapeVariant
+        {
+            /*!
+             * The input variable of the network.
+             */
+            CNTK::Variable input;
+            /*!
+             * The network.
+             */
+            CNTK::FunctionPtr network;
+            /*!
+             * The estimated activation memory of the network (for the configured batch size).
+             */
+            size_t bytes;
+        };
+
+        /*!
+         * Caches one network per distinct input shape. The network is built once from a prototype input shape. All
+         * other shapes are derived by cloning the prototype graph with shared parameters, hence, no variant duplicates
+         * any weights and no variant pays for rebuilding the layers. When the estimated activation memory of all
+         * variants exceeds the memory budget, the least recently used variants are evicted.
+         *
+         * All methods are thread-safe.
+         */
+        class ShapeCache
+        {
+        public:
+            typedef ShapeCache Self;
+            typedef std::function<CNTK::FunctionPtr(CNTK::Variable)> NetworkFactory;
+
+            /*!
+             * The activation memory budget of all cached variants in bytes.
+             */
+            size_t _memoryBudget;
+            /*!
+             * The batch size for which the activation memory is estimated.
+             */
+            size_t _batchSize;
+
+        public:
+            /*!
+             * Initializes a new instance of the <ShapeCache> class.
+             *
+             * @param factory Builds the network for an input variable. It is only called once.
+             * @param prototypeShape The input shape of the prototype network
+             */
+            ShapeCache(const NetworkFactory & factory, const CNTK::NDShape & prototypeShape) :
+                    _memoryBudget(static_cast<size_t>(1) << 30),
+                    _batchSize(1),
+                    prototypeInput(CNTK::InputVariable(prototypeShape, CNTK::DataType::Float)),
+                    prototype(factory(prototypeInput)),
+                    memoryUsage(0)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(memoryBudget, _memoryBudget)
+            MAKE_SETTER(memoryBudget, _memoryBudget)
+
+            MAKE_GETTER(batchSize, _batchSize)
+            MAKE_SETTER(batchSize, _batchSize)
+
+            /*!
+             * Returns the network for an input shape. The network is created if it is not cached yet.
+             *
+             * @param shape The input shape
+             * @return The network variant
+             */
+            ShapeVariant get(const CNTK::NDShape & shape)
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+
+                const std::vector<size_t> key = shape.Dimensions();
+                auto it = this->variants.find(key);
+
+                if (it != this->variants.end())
+                {
+                    // Mark the variant as most recently used
+                    this->recency.splice(this->recency.begin(), this->recency, it->second.first);
+                    return it->second.second;
+                }
+
+                ShapeVariant variant;
+                variant.input = CNTK::InputVariable(shape, CNTK::DataType::Float);
+                variant.network = this->prototype->Clone(CNTK::ParameterCloningMethod::Share, {{this->prototypeInput, variant.input}});
+                variant.bytes = estimateActivationBytes(variant.network) * this->_batchSize;
+
+                // Make room for the new variant
+                while (!this->recency.empty() && this->memoryUsage + variant.bytes > this->_memoryBudget)
+                {
+                    auto evicted = this->variants.find(this->recency.back());
+                    this->memoryUsage -= evicted->second.second.bytes;
+                    this->variants.erase(evicted);
+                    this->recency.pop_back();
+                }
+
+                this->recency.push_front(key);
+                this->variants[key] = {this->recency.begin(), variant};
+                this->memoryUsage += variant.bytes;
+
+                return variant;
+            }
+
+            /*!
+             * Returns the number of cached variants.
+             */
+            size_t size() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->variants.size();
+            }
+
+            /*!
+             * Returns the estimated activation memory of all cached variants.
+             */
+            size_t bytes() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->memoryUsage;
+            }
+
+            /*!
+             * Returns the prototype network. All variants share its parameters.
+             */
+            CNTK::FunctionPtr prototypeNetwork() const
+            {
+                return this->prototype;
+            }
+
+        private:
+            /*!
+             * The input variable of the prototype.
+             */
+            CNTK::Variable prototypeInput;
+            /*!
+             * The prototype network.
+             */
+            CNTK::FunctionPtr prototype;
+            /*!
+             * The input shapes ordered from the most to the least recently used.
+             */
+            std::list<std::vector<size_t>> recency;
+            /*!
+             * The cached variants together with their position in the recency list.
+             */
+            std::map<std::vector<size_t>, std::pair<std::list<std::vector<size_t>>::iterator, ShapeVariant>> variants;
+            /*!
+             * The estimated activation memory of all cached variants.
+             */
+            size_t memoryUsage;
+            /*!
+             * Guards the cache.
+             */
+            mutable std::mutex mutex;
+        };
+
+        /*!
+         * Computes the memory that is occupied by the parameters of several networks. Parameters that share their
+         * storage are only counted once.
+         *
+         * @param networks The networks
+         * @return The number of bytes
+         */
+        inline size_t parameterBytes(const std::vector<CNTK::FunctionPtr> & networks)
+        {
+            size_t bytes = 0;
+            std::unordered_set<const float*> buffers;
+
+            for (const auto & network : networks)
+            {
+                for (const auto & parameter : network->Parameters())
+                {
+                    if (buffers.insert(parameter.Value()->DataBuffer<float>()).second)
+                    {
+                        bytes += parameter.Shape().TotalSize() * sizeof(float);
+                    }
+                }
+            }
+
+            return bytes;
+        }
+
+        /*!
+         * An execution context of a model. A session owns its own graph and activation buffers but shares the
+         * parameters with the model it has been created from. A single session must not be used by several threads at
+         * the same time.
+         *
+         * Streaming layers (e.g. <Layers::LSTMLayer::streaming>) keep their states in the session's graph, hence, every
+         * stream needs a dedicated session. Sessions of a <Model> pool must not be used for streaming.
+         */
+        class Session
+        {
+        public:
+            typedef Session Self;
+
+            /*!
+             * The execution context on which the CPU work of this session is scheduled.
+             */
+            std::shared_ptr<Threading::Context> _context;
+            /*!
+             * The maximum number of threads this session may occupy on the context (0 means all threads).
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <Session> class.
+             *
+             * @param network The network whose parameters shall be shared
+             * @param device The device to compute on
+             */
+            Session(const CNTK::FunctionPtr & network, const CNTK::DeviceDescriptor & device) :
+                    _context(Threading::Context::global()),
+                    _numThreads(0),
+                    network(network->Clone(CNTK::ParameterCloningMethod::Share)),
+                    device(device)
+            {
+                const auto arguments = this->network->Arguments();
+                Exception::assertArgument(arguments.size() == 1, "Only networks with a single input are supported.");
+                this->input = arguments[0];
+                this->output = this->network->Output();
+            }
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(context, _context)
+            MAKE_SETTER(context, _context)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Evaluates the network.
+             *
+             * @param input The input batch of shape (input shape, sequence, batch)
+             * @return The output batch of shape (output shape, sequence, batch)
+             */
+            Eigen::Tensor<float, 5> evaluate(const Eigen::Tensor<float, 5> & input)
+            {
+                const size_t numSamples = static_cast<size_t>(input.dimension(3) * input.dimension(4));
+                Exception::assertArgument(static_cast<size_t>(input.size()) == this->input.Shape().TotalSize() * numSamples, "The input does not match the input shape of the network.");
+
+                // The output is padded to rank 3 such that image and vector outputs are handled alike
+                Eigen::array<long int, 5> dimensions = {{1, 1, 1, input.dimension(3), input.dimension(4)}};
+                const auto & outputShape = this->output.Shape();
+                Exception::assertArgument(outputShape.Rank() <= 3, "Only outputs of rank 3 or less are supported.");
+                for (size_t n = 0; n < outputShape.Rank(); n++)
+                {
+                    dimensions[n] = static_cast<long int>(outputShape[n]);
+                }
+
+                Eigen::Tensor<float, 5> result(dimensions);
+                auto inputValue = Util::tensorToValue(input);
+                auto outputValue = Util::tensorToValue(result);
+                std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{this->output, outputValue}};
+                Threading::Scope scope(*this->_context, this->_numThreads);
+                this->network->Forward({{this->input, inputValue}}, outputs, this->device);
+
+                return result;
+            }
+
+            /*!
+             * Resets the states of all streaming layers, such that the next evaluation starts new streams.
+             */
+            void reset()
+            {
+                forEachFunction(this->network, [](const CNTK::FunctionPtr & function) {
+                    auto stateful = dynamic_cast<Functions::StatefulFunction*>(function.get());
+                    if (stateful != nullptr)
+                    {
+                        stateful->resetState();
+                    }
+                });
+            }
+
+            /*!
+             * Returns the network of this session.
+             */
+            CNTK::FunctionPtr sessionNetwork() const
+            {
+                return this->network;
+            }
+
+        private:
+            /*!
+             * The cloned network.
+             */
+            CNTK::FunctionPtr network;
+            /*!
+             * The input variable of the cloned network.
+             */
+            CNTK::Variable input;
+            /*!
+             * The output variable of the cloned network.
+             */
+            CNTK::Variable output;
+            /*!
+             * The device to compute on.
+             */
+            CNTK::DeviceDescriptor device;
+        };
+
+        /*!
+         * A model that can be evaluated by any number of threads concurrently. The parameters are stored once and shared
+         * read-only by all sessions. Every concurrent caller is served by its own session which is taken from a pool,
+         * hence, the number of activation buffers grows with the peak concurrency and not with the number of calls.
+         */
+        class Model
+        {
+        public:
+            typedef Model Self;
+
+            /*!
+             * The execution context on which the CPU work of all sessions is scheduled.
+             */
+            std::shared_ptr<Threading::Context> _context;
+            /*!
+             * The maximum number of threads every session may occupy on the context (0 means all threads).
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <Model> class.
+             *
+             * @param network The network
+             * @param device The device to compute on
+             */
+            Model(const CNTK::FunctionPtr & network, const CNTK::DeviceDescriptor & device) :
+                    _context(Threading::Context::global()),
+                    _numThreads(0),
+                    network(network),
+                    device(device),
+                    numSessions(0)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(context, _context)
+            MAKE_SETTER(context, _context)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Creates a new session that shares the parameters of this model.
+             */
+            std::unique_ptr<Session> createSession() const
+            {
+                std::unique_ptr<Session> session(new Session(this->network, this->device));
+                session->context(this->_context).numThreads(this->_numThreads);
+                return session;
+            }
+
+            /*!
+             * Evaluates the network. This method can be called from several threads concurrently.
+             *
+             * @param input The input batch of shape (input shape, sequence, batch)
+             * @return The output batch of shape (output shape, sequence, batch)
+             */
+            Eigen::Tensor<float, 5> evaluate(const Eigen::Tensor<float, 5> & input)
+            {
+                std::unique_ptr<Session> session = this->acquire();
+
+                try
+                {
+                    Eigen::Tensor<float, 5> result = session->evaluate(input);
+                    this->release(std::move(session));
+                    return result;
+                }
+                catch (...)
+                {
+                    this->release(std::move(session));
+                    throw;
+                }
+            }
+
+            /*!
+             * Returns the number of sessions that have been created by the pool.
+             */
+            size_t sessionCount() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->numSessions;
+            }
+
+            /*!
+             * Returns the networks of the model and of all idle sessions.
+             */
+            std::vector<CNTK::FunctionPtr> networks() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                std::vector<CNTK::FunctionPtr> result = {this->network};
+                for (const auto & session : this->idle)
+                {
+                    result.push_back(session->sessionNetwork());
+                }
+                return result;
+            }
+
+        private:
+            /*!
+             * Takes an idle session from the pool or creates a new one.
+             */
+            std::unique_ptr<Session> acquire()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    if (!this->idle.empty())
+                    {
+                        std::unique_ptr<Session> session = std::move(this->idle.back());
+                        this->idle.pop_back();
+                        return session;
+                    }
+                    this->numSessions++;
+                }
+
+                // Cloning the graph is expensive, so do it outside of the lock
+                return this->createSession();
+            }
+
+            /*!
+             * Returns a session to the pool.
+             */
+            void release(std::unique_ptr<Session> session)
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->idle.push_back(std::move(session));
+            }
+
+            /*!
+             * The network that holds the parameters.
+             */
+            CNTK::FunctionPtr network;
+            /*!
+             * The device to compute on.
+             */
+            CNTK::DeviceDescriptor device;
+            /*!
+             * The idle sessions.
+             */
+            std::vector<std::unique_ptr<Session>> idle;
+            /*!
+             * The number of sessions that have been created by the pool.
+             */
+            size_t numSessions;
+            /*!
+             * Guards the pool.
+             */
+            mutable std::mutex mutex;
+        };
+    }
+}
@@ -0,0 +1,604 @@
+#pragma once
+
+#include "../exception.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * An activation function that can be fused into the epilogue of a CPU kernel. GELU uses the tanh formulation
+         * 0.5 x (1 + tanh(sqrt(2 / pi) (x + 0.044715 x^3))).
+         */
+        enum class Activation
+        {
+            Identity,
+            ReLU,
+            Sigmoid,
+            Tanh,
+            ELU,
+            GELU,
+            Swish
+        };
+
+        /*!
+         * The accuracy of the activation kernels.
+         */
+        enum class ActivationAccuracy
+        {
+            /*!
+             * The functions are evaluated in double precision and rounded, i.e. the results are within 1 ULP.
+             */
+            Exact,
+            /*!
+             * Vectorized polynomial and rational approximations. See test/activation.cpp for the error bounds.
+             */
+            Fast
+        };
+
+        /*!
+         * Returns the name of an activation function.
+         */
+        inline std::string activationName(Activation activation)
+        {
+            switch (activation)
+            {
+                case Activation::Identity:
+                    return "identity";
+                case Activation::ReLU:
+                    return "relu";
+                case Activation::Sigmoid:
+                    return "sigmoid";
+                case Activation::Tanh:
+                    return "tanh";
+                case Activation::ELU:
+                    return "elu";
+                case Activation::GELU:
+                    return "gelu";
+                case Activation::Swish:
+                    return "swish";
+            }
+            return "unknown";
+        }
+
+        /*!
+         * Returns the accuracy of the activation kernels. It is determined once per process from the environment
+         * variable CHIANTI_ACTIVATION_ACCURACY (exact or fast) and defaults to exact.
+         */
+        inline ActivationAccuracy activationAccuracy()
+        {
+            static const ActivationAccuracy accuracy = []() {
+                const char * name = std::getenv("CHIANTI_ACTIVATION_ACCURACY");
+                if (name == nullptr || std::string(name).empty() || std::string(name) == "exact")
+                {
+                    return ActivationAccuracy::Exact;
+                }
+                else if (std::string(name) == "fast")
+                {
+                    return ActivationAccuracy::Fast;
+                }
+                throw Exception::IllegalArgumentException("Unknown activation accuracy. Must be exact or fast.");
+            }();
+            return accuracy;
+        }
+
+        /*!
+         * Applies an activation function to a single value.
+         */
+        inline float activate(Activation activation, float value)
+        {
+            const double x = value;
+            switch (activation)
+            {
+                case Activation::Identity:
+                    return value;
+                case Activation::ReLU:
+                    return std::max(value, 0.0f);
+                case Activation::Sigmoid:
+                    return static_cast<float>(1.0 / (1.0 + std::exp(-x)));
+                case Activation::Tanh:
+                    return static_cast<float>(std::tanh(x));
+                case Activation::ELU:
+                    return value > 0.0f ? value : static_cast<float>(std::expm1(x));
+                case Activation::GELU:
+                    // 0.5 (1 + tanh(z)) = 1 / (1 + exp(-2 z)) does not cancel for negative values
+                    return static_cast<float>(x / (1.0 + std::exp(-2.0 * 0.7978845608028654 * (x + 0.044715 * x * x * x))));
+                case Activation::Swish:
+                    return static_cast<float>(x / (1.0 + std::exp(-x)));
+            }
+            return value;
+        }
+
+        namespace Internal
+        {
+            /*!
+             * Computes the ReLU in place with portable code.
+             */
+            inline void reluScalar(float * data, size_t size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    data[i] = std::max(data[i], 0.0f);
+                }
+            }
+
+#ifdef CHIANTI_X86_DISPATCH
+            // The zero is the first operand such that NaNs are propagated like std::max does
+
+            CHIANTI_TARGET_SSE42 inline void reluSSE42(float * data, size_t size)
+            {
+                const __m128 zero = _mm_setzero_ps();
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    _mm_storeu_ps(data + i, _mm_max_ps(zero, _mm_loadu_ps(data + i)));
+                }
+                reluScalar(data + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void reluAVX2(float * data, size_t size)
+            {
+                const __m256 zero = _mm256_setzero_ps();
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    _mm256_storeu_ps(data + i, _mm256_max_ps(zero, _mm256_loadu_ps(data + i)));
+                }
+                reluScalar(data + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void reluAVX512(float * data, size_t size)
+            {
+                const __m512 zero = _mm512_setzero_ps();
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    _mm512_storeu_ps(data + i, _mm512_max_ps(zero, _mm512_loadu_ps(data + i)));
+                }
+                reluScalar(data + i, size - i);
+            }
+#endif
+        }
+
+        /*!
+         * Returns the variants of the in-place ReLU.
+         */
+        inline const KernelRegistry<void (*)(float *, size_t)> & reluKernels()
+        {
+            static const KernelRegistry<void (*)(float *, size_t)> registry = []() {
+                KernelRegistry<void (*)(float *, size_t)> result("relu", &Internal::reluScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::reluSSE42)
+                      .add(CpuTier::AVX2, &Internal::reluAVX2)
+                      .add(CpuTier::AVX512, &Internal::reluAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        namespace Internal
+        {
+            /*!
+             * Computes the logistic sigmoid with vectorized approximations. Eigen clamps the argument of exp to
+             * [-88, 88], hence, exp(-|v|) is computed as the square of exp(-|v| / 2) to keep the tail accurate.
+             */
+            typedef Eigen::Array<float, Eigen::Dynamic, 1, Eigen::ColMajor, 256, 1> ActivationBlock;
+
+            inline ActivationBlock fastSigmoid(const ActivationBlock & v)
+            {
+                const ActivationBlock t = (-0.5f * v.abs()).exp();
+                const ActivationBlock t2 = t * t;
+                return (v >= 0.0f).select(1.0f, t2) / (1.0f + t2);
+            }
+
+            /*!
+             * Computes an activation function in place with vectorized approximations. Eigen evaluates exp and tanh
+             * with polynomial and rational approximations on whole SIMD registers.
+             */
+            inline void activateFast(Activation activation, float * data, size_t size)
+            {
+                // The blocks and their temporaries stay in the L1 cache
+                for (size_t first = 0; first < size; first += ActivationBlock::MaxRowsAtCompileTime)
+                {
+                    const size_t count = std::min<size_t>(ActivationBlock::MaxRowsAtCompileTime, size - first);
+                    Eigen::Map<Eigen::ArrayXf> y(data + first, static_cast<Eigen::Index>(count));
+                    const ActivationBlock x = y;
+
+                    switch (activation)
+                    {
+                        case Activation::Identity:
+                        case Activation::ReLU:
+                            break;
+                        case Activation::Sigmoid:
+                            y = fastSigmoid(x);
+                            break;
+                        case Activation::Tanh:
+                            y = x.tanh();
+                            break;
+                        case Activation::ELU:
+                        {
+                            // exp(x) - 1 = 2 t / (1 - t) with t = tanh(x / 2) does not cancel near 0
+                            const ActivationBlock t = (0.5f * x.min(0.0f)).tanh();
+                            y = (x > 0.0f).select(x, 2.0f * t / (1.0f - t));
+                            break;
+                        }
+                        case Activation::GELU:
+                            y = x * fastSigmoid(1.5957691216057308f * (x + 0.044715f * x.cube()));
+                            break;
+                        case Activation::Swish:
+                            y = x * fastSigmoid(x);
+                            break;
+                    }
+                }
+            }
+        }
+
+        namespace Internal
+        {
+            /*!
+             * The coefficients of the vectorized approximations, which are the ones of Eigen's packet math: exp uses
+             * the Cephes polynomial after the reduction by multiples of ln(2), tanh a rational function on [-9, 9].
+             */
+            const float expLimit = 88.3762626647950f;
+            const float expCoefficients[6] = { 1.9875691500E-4f, 1.3981999507E-3f, 8.3334519073E-3f, 4.1665795894E-2f, 1.6666665459E-1f, 5.0000001201E-1f };
+            const float tanhNumerator[7] = { -2.76076847742355e-16f, 2.00018790482477e-13f, -8.60467152213735e-11f, 5.12229709037114e-08f, 1.48572235717979e-05f, 6.37261928875436e-04f, 4.89352455891786e-03f };
+            const float tanhDenominator[4] = { 1.19825839466702e-06f, 1.18534705686654e-04f, 2.26843463243900e-03f, 4.89352518554385e-03f };
+
+#ifdef CHIANTI_X86_DISPATCH
+            // The variants below compute the same approximations as <activateFast> on whole registers. The remaining
+            // values are computed on a padded register, such that every value gets the same approximation.
+
+            CHIANTI_TARGET_SSE42 inline __m128 expSSE42(__m128 v)
+            {
+                const __m128 x = _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(expLimit)), _mm_set1_ps(-expLimit));
+                const __m128 m = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+
+                // Subtract m ln(2) in two parts, such that the product is exact
+                __m128 r = _mm_sub_ps(x, _mm_mul_ps(m, _mm_set1_ps(0.693359375f)));
+                r = _mm_sub_ps(r, _mm_mul_ps(m, _mm_set1_ps(-2.12194440e-4f)));
+
+                __m128 y = _mm_set1_ps(expCoefficients[0]);
+                for (size_t k = 1; k < 6; k++)
+                {
+                    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(expCoefficients[k]));
+                }
+                y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(r, r)), r), _mm_set1_ps(1.0f));
+
+                const __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(m), _mm_set1_epi32(127)), 23);
+                return _mm_max_ps(_mm_mul_ps(y, _mm_castsi128_ps(exponent)), v);
+            }
+
+            CHIANTI_TARGET_SSE42 inline __m128 tanhSSE42(__m128 v)
+            {
+                const __m128 x = _mm_max_ps(_mm_set1_ps(-9.0f), _mm_min_ps(_mm_set1_ps(9.0f), v));
+                const __m128 x2 = _mm_mul_ps(x, x);
+
+                __m128 p = _mm_set1_ps(tanhNumerator[0]);
+                for (size_t k = 1; k < 7; k++)
+                {
+                    p = _mm_add_ps(_mm_mul_ps(x2, p), _mm_set1_ps(tanhNumerator[k]));
+                }
+                __m128 q = _mm_set1_ps(tanhDenominator[0]);
+                for (size_t k = 1; k < 4; k++)
+                {
+                    q = _mm_add_ps(_mm_mul_ps(x2, q), _mm_set1_ps(tanhDenominator[k]));
+                }
+                return _mm_div_ps(_mm_mul_ps(x, p), q);
+            }
+
+            CHIANTI_TARGET_SSE42 inline __m128 sigmoidSSE42(__m128 v)
+            {
+                const __m128 t = expSSE42(_mm_mul_ps(_mm_set1_ps(-0.5f), _mm_andnot_ps(_mm_set1_ps(-0.0f), v)));
+                const __m128 t2 = _mm_mul_ps(t, t);
+                const __m128 numerator = _mm_blendv_ps(t2, _mm_set1_ps(1.0f), _mm_cmpge_ps(v, _mm_setzero_ps()));
+                return _mm_div_ps(numerator, _mm_add_ps(_mm_set1_ps(1.0f), t2));
+            }
+
+            CHIANTI_TARGET_SSE42 inline __m128 activateSSE42(Activation activation, __m128 x)
+            {
+                switch (activation)
+                {
+                    case Activation::Sigmoid:
+                        return sigmoidSSE42(x);
+                    case Activation::Tanh:
+                        return tanhSSE42(x);
+                    case Activation::ELU:
+                    {
+                        const __m128 t = tanhSSE42(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_min_ps(x, _mm_setzero_ps())));
+                        const __m128 negative = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(2.0f), t), _mm_sub_ps(_mm_set1_ps(1.0f), t));
+                        return _mm_blendv_ps(negative, x, _mm_cmpgt_ps(x, _mm_setzero_ps()));
+                    }
+                    case Activation::GELU:
+                    {
+                        const __m128 cube = _mm_mul_ps(_mm_mul_ps(x, x), x);
+                        const __m128 z = _mm_mul_ps(_mm_set1_ps(1.5957691216057308f), _mm_add_ps(x, _mm_mul_ps(_mm_set1_ps(0.044715f), cube)));
+                        return _mm_mul_ps(x, sigmoidSSE42(z));
+                    }
+                    case Activation::Swish:
+                        return _mm_mul_ps(x, sigmoidSSE42(x));
+                    default:
+                        return x;
+                }
+            }
+
+            CHIANTI_TARGET_SSE42 inline void activateFastSSE42(Activation activation, float * data, size_t size)
+            {
+                if (activation == Activation::Identity || activation == Activation::ReLU)
+                {
+                    return;
+                }
+
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    _mm_storeu_ps(data + i, activateSSE42(activation, _mm_loadu_ps(data + i)));
+                }
+                if (i < size)
+                {
+                    float rest[4] = {};
+                    std::copy(data + i, data + size, rest);
+                    _mm_storeu_ps(rest, activateSSE42(activation, _mm_loadu_ps(rest)));
+                    std::copy(rest, rest + (size - i), data + i);
+                }
+            }
+
+            CHIANTI_TARGET_AVX2 inline __m256 expAVX2(__m256 v)
+            {
+                const __m256 x = _mm256_max_ps(_mm256_min_ps(v, _mm256_set1_ps(expLimit)), _mm256_set1_ps(-expLimit));
+                const __m256 m = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+
+                // The fused multiply-add subtracts m ln(2) without rounding the product
+                const __m256 r = _mm256_fmadd_ps(m, _mm256_set1_ps(-0.6931471805599453f), x);
+
+                __m256 y = _mm256_set1_ps(expCoefficients[0]);
+                for (size_t k = 1; k < 6; k++)
+                {
+                    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(expCoefficients[k]));
+                }
+                y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(r, r), r), _mm256_set1_ps(1.0f));
+
+                const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(m), _mm256_set1_epi32(127)), 23);
+                return _mm256_max_ps(_mm256_mul_ps(y, _mm256_castsi256_ps(exponent)), v);
+            }
+
+            CHIANTI_TARGET_AVX2 inline __m256 tanhAVX2(__m256 v)
+            {
+                const __m256 x = _mm256_max_ps(_mm256_set1_ps(-9.0f), _mm256_min_ps(_mm256_set1_ps(9.0f), v));
+                const __m256 x2 = _mm256_mul_ps(x, x);
+
+                __m256 p = _mm256_set1_ps(tanhNumerator[0]);
+                for (size_t k = 1; k < 7; k++)
+                {
+                    p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(tanhNumerator[k]));
+                }
+                __m256 q = _mm256_set1_ps(tanhDenominator[0]);
+                for (size_t k = 1; k < 4; k++)
+                {
+                    q = _mm256_fmadd_ps(x2, q, _mm256_set1_ps(tanhDenominator[k]));
+                }
+                return _mm256_div_ps(_mm256_mul_ps(x, p), q);
+            }
+
+            CHIANTI_TARGET_AVX2 inline __m256 sigmoidAVX2(__m256 v)
+            {
+                const __m256 t = expAVX2(_mm256_mul_ps(_mm256_set1_ps(-0.5f), _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v)));
+                const __m256 t2 = _mm256_mul_ps(t, t);
+                const __m256 numerator = _mm256_blendv_ps(t2, _mm256_set1_ps(1.0f), _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ));
+                return _mm256_div_ps(numerator, _mm256_add_ps(_mm256_set1_ps(1.0f), t2));
+            }
+
+            CHIANTI_TARGET_AVX2 inline __m256 activateAVX2(Activation activation, __m256 x)
+            {
+                switch (activation)
+                {
+                    case Activation::Sigmoid:
+                        return sigmoidAVX2(x);
+                    case Activation::Tanh:
+                        return tanhAVX2(x);
+                    case Activation::ELU:
+                    {
+                        const __m256 t = tanhAVX2(_mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_min_ps(x, _mm256_setzero_ps())));
+                        const __m256 negative = _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), t), _mm256_sub_ps(_mm256_set1_ps(1.0f), t));
+                        return _mm256_blendv_ps(negative, x, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+                    }
+                    case Activation::GELU:
+                    {
+                        const __m256 cube = _mm256_mul_ps(_mm256_mul_ps(x, x), x);
+                        const __m256 z = _mm256_mul_ps(_mm256_set1_ps(1.5957691216057308f), _mm256_fmadd_ps(_mm256_set1_ps(0.044715f), cube, x));
+                        return _mm256_mul_ps(x, sigmoidAVX2(z));
+                    }
+                    case Activation::Swish:
+                        return _mm256_mul_ps(x, sigmoidAVX2(x));
+                    default:
+                        return x;
+                }
+            }
+
+            CHIANTI_TARGET_AVX2 inline void activateFastAVX2(Activation activation, float * data, size_t size)
+            {
+                if (activation == Activation::Identity || activation == Activation::ReLU)
+                {
+                    return;
+                }
+
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    _mm256_storeu_ps(data + i, activateAVX2(activation, _mm256_loadu_ps(data + i)));
+                }
+                if (i < size)
+                {
+                    float rest[8] = {};
+                    std::copy(data + i, data + size, rest);
+                    _mm256_storeu_ps(rest, activateAVX2(activation, _mm256_loadu_ps(rest)));
+                    std::copy(rest, rest + (size - i), data + i);
+                }
+            }
+
+            CHIANTI_TARGET_AVX512 inline __m512 expAVX512(__m512 v)
+            {
+                const __m512 x = _mm512_max_ps(_mm512_min_ps(v, _mm512_set1_ps(expLimit)), _mm512_set1_ps(-expLimit));
+                const __m512 m = _mm512_roundscale_ps(_mm512_fmadd_ps(x, _mm512_set1_ps(1.44269504088896341f), _mm512_set1_ps(0.5f)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+                const __m512 r = _mm512_fmadd_ps(m, _mm512_set1_ps(-0.6931471805599453f), x);
+
+                __m512 y = _mm512_set1_ps(expCoefficients[0]);
+                for (size_t k = 1; k < 6; k++)
+                {
+                    y = _mm512_fmadd_ps(y, r, _mm512_set1_ps(expCoefficients[k]));
+                }
+                y = _mm512_add_ps(_mm512_fmadd_ps(y, _mm512_mul_ps(r, r), r), _mm512_set1_ps(1.0f));
+
+                const __m512i exponent = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(m), _mm512_set1_epi32(127)), 23);
+                return _mm512_max_ps(_mm512_mul_ps(y, _mm512_castsi512_ps(exponent)), v);
+            }
+
+            CHIANTI_TARGET_AVX512 inline __m512 tanhAVX512(__m512 v)
+            {
+                const __m512 x = _mm512_max_ps(_mm512_set1_ps(-9.0f), _mm512_min_ps(_mm512_set1_ps(9.0f), v));
+                const __m512 x2 = _mm512_mul_ps(x, x);
+
+                __m512 p = _mm512_set1_ps(tanhNumerator[0]);
+                for (size_t k = 1; k < 7; k++)
+                {
+                    p = _mm512_fmadd_ps(x2, p, _mm512_set1_ps(tanhNumerator[k]));
+                }
+                __m512 q = _mm512_set1_ps(tanhDenominator[0]);
+                for (size_t k = 1; k < 4; k++)
+                {
+                    q = _mm512_fmadd_ps(x2, q, _mm512_set1_ps(tanhDenominator[k]));
+                }
+                return _mm512_div_ps(_mm512_mul_ps(x, p), q);
+            }
+
+            CHIANTI_TARGET_AVX512 inline __m512 sigmoidAVX512(__m512 v)
+            {
+                const __m512 t = expAVX512(_mm512_mul_ps(_mm512_set1_ps(-0.5f), _mm512_abs_ps(v)));
+                const __m512 t2 = _mm512_mul_ps(t, t);
+                const __m512 numerator = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(v, _mm512_setzero_ps(), _CMP_GE_OQ), t2, _mm512_set1_ps(1.0f));
+                return _mm512_div_ps(numerator, _mm512_add_ps(_mm512_set1_ps(1.0f), t2));
+            }
+
+            CHIANTI_TARGET_AVX512 inline __m512 activateAVX512(Activation activation, __m512 x)
+            {
+                switch (activation)
+                {
+                    case Activation::Sigmoid:
+                        return sigmoidAVX512(x);
+                    case Activation::Tanh:
+                        return tanhAVX512(x);
+                    case Activation::ELU:
+                    {
+                        const __m512 t = tanhAVX512(_mm512_mul_ps(_mm512_set1_ps(0.5f), _mm512_min_ps(x, _mm512_setzero_ps())));
+                        const __m512 negative = _mm512_div_ps(_mm512_mul_ps(_mm512_set1_ps(2.0f), t), _mm512_sub_ps(_mm512_set1_ps(1.0f), t));
+                        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GT_OQ), negative, x);
+                    }
+                    case Activation::GELU:
+                    {
+                        const __m512 cube = _mm512_mul_ps(_mm512_mul_ps(x, x), x);
+                        const __m512 z = _mm512_mul_ps(_mm512_set1_ps(1.5957691216057308f), _mm512_fmadd_ps(_mm512_set1_ps(0.044715f), cube, x));
+                        return _mm512_mul_ps(x, sigmoidAVX512(z));
+                    }
+                    case Activation::Swish:
+                        return _mm512_mul_ps(x, sigmoidAVX512(x));
+                    default:
+                        return x;
+                }
+            }
+
+            CHIANTI_TARGET_AVX512 inline void activateFastAVX512(Activation activation, float * data, size_t size)
+            {
+                if (activation == Activation::Identity || activation == Activation::ReLU)
+                {
+                    return;
+                }
+
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    _mm512_storeu_ps(data + i, activateAVX512(activation, _mm512_loadu_ps(data + i)));
+                }
+                if (i < size)
+                {
+                    // A masked load and store keep the remaining values in a single register
+                    const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1);
+                    _mm512_mask_storeu_ps(data + i, mask, activateAVX512(activation, _mm512_maskz_loadu_ps(mask, data + i)));
+                }
+            }
+#endif
+        }
+
+        /*!
+         * Returns the variants of the fast activation functions (see <ActivationAccuracy::Fast>). The portable variant
+         * is vectorized by Eigen for the instruction set the binary has been compiled for. Identity and ReLU leave the
+         * values unchanged, the ReLU has its own kernels (see <reluKernels>).
+         */
+        inline const KernelRegistry<void (*)(Activation, float *, size_t)> & fastActivationKernels()
+        {
+            static const KernelRegistry<void (*)(Activation, float *, size_t)> registry = []() {
+                KernelRegistry<void (*)(Activation, float *, size_t)> result("fast-activation", &Internal::activateFast);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::activateFastSSE42)
+                      .add(CpuTier::AVX2, &Internal::activateFastAVX2)
+                      .add(CpuTier::AVX512, &Internal::activateFastAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * Applies an activation function in place.
+         *
+         * @param activation The activation function
+         * @param accuracy The accuracy
+         * @param data The values
+         * @param size The number of values
+         */
+        inline void applyActivation(Activation activation, ActivationAccuracy accuracy, float * data, size_t size)
+        {
+            static void (* const relu)(float *, size_t) = reluKernels().select();
+            static void (* const fast)(Activation, float *, size_t) = fastActivationKernels().select();
+
+            if (activation == Activation::Identity)
+            {
+                return;
+            }
+            else if (activation == Activation::ReLU)
+            {
+                relu(data, size);
+            }
+            else if (accuracy == ActivationAccuracy::Fast)
+            {
+                fast(activation, data, size);
+            }
+            else
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    data[i] = activate(activation, data[i]);
+                }
+            }
+        }
+
+        /*!
+         * Applies an activation function in place with the accuracy of the process.
+         *
+         * @param activation The activation function
+         * @param data The values
+         * @param size The number of values
+         */
+        inline void applyActivation(Activation activation, float * data, size_t size)
+        {
+            applyActivation(activation, activationAccuracy(), data, size);
+        }
+    }
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+#include "activation.h"
+#include "conv2d.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a causal 1D convolution over the frames of a sequence. Every output frame t only depends on
+         * the input frames t - k * dilation for k = 0 ... filterSize - 1, frames before the start of the sequence are
+         * zero. All buffers use the CNTK layout, i.e. a sequence is a (channels x length) matrix and the weights are
+         * a (numFilters x channels x filterSize) tensor with the first dimension varying fastest. The last tap
+         * (filterSize - 1) belongs to the current frame.
+         */
+        struct CausalConv1DConfig
+        {
+            size_t channels;
+            size_t numFilters;
+            size_t filterSize;
+            size_t dilation;
+            /*!
+             * The activation function that is applied after the bias.
+             */
+            Activation activation;
+
+            /*!
+             * Returns the number of past frames an output frame depends on.
+             */
+            size_t history() const
+            {
+                return (this->filterSize - 1) * this->dilation;
+            }
+        };
+
+        /*!
+         * The last <CausalConv1DConfig::history> input frames of every sequence a causal convolution has processed so
+         * far. It allows to process streams in chunks. The frames are stored as a (channels x history x numSequences)
+         * tensor.
+         */
+        struct CausalConv1DState
+        {
+            std::vector<float> frames;
+        };
+
+        /*!
+         * A causal 1D convolution on the CPU. The history and the new frames of a sequence are stored in one buffer,
+         * such that the inputs of every tap are a contiguous block of frames. Every tap is a single matrix product
+         * over all frames of the sequence, bias and activation are applied while the results are written. The
+         * sequences are split among the threads of the pool.
+         *
+         * Plans are immutable, hence, a single plan can be run by several threads concurrently.
+         */
+        class CausalConv1DPlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <CausalConv1DPlan> class.
+             *
+             * @param config The geometry of the convolution
+             * @param weights The (numFilters x channels x filterSize) weights
+             */
+            CausalConv1DPlan(const CausalConv1DConfig & config, const float * weights) :
+                    config(config),
+                    weights(weights, weights + config.numFilters * config.channels * config.filterSize)
+            {}
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input sequences
+             * @param bias The bias per filter or nullptr
+             * @param output The output sequences
+             * @param length The number of frames per sequence
+             * @param numSequences The number of sequences
+             * @param state If not nullptr, the sequences continue after these frames, which are replaced by the last
+             * frames of the input. States of a different number of sequences are reset to zero.
+             */
+            void run(const float * input, const float * bias, float * output, size_t length, size_t numSequences, CausalConv1DState * state = nullptr) const
+            {
+                const CausalConv1DConfig & c = this->config;
+                const size_t history = c.history();
+
+                if (state != nullptr && state->frames.size() != c.channels * history * numSequences)
+                {
+                    state->frames.assign(c.channels * history * numSequences, 0.0f);
+                }
+
+                Threading::parallelFor(numSequences, [&](size_t begin, size_t end) {
+                    Eigen::MatrixXf frames(c.channels, history + length);
+                    Eigen::MatrixXf sums(c.numFilters, length);
+
+                    for (size_t n = begin; n < end; n++)
+                    {
+                        // The history is followed by the new frames
+                        float * past = state != nullptr ? state->frames.data() + n * c.channels * history : nullptr;
+                        if (past != nullptr)
+                        {
+                            std::copy_n(past, c.channels * history, frames.data());
+                        }
+                        else
+                        {
+                            frames.leftCols(history).setZero();
+                        }
+                        std::copy_n(input + n * c.channels * length, c.channels * length, frames.data() + c.channels * history);
+
+                        sums.setZero();
+                        for (size_t k = 0; k < c.filterSize; k++)
+                        {
+                            Eigen::Map<const Eigen::MatrixXf> tap(this->weights.data() + k * c.numFilters * c.channels, c.numFilters, c.channels);
+                            sums.noalias() += tap * frames.middleCols(k * c.dilation, length);
+                        }
+
+                        float * out = output + n * c.numFilters * length;
+                        Eigen::Map<Eigen::MatrixXf> result(out, c.numFilters, length);
+                        if (bias != nullptr)
+                        {
+                            result = sums.colwise() + Eigen::Map<const Eigen::VectorXf>(bias, c.numFilters);
+                        }
+                        else
+                        {
+                            result = sums;
+                        }
+                        applyActivation(c.activation, out, c.numFilters * length);
+
+                        if (past != nullptr)
+                        {
+                            std::copy_n(frames.data() + c.channels * length, c.channels * history, past);
+                        }
+                    }
+                });
+            }
+
+            /*!
+             * Returns the geometry of the convolution.
+             */
+            const CausalConv1DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+        private:
+            CausalConv1DConfig config;
+            /*!
+             * The weights of all taps.
+             */
+            std::vector<float> weights;
+        };
+
+        /*!
+         * The geometry of a 1D convolution over the first axis of a static (length x channels) tensor, e.g. audio
+         * samples. All buffers use the CNTK layout, i.e. the samples of a channel are contiguous, the weights are a
+         * (filterSize x channels x numFilters) tensor and the output is a (outputLength x numFilters) tensor.
+         */
+        struct Conv1DConfig
+        {
+            size_t inputLength;
+            size_t channels;
+            size_t numFilters;
+            size_t filterSize;
+            size_t stride;
+            size_t dilation;
+            /*!
+             * The number of zeros before the first input sample.
+             */
+            int64_t pad;
+            size_t outputLength;
+            /*!
+             * The activation function that is applied after the bias.
+             */
+            Activation activation;
+
+            /*!
+             * Returns the extent of a filter including the gaps of the dilation.
+             */
+            size_t dilatedFilterSize() const
+            {
+                return (this->filterSize - 1) * this->dilation + 1;
+            }
+
+            /*!
+             * Returns the number of input values per sample.
+             */
+            size_t inputSize() const
+            {
+                return this->inputLength * this->channels;
+            }
+
+            /*!
+             * Returns the number of output values per sample.
+             */
+            size_t outputSize() const
+            {
+                return this->outputLength * this->numFilters;
+            }
+        };
+
+        /*!
+         * Computes the geometry of a 1D convolution the same way CNTK does for the dilated filter.
+         *
+         * @param inputLength The length of the input
+         * @param channels The number of input channels
+         * @param numFilters The number of filters
+         * @param filterSize The number of taps per filter
+         * @param stride The stride
+         * @param dilation The distance between the taps
+         * @param autoPadding Whether the filter shall be centered (CNTK's automatic padding)
+         * @param lowerPad The explicit padding before the first sample (ignored for automatic padding)
+         * @param upperPad The explicit padding after the last sample (ignored for automatic padding)
+         * @return The geometry
+         */
+        inline Conv1DConfig makeConv1DConfig(
+                size_t inputLength,
+                size_t channels,
+                size_t numFilters,
+                size_t filterSize,
+                size_t stride,
+                size_t dilation,
+                bool autoPadding,
+                size_t lowerPad = 0,
+                size_t upperPad = 0)
+        {
+            Exception::assertArgument(stride > 0 && dilation > 0, "The stride and the dilation must be positive.");
+            Exception::assertArgument(filterSize > 0, "The filter size must be positive.");
+
+            Conv1DConfig config;
+            config.inputLength = inputLength;
+            config.channels = channels;
+            config.numFilters = numFilters;
+            config.filterSize = filterSize;
+            config.stride = stride;
+            config.dilation = dilation;
+            config.activation = Activation::Identity;
+
+            const size_t extent = config.dilatedFilterSize();
+            if (autoPadding)
+            {
+                // CNTK centers the filter and distributes the samples that are not covered by the strides evenly
+                config.outputLength = (inputLength - 1) / stride + 1;
+                const size_t extra = inputLength - ((config.outputLength - 1) * stride + 1);
+                config.pad = static_cast<int64_t>(extent / 2) - static_cast<int64_t>(extra / 2);
+            }
+            else
+            {
+                const size_t paddedSize = inputLength + lowerPad + upperPad;
+                Exception::assertArgument(paddedSize >= extent, "The filter is larger than the padded input.");
+                config.outputLength = (paddedSize - extent) / stride + 1;
+                config.pad = static_cast<int64_t>(lowerPad);
+            }
+
+            return config;
+        }
+
+        /*!
+         * A 1D convolution on the CPU for long inputs. The output is split into blocks of <Internal::gemmBlockSize>
+         * positions. Per block, every tap is a single (positions x channels) x (channels x filters) matrix product,
+         * whose left operand is read in place from the input with the stride as inner stride. Hence, no samples are
+         * copied and no work is spent on a degenerate height axis. The output block stays in the cache while all
+         * taps are accumulated, bias and activation are applied before the next block starts. The blocks of all
+         * samples are split among the threads of the pool.
+         *
+         * Inputs with few channels (e.g. raw audio) would degrade the products to rank-1 updates. Their blocks are
+         * unrolled into a (positions x taps * channels) matrix instead, which is multiplied by all weights at once.
+         *
+         * Plans are immutable, hence, a single plan can be run by several threads concurrently.
+         */
+        class Conv1DPlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Conv1DPlan> class.
+             *
+             * @param config The geometry of the convolution
+             * @param weights The (filterSize x channels x numFilters) weights
+             */
+            Conv1DPlan(const Conv1DConfig & config, const float * weights) :
+                    config(config),
+                    weights(Eigen::Map<const Internal::Matrix>(weights, config.filterSize * config.channels, config.numFilters)),
+                    taps(config.filterSize)
+            {
+                // Every tap is stored as a contiguous (channels x filters) matrix
+                typedef Eigen::Map<const Internal::Matrix, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> TapMap;
+                const Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> stride(config.filterSize * config.channels, config.filterSize);
+                for (size_t k = 0; k < config.filterSize; k++)
+                {
+                    this->taps[k] = TapMap(weights + k, config.channels, config.numFilters, stride);
+                }
+            }
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input samples
+             * @param bias The bias per filter or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const
+            {
+                typedef Eigen::Map<const Internal::Matrix, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> InputMap;
+                const Conv1DConfig & c = this->config;
+                const size_t numBlocks = (c.outputLength + Internal::gemmBlockSize - 1) / Internal::gemmBlockSize;
+
+                Threading::parallelFor(numSamples * numBlocks, [&](size_t begin, size_t end) {
+                    Internal::Matrix columns;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / numBlocks;
+                        const size_t first = (task % numBlocks) * Internal::gemmBlockSize;
+                        const size_t count = std::min(Internal::gemmBlockSize, c.outputLength - first);
+                        const float * in = input + n * c.inputSize();
+
+                        Internal::StridedMap out(output + n * c.outputSize() + first, count, c.numFilters, Eigen::OuterStride<>(c.outputLength));
+                        Internal::initializeWithBias(out, bias);
+
+                        if (c.channels < unrollChannels)
+                        {
+                            // Unroll the receptive fields of the block
+                            columns.resize(count, c.filterSize * c.channels);
+                            for (size_t j = 0; j < c.channels; j++)
+                            {
+                                for (size_t k = 0; k < c.filterSize; k++)
+                                {
+                                    float * column = columns.data() + (k + c.filterSize * j) * count;
+                                    const float * samples = in + j * c.inputLength;
+                                    const int64_t offset = static_cast<int64_t>(first * c.stride + k * c.dilation) - c.pad;
+
+                                    size_t x0, x1;
+                                    validRange(count, c.stride, offset, c.inputLength, x0, x1);
+                                    std::fill(column, column + x0, 0.0f);
+                                    for (size_t x = x0; x < x1; x++)
+                                    {
+                                        column[x] = samples[offset + static_cast<int64_t>(x * c.stride)];
+                                    }
+                                    std::fill(column + x1, column + count, 0.0f);
+                                }
+                            }
+
+                            out.noalias() += columns * this->weights;
+                            Internal::activateBlock(out, c.activation);
+                            continue;
+                        }
+
+                        for (size_t k = 0; k < c.filterSize; k++)
+                        {
+                            // The positions of the block whose input sample of this tap lies within the input
+                            const int64_t offset = static_cast<int64_t>(first * c.stride + k * c.dilation) - c.pad;
+                            size_t x0, x1;
+                            validRange(count, c.stride, offset, c.inputLength, x0, x1);
+                            if (x0 == x1)
+                            {
+                                continue;
+                            }
+
+                            InputMap samples(
+                                    in + offset + static_cast<int64_t>(x0 * c.stride),
+                                    x1 - x0,
+                                    c.channels,
+                                    Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(c.inputLength, c.stride));
+                            out.middleRows(x0, x1 - x0).noalias() += samples * this->taps[k];
+                        }
+
+                        Internal::activateBlock(out, c.activation);
+                    }
+                });
+            }
+
+            /*!
+             * Returns the geometry of the convolution.
+             */
+            const Conv1DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Inputs with fewer channels are unrolled.
+             */
+            static const size_t unrollChannels = 8;
+
+        private:
+            Conv1DConfig config;
+            /*!
+             * The (filterSize * channels x filters) weights.
+             */
+            Internal::Matrix weights;
+            /*!
+             * The (channels x filters) weights of every tap.
+             */
+            std::vector<Internal::Matrix> taps;
+        };
+    }
+}
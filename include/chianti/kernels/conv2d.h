@@ -0,0 +1,950 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+#include "activation.h"
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <unsupported/Eigen/FFT>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a 2D convolution. All buffers use the CNTK layout, i.e. the input of a sample is stored as
+         * (width, height, channels), the output as (width, height, filters) and the weights as (filter width, filter
+         * height, channels, filters), each with the first dimension varying fastest. Like CNTK, the kernels compute a
+         * cross-correlation.
+         */
+        struct Conv2DConfig
+        {
+            size_t inputWidth;
+            size_t inputHeight;
+            size_t inputChannels;
+            size_t numFilters;
+            size_t filterWidth;
+            size_t filterHeight;
+            size_t strideX;
+            size_t strideY;
+            /*!
+             * The padding before the first pixel. It may be negative if CNTK's automatic padding skips input pixels.
+             */
+            int64_t padX;
+            int64_t padY;
+            size_t outputWidth;
+            size_t outputHeight;
+            /*!
+             * The activation function that is applied after the bias.
+             */
+            Activation activation;
+
+            /*!
+             * Returns the number of values per input sample.
+             */
+            size_t inputSize() const
+            {
+                return this->inputWidth * this->inputHeight * this->inputChannels;
+            }
+
+            /*!
+             * Returns the number of values per output sample.
+             */
+            size_t outputSize() const
+            {
+                return this->outputWidth * this->outputHeight * this->numFilters;
+            }
+
+            /*!
+             * Returns the number of weights.
+             */
+            size_t weightSize() const
+            {
+                return this->filterWidth * this->filterHeight * this->inputChannels * this->numFilters;
+            }
+
+            /*!
+             * Returns a string that uniquely identifies the geometry.
+             */
+            std::string key() const
+            {
+                std::ostringstream stream;
+                stream << "conv2d"
+                       << " in=" << this->inputWidth << "x" << this->inputHeight << "x" << this->inputChannels
+                       << " filter=" << this->filterWidth << "x" << this->filterHeight << "x" << this->numFilters
+                       << " stride=" << this->strideX << "x" << this->strideY
+                       << " pad=" << this->padX << "x" << this->padY;
+                if (this->activation != Activation::Identity)
+                {
+                    stream << " activation=" << activationName(this->activation);
+                }
+                return stream.str();
+            }
+        };
+
+        /*!
+         * Computes the geometry of a convolution the same way CNTK does.
+         *
+         * @param inputWidth The width of the input
+         * @param inputHeight The height of the input
+         * @param inputChannels The number of input channels
+         * @param numFilters The number of filters
+         * @param filterWidth The width of the filters
+         * @param filterHeight The height of the filters
+         * @param strideX The horizontal stride
+         * @param strideY The vertical stride
+         * @param autoPadding Whether the filter shall be centered (CNTK's automatic padding)
+         * @param lowerPad The explicit padding before the first pixel (ignored for automatic padding)
+         * @param upperPad The explicit padding after the last pixel (ignored for automatic padding)
+         * @return The geometry
+         */
+        inline Conv2DConfig makeConv2DConfig(
+                size_t inputWidth,
+                size_t inputHeight,
+                size_t inputChannels,
+                size_t numFilters,
+                size_t filterWidth,
+                size_t filterHeight,
+                size_t strideX,
+                size_t strideY,
+                bool autoPadding,
+                const std::vector<size_t> & lowerPad = {0, 0},
+                const std::vector<size_t> & upperPad = {0, 0})
+        {
+            Exception::assertArgument(strideX > 0 && strideY > 0, "The stride must be positive.");
+            Exception::assertArgument(filterWidth > 0 && filterHeight > 0, "The filter size must be positive.");
+
+            Conv2DConfig config;
+            config.inputWidth = inputWidth;
+            config.inputHeight = inputHeight;
+            config.inputChannels = inputChannels;
+            config.numFilters = numFilters;
+            config.filterWidth = filterWidth;
+            config.filterHeight = filterHeight;
+            config.strideX = strideX;
+            config.strideY = strideY;
+            config.activation = Activation::Identity;
+
+            const size_t inputs[2] = {inputWidth, inputHeight};
+            const size_t filters[2] = {filterWidth, filterHeight};
+            const size_t strides[2] = {strideX, strideY};
+            size_t outputs[2];
+            int64_t pads[2];
+
+            for (size_t i = 0; i < 2; i++)
+            {
+                if (autoPadding)
+                {
+                    // CNTK centers the filter and distributes the pixels that are not covered by the strides evenly
+                    outputs[i] = (inputs[i] - 1) / strides[i] + 1;
+                    const size_t extra = inputs[i] - ((outputs[i] - 1) * strides[i] + 1);
+                    pads[i] = static_cast<int64_t>(filters[i] / 2) - static_cast<int64_t>(extra / 2);
+                }
+                else
+                {
+                    const size_t paddedSize = inputs[i] + lowerPad[i] + upperPad[i];
+                    Exception::assertArgument(paddedSize >= filters[i], "The filter is larger than the padded input.");
+                    outputs[i] = (paddedSize - filters[i]) / strides[i] + 1;
+                    pads[i] = static_cast<int64_t>(lowerPad[i]);
+                }
+            }
+
+            config.outputWidth = outputs[0];
+            config.outputHeight = outputs[1];
+            config.padX = pads[0];
+            config.padY = pads[1];
+
+            return config;
+        }
+
+        /*!
+         * Computes the range of output positions o for which o * stride + offset lies within [0, size).
+         *
+         * @param numOutputs The number of output positions
+         * @param stride The stride
+         * @param offset The input position of the first output position
+         * @param size The size of the input
+         * @param begin The first valid output position
+         * @param end One past the last valid output position
+         */
+        inline void validRange(size_t numOutputs, size_t stride, int64_t offset, size_t size, size_t & begin, size_t & end)
+        {
+            const int64_t s = static_cast<int64_t>(stride);
+            const int64_t first = offset >= 0 ? 0 : (-offset + s - 1) / s;
+            const int64_t last = static_cast<int64_t>(size) - 1 - offset;
+            begin = static_cast<size_t>(std::min<int64_t>(first, static_cast<int64_t>(numOutputs)));
+            end = last < 0 ? begin : static_cast<size_t>(std::min<int64_t>(last / s + 1, static_cast<int64_t>(numOutputs)));
+            end = std::max(begin, end);
+        }
+
+        /*!
+         * A convolution that has been prepared for a fixed geometry and fixed weights. Plans are immutable, hence, a
+         * single plan can be run by several threads concurrently.
+         */
+        class Conv2DPlan
+        {
+        public:
+            virtual ~Conv2DPlan() {}
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input samples
+             * @param bias The bias per filter or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            virtual void run(const float * input, const float * bias, float * output, size_t numSamples) const = 0;
+        };
+
+        namespace Internal
+        {
+            typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+            typedef Eigen::Map<Matrix, 0, Eigen::OuterStride<>> StridedMap;
+            typedef Eigen::Map<const Matrix, 0, Eigen::OuterStride<>> ConstStridedMap;
+
+            /*!
+             * The number of output pixels that are processed by a single GEMM task.
+             */
+            const size_t gemmBlockSize = 256;
+
+            /*!
+             * Initializes an output block with the bias or with zeros.
+             */
+            inline void initializeWithBias(StridedMap & output, const float * bias)
+            {
+                for (Eigen::Index f = 0; f < output.cols(); f++)
+                {
+                    output.col(f).setConstant(bias != nullptr ? bias[f] : 0.0f);
+                }
+            }
+
+            /*!
+             * Applies the activation function to an output block while it is still in the cache.
+             */
+            inline void activateBlock(StridedMap & output, Activation activation)
+            {
+                for (Eigen::Index f = 0; f < output.cols(); f++)
+                {
+                    applyActivation(activation, output.col(f).data(), static_cast<size_t>(output.rows()));
+                }
+            }
+        }
+
+        /*!
+         * Direct convolution. It streams each filter tap over whole input rows and needs no extra memory.
+         */
+        class DirectConv2DPlan : public Conv2DPlan
+        {
+        public:
+            DirectConv2DPlan(const Conv2DConfig & config, const float * weights) :
+                    config(config),
+                    weights(weights, weights + config.weightSize())
+            {}
+
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const override
+            {
+                const Conv2DConfig & c = this->config;
+                const size_t planeSize = c.outputWidth * c.outputHeight;
+
+                Threading::parallelFor(numSamples * c.numFilters, [&](size_t begin, size_t end) {
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / c.numFilters;
+                        const size_t f = task % c.numFilters;
+                        const float * in = input + n * c.inputSize();
+                        float * out = output + n * c.outputSize() + f * planeSize;
+
+                        std::fill(out, out + planeSize, bias != nullptr ? bias[f] : 0.0f);
+
+                        for (size_t ch = 0; ch < c.inputChannels; ch++)
+                        {
+                            const float * plane = in + ch * c.inputWidth * c.inputHeight;
+
+                            for (size_t j = 0; j < c.filterHeight; j++)
+                            {
+                                size_t y0, y1;
+                                validRange(c.outputHeight, c.strideY, static_cast<int64_t>(j) - c.padY, c.inputHeight, y0, y1);
+
+                                for (size_t i = 0; i < c.filterWidth; i++)
+                                {
+                                    const float w = this->weights[i + c.filterWidth * (j + c.filterHeight * (ch + c.inputChannels * f))];
+                                    const int64_t offsetX = static_cast<int64_t>(i) - c.padX;
+
+                                    size_t x0, x1;
+                                    validRange(c.outputWidth, c.strideX, offsetX, c.inputWidth, x0, x1);
+
+                                    for (size_t y = y0; y < y1; y++)
+                                    {
+                                        const float * row = plane + (y * c.strideY + j - c.padY) * c.inputWidth;
+                                        float * target = out + y * c.outputWidth;
+
+                                        for (size_t x = x0; x < x1; x++)
+                                        {
+                                            target[x] += w * row[static_cast<int64_t>(x * c.strideX) + offsetX];
+                                        }
+                                    }
+                                }
+                            }
+                        }
+
+                        applyActivation(c.activation, out, planeSize);
+                    }
+                });
+            }
+
+        private:
+            Conv2DConfig config;
+            std::vector<float> weights;
+        };
+
+        /*!
+         * Lowers the convolution to a matrix product. Blocks of output pixels are unrolled into a (pixels x taps)
+         * matrix which is multiplied by the (taps x filters) weight matrix. The weights are already stored in the
+         * required layout.
+         */
+        class Im2ColConv2DPlan : public Conv2DPlan
+        {
+        public:
+            Im2ColConv2DPlan(const Conv2DConfig & config, const float * weights) :
+                    config(config),
+                    weights(Eigen::Map<const Internal::Matrix>(weights, config.filterWidth * config.filterHeight * config.inputChannels, config.numFilters))
+            {}
+
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const override
+            {
+                const Conv2DConfig & c = this->config;
+                const size_t numPixels = c.outputWidth * c.outputHeight;
+                const size_t numTaps = c.filterWidth * c.filterHeight * c.inputChannels;
+                const size_t numBlocks = (numPixels + Internal::gemmBlockSize - 1) / Internal::gemmBlockSize;
+
+                Threading::parallelFor(numSamples * numBlocks, [&](size_t begin, size_t end) {
+                    Internal::Matrix columns;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / numBlocks;
+                        const size_t first = (task % numBlocks) * Internal::gemmBlockSize;
+                        const size_t count = std::min(Internal::gemmBlockSize, numPixels - first);
+                        const float * in = input + n * c.inputSize();
+
+                        // Unroll the receptive fields of the block
+                        columns.resize(count, numTaps);
+                        for (size_t ch = 0; ch < c.inputChannels; ch++)
+                        {
+                            for (size_t j = 0; j < c.filterHeight; j++)
+                            {
+                                for (size_t i = 0; i < c.filterWidth; i++)
+                                {
+                                    float * column = columns.data() + (i + c.filterWidth * (j + c.filterHeight * ch)) * count;
+
+                                    for (size_t p = 0; p < count; p++)
+                                    {
+                                        const size_t x = (first + p) % c.outputWidth;
+                                        const size_t y = (first + p) / c.outputWidth;
+                                        const int64_t ix = static_cast<int64_t>(x * c.strideX + i) - c.padX;
+                                        const int64_t iy = static_cast<int64_t>(y * c.strideY + j) - c.padY;
+                                        const bool inside = ix >= 0 && iy >= 0 && ix < static_cast<int64_t>(c.inputWidth) && iy < static_cast<int64_t>(c.inputHeight);
+                                        column[p] = inside ? in[ix + c.inputWidth * (iy + c.inputHeight * ch)] : 0.0f;
+                                    }
+                                }
+                            }
+                        }
+
+                        Internal::StridedMap out(output + n * c.outputSize() + first, count, c.numFilters, Eigen::OuterStride<>(numPixels));
+                        Internal::initializeWithBias(out, bias);
+                        out.noalias() += columns * this->weights;
+                        Internal::activateBlock(out, c.activation);
+                    }
+                });
+            }
+
+        private:
+            Conv2DConfig config;
+            Internal::Matrix weights;
+        };
+
+        /*!
+         * A 1x1 convolution without padding is a plain matrix product of the (pixels x channels) input and the
+         * (channels x filters) weight matrix. With unit strides the input is used in place. The pixels of all samples
+         * are processed in blocks whose bias and activation are applied right after the product while the block is
+         * still in the cache.
+         */
+        class Gemm1x1Conv2DPlan : public Conv2DPlan
+        {
+        public:
+            Gemm1x1Conv2DPlan(const Conv2DConfig & config, const float * weights) :
+                    config(config),
+                    weights(Eigen::Map<const Internal::Matrix>(weights, config.inputChannels, config.numFilters))
+            {}
+
+            static bool supports(const Conv2DConfig & c)
+            {
+                return c.filterWidth == 1 && c.filterHeight == 1 && c.padX == 0 && c.padY == 0;
+            }
+
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const override
+            {
+                const Conv2DConfig & c = this->config;
+                const size_t numPixels = c.outputWidth * c.outputHeight;
+                const size_t inputPixels = c.inputWidth * c.inputHeight;
+                const size_t numBlocks = (numPixels + Internal::gemmBlockSize - 1) / Internal::gemmBlockSize;
+                const bool strided = c.strideX != 1 || c.strideY != 1;
+
+                Threading::parallelFor(numSamples * numBlocks, [&](size_t begin, size_t end) {
+                    Internal::Matrix gathered;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / numBlocks;
+                        const size_t first = (task % numBlocks) * Internal::gemmBlockSize;
+                        const size_t count = std::min(Internal::gemmBlockSize, numPixels - first);
+                        const float * in = input + n * c.inputSize();
+
+                        Internal::StridedMap out(output + n * c.outputSize() + first, count, c.numFilters, Eigen::OuterStride<>(numPixels));
+                        Internal::initializeWithBias(out, bias);
+
+                        if (!strided)
+                        {
+                            Internal::ConstStridedMap pixels(in + first, count, c.inputChannels, Eigen::OuterStride<>(inputPixels));
+                            out.noalias() += pixels * this->weights;
+                        }
+                        else
+                        {
+                            gathered.resize(count, c.inputChannels);
+                            for (size_t ch = 0; ch < c.inputChannels; ch++)
+                            {
+                                for (size_t p = 0; p < count; p++)
+                                {
+                                    const size_t x = (first + p) % c.outputWidth;
+                                    const size_t y = (first + p) / c.outputWidth;
+                                    gathered(p, ch) = in[x * c.strideX + c.inputWidth * (y * c.strideY + c.inputHeight * ch)];
+                                }
+                            }
+                            out.noalias() += gathered * this->weights;
+                        }
+
+                        Internal::activateBlock(out, c.activation);
+                    }
+                });
+            }
+
+        private:
+            Conv2DConfig config;
+            Internal::Matrix weights;
+        };
+
+        /*!
+         * Winograd convolution F(2x2, 3x3). Each 2x2 output tile is computed from a 4x4 input tile with 16 instead of 36
+         * multiplications per channel and filter. The element-wise products are batched into 16 matrix products over
+         * all tiles of a block. The filter transforms are computed once when the plan is created.
+         */
+        class WinogradConv2DPlan : public Conv2DPlan
+        {
+        public:
+            WinogradConv2DPlan(const Conv2DConfig & config, const float * weights) :
+                    config(config),
+                    transformedWeights(16)
+            {
+                const size_t C = config.inputChannels;
+                const size_t F = config.numFilters;
+
+                for (size_t xi = 0; xi < 16; xi++)
+                {
+                    this->transformedWeights[xi].resize(C, F);
+                }
+
+                for (size_t f = 0; f < F; f++)
+                {
+                    for (size_t ch = 0; ch < C; ch++)
+                    {
+                        const float * g = weights + 9 * (ch + C * f);
+
+                        // U = G g G^T, where g[a + 3 * b] is the tap at (x = a, y = b)
+                        float Gg[4][3];
+                        for (size_t b = 0; b < 3; b++)
+                        {
+                            Gg[0][b] = g[0 + 3 * b];
+                            Gg[1][b] = 0.5f * (g[0 + 3 * b] + g[1 + 3 * b] + g[2 + 3 * b]);
+                            Gg[2][b] = 0.5f * (g[0 + 3 * b] - g[1 + 3 * b] + g[2 + 3 * b]);
+                            Gg[3][b] = g[2 + 3 * b];
+                        }
+
+                        for (size_t a = 0; a < 4; a++)
+                        {
+                            const float u[4] = {
+                                    Gg[a][0],
+                                    0.5f * (Gg[a][0] + Gg[a][1] + Gg[a][2]),
+                                    0.5f * (Gg[a][0] - Gg[a][1] + Gg[a][2]),
+                                    Gg[a][2]
+                            };
+
+                            for (size_t b = 0; b < 4; b++)
+                            {
+                                this->transformedWeights[a + 4 * b](ch, f) = u[b];
+                            }
+                        }
+                    }
+                }
+            }
+
+            static bool supports(const Conv2DConfig & c)
+            {
+                return c.filterWidth == 3 && c.filterHeight == 3 && c.strideX == 1 && c.strideY == 1;
+            }
+
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const override
+            {
+                const Conv2DConfig & c = this->config;
+                const size_t C = c.inputChannels;
+                const size_t F = c.numFilters;
+                const size_t tilesX = (c.outputWidth + 1) / 2;
+                const size_t tilesY = (c.outputHeight + 1) / 2;
+                const size_t numTiles = tilesX * tilesY;
+                const size_t blockSize = Internal::gemmBlockSize / 4;
+                const size_t numBlocks = (numTiles + blockSize - 1) / blockSize;
+
+                Threading::parallelFor(numSamples * numBlocks, [&](size_t begin, size_t end) {
+                    Internal::Matrix V;
+                    Internal::Matrix M;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / numBlocks;
+                        const size_t first = (task % numBlocks) * blockSize;
+                        const size_t count = std::min(blockSize, numTiles - first);
+                        const float * in = input + n * c.inputSize();
+                        float * out = output + n * c.outputSize();
+
+                        // Transform the input tiles: V = B^T d B
+                        V.resize(count, 16 * C);
+                        for (size_t ch = 0; ch < C; ch++)
+                        {
+                            const float * plane = in + ch * c.inputWidth * c.inputHeight;
+
+                            for (size_t t = 0; t < count; t++)
+                            {
+                                const int64_t x0 = static_cast<int64_t>(2 * ((first + t) % tilesX)) - c.padX;
+                                const int64_t y0 = static_cast<int64_t>(2 * ((first + t) / tilesX)) - c.padY;
+
+                                float d[4][4];
+                                for (int64_t b = 0; b < 4; b++)
+                                {
+                                    for (int64_t a = 0; a < 4; a++)
+                                    {
+                                        const int64_t x = x0 + a;
+                                        const int64_t y = y0 + b;
+                                        const bool inside = x >= 0 && y >= 0 && x < static_cast<int64_t>(c.inputWidth) && y < static_cast<int64_t>(c.inputHeight);
+                                        d[a][b] = inside ? plane[x + c.inputWidth * y] : 0.0f;
+                                    }
+                                }
+
+                                float Btd[4][4];
+                                for (size_t b = 0; b < 4; b++)
+                                {
+                                    Btd[0][b] = d[0][b] - d[2][b];
+                                    Btd[1][b] = d[1][b] + d[2][b];
+                                    Btd[2][b] = d[2][b] - d[1][b];
+                                    Btd[3][b] = d[1][b] - d[3][b];
+                                }
+
+                                for (size_t a = 0; a < 4; a++)
+                                {
+                                    V(t, (a + 4 * 0) * C + ch) = Btd[a][0] - Btd[a][2];
+                                    V(t, (a + 4 * 1) * C + ch) = Btd[a][1] + Btd[a][2];
+                                    V(t, (a + 4 * 2) * C + ch) = Btd[a][2] - Btd[a][1];
+                                    V(t, (a + 4 * 3) * C + ch) = Btd[a][1] - Btd[a][3];
+                                }
+                            }
+                        }
+
+                        // Multiply in the transformed domain
+                        M.resize(count, 16 * F);
+                        for (size_t xi = 0; xi < 16; xi++)
+                        {
+                            M.middleCols(xi * F, F).noalias() = V.middleCols(xi * C, C) * this->transformedWeights[xi];
+                        }
+
+                        // Transform the output tiles back: Y = A^T m A
+                        for (size_t f = 0; f < F; f++)
+                        {
+                            const float offset = bias != nullptr ? bias[f] : 0.0f;
+                            float * plane = out + f * c.outputWidth * c.outputHeight;
+
+                            for (size_t t = 0; t < count; t++)
+                            {
+                                const size_t x0 = 2 * ((first + t) % tilesX);
+                                const size_t y0 = 2 * ((first + t) / tilesX);
+
+                                float Atm[2][4];
+                                for (size_t b = 0; b < 4; b++)
+                                {
+                                    const float m0 = M(t, (0 + 4 * b) * F + f);
+                                    const float m1 = M(t, (1 + 4 * b) * F + f);
+                                    const float m2 = M(t, (2 + 4 * b) * F + f);
+                                    const float m3 = M(t, (3 + 4 * b) * F + f);
+                                    Atm[0][b] = m0 + m1 + m2;
+                                    Atm[1][b] = m1 - m2 - m3;
+                                }
+
+                                for (size_t a = 0; a < 2 && x0 + a < c.outputWidth; a++)
+                                {
+                                    plane[x0 + a + c.outputWidth * y0] = offset + Atm[a][0] + Atm[a][1] + Atm[a][2];
+                                    if (y0 + 1 < c.outputHeight)
+                                    {
+                                        plane[x0 + a + c.outputWidth * (y0 + 1)] = offset + Atm[a][1] - Atm[a][2] - Atm[a][3];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                });
+
+                // The tiles of a block are scattered over the planes, so the activation runs over whole planes
+                if (c.activation != Activation::Identity)
+                {
+                    const size_t planeSize = c.outputWidth * c.outputHeight;
+                    Threading::parallelFor(numSamples * F, [&](size_t begin, size_t end) {
+                        applyActivation(c.activation, output + begin * planeSize, (end - begin) * planeSize);
+                    });
+                }
+            }
+
+        private:
+            Conv2DConfig config;
+            /*!
+             * The transformed filters. Element xi = a + 4 * b holds the (channels x filters) matrix of tile position
+             * (a, b).
+             */
+            std::vector<Internal::Matrix> transformedWeights;
+        };
+
+        /*!
+         * FFT convolution for large filters. The output is split into tiles that are computed with overlap-save: every
+         * tile transforms an (fftWidth x fftHeight) window of the input, where the FFT sizes are powers of two, and the
+         * element-wise products are batched into one complex matrix product over the channels per frequency. The
+         * filter spectra are computed once when the plan is created. The costs per output pixel barely depend on the
+         * filter size, hence, the algorithm wins for large filters. Only unit strides are supported.
+         */
+        class FftConv2DPlan : public Conv2DPlan
+        {
+        public:
+            typedef std::complex<float> Complex;
+            typedef Eigen::Matrix<Complex, Eigen::Dynamic, Eigen::Dynamic> ComplexMatrix;
+
+            FftConv2DPlan(const Conv2DConfig & config, const float * weights) :
+                    config(config),
+                    fftWidth(fftSize(config.outputWidth, config.filterWidth)),
+                    fftHeight(fftSize(config.outputHeight, config.filterHeight)),
+                    numBins((fftWidth / 2 + 1) * fftHeight)
+            {
+                const size_t C = config.inputChannels;
+                const size_t F = config.numFilters;
+
+                Eigen::FFT<float> fft;
+                fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+                std::vector<float> window(this->fftWidth * this->fftHeight);
+                std::vector<Complex> spectrum(this->numBins);
+                std::vector<Complex> scratch(this->numBins);
+
+                // The correlation with a filter is the product with its conjugated spectrum
+                this->spectra.resize(C, F * this->numBins);
+                for (size_t f = 0; f < F; f++)
+                {
+                    for (size_t ch = 0; ch < C; ch++)
+                    {
+                        std::fill(window.begin(), window.end(), 0.0f);
+                        for (size_t j = 0; j < config.filterHeight; j++)
+                        {
+                            for (size_t i = 0; i < config.filterWidth; i++)
+                            {
+                                window[i + this->fftWidth * j] = weights[i + config.filterWidth * (j + config.filterHeight * (ch + C * f))];
+                            }
+                        }
+
+                        this->forward(fft, window.data(), spectrum.data(), scratch);
+                        for (size_t bin = 0; bin < this->numBins; bin++)
+                        {
+                            this->spectra(ch, bin * F + f) = std::conj(spectrum[bin]);
+                        }
+                    }
+                }
+            }
+
+            static bool supports(const Conv2DConfig & c)
+            {
+                return std::max(c.filterWidth, c.filterHeight) >= 5 && c.strideX == 1 && c.strideY == 1;
+            }
+
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const override
+            {
+                const Conv2DConfig & c = this->config;
+                const size_t C = c.inputChannels;
+                const size_t F = c.numFilters;
+                const size_t tileWidth = this->fftWidth - c.filterWidth + 1;
+                const size_t tileHeight = this->fftHeight - c.filterHeight + 1;
+                const size_t tilesX = (c.outputWidth + tileWidth - 1) / tileWidth;
+                const size_t tilesY = (c.outputHeight + tileHeight - 1) / tileHeight;
+                const size_t numTiles = tilesX * tilesY;
+                const size_t blockSize = 8;
+                const size_t numBlocks = (numTiles + blockSize - 1) / blockSize;
+
+                Threading::parallelFor(numSamples * numBlocks, [&](size_t begin, size_t end) {
+                    // The FFT objects cache their plans and buffers, hence, every thread needs its own
+                    Eigen::FFT<float> fft;
+                    fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+                    std::vector<float> window(this->fftWidth * this->fftHeight);
+                    std::vector<Complex> spectrum(this->numBins);
+                    std::vector<Complex> scratch(this->numBins);
+                    ComplexMatrix D;
+                    ComplexMatrix Y;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / numBlocks;
+                        const size_t first = (task % numBlocks) * blockSize;
+                        const size_t count = std::min(blockSize, numTiles - first);
+                        const float * in = input + n * c.inputSize();
+                        float * out = output + n * c.outputSize();
+
+                        // Transform the input windows
+                        D.resize(count, C * this->numBins);
+                        for (size_t t = 0; t < count; t++)
+                        {
+                            const int64_t x0 = static_cast<int64_t>(tileWidth * ((first + t) % tilesX)) - c.padX;
+                            const int64_t y0 = static_cast<int64_t>(tileHeight * ((first + t) / tilesX)) - c.padY;
+
+                            for (size_t ch = 0; ch < C; ch++)
+                            {
+                                const float * plane = in + ch * c.inputWidth * c.inputHeight;
+
+                                for (size_t v = 0; v < this->fftHeight; v++)
+                                {
+                                    const int64_t y = y0 + static_cast<int64_t>(v);
+                                    float * row = window.data() + v * this->fftWidth;
+
+                                    for (size_t u = 0; u < this->fftWidth; u++)
+                                    {
+                                        const int64_t x = x0 + static_cast<int64_t>(u);
+                                        const bool inside = x >= 0 && y >= 0 && x < static_cast<int64_t>(c.inputWidth) && y < static_cast<int64_t>(c.inputHeight);
+                                        row[u] = inside ? plane[x + c.inputWidth * y] : 0.0f;
+                                    }
+                                }
+
+                                this->forward(fft, window.data(), spectrum.data(), scratch);
+                                for (size_t bin = 0; bin < this->numBins; bin++)
+                                {
+                                    D(t, bin * C + ch) = spectrum[bin];
+                                }
+                            }
+                        }
+
+                        // Multiply in the frequency domain
+                        Y.resize(count, F * this->numBins);
+                        for (size_t bin = 0; bin < this->numBins; bin++)
+                        {
+                            Y.middleCols(bin * F, F).noalias() = D.middleCols(bin * C, C) * this->spectra.middleCols(bin * F, F);
+                        }
+
+                        // Transform the output tiles back
+                        for (size_t t = 0; t < count; t++)
+                        {
+                            const size_t x0 = tileWidth * ((first + t) % tilesX);
+                            const size_t y0 = tileHeight * ((first + t) / tilesX);
+                            const size_t width = std::min(tileWidth, c.outputWidth - x0);
+                            const size_t height = std::min(tileHeight, c.outputHeight - y0);
+
+                            for (size_t f = 0; f < F; f++)
+                            {
+                                for (size_t bin = 0; bin < this->numBins; bin++)
+                                {
+                                    spectrum[bin] = Y(t, bin * F + f);
+                                }
+                                this->inverse(fft, spectrum.data(), window.data(), scratch);
+
+                                const float offset = bias != nullptr ? bias[f] : 0.0f;
+                                float * plane = out + f * c.outputWidth * c.outputHeight;
+
+                                for (size_t y = 0; y < height; y++)
+                                {
+                                    float * row = plane + x0 + c.outputWidth * (y0 + y);
+                                    for (size_t x = 0; x < width; x++)
+                                    {
+                                        row[x] = offset + window[x + this->fftWidth * y];
+                                    }
+                                    applyActivation(c.activation, row, width);
+                                }
+                            }
+                        }
+                    }
+                });
+            }
+
+        private:
+            /*!
+             * Returns the FFT size along one axis. Small outputs are computed as a single tile, large outputs are split
+             * into tiles that are a few times larger than the filter.
+             */
+            static size_t fftSize(size_t numOutputs, size_t filterSize)
+            {
+                auto nextPowerOfTwo = [](size_t value) {
+                    size_t result = 1;
+                    while (result < value)
+                    {
+                        result *= 2;
+                    }
+                    return result;
+                };
+
+                const size_t whole = nextPowerOfTwo(numOutputs + filterSize - 1);
+                const size_t tiled = std::max<size_t>(16, nextPowerOfTwo(4 * filterSize));
+                return std::max<size_t>(4, std::min(whole, tiled));
+            }
+
+            /*!
+             * Computes the half spectrum of a real window. Bin kx * fftHeight + ky holds frequency (kx, ky).
+             */
+            void forward(Eigen::FFT<float> & fft, const float * window, Complex * spectrum, std::vector<Complex> & scratch) const
+            {
+                const size_t halfWidth = this->fftWidth / 2 + 1;
+
+                for (size_t y = 0; y < this->fftHeight; y++)
+                {
+                    fft.fwd(scratch.data() + y * halfWidth, window + y * this->fftWidth, this->fftWidth);
+                }
+
+                std::vector<Complex> column(this->fftHeight);
+                for (size_t kx = 0; kx < halfWidth; kx++)
+                {
+                    for (size_t y = 0; y < this->fftHeight; y++)
+                    {
+                        column[y] = scratch[kx + halfWidth * y];
+                    }
+                    fft.fwd(spectrum + kx * this->fftHeight, column.data(), this->fftHeight);
+                }
+            }
+
+            /*!
+             * Computes the real window of a half spectrum. This is the inverse of <forward>.
+             */
+            void inverse(Eigen::FFT<float> & fft, const Complex * spectrum, float * window, std::vector<Complex> & scratch) const
+            {
+                const size_t halfWidth = this->fftWidth / 2 + 1;
+
+                for (size_t kx = 0; kx < halfWidth; kx++)
+                {
+                    fft.inv(scratch.data() + kx * this->fftHeight, spectrum + kx * this->fftHeight, this->fftHeight);
+                }
+
+                std::vector<Complex> row(halfWidth);
+                for (size_t y = 0; y < this->fftHeight; y++)
+                {
+                    for (size_t kx = 0; kx < halfWidth; kx++)
+                    {
+                        row[kx] = scratch[y + this->fftHeight * kx];
+                    }
+                    fft.inv(window + y * this->fftWidth, row.data(), this->fftWidth);
+                }
+            }
+
+            Conv2DConfig config;
+            /*!
+             * The FFT size along the x-axis.
+             */
+            size_t fftWidth;
+            /*!
+             * The FFT size along the y-axis.
+             */
+            size_t fftHeight;
+            /*!
+             * The number of frequencies of the half spectrum.
+             */
+            size_t numBins;
+            /*!
+             * The conjugated filter spectra. Columns bin * filters to (bin + 1) * filters hold the (channels x filters)
+             * matrix of a frequency.
+             */
+            ComplexMatrix spectra;
+        };
+
+        /*!
+         * A convolution algorithm.
+         */
+        struct Conv2DAlgorithm
+        {
+            /*!
+             * The name under which the algorithm can be selected.
+             */
+            std::string name;
+            /*!
+             * Returns true if the algorithm can handle a geometry.
+             */
+            std::function<bool(const Conv2DConfig &)> supports;
+            /*!
+             * Creates a plan for a geometry and a set of weights.
+             */
+            std::function<std::shared_ptr<Conv2DPlan>(const Conv2DConfig &, const float *)> create;
+        };
+
+        /*!
+         * Returns all available convolution algorithms.
+         */
+        inline const std::vector<Conv2DAlgorithm> & conv2DAlgorithms()
+        {
+            static const std::vector<Conv2DAlgorithm> algorithms = {
+                    {
+                            "direct",
+                            [](const Conv2DConfig &) { return true; },
+                            [](const Conv2DConfig & c, const float * w) { return std::make_shared<DirectConv2DPlan>(c, w); }
+                    },
+                    {
+                            "im2col",
+                            [](const Conv2DConfig &) { return true; },
+                            [](const Conv2DConfig & c, const float * w) { return std::make_shared<Im2ColConv2DPlan>(c, w); }
+                    },
+                    {
+                            "winograd",
+                            &WinogradConv2DPlan::supports,
+                            [](const Conv2DConfig & c, const float * w) { return std::make_shared<WinogradConv2DPlan>(c, w); }
+                    },
+                    {
+                            "gemm1x1",
+                            &Gemm1x1Conv2DPlan::supports,
+                            [](const Conv2DConfig & c, const float * w) { return std::make_shared<Gemm1x1Conv2DPlan>(c, w); }
+                    },
+                    {
+                            "fft",
+                            &FftConv2DPlan::supports,
+                            [](const Conv2DConfig & c, const float * w) { return std::make_shared<FftConv2DPlan>(c, w); }
+                    }
+            };
+            return algorithms;
+        }
+
+        /*!
+         * Looks up a convolution algorithm by name.
+         *
+         * @param name The name of the algorithm
+         * @return The algorithm or nullptr if there is no such algorithm
+         */
+        inline const Conv2DAlgorithm * findConv2DAlgorithm(const std::string & name)
+        {
+            for (const auto & algorithm : conv2DAlgorithms())
+            {
+                if (algorithm.name == name)
+                {
+                    return &algorithm;
+                }
+            }
+            return nullptr;
+        }
+    }
+}
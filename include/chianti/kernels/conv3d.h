@@ -0,0 +1,287 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+#include "activation.h"
+#include "conv1d.h"
+#include "conv2d.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a 3D convolution. All buffers use the CNTK layout, i.e. the input of a sample is stored as
+         * (width, height, depth, channels), the filters as (width, height, depth, channels, filters) and the output as
+         * (output width, output height, output depth, filters), each with the first dimension varying fastest.
+         */
+        struct Conv3DConfig
+        {
+            size_t inputWidth;
+            size_t inputHeight;
+            size_t inputDepth;
+            size_t inputChannels;
+            size_t numFilters;
+            size_t filterWidth;
+            size_t filterHeight;
+            size_t filterDepth;
+            size_t strideX;
+            size_t strideY;
+            size_t strideZ;
+            /*!
+             * The padding before the first voxel. It may be negative if CNTK's automatic padding skips input voxels.
+             */
+            int64_t padX;
+            int64_t padY;
+            int64_t padZ;
+            size_t outputWidth;
+            size_t outputHeight;
+            size_t outputDepth;
+            /*!
+             * The activation function that is applied after the bias.
+             */
+            Activation activation;
+
+            /*!
+             * Returns the number of values per input sample.
+             */
+            size_t inputSize() const
+            {
+                return this->inputWidth * this->inputHeight * this->inputDepth * this->inputChannels;
+            }
+
+            /*!
+             * Returns the number of values per output sample.
+             */
+            size_t outputSize() const
+            {
+                return this->outputWidth * this->outputHeight * this->outputDepth * this->numFilters;
+            }
+
+            /*!
+             * Returns the number of weights of one filter.
+             */
+            size_t numTaps() const
+            {
+                return this->filterWidth * this->filterHeight * this->filterDepth * this->inputChannels;
+            }
+        };
+
+        /*!
+         * Computes the geometry of a 3D convolution the same way CNTK does. CNTK determines the geometry of every
+         * axis independently, hence, it is given by <makeConv1DConfig>.
+         *
+         * @param inputWidth The width of the input
+         * @param inputHeight The height of the input
+         * @param inputDepth The depth of the input
+         * @param inputChannels The number of input channels
+         * @param numFilters The number of filters
+         * @param filterSize The width, height and depth of the filters
+         * @param stride The strides along the width, height and depth
+         * @param autoPadding Whether the filter shall be centered (CNTK's automatic padding)
+         * @param lowerPad The explicit padding before the first voxel (ignored for automatic padding)
+         * @param upperPad The explicit padding after the last voxel (ignored for automatic padding)
+         * @return The geometry
+         */
+        inline Conv3DConfig makeConv3DConfig(
+                size_t inputWidth,
+                size_t inputHeight,
+                size_t inputDepth,
+                size_t inputChannels,
+                size_t numFilters,
+                const std::vector<size_t> & filterSize,
+                const std::vector<size_t> & stride,
+                bool autoPadding,
+                const std::vector<size_t> & lowerPad = {0, 0, 0},
+                const std::vector<size_t> & upperPad = {0, 0, 0})
+        {
+            const size_t inputs[3] = {inputWidth, inputHeight, inputDepth};
+            Conv1DConfig axes[3];
+            for (size_t i = 0; i < 3; i++)
+            {
+                axes[i] = makeConv1DConfig(inputs[i], 1, 1, filterSize[i], stride[i], 1, autoPadding, lowerPad[i], upperPad[i]);
+            }
+
+            Conv3DConfig config;
+            config.inputWidth = inputWidth;
+            config.inputHeight = inputHeight;
+            config.inputDepth = inputDepth;
+            config.inputChannels = inputChannels;
+            config.numFilters = numFilters;
+            config.filterWidth = filterSize[0];
+            config.filterHeight = filterSize[1];
+            config.filterDepth = filterSize[2];
+            config.strideX = stride[0];
+            config.strideY = stride[1];
+            config.strideZ = stride[2];
+            config.padX = axes[0].pad;
+            config.padY = axes[1].pad;
+            config.padZ = axes[2].pad;
+            config.outputWidth = axes[0].outputLength;
+            config.outputHeight = axes[1].outputLength;
+            config.outputDepth = axes[2].outputLength;
+            config.activation = Activation::Identity;
+            return config;
+        }
+
+        /*!
+         * A 3D convolution on the CPU that is tiled over the depth. Every task computes a block of at most
+         * <Internal::gemmBlockSize> output voxels of a single output plane: the receptive fields of the block are
+         * unrolled into a (voxels x taps) matrix, which is multiplied by the (taps x filters) weights. Bias and
+         * activation are applied while the block is in the cache. Consecutive tasks belong to consecutive planes, so
+         * every thread slides over a window of filterDepth input planes that stays cache-resident.
+         *
+         * The scratch memory is one block per thread (gemmBlockSize x taps values), whereas unrolling a whole volume
+         * would take taps values per output voxel, i.e. filterWidth * filterHeight * filterDepth times the input.
+         * Pointwise convolutions read the input in place and need no scratch memory at all.
+         *
+         * Plans are immutable, hence, a single plan can be run by several threads concurrently.
+         */
+        class Conv3DPlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Conv3DPlan> class.
+             *
+             * @param config The geometry of the convolution
+             * @param weights The (width x height x depth x channels x filters) weights
+             */
+            Conv3DPlan(const Conv3DConfig & config, const float * weights) :
+                    config(config),
+                    weights(Eigen::Map<const Internal::Matrix>(weights, config.numTaps(), config.numFilters))
+            {}
+
+            /*!
+             * Runs the convolution.
+             *
+             * @param input The input samples
+             * @param bias The bias per filter or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const
+            {
+                const Conv3DConfig & c = this->config;
+                const size_t planeSize = c.outputWidth * c.outputHeight;
+                const size_t numVoxels = planeSize * c.outputDepth;
+                const size_t inputPlaneSize = c.inputWidth * c.inputHeight;
+                const size_t inputVolume = inputPlaneSize * c.inputDepth;
+                const size_t blocksPerPlane = (planeSize + Internal::gemmBlockSize - 1) / Internal::gemmBlockSize;
+                const bool pointwise = c.numTaps() == c.inputChannels && c.strideX == 1 && c.strideY == 1 && c.strideZ == 1 && c.padX == 0 && c.padY == 0 && c.padZ == 0;
+
+                Threading::parallelFor(numSamples * c.outputDepth * blocksPerPlane, [&](size_t begin, size_t end) {
+                    Internal::Matrix columns;
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t n = task / (c.outputDepth * blocksPerPlane);
+                        const size_t z = (task / blocksPerPlane) % c.outputDepth;
+                        const size_t first = (task % blocksPerPlane) * Internal::gemmBlockSize;
+                        const size_t count = std::min(Internal::gemmBlockSize, planeSize - first);
+                        const float * in = input + n * c.inputSize();
+
+                        Internal::StridedMap out(output + n * c.outputSize() + z * planeSize + first, count, c.numFilters, Eigen::OuterStride<>(numVoxels));
+                        Internal::initializeWithBias(out, bias);
+
+                        if (pointwise)
+                        {
+                            // The voxels of a block are a (voxels x channels) matrix in the input
+                            Internal::ConstStridedMap voxels(in + z * inputPlaneSize + first, count, c.inputChannels, Eigen::OuterStride<>(inputVolume));
+                            out.noalias() += voxels * this->weights;
+                            Internal::activateBlock(out, c.activation);
+                            continue;
+                        }
+
+                        // Unroll the receptive fields of the block
+                        columns.resize(count, c.numTaps());
+                        for (size_t ch = 0; ch < c.inputChannels; ch++)
+                        {
+                            for (size_t k = 0; k < c.filterDepth; k++)
+                            {
+                                const int64_t iz = static_cast<int64_t>(z * c.strideZ + k) - c.padZ;
+                                const bool planeInside = iz >= 0 && iz < static_cast<int64_t>(c.inputDepth);
+                                const float * plane = in + ch * inputVolume + (planeInside ? iz : 0) * inputPlaneSize;
+
+                                for (size_t j = 0; j < c.filterHeight; j++)
+                                {
+                                    for (size_t i = 0; i < c.filterWidth; i++)
+                                    {
+                                        float * column = columns.data() + (i + c.filterWidth * (j + c.filterHeight * (k + c.filterDepth * ch))) * count;
+                                        if (!planeInside)
+                                        {
+                                            std::fill(column, column + count, 0.0f);
+                                            continue;
+                                        }
+
+                                        // Copy the block row by row, only the ends of a row can be padding
+                                        const int64_t offsetX = static_cast<int64_t>(i) - c.padX;
+                                        size_t x0, x1;
+                                        validRange(c.outputWidth, c.strideX, offsetX, c.inputWidth, x0, x1);
+
+                                        for (size_t p = 0; p < count;)
+                                        {
+                                            const size_t x = (first + p) % c.outputWidth;
+                                            const size_t y = (first + p) / c.outputWidth;
+                                            const size_t length = std::min(c.outputWidth - x, count - p);
+                                            const int64_t iy = static_cast<int64_t>(y * c.strideY + j) - c.padY;
+                                            float * target = column + p;
+                                            p += length;
+
+                                            if (iy < 0 || iy >= static_cast<int64_t>(c.inputHeight))
+                                            {
+                                                std::fill(target, target + length, 0.0f);
+                                                continue;
+                                            }
+
+                                            const float * row = plane + iy * c.inputWidth;
+                                            const size_t begin = std::min(std::max(x0, x), x + length);
+                                            const size_t end = std::max(std::min(x1, x + length), begin);
+                                            std::fill(target, target + (begin - x), 0.0f);
+                                            for (size_t ox = begin; ox < end; ox++)
+                                            {
+                                                target[ox - x] = row[static_cast<int64_t>(ox * c.strideX) + offsetX];
+                                            }
+                                            std::fill(target + (end - x), target + length, 0.0f);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+
+                        out.noalias() += columns * this->weights;
+                        Internal::activateBlock(out, c.activation);
+                    }
+                });
+            }
+
+            /*!
+             * Returns the geometry of the convolution.
+             */
+            const Conv3DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Returns the scratch memory that a single thread needs in bytes.
+             */
+            size_t scratchBytes() const
+            {
+                return Internal::gemmBlockSize * this->config.numTaps() * sizeof(float);
+            }
+
+        private:
+            Conv3DConfig config;
+            /*!
+             * The (taps x filters) weights.
+             */
+            Internal::Matrix weights;
+        };
+    }
+}
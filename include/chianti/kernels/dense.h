@@ -0,0 +1,329 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+#include "activation.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a fully connected layer. All buffers use the CNTK layout, i.e. the input of a sample is a
+         * vector of inputSize values, the output a vector of numUnits values and the weights a (numUnits x inputSize)
+         * matrix with the first dimension varying fastest.
+         */
+        struct DenseConfig
+        {
+            size_t inputSize;
+            size_t numUnits;
+            /*!
+             * The activation function that is applied after the bias.
+             */
+            Activation activation;
+        };
+
+        namespace Internal
+        {
+            /*!
+             * The number of units per weight panel. It spans several SIMD registers of all supported instruction sets.
+             */
+            const size_t densePanelWidth = 16;
+
+            /*!
+             * The signature of the matrix-vector kernels. They multiply a panel with up to 4 samples and store the
+             * 16 sums per sample consecutively.
+             */
+            typedef void (* DenseKernel)(const float * panel, const float * input, size_t inputSize, size_t numSamples, float * sums);
+
+            /*!
+             * Runs an accumulator with a compile-time number of samples, such that the sums stay in registers.
+             */
+            template<typename Accumulator>
+            void accumulatePanel(const float * panel, const float * input, size_t inputSize, size_t numSamples, float * sums)
+            {
+                switch (numSamples)
+                {
+                    case 1:
+                        Accumulator::template run<1>(panel, input, inputSize, sums);
+                        break;
+                    case 2:
+                        Accumulator::template run<2>(panel, input, inputSize, sums);
+                        break;
+                    case 3:
+                        Accumulator::template run<3>(panel, input, inputSize, sums);
+                        break;
+                    case 4:
+                        Accumulator::template run<4>(panel, input, inputSize, sums);
+                        break;
+                    default:
+                        throw Exception::IllegalArgumentException("The matrix-vector kernels run 1 to 4 samples.");
+                }
+            }
+
+            /*!
+             * Portable accumulator. Eigen vectorizes it for the instruction set the binary has been compiled for.
+             */
+            struct PortableDenseAccumulator
+            {
+                typedef Eigen::Array<float, densePanelWidth, 1> Panel;
+
+                template<size_t numSamples>
+                static void run(const float * panel, const float * input, size_t inputSize, float * sums)
+                {
+                    Panel partial[numSamples];
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        partial[s].setZero();
+                    }
+
+                    for (size_t k = 0; k < inputSize; k++)
+                    {
+                        const Panel w = Eigen::Map<const Panel>(panel + k * densePanelWidth);
+                        for (size_t s = 0; s < numSamples; s++)
+                        {
+                            partial[s] += input[s * inputSize + k] * w;
+                        }
+                    }
+
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        Eigen::Map<Panel>(sums + s * densePanelWidth) = partial[s];
+                    }
+                }
+            };
+
+#ifdef CHIANTI_X86_DISPATCH
+            struct SSE42DenseAccumulator
+            {
+                template<size_t numSamples>
+                CHIANTI_TARGET_SSE42 static void run(const float * panel, const float * input, size_t inputSize, float * sums)
+                {
+                    __m128 partial[numSamples][4];
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        for (size_t r = 0; r < 4; r++)
+                        {
+                            partial[s][r] = _mm_setzero_ps();
+                        }
+                    }
+
+                    for (size_t k = 0; k < inputSize; k++)
+                    {
+                        const float * w = panel + k * densePanelWidth;
+                        const __m128 w0 = _mm_loadu_ps(w);
+                        const __m128 w1 = _mm_loadu_ps(w + 4);
+                        const __m128 w2 = _mm_loadu_ps(w + 8);
+                        const __m128 w3 = _mm_loadu_ps(w + 12);
+                        for (size_t s = 0; s < numSamples; s++)
+                        {
+                            const __m128 x = _mm_set1_ps(input[s * inputSize + k]);
+                            partial[s][0] = _mm_add_ps(partial[s][0], _mm_mul_ps(x, w0));
+                            partial[s][1] = _mm_add_ps(partial[s][1], _mm_mul_ps(x, w1));
+                            partial[s][2] = _mm_add_ps(partial[s][2], _mm_mul_ps(x, w2));
+                            partial[s][3] = _mm_add_ps(partial[s][3], _mm_mul_ps(x, w3));
+                        }
+                    }
+
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        for (size_t r = 0; r < 4; r++)
+                        {
+                            _mm_storeu_ps(sums + s * densePanelWidth + 4 * r, partial[s][r]);
+                        }
+                    }
+                }
+            };
+
+            struct AVX2DenseAccumulator
+            {
+                template<size_t numSamples>
+                CHIANTI_TARGET_AVX2 static void run(const float * panel, const float * input, size_t inputSize, float * sums)
+                {
+                    __m256 partial[numSamples][2];
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        partial[s][0] = _mm256_setzero_ps();
+                        partial[s][1] = _mm256_setzero_ps();
+                    }
+
+                    for (size_t k = 0; k < inputSize; k++)
+                    {
+                        const __m256 w0 = _mm256_loadu_ps(panel + k * densePanelWidth);
+                        const __m256 w1 = _mm256_loadu_ps(panel + k * densePanelWidth + 8);
+                        for (size_t s = 0; s < numSamples; s++)
+                        {
+                            const __m256 x = _mm256_set1_ps(input[s * inputSize + k]);
+                            partial[s][0] = _mm256_fmadd_ps(x, w0, partial[s][0]);
+                            partial[s][1] = _mm256_fmadd_ps(x, w1, partial[s][1]);
+                        }
+                    }
+
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        _mm256_storeu_ps(sums + s * densePanelWidth, partial[s][0]);
+                        _mm256_storeu_ps(sums + s * densePanelWidth + 8, partial[s][1]);
+                    }
+                }
+            };
+
+            struct AVX512DenseAccumulator
+            {
+                template<size_t numSamples>
+                CHIANTI_TARGET_AVX512 static void run(const float * panel, const float * input, size_t inputSize, float * sums)
+                {
+                    __m512 partial[numSamples];
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        partial[s] = _mm512_setzero_ps();
+                    }
+
+                    for (size_t k = 0; k < inputSize; k++)
+                    {
+                        const __m512 w = _mm512_loadu_ps(panel + k * densePanelWidth);
+                        for (size_t s = 0; s < numSamples; s++)
+                        {
+                            partial[s] = _mm512_fmadd_ps(_mm512_set1_ps(input[s * inputSize + k]), w, partial[s]);
+                        }
+                    }
+
+                    for (size_t s = 0; s < numSamples; s++)
+                    {
+                        _mm512_storeu_ps(sums + s * densePanelWidth, partial[s]);
+                    }
+                }
+            };
+#endif
+        }
+
+        /*!
+         * Returns the variants of the matrix-vector kernel of <PackedDensePlan>.
+         */
+        inline const KernelRegistry<Internal::DenseKernel> & packedDenseKernels()
+        {
+            static const KernelRegistry<Internal::DenseKernel> registry = []() {
+                KernelRegistry<Internal::DenseKernel> result("packed-dense", &Internal::accumulatePanel<Internal::PortableDenseAccumulator>);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::accumulatePanel<Internal::SSE42DenseAccumulator>)
+                      .add(CpuTier::AVX2, &Internal::accumulatePanel<Internal::AVX2DenseAccumulator>)
+                      .add(CpuTier::AVX512, &Internal::accumulatePanel<Internal::AVX512DenseAccumulator>);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * A fully connected layer for small batches. The weights are packed once into panels of 16 units, such that
+         * every panel is a contiguous (inputSize x 16) matrix in row-major order. Up to 4 samples are computed by a
+         * matrix-vector kernel that streams every panel once and keeps the partial sums in registers. Larger batches
+         * multiply each panel with all samples, such that the panel stays in the cache. Bias and activation are applied
+         * while the results are written. This targets the memory bound regime of small-batch serving, in which a
+         * general GEMM spends most of its time packing its operands.
+         *
+         * Plans are immutable, hence, a single plan can be run by several threads concurrently.
+         */
+        class PackedDensePlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <PackedDensePlan> class.
+             *
+             * @param config The geometry of the layer
+             * @param weights The (numUnits x inputSize) weight matrix
+             */
+            PackedDensePlan(const DenseConfig & config, const float * weights) :
+                    config(config),
+                    numPanels((config.numUnits + Internal::densePanelWidth - 1) / Internal::densePanelWidth),
+                    panels(numPanels * config.inputSize * Internal::densePanelWidth, 0.0f),
+                    kernel(packedDenseKernels().select())
+            {
+                for (size_t p = 0; p < this->numPanels; p++)
+                {
+                    const size_t units = std::min(Internal::densePanelWidth, config.numUnits - p * Internal::densePanelWidth);
+                    float * panel = this->panels.data() + p * config.inputSize * Internal::densePanelWidth;
+
+                    for (size_t k = 0; k < config.inputSize; k++)
+                    {
+                        for (size_t j = 0; j < units; j++)
+                        {
+                            panel[k * Internal::densePanelWidth + j] = weights[p * Internal::densePanelWidth + j + config.numUnits * k];
+                        }
+                    }
+                }
+            }
+
+            /*!
+             * Runs the layer.
+             *
+             * @param input The input samples
+             * @param bias The bias per unit or nullptr
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, const float * bias, float * output, size_t numSamples) const
+            {
+                const DenseConfig & c = this->config;
+                if (numSamples == 0)
+                {
+                    return;
+                }
+
+                Threading::parallelFor(this->numPanels, [&](size_t begin, size_t end) {
+                    Eigen::MatrixXf sums(Internal::densePanelWidth, numSamples);
+
+                    for (size_t p = begin; p < end; p++)
+                    {
+                        const float * panel = this->panels.data() + p * c.inputSize * Internal::densePanelWidth;
+
+                        if (numSamples <= 4)
+                        {
+                            this->kernel(panel, input, c.inputSize, numSamples, sums.data());
+                        }
+                        else
+                        {
+                            // The panel is the transposed (16 x inputSize) block of the weights
+                            Eigen::Map<const Eigen::MatrixXf> weights(panel, Internal::densePanelWidth, c.inputSize);
+                            Eigen::Map<const Eigen::MatrixXf> samples(input, c.inputSize, numSamples);
+                            sums.noalias() = weights * samples;
+                        }
+
+                        // Apply bias and activation while writing the results
+                        const size_t firstUnit = p * Internal::densePanelWidth;
+                        const size_t units = std::min(Internal::densePanelWidth, c.numUnits - firstUnit);
+
+                        for (size_t n = 0; n < numSamples; n++)
+                        {
+                            float * out = output + n * c.numUnits + firstUnit;
+                            for (size_t j = 0; j < units; j++)
+                            {
+                                out[j] = sums(j, n) + (bias != nullptr ? bias[firstUnit + j] : 0.0f);
+                            }
+                            applyActivation(c.activation, out, units);
+                        }
+                    }
+                });
+            }
+
+        private:
+            DenseConfig config;
+            /*!
+             * The number of panels. The last panel is padded with zeros.
+             */
+            size_t numPanels;
+            /*!
+             * The packed weights.
+             */
+            std::vector<float, Eigen::aligned_allocator<float>> panels;
+            /*!
+             * The matrix-vector kernel for the CPU tier of the process.
+             */
+            Internal::DenseKernel kernel;
+        };
+    }
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "../exception.h"
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Kernel variants for wider instruction sets are compiled with function level target attributes, such that a single
+// binary runs on every x86 machine and picks the best variant at runtime. The kernels that register their variants in a
+// <KernelRegistry> are dispatched: the ReLU epilogue, the fast activation functions, the packed dense kernel and the row
+// kernels of elementwise.h, which run the van Herk/Gil-Werman max pooling, the separable 3D pooling, the pure crop of
+// the augmentation and the 8 bit image conversion. The direct and arg-max pooling, the integral images, bilinear
+// sampling and the kernels built on Eigen's reductions, matrix products or FFTs use the instruction set the library
+// has been compiled for.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHIANTI_X86_DISPATCH 1
+#include <immintrin.h>
+#define CHIANTI_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CHIANTI_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CHIANTI_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The instruction set tiers for which kernels provide variants. The tiers are ordered, every tier includes the
+         * instructions of the lower ones.
+         */
+        enum class CpuTier
+        {
+            Scalar = 0,
+            SSE42 = 1,
+            AVX2 = 2,
+            AVX512 = 3
+        };
+
+        /*!
+         * Returns all tiers in ascending order.
+         */
+        inline const std::vector<CpuTier> & allCpuTiers()
+        {
+            static const std::vector<CpuTier> tiers = { CpuTier::Scalar, CpuTier::SSE42, CpuTier::AVX2, CpuTier::AVX512 };
+            return tiers;
+        }
+
+        /*!
+         * Returns the name of a tier as accepted by <parseCpuTier>.
+         */
+        inline std::string cpuTierName(CpuTier tier)
+        {
+            switch (tier)
+            {
+                case CpuTier::Scalar:
+                    return "scalar";
+                case CpuTier::SSE42:
+                    return "sse4.2";
+                case CpuTier::AVX2:
+                    return "avx2";
+                case CpuTier::AVX512:
+                    return "avx512";
+            }
+            return "unknown";
+        }
+
+        /*!
+         * Parses the name of a tier.
+         *
+         * @param name The name
+         * @return The tier
+         */
+        inline CpuTier parseCpuTier(const std::string & name)
+        {
+            for (CpuTier tier : allCpuTiers())
+            {
+                if (cpuTierName(tier) == name)
+                {
+                    return tier;
+                }
+            }
+            throw Exception::IllegalArgumentException("Unknown CPU tier. Must be scalar, sse4.2, avx2 or avx512.");
+        }
+
+        /*!
+         * Returns the highest tier the CPU supports.
+         */
+        inline CpuTier detectCpuTier()
+        {
+#ifdef CHIANTI_X86_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            {
+                return CpuTier::AVX512;
+            }
+            else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            {
+                return CpuTier::AVX2;
+            }
+            else if (__builtin_cpu_supports("sse4.2"))
+            {
+                return CpuTier::SSE42;
+            }
+#endif
+            return CpuTier::Scalar;
+        }
+
+        /*!
+         * Returns the tier that is used by all registered kernels. It is determined once per process: The detected tier can be
+         * lowered with the environment variable CHIANTI_CPU_TIER (scalar, sse4.2, avx2 or avx512), e.g. to test a
+         * lower tier on a newer machine. Tiers above the detected one are ignored.
+         */
+        inline CpuTier cpuTier()
+        {
+            static const CpuTier tier = []() {
+                const CpuTier detected = detectCpuTier();
+                const char * name = std::getenv("CHIANTI_CPU_TIER");
+                if (name == nullptr || std::string(name).empty())
+                {
+                    return detected;
+                }
+
+                const CpuTier requested = parseCpuTier(name);
+                return requested < detected ? requested : detected;
+            }();
+            return tier;
+        }
+
+        /*!
+         * The variants of a kernel for the individual tiers. A kernel selects its variant once, all registered
+         * kernels of a process use the same tier.
+         */
+        template<typename Function>
+        class KernelRegistry
+        {
+        public:
+            typedef KernelRegistry<Function> Self;
+
+            /*!
+             * Initializes a new instance of the <KernelRegistry> class.
+             *
+             * @param name The name of the kernel
+             * @param scalar The portable variant
+             */
+            KernelRegistry(const std::string & name, Function scalar) :
+                    _name(name)
+            {
+                this->variants.push_back(std::make_pair(CpuTier::Scalar, scalar));
+            }
+
+            /*!
+             * Adds a variant. Variants must be added in ascending order of their tiers.
+             *
+             * @param tier The tier the variant requires
+             * @param variant The variant
+             * @return This registry
+             */
+            Self & add(CpuTier tier, Function variant)
+            {
+                Exception::assertArgument(tier > this->variants.back().first, "Variants must be added in ascending order of their tiers.");
+                this->variants.push_back(std::make_pair(tier, variant));
+                return *this;
+            }
+
+            /*!
+             * Returns the name of the kernel.
+             */
+            const std::string & name() const
+            {
+                return this->_name;
+            }
+
+            /*!
+             * Returns the tiers for which there are variants.
+             */
+            std::vector<CpuTier> tiers() const
+            {
+                std::vector<CpuTier> result;
+                for (const auto & variant : this->variants)
+                {
+                    result.push_back(variant.first);
+                }
+                return result;
+            }
+
+            /*!
+             * Returns the best variant for a tier.
+             *
+             * @param tier The highest tier the variant may require
+             * @return The variant
+             */
+            Function select(CpuTier tier) const
+            {
+                Function result = this->variants.front().second;
+                for (const auto & variant : this->variants)
+                {
+                    if (variant.first <= tier)
+                    {
+                        result = variant.second;
+                    }
+                }
+                return result;
+            }
+
+            /*!
+             * Returns the best variant for the tier of this process.
+             */
+            Function select() const
+            {
+                return this->select(cpuTier());
+            }
+
+        private:
+            /*!
+             * The name of the kernel.
+             */
+            std::string _name;
+            /*!
+             * The variants in ascending order of their tiers.
+             */
+            std::vector<std::pair<CpuTier, Function>> variants;
+        };
+    }
+}
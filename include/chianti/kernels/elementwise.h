@@ -0,0 +1,487 @@
+#pragma once
+
+#include "dispatch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The signature of the kernels that combine two rows elementwise, i.e. out[i] = op(a[i], b[i]). The output may
+         * be one of the operands.
+         */
+        typedef void (* BinaryRowKernel)(const float * a, const float * b, float * out, size_t size);
+
+        /*!
+         * The signature of the kernels that transform a row with out[i] = alpha * in[i] + beta. The output may be the
+         * input.
+         */
+        typedef void (* AffineRowKernel)(const float * in, float alpha, float beta, float * out, size_t size);
+
+        /*!
+         * The signature of the kernels that split a row of interleaved 8 bit pixels into planes of scaled floats, i.e.
+         * planes[c][x] = scale * pixels[x * numChannels + c].
+         */
+        typedef void (* DeinterleaveKernel)(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width);
+
+        namespace Internal
+        {
+            inline void maxRowsScalar(const float * a, const float * b, float * out, size_t size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    out[i] = std::max(a[i], b[i]);
+                }
+            }
+
+            inline void addRowsScalar(const float * a, const float * b, float * out, size_t size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    out[i] = a[i] + b[i];
+                }
+            }
+
+            inline void affineRowScalar(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    out[i] = alpha * in[i] + beta;
+                }
+            }
+
+            inline void reversedAffineRowScalar(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    out[i] = alpha * in[size - 1 - i] + beta;
+                }
+            }
+
+            inline void deinterleaveScalar(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width)
+            {
+                for (size_t c = 0; c < numChannels; c++)
+                {
+                    const uint8_t * in = pixels + c;
+                    float * out = planes[c];
+                    for (size_t x = 0; x < width; x++)
+                    {
+                        out[x] = scale * static_cast<float>(in[x * numChannels]);
+                    }
+                }
+            }
+
+#ifdef CHIANTI_X86_DISPATCH
+            // The second operand of the max instructions is returned for NaNs, hence, a is passed second to match
+            // std::max(a, b)
+
+            CHIANTI_TARGET_SSE42 inline void maxRowsSSE42(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    _mm_storeu_ps(out + i, _mm_max_ps(_mm_loadu_ps(b + i), _mm_loadu_ps(a + i)));
+                }
+                maxRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void maxRowsAVX2(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    _mm256_storeu_ps(out + i, _mm256_max_ps(_mm256_loadu_ps(b + i), _mm256_loadu_ps(a + i)));
+                }
+                maxRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void maxRowsAVX512(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    _mm512_storeu_ps(out + i, _mm512_max_ps(_mm512_loadu_ps(b + i), _mm512_loadu_ps(a + i)));
+                }
+                maxRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_SSE42 inline void addRowsSSE42(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                }
+                addRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void addRowsAVX2(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                }
+                addRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void addRowsAVX512(const float * a, const float * b, float * out, size_t size)
+            {
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+                }
+                addRowsScalar(a + i, b + i, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_SSE42 inline void affineRowSSE42(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m128 a = _mm_set1_ps(alpha);
+                const __m128 b = _mm_set1_ps(beta);
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(in + i)), b));
+                }
+                affineRowScalar(in + i, alpha, beta, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void affineRowAVX2(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m256 a = _mm256_set1_ps(alpha);
+                const __m256 b = _mm256_set1_ps(beta);
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    _mm256_storeu_ps(out + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(in + i), b));
+                }
+                affineRowScalar(in + i, alpha, beta, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void affineRowAVX512(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m512 a = _mm512_set1_ps(alpha);
+                const __m512 b = _mm512_set1_ps(beta);
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    _mm512_storeu_ps(out + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(in + i), b));
+                }
+                affineRowScalar(in + i, alpha, beta, out + i, size - i);
+            }
+
+            // The reversed variants read the input from its end and reverse the lanes of every register. The
+            // remaining values are at the start of the input.
+
+            CHIANTI_TARGET_SSE42 inline void reversedAffineRowSSE42(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m128 a = _mm_set1_ps(alpha);
+                const __m128 b = _mm_set1_ps(beta);
+                size_t i = 0;
+                for (; i + 4 <= size; i += 4)
+                {
+                    const __m128 x = _mm_loadu_ps(in + size - i - 4);
+                    _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 1, 2, 3))), b));
+                }
+                reversedAffineRowScalar(in, alpha, beta, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void reversedAffineRowAVX2(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m256 a = _mm256_set1_ps(alpha);
+                const __m256 b = _mm256_set1_ps(beta);
+                const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    const __m256 x = _mm256_permutevar8x32_ps(_mm256_loadu_ps(in + size - i - 8), reverse);
+                    _mm256_storeu_ps(out + i, _mm256_fmadd_ps(a, x, b));
+                }
+                reversedAffineRowScalar(in, alpha, beta, out + i, size - i);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void reversedAffineRowAVX512(const float * in, float alpha, float beta, float * out, size_t size)
+            {
+                const __m512 a = _mm512_set1_ps(alpha);
+                const __m512 b = _mm512_set1_ps(beta);
+                const __m512i reverse = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+                size_t i = 0;
+                for (; i + 16 <= size; i += 16)
+                {
+                    const __m512 x = _mm512_permutexvar_ps(reverse, _mm512_loadu_ps(in + size - i - 16));
+                    _mm512_storeu_ps(out + i, _mm512_fmadd_ps(a, x, b));
+                }
+                reversedAffineRowScalar(in, alpha, beta, out + i, size - i);
+            }
+
+            /*!
+             * The byte shuffles that gather one channel of 16 RGB pixels from the three registers that hold them.
+             * Entry [c][r] picks the bytes of channel c that are stored in register r, all other bytes become zero.
+             */
+            struct DeinterleaveMasks
+            {
+                alignas(16) int8_t masks[3][3][16];
+
+                DeinterleaveMasks()
+                {
+                    for (int c = 0; c < 3; c++)
+                    {
+                        for (int r = 0; r < 3; r++)
+                        {
+                            for (int j = 0; j < 16; j++)
+                            {
+                                const int position = 3 * j + c;
+                                masks[c][r][j] = static_cast<int8_t>(position / 16 == r ? position % 16 : -128);
+                            }
+                        }
+                    }
+                }
+            };
+
+            inline const DeinterleaveMasks & deinterleaveMasks()
+            {
+                static const DeinterleaveMasks masks;
+                return masks;
+            }
+
+            /*!
+             * Splits 16 RGB pixels into one register per channel.
+             */
+            CHIANTI_TARGET_SSE42 inline void deinterleave3(const uint8_t * pixels, const DeinterleaveMasks & m, __m128i * channels)
+            {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 16));
+                const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 32));
+                for (int c = 0; c < 3; c++)
+                {
+                    const __m128i * masks = reinterpret_cast<const __m128i *>(m.masks[c]);
+                    channels[c] = _mm_or_si128(
+                            _mm_or_si128(_mm_shuffle_epi8(v0, _mm_load_si128(masks)), _mm_shuffle_epi8(v1, _mm_load_si128(masks + 1))),
+                            _mm_shuffle_epi8(v2, _mm_load_si128(masks + 2)));
+                }
+            }
+
+            CHIANTI_TARGET_SSE42 inline void storeScaledSSE42(__m128i bytes, __m128 scale, float * out)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    const __m128 values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+                    _mm_storeu_ps(out + 4 * k, _mm_mul_ps(scale, values));
+                    bytes = _mm_srli_si128(bytes, 4);
+                }
+            }
+
+            CHIANTI_TARGET_AVX2 inline void storeScaledAVX2(__m128i bytes, __m256 scale, float * out)
+            {
+                _mm256_storeu_ps(out, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes))));
+                _mm256_storeu_ps(out + 8, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)))));
+            }
+
+            CHIANTI_TARGET_AVX512 inline void storeScaledAVX512(__m128i bytes, __m512 scale, float * out)
+            {
+                _mm512_storeu_ps(out, _mm512_mul_ps(scale, _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes))));
+            }
+
+            /*!
+             * Converts the pixels from the x-th on with the scalar code. Only one and three channels are vectorized,
+             * hence, x is 0 for all other channel counts.
+             */
+            inline void deinterleaveTail(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width, size_t x)
+            {
+                if (x == 0)
+                {
+                    deinterleaveScalar(pixels, numChannels, scale, planes, width);
+                    return;
+                }
+
+                float * rest[3];
+                for (size_t c = 0; c < numChannels; c++)
+                {
+                    rest[c] = planes[c] + x;
+                }
+                deinterleaveScalar(pixels + x * numChannels, numChannels, scale, rest, width - x);
+            }
+
+            // Single channels are converted directly, three channels are split with byte shuffles first. All other
+            // channel counts use the scalar code.
+
+            CHIANTI_TARGET_SSE42 inline void deinterleaveSSE42(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width)
+            {
+                const __m128 s = _mm_set1_ps(scale);
+                size_t x = 0;
+                if (numChannels == 1)
+                {
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        storeScaledSSE42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x)), s, planes[0] + x);
+                    }
+                }
+                else if (numChannels == 3)
+                {
+                    const DeinterleaveMasks & masks = deinterleaveMasks();
+                    __m128i channels[3];
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        deinterleave3(pixels + 3 * x, masks, channels);
+                        for (int c = 0; c < 3; c++)
+                        {
+                            storeScaledSSE42(channels[c], s, planes[c] + x);
+                        }
+                    }
+                }
+
+                deinterleaveTail(pixels, numChannels, scale, planes, width, x);
+            }
+
+            CHIANTI_TARGET_AVX2 inline void deinterleaveAVX2(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width)
+            {
+                const __m256 s = _mm256_set1_ps(scale);
+                size_t x = 0;
+                if (numChannels == 1)
+                {
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        storeScaledAVX2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x)), s, planes[0] + x);
+                    }
+                }
+                else if (numChannels == 3)
+                {
+                    const DeinterleaveMasks & masks = deinterleaveMasks();
+                    __m128i channels[3];
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        deinterleave3(pixels + 3 * x, masks, channels);
+                        for (int c = 0; c < 3; c++)
+                        {
+                            storeScaledAVX2(channels[c], s, planes[c] + x);
+                        }
+                    }
+                }
+
+                deinterleaveTail(pixels, numChannels, scale, planes, width, x);
+            }
+
+            CHIANTI_TARGET_AVX512 inline void deinterleaveAVX512(const uint8_t * pixels, size_t numChannels, float scale, float * const * planes, size_t width)
+            {
+                const __m512 s = _mm512_set1_ps(scale);
+                size_t x = 0;
+                if (numChannels == 1)
+                {
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        storeScaledAVX512(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x)), s, planes[0] + x);
+                    }
+                }
+                else if (numChannels == 3)
+                {
+                    const DeinterleaveMasks & masks = deinterleaveMasks();
+                    __m128i channels[3];
+                    for (; x + 16 <= width; x += 16)
+                    {
+                        deinterleave3(pixels + 3 * x, masks, channels);
+                        for (int c = 0; c < 3; c++)
+                        {
+                            storeScaledAVX512(channels[c], s, planes[c] + x);
+                        }
+                    }
+                }
+
+                deinterleaveTail(pixels, numChannels, scale, planes, width, x);
+            }
+#endif
+        }
+
+        /*!
+         * Returns the variants of the elementwise maximum of two rows. Like std::max(a, b), a is returned for NaNs.
+         */
+        inline const KernelRegistry<BinaryRowKernel> & maxRowsKernels()
+        {
+            static const KernelRegistry<BinaryRowKernel> registry = []() {
+                KernelRegistry<BinaryRowKernel> result("max-rows", &Internal::maxRowsScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::maxRowsSSE42)
+                      .add(CpuTier::AVX2, &Internal::maxRowsAVX2)
+                      .add(CpuTier::AVX512, &Internal::maxRowsAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * Returns the variants of the elementwise sum of two rows.
+         */
+        inline const KernelRegistry<BinaryRowKernel> & addRowsKernels()
+        {
+            static const KernelRegistry<BinaryRowKernel> registry = []() {
+                KernelRegistry<BinaryRowKernel> result("add-rows", &Internal::addRowsScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::addRowsSSE42)
+                      .add(CpuTier::AVX2, &Internal::addRowsAVX2)
+                      .add(CpuTier::AVX512, &Internal::addRowsAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * Returns the variants of the affine transformation of a row. The AVX2 and AVX-512 variants use fused
+         * multiply-adds, hence, their results may differ from the others in the last bit.
+         */
+        inline const KernelRegistry<AffineRowKernel> & affineRowKernels()
+        {
+            static const KernelRegistry<AffineRowKernel> registry = []() {
+                KernelRegistry<AffineRowKernel> result("affine-row", &Internal::affineRowScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::affineRowSSE42)
+                      .add(CpuTier::AVX2, &Internal::affineRowAVX2)
+                      .add(CpuTier::AVX512, &Internal::affineRowAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * Returns the variants of the affine transformation of a mirrored row, i.e. out[i] = alpha * in[size - 1 - i]
+         * + beta. The output must not overlap the input.
+         */
+        inline const KernelRegistry<AffineRowKernel> & reversedAffineRowKernels()
+        {
+            static const KernelRegistry<AffineRowKernel> registry = []() {
+                KernelRegistry<AffineRowKernel> result("reversed-affine-row", &Internal::reversedAffineRowScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::reversedAffineRowSSE42)
+                      .add(CpuTier::AVX2, &Internal::reversedAffineRowAVX2)
+                      .add(CpuTier::AVX512, &Internal::reversedAffineRowAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+
+        /*!
+         * Returns the variants of the conversion of interleaved 8 bit pixels into planes of floats. The variants
+         * vectorize one and three channels.
+         */
+        inline const KernelRegistry<DeinterleaveKernel> & deinterleaveKernels()
+        {
+            static const KernelRegistry<DeinterleaveKernel> registry = []() {
+                KernelRegistry<DeinterleaveKernel> result("deinterleave-u8", &Internal::deinterleaveScalar);
+#ifdef CHIANTI_X86_DISPATCH
+                result.add(CpuTier::SSE42, &Internal::deinterleaveSSE42)
+                      .add(CpuTier::AVX2, &Internal::deinterleaveAVX2)
+                      .add(CpuTier::AVX512, &Internal::deinterleaveAVX512);
+#endif
+                return result;
+            }();
+            return registry;
+        }
+    }
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a lookup table. The table uses the CNTK layout of a (numUnits x numRows) matrix, i.e. every
+         * row of the table is a contiguous vector of numUnits values. Gathered rows and their gradients are stored as
+         * (numUnits x count) matrices.
+         */
+        struct EmbeddingConfig
+        {
+            size_t numRows;
+            size_t numUnits;
+        };
+
+        /*!
+         * Converts indices, which CNTK stores as floats, into row numbers.
+         *
+         * @param config The geometry of the table
+         * @param indices The indices
+         * @param count The number of indices
+         * @return The row numbers
+         */
+        inline std::vector<size_t> embeddingRows(const EmbeddingConfig & config, const float * indices, size_t count)
+        {
+            std::vector<size_t> rows(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                const float index = indices[i];
+                Exception::assertArgument(index >= 0.0f && index < static_cast<float>(config.numRows) && index == std::floor(index), "The indices must be integers in [0, numRows).");
+                rows[i] = static_cast<size_t>(index);
+            }
+            return rows;
+        }
+
+        /*!
+         * Copies rows of a table. This replaces the product of the table with one-hot vectors, which reads the whole
+         * table, by reading count rows.
+         *
+         * @param config The geometry of the table
+         * @param table The table
+         * @param rows The rows to copy
+         * @param output The (numUnits x count) output
+         * @param count The number of rows
+         */
+        inline void gatherRows(const EmbeddingConfig & config, const float * table, const size_t * rows, float * output, size_t count)
+        {
+            Threading::parallelFor(count, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const float * row = table + rows[i] * config.numUnits;
+                    std::copy(row, row + config.numUnits, output + i * config.numUnits);
+                }
+            });
+        }
+
+        /*!
+         * The gradient of a table with respect to a batch of lookups. Only the touched rows are stored, every row
+         * appears once.
+         */
+        struct SparseRowGradient
+        {
+            /*!
+             * The touched rows in ascending order.
+             */
+            std::vector<size_t> rows;
+            /*!
+             * The (numUnits x rows) gradients of the touched rows.
+             */
+            Eigen::MatrixXf values;
+        };
+
+        /*!
+         * Computes the gradient of a table from the gradients of the gathered rows. Rows that have been gathered
+         * several times receive the sum of their gradients.
+         *
+         * @param config The geometry of the table
+         * @param rows The gathered rows
+         * @param gradient The (numUnits x count) gradients of the gathered rows
+         * @param count The number of gathered rows
+         * @param result The gradient of the table
+         */
+        inline void accumulateRowGradients(const EmbeddingConfig & config, const size_t * rows, const float * gradient, size_t count, SparseRowGradient & result)
+        {
+            // Sort the lookups by row such that the lookups of every row are consecutive
+            std::vector<size_t> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rows[a] < rows[b]; });
+
+            std::vector<size_t> starts;
+            result.rows.clear();
+            for (size_t i = 0; i < count; i++)
+            {
+                if (i == 0 || rows[order[i]] != rows[order[i - 1]])
+                {
+                    starts.push_back(i);
+                    result.rows.push_back(rows[order[i]]);
+                }
+            }
+            starts.push_back(count);
+
+            const Eigen::Index units = static_cast<Eigen::Index>(config.numUnits);
+            result.values.resize(units, static_cast<Eigen::Index>(result.rows.size()));
+            Threading::parallelFor(result.rows.size(), [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; r++)
+                {
+                    auto sum = result.values.col(r);
+                    sum = Eigen::Map<const Eigen::VectorXf>(gradient + order[starts[r]] * config.numUnits, units);
+                    for (size_t i = starts[r] + 1; i < starts[r + 1]; i++)
+                    {
+                        sum += Eigen::Map<const Eigen::VectorXf>(gradient + order[i] * config.numUnits, units);
+                    }
+                }
+            });
+        }
+
+        /*!
+         * Writes a sparse gradient into a dense gradient of the whole table. Rows that have not been touched are left
+         * unchanged, hence, the dense gradient must be zero initially.
+         *
+         * @param config The geometry of the table
+         * @param gradient The sparse gradient
+         * @param dense The (numUnits x numRows) dense gradient
+         */
+        inline void scatterRowGradients(const EmbeddingConfig & config, const SparseRowGradient & gradient, float * dense)
+        {
+            Threading::parallelFor(gradient.rows.size(), [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; r++)
+                {
+                    const float * values = gradient.values.data() + r * config.numUnits;
+                    std::copy(values, values + config.numUnits, dense + gradient.rows[r] * config.numUnits);
+                }
+            });
+        }
+
+        /*!
+         * The update rule of a <SparseRowUpdater>.
+         *
+         * SGD: w_r -= learningRate * g_r
+         * AdaGrad: The accumulator holds a single value per row (row-wise AdaGrad), which keeps the state at 4 bytes
+         * per row instead of a copy of the table.
+         *   a_r += mean(g_r^2)
+         *   w_r -= learningRate * g_r / (sqrt(a_r) + epsilon)
+         */
+        enum class SparseUpdateRule
+        {
+            SGD,
+            AdaGrad
+        };
+
+        /*!
+         * Applies sparse gradients to a table in place. Only the touched rows are read and written, hence, the costs
+         * of an update do not depend on the size of the table. This includes the state of AdaGrad: rows that have not
+         * been touched keep their accumulators, whereas a dense optimizer would have to visit every row per update.
+         *
+         * All methods are thread-safe.
+         */
+        class SparseRowUpdater
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <SparseRowUpdater> class.
+             *
+             * @param config The geometry of the table
+             * @param rule The update rule
+             * @param learningRate The learning rate
+             * @param epsilon The regularization of the AdaGrad denominator
+             */
+            SparseRowUpdater(const EmbeddingConfig & config, SparseUpdateRule rule, float learningRate, float epsilon = 1e-8f) :
+                    config(config),
+                    rule(rule),
+                    learningRate(learningRate),
+                    epsilon(epsilon),
+                    accumulators(rule == SparseUpdateRule::AdaGrad ? config.numRows : 0, 0.0f)
+            {
+                Exception::assertArgument(learningRate > 0.0f, "The learning rate must be positive.");
+            }
+
+            /*!
+             * Applies a gradient.
+             *
+             * @param table The (numUnits x numRows) table
+             * @param gradient The gradient of the table
+             */
+            void apply(float * table, const SparseRowGradient & gradient)
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                const Eigen::Index units = static_cast<Eigen::Index>(this->config.numUnits);
+
+                // The rows of a sparse gradient are distinct, hence, the threads never write the same row
+                Threading::parallelFor(gradient.rows.size(), [&](size_t begin, size_t end) {
+                    for (size_t r = begin; r < end; r++)
+                    {
+                        const size_t row = gradient.rows[r];
+                        const auto values = gradient.values.col(r);
+                        Eigen::Map<Eigen::VectorXf> weights(table + row * this->config.numUnits, units);
+
+                        if (this->rule == SparseUpdateRule::SGD)
+                        {
+                            weights -= this->learningRate * values;
+                        }
+                        else
+                        {
+                            this->accumulators[row] += values.squaredNorm() / static_cast<float>(units);
+                            weights -= (this->learningRate / (std::sqrt(this->accumulators[row]) + this->epsilon)) * values;
+                        }
+                    }
+                });
+            }
+
+            /*!
+             * Creates an updater with the same rule and learning rate whose accumulators have not seen any gradient,
+             * e.g. for a copy of the table.
+             */
+            std::shared_ptr<SparseRowUpdater> withFreshState() const
+            {
+                return std::make_shared<SparseRowUpdater>(this->config, this->rule, this->learningRate, this->epsilon);
+            }
+
+            /*!
+             * Returns the geometry of the table.
+             */
+            const EmbeddingConfig & geometry() const
+            {
+                return this->config;
+            }
+
+            /*!
+             * Returns the memory of the optimizer state in bytes.
+             */
+            size_t stateBytes() const
+            {
+                return this->accumulators.size() * sizeof(float);
+            }
+
+        private:
+            EmbeddingConfig config;
+            SparseUpdateRule rule;
+            float learningRate;
+            float epsilon;
+            /*!
+             * The AdaGrad accumulator per row.
+             */
+            std::vector<float> accumulators;
+            /*!
+             * Serializes the updates.
+             */
+            std::mutex mutex;
+        };
+    }
+}
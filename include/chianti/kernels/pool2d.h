@@ -0,0 +1,695 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+#include "conv2d.h"
+#include "elementwise.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a 2D pooling. All buffers use the CNTK layout, i.e. the input of a sample is stored as
+         * (width, height, channels) and the output as (output width, output height, channels), each with the first
+         * dimension varying fastest. Like CNTK, padded pixels do not take part in the pooling, e.g. they are not
+         * counted by average pooling.
+         */
+        struct Pool2DConfig
+        {
+            size_t inputWidth;
+            size_t inputHeight;
+            size_t channels;
+            size_t poolWidth;
+            size_t poolHeight;
+            size_t strideX;
+            size_t strideY;
+            /*!
+             * The padding before the first pixel. It may be negative if CNTK's automatic padding skips input pixels.
+             */
+            int64_t padX;
+            int64_t padY;
+            size_t outputWidth;
+            size_t outputHeight;
+
+            /*!
+             * Returns the number of values per input sample.
+             */
+            size_t inputSize() const
+            {
+                return this->inputWidth * this->inputHeight * this->channels;
+            }
+
+            /*!
+             * Returns the number of values per output sample.
+             */
+            size_t outputSize() const
+            {
+                return this->outputWidth * this->outputHeight * this->channels;
+            }
+
+            /*!
+             * Returns a string that uniquely identifies the geometry.
+             */
+            std::string key() const
+            {
+                std::ostringstream stream;
+                stream << "pool2d"
+                       << " in=" << this->inputWidth << "x" << this->inputHeight << "x" << this->channels
+                       << " pool=" << this->poolWidth << "x" << this->poolHeight
+                       << " stride=" << this->strideX << "x" << this->strideY
+                       << " pad=" << this->padX << "x" << this->padY;
+                return stream.str();
+            }
+        };
+
+        /*!
+         * Computes the geometry of a pooling the same way CNTK does. CNTK shares the geometry of pooling and
+         * convolution, hence, the padding is determined by <makeConv2DConfig>.
+         *
+         * @param inputWidth The width of the input
+         * @param inputHeight The height of the input
+         * @param channels The number of channels
+         * @param poolWidth The width of the pooling window
+         * @param poolHeight The height of the pooling window
+         * @param strideX The horizontal stride
+         * @param strideY The vertical stride
+         * @param autoPadding Whether the window shall be centered (CNTK's automatic padding)
+         * @param lowerPad The explicit padding before the first pixel (ignored for automatic padding)
+         * @param upperPad The explicit padding after the last pixel (ignored for automatic padding)
+         * @return The geometry
+         */
+        inline Pool2DConfig makePool2DConfig(
+                size_t inputWidth,
+                size_t inputHeight,
+                size_t channels,
+                size_t poolWidth,
+                size_t poolHeight,
+                size_t strideX,
+                size_t strideY,
+                bool autoPadding,
+                const std::vector<size_t> & lowerPad = {0, 0},
+                const std::vector<size_t> & upperPad = {0, 0})
+        {
+            const Conv2DConfig geometry = makeConv2DConfig(
+                    inputWidth, inputHeight, channels, channels, poolWidth, poolHeight, strideX, strideY, autoPadding, lowerPad, upperPad);
+
+            Pool2DConfig config;
+            config.inputWidth = inputWidth;
+            config.inputHeight = inputHeight;
+            config.channels = channels;
+            config.poolWidth = poolWidth;
+            config.poolHeight = poolHeight;
+            config.strideX = strideX;
+            config.strideY = strideY;
+            config.padX = geometry.padX;
+            config.padY = geometry.padY;
+            config.outputWidth = geometry.outputWidth;
+            config.outputHeight = geometry.outputHeight;
+            return config;
+        }
+
+        /*!
+         * Computes the geometry of a pooling whose window covers the whole input, i.e. that reduces every channel to a
+         * single value.
+         *
+         * @param inputWidth The width of the input
+         * @param inputHeight The height of the input
+         * @param channels The number of channels
+         * @return The geometry
+         */
+        inline Pool2DConfig makeGlobalPool2DConfig(size_t inputWidth, size_t inputHeight, size_t channels)
+        {
+            return makePool2DConfig(inputWidth, inputHeight, channels, inputWidth, inputHeight, 1, 1, false);
+        }
+
+        namespace Internal
+        {
+            /*!
+             * Clips the window of an output position to the input, i.e. computes [begin, end) = [o * stride - pad,
+             * o * stride - pad + window) intersected with [0, size).
+             */
+            inline void poolWindow(size_t o, size_t stride, int64_t pad, size_t window, size_t size, size_t & begin, size_t & end)
+            {
+                const int64_t first = static_cast<int64_t>(o * stride) - pad;
+                const int64_t last = first + static_cast<int64_t>(window);
+                begin = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(first, 0), static_cast<int64_t>(size)));
+                end = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(last, 0), static_cast<int64_t>(size)));
+            }
+
+            /*!
+             * The value of padded pixels for max pooling. Like CNTK, windows that only cover padding yield it.
+             */
+            const float maxPoolPadding = std::numeric_limits<float>::lowest();
+
+            /*!
+             * Computes a strided running maximum with the van Herk/Gil-Werman algorithm. The sequence is split into
+             * blocks of the window size, for which the prefix and suffix maxima are computed. Every window spans at
+             * most two blocks, hence, its maximum is the maximum of a suffix and a prefix. This takes about three
+             * comparisons per element independent of the window size. The elements of the sequence are vectors of
+             * several lanes, such that a vertical pass processes whole rows at once.
+             *
+             * @param input The sequence of (numOutputs - 1) * stride + window elements
+             * @param lanes The number of values per element
+             * @param window The size of the window
+             * @param stride The stride of the windows
+             * @param numOutputs The number of windows
+             * @param prefix Scratch memory for as many values as the input
+             * @param suffix Scratch memory for as many values as the input
+             * @param output The maximum of every window
+             */
+            inline void runningMax(const float * input, size_t lanes, size_t window, size_t stride, size_t numOutputs, float * prefix, float * suffix, float * output)
+            {
+                // Whole rows go to the dispatched kernel, single values are compared inline
+                static const BinaryRowKernel maxRowsKernel = maxRowsKernels().select();
+                const auto maxRows = [lanes](const float * a, const float * b, float * out) {
+                    if (lanes == 1)
+                    {
+                        *out = std::max(*a, *b);
+                    }
+                    else
+                    {
+                        maxRowsKernel(a, b, out, lanes);
+                    }
+                };
+
+                const size_t length = (numOutputs - 1) * stride + window;
+
+                for (size_t blockBegin = 0; blockBegin < length; blockBegin += window)
+                {
+                    const size_t blockEnd = std::min(blockBegin + window, length);
+
+                    std::copy(input + blockBegin * lanes, input + (blockBegin + 1) * lanes, prefix + blockBegin * lanes);
+                    for (size_t i = blockBegin + 1; i < blockEnd; i++)
+                    {
+                        maxRows(prefix + lanes * (i - 1), input + lanes * i, prefix + lanes * i);
+                    }
+
+                    std::copy(input + (blockEnd - 1) * lanes, input + blockEnd * lanes, suffix + (blockEnd - 1) * lanes);
+                    for (size_t i = blockEnd - 1; i > blockBegin; i--)
+                    {
+                        maxRows(suffix + lanes * i, input + lanes * (i - 1), suffix + lanes * (i - 1));
+                    }
+                }
+
+                for (size_t o = 0; o < numOutputs; o++)
+                {
+                    maxRows(suffix + o * stride * lanes, prefix + (o * stride + window - 1) * lanes, output + lanes * o);
+                }
+            }
+        }
+
+        /*!
+         * A pooling that has been prepared for a fixed geometry. Plans are immutable, hence, a single plan can be run
+         * by several threads concurrently.
+         */
+        class Pool2DPlan
+        {
+        public:
+            virtual ~Pool2DPlan() {}
+
+            /*!
+             * Runs the pooling.
+             *
+             * @param input The input samples
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            virtual void run(const float * input, float * output, size_t numSamples) const = 0;
+
+            /*!
+             * Returns the geometry the plan has been prepared for.
+             */
+            const Pool2DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+        protected:
+            explicit Pool2DPlan(const Pool2DConfig & config) :
+                    config(config)
+            {}
+
+            Pool2DConfig config;
+        };
+
+        /*!
+         * Average pooling with summed-area tables. The table of a channel holds the sums of all rectangles that start
+         * at the origin, such that the sum of every window is given by four lookups. The cost per output is
+         * independent of the window size, which pays off for the large windows of context aggregation modules. The
+         * tables are accumulated in double precision, such that the differences of large sums do not cancel.
+         */
+        class IntegralAveragePool2DPlan : public Pool2DPlan
+        {
+        public:
+            explicit IntegralAveragePool2DPlan(const Pool2DConfig & config) :
+                    Pool2DPlan(config)
+            {}
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                const Pool2DConfig & c = this->config;
+                const size_t tableWidth = c.inputWidth + 1;
+
+                // The clipped windows are the same for all channels
+                std::vector<size_t> xBegin(c.outputWidth), xEnd(c.outputWidth), yBegin(c.outputHeight), yEnd(c.outputHeight);
+                for (size_t x = 0; x < c.outputWidth; x++)
+                {
+                    Internal::poolWindow(x, c.strideX, c.padX, c.poolWidth, c.inputWidth, xBegin[x], xEnd[x]);
+                }
+                for (size_t y = 0; y < c.outputHeight; y++)
+                {
+                    Internal::poolWindow(y, c.strideY, c.padY, c.poolHeight, c.inputHeight, yBegin[y], yEnd[y]);
+                }
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    // The first row and column of the table are zero
+                    std::vector<double> table(tableWidth * (c.inputHeight + 1), 0.0);
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const float * plane = input + task * c.inputWidth * c.inputHeight;
+                        float * out = output + task * c.outputWidth * c.outputHeight;
+
+                        for (size_t y = 0; y < c.inputHeight; y++)
+                        {
+                            const float * row = plane + y * c.inputWidth;
+                            const double * above = table.data() + y * tableWidth;
+                            double * current = table.data() + (y + 1) * tableWidth;
+
+                            double rowSum = 0.0;
+                            for (size_t x = 0; x < c.inputWidth; x++)
+                            {
+                                rowSum += row[x];
+                                current[x + 1] = above[x + 1] + rowSum;
+                            }
+                        }
+
+                        for (size_t y = 0; y < c.outputHeight; y++)
+                        {
+                            const double * top = table.data() + yBegin[y] * tableWidth;
+                            const double * bottom = table.data() + yEnd[y] * tableWidth;
+                            const size_t height = yEnd[y] - yBegin[y];
+
+                            for (size_t x = 0; x < c.outputWidth; x++)
+                            {
+                                // Windows that only cover padding are zero
+                                const size_t count = height * (xEnd[x] - xBegin[x]);
+                                const double sum = bottom[xEnd[x]] - bottom[xBegin[x]] - top[xEnd[x]] + top[xBegin[x]];
+                                out[x + c.outputWidth * y] = count > 0 ? static_cast<float>(sum / count) : 0.0f;
+                            }
+                        }
+                    }
+                });
+            }
+        };
+
+        /*!
+         * Max pooling that compares every pixel of every window. It is the fastest algorithm for small or
+         * non-overlapping windows.
+         */
+        class DirectMaxPool2DPlan : public Pool2DPlan
+        {
+        public:
+            explicit DirectMaxPool2DPlan(const Pool2DConfig & config) :
+                    Pool2DPlan(config)
+            {}
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                const Pool2DConfig & c = this->config;
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const float * plane = input + task * c.inputWidth * c.inputHeight;
+                        float * out = output + task * c.outputWidth * c.outputHeight;
+
+                        for (size_t y = 0; y < c.outputHeight; y++)
+                        {
+                            size_t yBegin, yEnd;
+                            Internal::poolWindow(y, c.strideY, c.padY, c.poolHeight, c.inputHeight, yBegin, yEnd);
+
+                            for (size_t x = 0; x < c.outputWidth; x++)
+                            {
+                                size_t xBegin, xEnd;
+                                Internal::poolWindow(x, c.strideX, c.padX, c.poolWidth, c.inputWidth, xBegin, xEnd);
+
+                                float result = Internal::maxPoolPadding;
+                                for (size_t iy = yBegin; iy < yEnd; iy++)
+                                {
+                                    const float * row = plane + iy * c.inputWidth;
+                                    for (size_t ix = xBegin; ix < xEnd; ix++)
+                                    {
+                                        result = std::max(result, row[ix]);
+                                    }
+                                }
+                                out[x + c.outputWidth * y] = result;
+                            }
+                        }
+                    }
+                });
+            }
+        };
+
+        /*!
+         * Max pooling with the separable van Herk/Gil-Werman algorithm. A horizontal pass computes the running
+         * maximum of every input row, a vertical pass the running maximum of the resulting rows. Both take about three
+         * comparisons per value independent of the window size. The vertical pass processes whole rows, such that it
+         * is vectorized.
+         */
+        class VanHerkMaxPool2DPlan : public Pool2DPlan
+        {
+        public:
+            explicit VanHerkMaxPool2DPlan(const Pool2DConfig & config) :
+                    Pool2DPlan(config)
+            {}
+
+            /*!
+             * Returns true if the algorithm is expected to be faster than <DirectMaxPool2DPlan>. This is the case for
+             * windows of at least 3x3 pixels that overlap enough to outweigh the passes over all input pixels.
+             */
+            static bool preferred(const Pool2DConfig & config)
+            {
+                const size_t direct = config.outputWidth * config.outputHeight * config.poolWidth * config.poolHeight;
+                const size_t paddedWidth = (config.outputWidth - 1) * config.strideX + config.poolWidth;
+                const size_t paddedHeight = (config.outputHeight - 1) * config.strideY + config.poolHeight;
+                const size_t vanHerk = 3 * (paddedWidth * config.inputHeight + paddedHeight * config.outputWidth);
+                return config.poolWidth * config.poolHeight >= 9 && vanHerk < direct;
+            }
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                const Pool2DConfig & c = this->config;
+                const size_t paddedWidth = (c.outputWidth - 1) * c.strideX + c.poolWidth;
+                const size_t paddedHeight = (c.outputHeight - 1) * c.strideY + c.poolHeight;
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    std::vector<float> row(paddedWidth), rowPrefix(paddedWidth), rowSuffix(paddedWidth);
+                    std::vector<float> rows(paddedHeight * c.outputWidth), prefix(rows.size()), suffix(rows.size());
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const float * plane = input + task * c.inputWidth * c.inputHeight;
+
+                        // Rows that are not covered by the input are padding
+                        std::fill(rows.begin(), rows.end(), Internal::maxPoolPadding);
+
+                        for (size_t py = 0; py < paddedHeight; py++)
+                        {
+                            const int64_t y = static_cast<int64_t>(py) - c.padY;
+                            if (y < 0 || y >= static_cast<int64_t>(c.inputHeight))
+                            {
+                                continue;
+                            }
+
+                            const float * source = plane + y * c.inputWidth;
+                            for (size_t px = 0; px < paddedWidth; px++)
+                            {
+                                const int64_t x = static_cast<int64_t>(px) - c.padX;
+                                row[px] = x >= 0 && x < static_cast<int64_t>(c.inputWidth) ? source[x] : Internal::maxPoolPadding;
+                            }
+
+                            Internal::runningMax(row.data(), 1, c.poolWidth, c.strideX, c.outputWidth, rowPrefix.data(), rowSuffix.data(), rows.data() + py * c.outputWidth);
+                        }
+
+                        Internal::runningMax(rows.data(), c.outputWidth, c.poolHeight, c.strideY, c.outputHeight, prefix.data(), suffix.data(), output + task * c.outputWidth * c.outputHeight);
+                    }
+                });
+            }
+        };
+
+        /*!
+         * The reduction of a global pooling.
+         */
+        enum class GlobalPooling
+        {
+            Average,
+            Max
+        };
+
+        /*!
+         * Parses the name of a global pooling.
+         *
+         * @param name The name (average or max)
+         * @return The reduction
+         */
+        inline GlobalPooling parseGlobalPooling(const std::string & name)
+        {
+            if (name == "average")
+            {
+                return GlobalPooling::Average;
+            }
+            else if (name == "max")
+            {
+                return GlobalPooling::Max;
+            }
+            throw Exception::IllegalArgumentException("Unknown global pooling. Must be average or max.");
+        }
+
+        /*!
+         * Global pooling, i.e. the reduction of every channel to its average or maximum. Each channel is reduced in a
+         * single vectorized pass and the channels are distributed over the threads.
+         */
+        class GlobalPool2DPlan : public Pool2DPlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <GlobalPool2DPlan> class.
+             *
+             * @param config The geometry as computed by <makeGlobalPool2DConfig>
+             * @param pooling The reduction
+             */
+            GlobalPool2DPlan(const Pool2DConfig & config, GlobalPooling pooling) :
+                    Pool2DPlan(config),
+                    pooling(pooling)
+            {
+                Exception::assertArgument(config.outputWidth == 1 && config.outputHeight == 1, "A global pooling must reduce the whole input.");
+            }
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                const size_t planeSize = this->config.inputWidth * this->config.inputHeight;
+
+                Threading::parallelFor(numSamples * this->config.channels, [&](size_t begin, size_t end) {
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        Eigen::Map<const Eigen::ArrayXf> plane(input + task * planeSize, static_cast<Eigen::Index>(planeSize));
+                        output[task] = this->pooling == GlobalPooling::Average ? plane.sum() / planeSize : plane.maxCoeff();
+                    }
+                });
+            }
+
+            /*!
+             * Returns the reduction.
+             */
+            GlobalPooling reduction() const
+            {
+                return this->pooling;
+            }
+
+        private:
+            GlobalPooling pooling;
+        };
+
+        namespace Internal
+        {
+            /*!
+             * Max pooling that also stores the window-local position ky * poolWidth + kx of every maximum. Ties are
+             * resolved in favour of the first position in row-major order.
+             */
+            template<typename Index>
+            void argMaxPool(const Pool2DConfig & c, const float * input, float * output, Index * indices, size_t indexStride, size_t numSamples)
+            {
+                const size_t planeSize = c.outputWidth * c.outputHeight;
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t sample = task / c.channels;
+                        const size_t channel = task % c.channels;
+                        const float * plane = input + task * c.inputWidth * c.inputHeight;
+                        float * out = output + task * planeSize;
+                        Index * positions = indices + sample * indexStride + channel * planeSize;
+
+                        for (size_t y = 0; y < c.outputHeight; y++)
+                        {
+                            size_t yBegin, yEnd;
+                            poolWindow(y, c.strideY, c.padY, c.poolHeight, c.inputHeight, yBegin, yEnd);
+                            const int64_t top = static_cast<int64_t>(y * c.strideY) - c.padY;
+
+                            for (size_t x = 0; x < c.outputWidth; x++)
+                            {
+                                size_t xBegin, xEnd;
+                                poolWindow(x, c.strideX, c.padX, c.poolWidth, c.inputWidth, xBegin, xEnd);
+                                const int64_t left = static_cast<int64_t>(x * c.strideX) - c.padX;
+
+                                // Windows that only cover padding point to their first pixel
+                                float result = maxPoolPadding;
+                                size_t position = 0;
+                                if (xBegin < xEnd && yBegin < yEnd)
+                                {
+                                    position = static_cast<size_t>(static_cast<int64_t>(xBegin) - left) + c.poolWidth * static_cast<size_t>(static_cast<int64_t>(yBegin) - top);
+                                }
+
+                                for (size_t iy = yBegin; iy < yEnd; iy++)
+                                {
+                                    const float * row = plane + iy * c.inputWidth;
+                                    for (size_t ix = xBegin; ix < xEnd; ix++)
+                                    {
+                                        if (row[ix] > result)
+                                        {
+                                            result = row[ix];
+                                            position = static_cast<size_t>(static_cast<int64_t>(ix) - left) + c.poolWidth * static_cast<size_t>(static_cast<int64_t>(iy) - top);
+                                        }
+                                    }
+                                }
+                                out[x + c.outputWidth * y] = result;
+                                positions[x + c.outputWidth * y] = static_cast<Index>(position);
+                            }
+                        }
+                    }
+                });
+            }
+
+            /*!
+             * Scatters every value to the position of its maximum. All other pixels are zero.
+             */
+            template<typename Index>
+            void maxUnpool(const Pool2DConfig & c, const float * input, const Index * indices, size_t indexStride, float * output, size_t numSamples)
+            {
+                const size_t planeSize = c.outputWidth * c.outputHeight;
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const size_t sample = task / c.channels;
+                        const size_t channel = task % c.channels;
+                        const float * values = input + task * planeSize;
+                        const Index * positions = indices + sample * indexStride + channel * planeSize;
+                        float * plane = output + task * c.inputWidth * c.inputHeight;
+
+                        std::fill(plane, plane + c.inputWidth * c.inputHeight, 0.0f);
+
+                        for (size_t y = 0; y < c.outputHeight; y++)
+                        {
+                            for (size_t x = 0; x < c.outputWidth; x++)
+                            {
+                                const size_t position = positions[x + c.outputWidth * y];
+                                const int64_t ix = static_cast<int64_t>(x * c.strideX + position % c.poolWidth) - c.padX;
+                                const int64_t iy = static_cast<int64_t>(y * c.strideY + position / c.poolWidth) - c.padY;
+
+                                // Overlapping windows that share a maximum write the same value
+                                if (ix >= 0 && iy >= 0 && ix < static_cast<int64_t>(c.inputWidth) && iy < static_cast<int64_t>(c.inputHeight))
+                                {
+                                    plane[ix + c.inputWidth * iy] = values[x + c.outputWidth * y];
+                                }
+                            }
+                        }
+                    }
+                });
+            }
+        }
+
+        /*!
+         * Max pooling that stores the positions of the maxima, such that <unpool> can scatter values back to them.
+         * The positions are window-local, hence, they take a single byte for windows of up to 256 pixels and two
+         * bytes for windows of up to 65536 pixels. They are packed into float buffers, such that they can be passed
+         * through a CNTK graph: The positions of a sample take <indexSize> floats.
+         */
+        class ArgMaxPool2DPlan
+        {
+        public:
+            explicit ArgMaxPool2DPlan(const Pool2DConfig & config) :
+                    config(config)
+            {
+                Exception::assertArgument(config.poolWidth * config.poolHeight <= 65536, "Positions are only stored for windows of up to 65536 pixels.");
+            }
+
+            /*!
+             * Returns the number of bytes per position.
+             */
+            size_t bytesPerIndex() const
+            {
+                return this->config.poolWidth * this->config.poolHeight <= 256 ? 1 : 2;
+            }
+
+            /*!
+             * Returns the number of floats that hold the positions of a sample.
+             */
+            size_t indexSize() const
+            {
+                return (this->config.outputSize() * this->bytesPerIndex() + sizeof(float) - 1) / sizeof(float);
+            }
+
+            /*!
+             * Runs the pooling.
+             *
+             * @param input The input samples
+             * @param output The output samples
+             * @param indices The packed positions of the maxima
+             * @param numSamples The number of samples
+             */
+            void run(const float * input, float * output, float * indices, size_t numSamples) const
+            {
+                const size_t stride = this->indexSize() * sizeof(float) / this->bytesPerIndex();
+                if (this->bytesPerIndex() == 1)
+                {
+                    // Character types may alias the floats
+                    Internal::argMaxPool(this->config, input, output, reinterpret_cast<unsigned char *>(indices), stride, numSamples);
+                }
+                else
+                {
+                    // Accessing the floats through a uint16_t pointer would break strict aliasing, hence, the positions
+                    // are copied bytewise
+                    std::vector<uint16_t> positions(stride * numSamples);
+                    Internal::argMaxPool(this->config, input, output, positions.data(), stride, numSamples);
+                    std::memcpy(indices, positions.data(), positions.size() * sizeof(uint16_t));
+                }
+            }
+
+            /*!
+             * Scatters values to the positions of the maxima. This is the inverse of <run> for the maxima.
+             *
+             * @param input The pooled samples
+             * @param indices The packed positions as computed by <run>
+             * @param output The unpooled samples, zero except for the positions of the maxima
+             * @param numSamples The number of samples
+             */
+            void unpool(const float * input, const float * indices, float * output, size_t numSamples) const
+            {
+                const size_t stride = this->indexSize() * sizeof(float) / this->bytesPerIndex();
+                if (this->bytesPerIndex() == 1)
+                {
+                    Internal::maxUnpool(this->config, input, reinterpret_cast<const unsigned char *>(indices), stride, output, numSamples);
+                }
+                else
+                {
+                    std::vector<uint16_t> positions(stride * numSamples);
+                    std::memcpy(positions.data(), indices, positions.size() * sizeof(uint16_t));
+                    Internal::maxUnpool(this->config, input, positions.data(), stride, output, numSamples);
+                }
+            }
+
+            /*!
+             * Returns the geometry of the pooling.
+             */
+            const Pool2DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+        private:
+            Pool2DConfig config;
+        };
+    }
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "../threading.h"
+#include "conv3d.h"
+#include "elementwise.h"
+#include "pool2d.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The geometry of a 3D pooling. All buffers use the CNTK layout, i.e. the input of a sample is stored as
+         * (width, height, depth, channels) and the output as (output width, output height, output depth, channels),
+         * each with the first dimension varying fastest. Like CNTK, padded voxels do not take part in the pooling.
+         */
+        struct Pool3DConfig
+        {
+            size_t inputWidth;
+            size_t inputHeight;
+            size_t inputDepth;
+            size_t channels;
+            size_t poolWidth;
+            size_t poolHeight;
+            size_t poolDepth;
+            size_t strideX;
+            size_t strideY;
+            size_t strideZ;
+            /*!
+             * The padding before the first voxel. It may be negative if CNTK's automatic padding skips input voxels.
+             */
+            int64_t padX;
+            int64_t padY;
+            int64_t padZ;
+            size_t outputWidth;
+            size_t outputHeight;
+            size_t outputDepth;
+
+            /*!
+             * Returns the number of values per input sample.
+             */
+            size_t inputSize() const
+            {
+                return this->inputWidth * this->inputHeight * this->inputDepth * this->channels;
+            }
+
+            /*!
+             * Returns the number of values per output sample.
+             */
+            size_t outputSize() const
+            {
+                return this->outputWidth * this->outputHeight * this->outputDepth * this->channels;
+            }
+        };
+
+        /*!
+         * Computes the geometry of a 3D pooling the same way CNTK does, see <makeConv3DConfig>.
+         *
+         * @param inputWidth The width of the input
+         * @param inputHeight The height of the input
+         * @param inputDepth The depth of the input
+         * @param channels The number of channels
+         * @param poolSize The width, height and depth of the pooling window
+         * @param stride The strides along the width, height and depth
+         * @param autoPadding Whether the window shall be centered (CNTK's automatic padding)
+         * @param lowerPad The explicit padding before the first voxel (ignored for automatic padding)
+         * @param upperPad The explicit padding after the last voxel (ignored for automatic padding)
+         * @return The geometry
+         */
+        inline Pool3DConfig makePool3DConfig(
+                size_t inputWidth,
+                size_t inputHeight,
+                size_t inputDepth,
+                size_t channels,
+                const std::vector<size_t> & poolSize,
+                const std::vector<size_t> & stride,
+                bool autoPadding,
+                const std::vector<size_t> & lowerPad = {0, 0, 0},
+                const std::vector<size_t> & upperPad = {0, 0, 0})
+        {
+            const Conv3DConfig geometry = makeConv3DConfig(
+                    inputWidth, inputHeight, inputDepth, channels, channels, poolSize, stride, autoPadding, lowerPad, upperPad);
+
+            Pool3DConfig config;
+            config.inputWidth = inputWidth;
+            config.inputHeight = inputHeight;
+            config.inputDepth = inputDepth;
+            config.channels = channels;
+            config.poolWidth = poolSize[0];
+            config.poolHeight = poolSize[1];
+            config.poolDepth = poolSize[2];
+            config.strideX = stride[0];
+            config.strideY = stride[1];
+            config.strideZ = stride[2];
+            config.padX = geometry.padX;
+            config.padY = geometry.padY;
+            config.padZ = geometry.padZ;
+            config.outputWidth = geometry.outputWidth;
+            config.outputHeight = geometry.outputHeight;
+            config.outputDepth = geometry.outputDepth;
+            return config;
+        }
+
+        /*!
+         * A pooling that has been prepared for a fixed geometry. Plans are immutable, hence, a single plan can be run
+         * by several threads concurrently.
+         */
+        class Pool3DPlan
+        {
+        public:
+            virtual ~Pool3DPlan() {}
+
+            /*!
+             * Runs the pooling.
+             *
+             * @param input The input samples
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            virtual void run(const float * input, float * output, size_t numSamples) const = 0;
+
+            /*!
+             * Returns the geometry the plan has been prepared for.
+             */
+            const Pool3DConfig & geometry() const
+            {
+                return this->config;
+            }
+
+        protected:
+            explicit Pool3DPlan(const Pool3DConfig & config) :
+                    config(config)
+            {}
+
+            Pool3DConfig config;
+        };
+
+        namespace Internal
+        {
+            /*!
+             * Runs a separable 3D pooling, which is tiled over the output depth. For every output plane, the input
+             * planes of the window are reduced into a single plane, whose rows are reduced next and whose columns are
+             * reduced last. The first two passes process whole planes and rows, such that they are vectorized. The
+             * clipped windows are products of one interval per axis, hence, averages can be taken per axis as well.
+             * The scratch memory is a single input plane plus a reduced plane per thread.
+             *
+             * @param config The geometry of the pooling
+             * @param average Whether the average or the maximum is computed
+             * @param input The input samples
+             * @param output The output samples
+             * @param numSamples The number of samples
+             */
+            inline void separablePool3D(const Pool3DConfig & config, bool average, const float * input, float * output, size_t numSamples)
+            {
+                const Pool3DConfig & c = config;
+                const size_t inputPlaneSize = c.inputWidth * c.inputHeight;
+                const size_t outputPlaneSize = c.outputWidth * c.outputHeight;
+                const float empty = average ? 0.0f : maxPoolPadding;
+
+                // The clipped windows of the columns are the same for all rows
+                std::vector<size_t> xBegin(c.outputWidth), xEnd(c.outputWidth);
+                for (size_t x = 0; x < c.outputWidth; x++)
+                {
+                    poolWindow(x, c.strideX, c.padX, c.poolWidth, c.inputWidth, xBegin[x], xEnd[x]);
+                }
+
+                // The planes and rows are combined by the dispatched kernels
+                static const BinaryRowKernel addRows = addRowsKernels().select();
+                static const BinaryRowKernel maxRows = maxRowsKernels().select();
+                static const AffineRowKernel affineRow = affineRowKernels().select();
+                const BinaryRowKernel combine = average ? addRows : maxRows;
+
+                Threading::parallelFor(numSamples * c.channels, [&](size_t begin, size_t end) {
+                    Eigen::ArrayXf plane(inputPlaneSize);
+                    Eigen::ArrayXf rows(c.inputWidth * c.outputHeight);
+
+                    for (size_t task = begin; task < end; task++)
+                    {
+                        const float * volume = input + task * inputPlaneSize * c.inputDepth;
+                        float * out = output + task * outputPlaneSize * c.outputDepth;
+
+                        for (size_t z = 0; z < c.outputDepth; z++)
+                        {
+                            // Reduce the planes of the window
+                            size_t zBegin, zEnd;
+                            poolWindow(z, c.strideZ, c.padZ, c.poolDepth, c.inputDepth, zBegin, zEnd);
+                            plane.setConstant(empty);
+                            for (size_t iz = zBegin; iz < zEnd; iz++)
+                            {
+                                combine(plane.data(), volume + iz * inputPlaneSize, plane.data(), inputPlaneSize);
+                            }
+                            if (average && zEnd > zBegin)
+                            {
+                                affineRow(plane.data(), 1.0f / static_cast<float>(zEnd - zBegin), 0.0f, plane.data(), inputPlaneSize);
+                            }
+
+                            // Reduce the rows of the window
+                            for (size_t y = 0; y < c.outputHeight; y++)
+                            {
+                                size_t yBegin, yEnd;
+                                poolWindow(y, c.strideY, c.padY, c.poolHeight, c.inputHeight, yBegin, yEnd);
+                                float * row = rows.data() + y * c.inputWidth;
+                                std::fill(row, row + c.inputWidth, empty);
+                                for (size_t iy = yBegin; iy < yEnd; iy++)
+                                {
+                                    combine(row, plane.data() + iy * c.inputWidth, row, c.inputWidth);
+                                }
+                                if (average && yEnd > yBegin)
+                                {
+                                    affineRow(row, 1.0f / static_cast<float>(yEnd - yBegin), 0.0f, row, c.inputWidth);
+                                }
+                            }
+
+                            // Reduce the columns of the window
+                            for (size_t y = 0; y < c.outputHeight; y++)
+                            {
+                                const float * row = rows.data() + y * c.inputWidth;
+                                float * target = out + z * outputPlaneSize + y * c.outputWidth;
+                                for (size_t x = 0; x < c.outputWidth; x++)
+                                {
+                                    float result = empty;
+                                    for (size_t ix = xBegin[x]; ix < xEnd[x]; ix++)
+                                    {
+                                        result = average ? result + row[ix] : std::max(result, row[ix]);
+                                    }
+                                    if (average && xEnd[x] > xBegin[x])
+                                    {
+                                        result /= static_cast<float>(xEnd[x] - xBegin[x]);
+                                    }
+                                    target[x] = result;
+                                }
+                            }
+                        }
+                    }
+                });
+            }
+        }
+
+        /*!
+         * Separable max pooling, see <Internal::separablePool3D>. It takes poolWidth + poolHeight + poolDepth
+         * comparisons per output instead of their product.
+         */
+        class MaxPool3DPlan : public Pool3DPlan
+        {
+        public:
+            explicit MaxPool3DPlan(const Pool3DConfig & config) :
+                    Pool3DPlan(config)
+            {}
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                Internal::separablePool3D(this->config, false, input, output, numSamples);
+            }
+        };
+
+        /*!
+         * Separable average pooling, see <Internal::separablePool3D>.
+         */
+        class AveragePool3DPlan : public Pool3DPlan
+        {
+        public:
+            explicit AveragePool3DPlan(const Pool3DConfig & config) :
+                    Pool3DPlan(config)
+            {}
+
+            void run(const float * input, float * output, size_t numSamples) const override
+            {
+                Internal::separablePool3D(this->config, true, input, output, numSamples);
+            }
+        };
+    }
+}
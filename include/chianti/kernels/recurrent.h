@@ -0,0 +1,216 @@
+#pragma once
+
+#include "../threading.h"
+
+#include <cstddef>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * The recurrent cell.
+         *
+         * LSTM: The gates are stacked in the order input (i), forget (f), cell (g) and output (o).
+         *   c_t = sigmoid(f) * c_{t-1} + sigmoid(i) * tanh(g)
+         *   h_t = sigmoid(o) * tanh(c_t)
+         *
+         * GRU: The gates are stacked in the order update (z), reset (r) and candidate (n). The reset gate is applied
+         * after the recurrent product of the candidate.
+         *   n_t = tanh(W_n x_t + b_n + sigmoid(r) * (H_n h_{t-1}))
+         *   h_t = (1 - sigmoid(z)) * n_t + sigmoid(z) * h_{t-1}
+         */
+        enum class RecurrentCell
+        {
+            LSTM,
+            GRU
+        };
+
+        /*!
+         * The geometry of a recurrent layer. All buffers use the CNTK layout. The input weights are a
+         * (numGates * numUnits x inputSize) matrix, the recurrent weights a (numGates * numUnits x numUnits) matrix and
+         * the bias a vector of numGates * numUnits values, all with the first dimension varying fastest. Sequences are
+         * stored as (inputSize x length) and (numUnits x length) matrices. The initial states are zero.
+         */
+        struct RecurrentConfig
+        {
+            size_t inputSize;
+            size_t numUnits;
+            RecurrentCell cell;
+
+            /*!
+             * Returns the number of gates per unit.
+             */
+            size_t numGates() const
+            {
+                return this->cell == RecurrentCell::LSTM ? 4 : 3;
+            }
+        };
+
+        namespace Internal
+        {
+            /*!
+             * Computes the logistic sigmoid with the vectorized tanh of Eigen.
+             */
+            template<typename Derived>
+            inline auto gateSigmoid(const Eigen::ArrayBase<Derived> & x) -> decltype(0.5f + 0.5f * (0.5f * x).tanh())
+            {
+                return 0.5f + 0.5f * (0.5f * x).tanh();
+            }
+        }
+
+        /*!
+         * The states of a recurrent layer at the end of the sequences it has processed so far. It allows to process
+         * streams in chunks. The hidden states and (for LSTMs) the cell states are (numUnits x numSequences) matrices.
+         */
+        struct RecurrentState
+        {
+            std::vector<float> hidden;
+            std::vector<float> cells;
+        };
+
+        /*!
+         * A recurrent layer on the CPU. The input projection of all time steps of all sequences is a single matrix
+         * product. Per time step, the recurrent weights of all gates are multiplied with the hidden states of all
+         * sequences at once, after which the gates and the state update are computed in one vectorized pass. The
+         * sequences are split among the threads of the pool, every thread runs the recurrence on its share.
+         *
+         * Plans are immutable, hence, a single plan can be run by several threads concurrently.
+         */
+        class RecurrentPlan
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <RecurrentPlan> class.
+             *
+             * @param config The geometry of the layer
+             * @param inputWeights The (numGates * numUnits x inputSize) input weights
+             * @param recurrentWeights The (numGates * numUnits x numUnits) recurrent weights
+             */
+            RecurrentPlan(const RecurrentConfig & config, const float * inputWeights, const float * recurrentWeights) :
+                    config(config),
+                    inputWeights(Eigen::Map<const Eigen::MatrixXf>(inputWeights, config.numGates() * config.numUnits, config.inputSize)),
+                    recurrentWeights(Eigen::Map<const Eigen::MatrixXf>(recurrentWeights, config.numGates() * config.numUnits, config.numUnits))
+            {}
+
+            /*!
+             * Runs the layer.
+             *
+             * @param input The input sequences
+             * @param bias The bias per gate and unit or nullptr
+             * @param output The hidden states of all time steps
+             * @param length The number of time steps per sequence
+             * @param numSequences The number of sequences
+             * @param state If not nullptr, the sequences continue from these states, which are replaced by the states
+             * after the last time step. States of a different number of sequences are reset to zero.
+             */
+            void run(const float * input, const float * bias, float * output, size_t length, size_t numSequences, RecurrentState * state = nullptr) const
+            {
+                const RecurrentConfig & c = this->config;
+                const Eigen::Index units = static_cast<Eigen::Index>(c.numUnits);
+                const Eigen::Index rows = static_cast<Eigen::Index>(c.numGates() * c.numUnits);
+
+                if (state != nullptr && state->hidden.size() != c.numUnits * numSequences)
+                {
+                    state->hidden.assign(c.numUnits * numSequences, 0.0f);
+                    state->cells.assign(c.numUnits * numSequences, 0.0f);
+                }
+
+                Threading::parallelFor(numSequences, [&](size_t begin, size_t end) {
+                    const Eigen::Index count = static_cast<Eigen::Index>(end - begin);
+                    const Eigen::Index steps = static_cast<Eigen::Index>(length);
+
+                    // The input projections of all time steps (column t + n * length)
+                    Eigen::MatrixXf projections(rows, steps * count);
+                    projections.noalias() = this->inputWeights * Eigen::Map<const Eigen::MatrixXf>(input + begin * length * c.inputSize, c.inputSize, steps * count);
+                    if (bias != nullptr)
+                    {
+                        projections.colwise() += Eigen::Map<const Eigen::VectorXf>(bias, rows);
+                    }
+
+                    Eigen::MatrixXf recurrent = Eigen::MatrixXf::Zero(rows, count);
+                    Eigen::ArrayXXf cells = Eigen::ArrayXXf::Zero(units, count);
+                    float * states = output + begin * length * c.numUnits;
+                    float * initial = state != nullptr ? state->hidden.data() + begin * c.numUnits : nullptr;
+                    if (state != nullptr && c.cell == RecurrentCell::LSTM)
+                    {
+                        cells = Eigen::Map<const Eigen::ArrayXXf>(state->cells.data() + begin * c.numUnits, units, count);
+                    }
+
+                    for (Eigen::Index t = 0; t < steps; t++)
+                    {
+                        // The previous hidden states are strided columns of the output or the initial states
+                        const float * previousStates = t > 0 ? states + (t - 1) * units : initial;
+                        const Eigen::Index stride = t > 0 ? steps * units : units;
+                        if (previousStates != nullptr)
+                        {
+                            Eigen::Map<const Eigen::MatrixXf, 0, Eigen::OuterStride<>> previous(previousStates, units, count, Eigen::OuterStride<>(stride));
+                            recurrent.noalias() = this->recurrentWeights * previous;
+                        }
+
+                        for (Eigen::Index n = 0; n < count; n++)
+                        {
+                            const auto x = projections.col(t + n * steps).array();
+                            const auto h = recurrent.col(n).array();
+                            Eigen::Map<Eigen::ArrayXf> hidden(states + (t + n * steps) * units, units);
+
+                            if (c.cell == RecurrentCell::LSTM)
+                            {
+                                cells.col(n) = Internal::gateSigmoid(x.segment(units, units) + h.segment(units, units)) * cells.col(n)
+                                        + Internal::gateSigmoid(x.head(units) + h.head(units)) * (x.segment(2 * units, units) + h.segment(2 * units, units)).tanh();
+                                hidden = Internal::gateSigmoid(x.tail(units) + h.tail(units)) * cells.col(n).tanh();
+                            }
+                            else
+                            {
+                                const Eigen::ArrayXf update = Internal::gateSigmoid(x.head(units) + h.head(units));
+                                const Eigen::ArrayXf candidate = (x.tail(units) + Internal::gateSigmoid(x.segment(units, units) + h.segment(units, units)) * h.tail(units)).tanh();
+                                if (previousStates != nullptr)
+                                {
+                                    Eigen::Map<const Eigen::ArrayXf> previous(previousStates + n * stride, units);
+                                    hidden = candidate + update * (previous - candidate);
+                                }
+                                else
+                                {
+                                    hidden = candidate - update * candidate;
+                                }
+                            }
+                        }
+                    }
+
+                    if (state != nullptr && steps > 0)
+                    {
+                        for (Eigen::Index n = 0; n < count; n++)
+                        {
+                            Eigen::Map<Eigen::ArrayXf>(initial + n * units, units) = Eigen::Map<const Eigen::ArrayXf>(states + (steps - 1 + n * steps) * units, units);
+                        }
+                        if (c.cell == RecurrentCell::LSTM)
+                        {
+                            Eigen::Map<Eigen::ArrayXXf>(state->cells.data() + begin * c.numUnits, units, count) = cells;
+                        }
+                    }
+                });
+            }
+
+            /*!
+             * Returns the geometry of the layer.
+             */
+            const RecurrentConfig & geometry() const
+            {
+                return this->config;
+            }
+
+        private:
+            RecurrentConfig config;
+            /*!
+             * The input weights of all gates.
+             */
+            Eigen::MatrixXf inputWeights;
+            /*!
+             * The recurrent weights of all gates.
+             */
+            Eigen::MatrixXf recurrentWeights;
+        };
+    }
+}
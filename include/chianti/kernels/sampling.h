@@ -0,0 +1,144 @@
+#pragma once
+
+#include "../exception.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        /*!
+         * Draws classes from a discrete distribution in constant time with Vose's alias method. The table is built
+         * once in O(n). Every draw consumes a single 64 bit random number: the upper half selects a column with a
+         * multiplication instead of a division and the lower half decides between the column and its alias.
+         */
+        class AliasSampler
+        {
+        public:
+            /*!
+             * Builds the table.
+             *
+             * @param weights The unnormalized, non-negative probabilities of the classes
+             */
+            explicit AliasSampler(const std::vector<double> & weights) :
+                    probabilities(weights.size()),
+                    thresholds(weights.size()),
+                    aliases(weights.size())
+            {
+                Exception::assertArgument(!weights.empty() && weights.size() <= UINT32_MAX, "The sampler requires between 1 and 2^32 - 1 classes.");
+
+                double total = 0;
+                for (double weight : weights)
+                {
+                    Exception::assertArgument(weight >= 0 && std::isfinite(weight), "The class weights must be finite and non-negative.");
+                    total += weight;
+                }
+                Exception::assertArgument(total > 0, "At least one class weight must be positive.");
+
+                // Every column holds the mass 1 after scaling; columns with less mass are topped up by an alias
+                const size_t numClasses = weights.size();
+                std::vector<double> mass(numClasses);
+                std::vector<uint32_t> small;
+                std::vector<uint32_t> large;
+                for (size_t c = 0; c < numClasses; c++)
+                {
+                    this->probabilities[c] = weights[c] / total;
+                    mass[c] = this->probabilities[c] * numClasses;
+                    (mass[c] < 1.0 ? small : large).push_back(static_cast<uint32_t>(c));
+                }
+
+                while (!small.empty() && !large.empty())
+                {
+                    const uint32_t lower = small.back();
+                    const uint32_t upper = large.back();
+                    small.pop_back();
+
+                    this->thresholds[lower] = static_cast<uint32_t>(mass[lower] * 4294967296.0);
+                    this->aliases[lower] = upper;
+
+                    mass[upper] -= 1.0 - mass[lower];
+                    if (mass[upper] < 1.0)
+                    {
+                        large.pop_back();
+                        small.push_back(upper);
+                    }
+                }
+
+                // The remaining columns are full up to rounding errors
+                for (const auto & list : {small, large})
+                {
+                    for (uint32_t c : list)
+                    {
+                        this->thresholds[c] = UINT32_MAX;
+                        this->aliases[c] = c;
+                    }
+                }
+            }
+
+            /*!
+             * Draws a class.
+             *
+             * @param generator A generator of 64 bit random numbers, e.g. std::mt19937_64
+             * @return The class
+             */
+            template<class Generator>
+            size_t operator()(Generator & generator) const
+            {
+                const uint64_t random = generator();
+                const uint64_t column = ((random >> 32) * this->thresholds.size()) >> 32;
+                return static_cast<uint32_t>(random) < this->thresholds[column] ? column : this->aliases[column];
+            }
+
+            /*!
+             * Returns the normalized probability of a class.
+             */
+            double probability(size_t c) const
+            {
+                return this->probabilities[c];
+            }
+
+            /*!
+             * Returns the number of classes.
+             */
+            size_t size() const
+            {
+                return this->probabilities.size();
+            }
+
+        private:
+            /*!
+             * The normalized probabilities.
+             */
+            std::vector<double> probabilities;
+            /*!
+             * The share of every column that belongs to the column's class, scaled to 2^32.
+             */
+            std::vector<uint32_t> thresholds;
+            /*!
+             * The class that owns the rest of every column.
+             */
+            std::vector<uint32_t> aliases;
+        };
+
+        /*!
+         * Returns the log-uniform (Zipfian) weights log((c + 2) / (c + 1)). They approximate the frequencies of words
+         * in a vocabulary that is sorted by decreasing frequency.
+         *
+         * @param numClasses The number of classes
+         * @return The weights
+         */
+        inline std::vector<double> logUniformWeights(size_t numClasses)
+        {
+            std::vector<double> weights(numClasses);
+            for (size_t c = 0; c < numClasses; c++)
+            {
+                weights[c] = std::log1p(1.0 / (c + 1.0));
+            }
+            return weights;
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "../exception.h"
+#include "../threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <Eigen/Core>
+
+namespace Chianti
+{
+    namespace Kernels
+    {
+        namespace Internal
+        {
+            /*!
+             * The number of classes that <topK> compares to its current threshold at once.
+             */
+            const size_t topKBlockSize = 64;
+        }
+
+        /*!
+         * Computes log(sum(exp(x))) without overflow. The maximum is subtracted before the exponentials are summed,
+         * both passes are vectorized.
+         *
+         * @param x The values
+         * @param size The number of values
+         * @return The log-sum-exp
+         */
+        inline float logSumExp(const float * x, size_t size)
+        {
+            Eigen::Map<const Eigen::ArrayXf> values(x, static_cast<Eigen::Index>(size));
+            const float maximum = values.maxCoeff();
+            return maximum + std::log((values - maximum).exp().sum());
+        }
+
+        /*!
+         * Computes the softmax of every sample. The exponentials are written to the output, such that they are only
+         * computed once, and scaled afterwards.
+         *
+         * @param logits The scores of the samples
+         * @param probabilities The probabilities of the samples
+         * @param numClasses The number of classes
+         * @param numSamples The number of samples
+         */
+        inline void softmax(const float * logits, float * probabilities, size_t numClasses, size_t numSamples)
+        {
+            Threading::parallelFor(numSamples, [&](size_t begin, size_t end) {
+                for (size_t n = begin; n < end; n++)
+                {
+                    Eigen::Map<const Eigen::ArrayXf> x(logits + n * numClasses, static_cast<Eigen::Index>(numClasses));
+                    Eigen::Map<Eigen::ArrayXf> y(probabilities + n * numClasses, static_cast<Eigen::Index>(numClasses));
+
+                    y = (x - x.maxCoeff()).exp();
+                    y *= 1.0f / y.sum();
+                }
+            });
+        }
+
+        /*!
+         * Computes the cross entropy between the labels and the softmax of the scores of every sample, i.e.
+         * -sum(labels * log(softmax(logits))) = sum(labels * (logSumExp(logits) - logits)). The probabilities are
+         * never materialized. The labels may be one-hot vectors or arbitrary distributions.
+         *
+         * @param logits The scores of the samples
+         * @param labels The labels of the samples
+         * @param loss The loss per sample
+         * @param numClasses The number of classes
+         * @param numSamples The number of samples
+         */
+        inline void softmaxCrossEntropy(const float * logits, const float * labels, float * loss, size_t numClasses, size_t numSamples)
+        {
+            Threading::parallelFor(numSamples, [&](size_t begin, size_t end) {
+                for (size_t n = begin; n < end; n++)
+                {
+                    Eigen::Map<const Eigen::ArrayXf> x(logits + n * numClasses, static_cast<Eigen::Index>(numClasses));
+                    Eigen::Map<const Eigen::ArrayXf> t(labels + n * numClasses, static_cast<Eigen::Index>(numClasses));
+
+                    loss[n] = (t * (logSumExp(x.data(), numClasses) - x)).sum();
+                }
+            });
+        }
+
+        /*!
+         * Determines the classes with the highest scores of every sample. The softmax is monotonic, hence, it is not
+         * computed. A single pass keeps the best k classes in a heap. Ties are resolved in favour of the lower class.
+         *
+         * @param logits The scores of the samples
+         * @param classes The k best classes per sample in descending order of their scores
+         * @param numClasses The number of classes
+         * @param k The number of classes per sample
+         * @param numSamples The number of samples
+         */
+        inline void topK(const float * logits, size_t * classes, size_t numClasses, size_t k, size_t numSamples)
+        {
+            Exception::assertArgument(k > 0 && k <= numClasses, "k must be between 1 and the number of classes.");
+
+            // The heap keeps the worst of the best classes on top
+            auto better = [](const std::pair<float, size_t> & a, const std::pair<float, size_t> & b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            };
+
+            Threading::parallelFor(numSamples, [&](size_t begin, size_t end) {
+                std::vector<std::pair<float, size_t>> heap;
+                heap.reserve(k);
+
+                for (size_t n = begin; n < end; n++)
+                {
+                    const float * x = logits + n * numClasses;
+                    size_t * best = classes + n * k;
+
+                    if (k == 1)
+                    {
+                        // A vectorized maximum and a search are faster than tracking the index
+                        const float maximum = Eigen::Map<const Eigen::ArrayXf>(x, static_cast<Eigen::Index>(numClasses)).maxCoeff();
+                        best[0] = static_cast<size_t>(std::find(x, x + numClasses, maximum) - x);
+                        continue;
+                    }
+
+                    heap.clear();
+                    for (size_t c = 0; c < k; c++)
+                    {
+                        heap.push_back(std::make_pair(x[c], c));
+                    }
+                    std::make_heap(heap.begin(), heap.end(), better);
+
+                    // Most blocks are rejected by their vectorized maximum
+                    for (size_t first = k; first < numClasses; first += Internal::topKBlockSize)
+                    {
+                        const size_t last = std::min(first + Internal::topKBlockSize, numClasses);
+                        if (Eigen::Map<const Eigen::ArrayXf>(x + first, static_cast<Eigen::Index>(last - first)).maxCoeff() <= heap.front().first)
+                        {
+                            continue;
+                        }
+
+                        for (size_t c = first; c < last; c++)
+                        {
+                            if (x[c] > heap.front().first)
+                            {
+                                std::pop_heap(heap.begin(), heap.end(), better);
+                                heap.back() = std::make_pair(x[c], c);
+                                std::push_heap(heap.begin(), heap.end(), better);
+                            }
+                        }
+                    }
+
+                    std::sort_heap(heap.begin(), heap.end(), better);
+                    for (size_t i = 0; i < k; i++)
+                    {
+                        best[i] = heap[i].second;
+                    }
+                }
+            });
+        }
+    }
+}
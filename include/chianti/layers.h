@@ -4,23 +4,13 @@
 #include "values.h"
 #include "nonlinearities.h"
 #include "exception.h"
+#include "functions.h"
 
 #include <unsupported/Eigen/CXX11/Tensor>
 #include <array>
 #include <string>
 #include <functional>
 
-#define MAKE_SETTER(functionName, parameterName) \
-Self & functionName(const decltype(parameterName) & parameterName) {\
-    this->parameterName = parameterName; \
-    return *this; \
-}
-
-#define MAKE_GETTER(functionName, parameterName) \
-decltype(parameterName) functionName() const {\
-    return this->parameterName; \
-}
-
 namespace Chianti
 {
     namespace Layers
@@ -138,6 +128,17 @@ namespace Chianti
          */
         class AbstractSingleInputLayer : public AbstractLayer
         {
+        public:
+            /*!
+             * Returns the CNTK variable that represents the layer input.
+             *
+             * @return The input variable.
+             */
+            const CNTK::Variable & inputVariable() const
+            {
+                return this->input;
+            }
+
         protected:
             /*!
              * Initializes a new instance of the <AbstractSingleInputLayer> class.
@@ -192,6 +193,17 @@ namespace Chianti
              * Non-linearity
              */
             std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            /*!
+             * The convolution algorithm. "cntk" uses CNTK's convolution, "auto" selects the fastest CPU kernel by
+             * autotuning and any other value selects a CPU kernel by name (direct, im2col, winograd, gemm1x1, fft). The CPU
+             * kernels fuse the bias and (if possible) the non-linearity and only support inference.
+             */
+            std::string _algorithm;
+            /*!
+             * The global pooling of the output: "none", "average" or "max". The CPU kernels pool every sample right
+             * after its convolution if the non-linearity can be fused as well.
+             */
+            std::string _globalPooling;
 
         public:
             /*!
@@ -208,7 +220,9 @@ namespace Chianti
                     _stride{1, 1},
                     _W(CNTK::HeNormalInitializer()),
                     _b(CNTK::ConstantInitializer(0)),
-                    _nonLinearity(Chianti::Nonlinearities::rectify)
+                    _nonLinearity(Chianti::Nonlinearities::rectify),
+                    _algorithm("cntk"),
+                    _globalPooling("none")
             {}
 
             // Define the getters and setters for the individual class members
@@ -234,6 +248,12 @@ namespace Chianti
             MAKE_GETTER(nonLinearity, _nonLinearity)
             MAKE_SETTER(nonLinearity, _nonLinearity)
 
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(globalPooling, _globalPooling)
+            MAKE_SETTER(globalPooling, _globalPooling)
+
             /*!
              * Converts the Chianti layer into a CNTK node.
              *
@@ -241,6 +261,9 @@ namespace Chianti
              */
             CNTK::FunctionPtr build() const
             {
+                const bool globalPooling = this->_globalPooling != "none";
+                const auto pooling = globalPooling ? Kernels::parseGlobalPooling(this->_globalPooling) : Kernels::GlobalPooling::Average;
+
                 // Determine the correct amount of padding
                 CNTK::NDShape lowerPad = {0};
                 CNTK::NDShape upperPad = {0};
@@ -289,22 +312,12 @@ namespace Chianti
 
                 size_t numInputChannels = this->input.Shape()[this->input.Shape().Rank() - 1];
 
-                // Set up the convolution
-                // ----------------------
-                // Determine the shape of the convolution
+                // Set up the parameters
+                // ---------------------
                 CNTK::NDShape filterShape = { this->_filterSize[0], this->_filterSize[1], numInputChannels, this->_numFilters };
                 auto convParams = resolveParameter<4>(this->_W, filterShape, this->device);
-                CNTK::FunctionPtr network = Convolution(
-                        convParams,
-                        this->input,
-                        { this->_stride[0], this->_stride[1], numInputChannels },
-                        { true },
-                        autoPadding,
-                        lowerPad,
-                        upperPad);
 
-                // Set up the bias term
-                // --------------------
+                std::vector<CNTK::Variable> biasParams;
                 if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
                 {
                     // Add a bias term
@@ -315,8 +328,7 @@ namespace Chianti
                     {
                         // The user didn't define anything
                         // Create a 0 initialized parameter
-                        auto biasParams = CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device);
-                        network = CNTK::Plus(network, biasParams);
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
                     }
                     else
                     {
@@ -328,66 +340,176 @@ namespace Chianti
                         }
 
                         // The user specified the bias
-                        auto biasParms = resolveParameter<3>(this->_b, biasShape, this->device);
-                        network = CNTK::Plus(network, biasParms);
+                        biasParams.push_back(resolveParameter<3>(this->_b, biasShape, this->device));
+                    }
+                }
+
+                CNTK::FunctionPtr network;
+                Kernels::Activation activation = Kernels::Activation::Identity;
+                bool fused = false;
+
+                if (this->_algorithm == "cntk")
+                {
+                    // Set up the convolution
+                    // ----------------------
+                    network = Convolution(
+                            convParams,
+                            this->input,
+                            { this->_stride[0], this->_stride[1], numInputChannels },
+                            { true },
+                            autoPadding,
+                            lowerPad,
+                            upperPad);
+
+                    // Set up the bias term
+                    // --------------------
+                    for (const auto & biasParam : biasParams)
+                    {
+                        network = CNTK::Plus(network, biasParam);
+                    }
+                }
+                else
+                {
+                    // Run the convolution and the bias on the CPU kernels
+                    // ---------------------------------------------------
+                    Exception::assertArgument(this->input.Shape().Rank() == 3, "The CPU convolution kernels require an input of shape (width, height, channels).");
+
+                    // Fuse the non-linearity into the kernel if possible
+                    fused = Functions::fusedActivation(this->_nonLinearity, activation);
+
+                    // The geometry follows the operand, such that clones for other input sizes get their own kernels
+                    const size_t numFilters = this->_numFilters;
+                    const auto filterSize = this->_filterSize;
+                    const auto stride = this->_stride;
+                    const std::string algorithmName = this->_algorithm;
+                    const std::vector<size_t> lower = { lowerPad[0], autoPadding[0] ? 0 : lowerPad[1] };
+                    const std::vector<size_t> upper = { upperPad[0], autoPadding[0] ? 0 : upperPad[1] };
+                    const bool centered = autoPadding[0];
+
+                    Functions::Internal::KernelFactory<Functions::Conv2DExecutor> factory = [=](const CNTK::NDShape & shape) {
+                        auto config = Kernels::makeConv2DConfig(
+                                shape[0], shape[1], numInputChannels, numFilters, filterSize[0], filterSize[1], stride[0], stride[1], centered, lower, upper);
+                        config.activation = activation;
+
+                        // Pointwise convolutions are always fastest as a single matrix product, so there is no need to tune them
+                        std::string algorithm = algorithmName;
+                        if (algorithm == "auto" && Kernels::Gemm1x1Conv2DPlan::supports(config))
+                        {
+                            algorithm = "gemm1x1";
+                        }
+                        return std::make_shared<Functions::Conv2DExecutor>(config, algorithm);
+                    };
+
+                    // The pooling can only be fused if the non-linearity is fused as well
+                    std::shared_ptr<Kernels::GlobalPool2DPlan> poolingPlan;
+                    if (globalPooling && fused)
+                    {
+                        const auto config = Kernels::makeConv2DConfig(
+                                this->input.Shape()[0], this->input.Shape()[1], numInputChannels, numFilters, filterSize[0], filterSize[1], stride[0], stride[1], centered, lower, upper);
+                        const auto poolingConfig = Kernels::makeGlobalPool2DConfig(config.outputWidth, config.outputHeight, config.numFilters);
+                        poolingPlan = std::make_shared<Kernels::GlobalPool2DPlan>(poolingConfig, pooling);
+                    }
+
+                    std::vector<CNTK::Variable> inputs = { this->input, convParams };
+                    inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                    network = Functions::Conv2DFunction::create(inputs, factory, poolingPlan);
+
+                    if (poolingPlan)
+                    {
+                        return network;
                     }
                 }
 
                 // Apply non-linearity
-                network = this->_nonLinearity(network);
+                if (!fused)
+                {
+                    network = this->_nonLinearity(network);
+                }
+
+                if (globalPooling)
+                {
+                    network = Functions::globalPool2D(network, pooling, this->_algorithm == "cntk" ? "cntk" : "reduce");
+                }
 
                 return network;
             }
         };
 
         /**
-         * Abstract pooling layer. Can do max pooling and average pooling.
+         * This layer adds a 1D convolution over the first axis of a (length, channels) input followed by a bias-term
+         * (optional) and a non-linearity (optional), e.g. for raw audio or static sequences of feature vectors.
          */
-        class AbstractPool2DLayer : public AbstractSingleInputLayer
+        class Conv1DLayer : public AbstractSingleInputLayer
         {
-        protected:
-            typedef AbstractPool2DLayer Self;
+        public:
+            typedef Conv1DLayer Self;
 
             /*!
-             * The size of the pooling region.
+             * The number of filter kernels.
              */
-            Values::ArrayValue<uint64_t, 2> _poolSize;
+            uint64_t _numFilters;
             /*!
-             * The amount of padding on each side
+             * The number of taps per filter.
              */
-            Values::CompositeValue<Values::ArrayValue<uint64_t, 2>, std::string, bool> _pad;
+            uint64_t _filterSize;
             /*!
-             * The pooling stride.
+             * The amount of padding on each side or "same", "valid" and "full".
              */
-            Values::ArrayValue<uint64_t, 2> _stride;
-
-        private:
-            /**
-             * The pooling type.
+            Values::CompositeValue<uint64_t, std::string> _pad;
+            /*!
+             * The filter stride.
              */
-            const CNTK::PoolingType poolingType;
+            uint64_t _stride;
+            /*!
+             * The distance between the taps of a filter.
+             */
+            uint64_t _dilation;
+            /*!
+             * Filter kernel of shape (filterSize, channels, numFilters).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 3>, CNTK::ParameterInitializer> _W;
+            /*!
+             * Bias parameter
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer, bool> _b;
+            /*!
+             * Non-linearity
+             */
+            std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            /*!
+             * The convolution algorithm. "cntk" uses CNTK's convolution (with a zero-filled filter for dilations).
+             * "direct" and "auto" use a CPU kernel that runs one matrix product per tap over blocks of the input. It
+             * fuses the bias and (if possible) the non-linearity and only supports inference.
+             */
+            std::string _algorithm;
 
-        protected:
+        public:
             /*!
-             * Initializes a new instance of the <Conv2DLayer> class.
+             * Initializes a new instance of the <Conv1DLayer> class.
              *
              * @param input The layer's input variables.
              * @param device The device where the parameters of the layer shall be stored.
              */
-            explicit AbstractPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device, const CNTK::PoolingType poolingType) :
-            AbstractSingleInputLayer(input, device),
-            _poolSize{2, 2},
-            _pad("auto"),
-            _stride{2, 2},
-            poolingType(poolingType)
+            explicit Conv1DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractSingleInputLayer(input, device),
+                    _numFilters(1),
+                    _filterSize(3),
+                    _pad("same"),
+                    _stride(1),
+                    _dilation(1),
+                    _W(CNTK::HeNormalInitializer()),
+                    _b(CNTK::ConstantInitializer(0)),
+                    _nonLinearity(Chianti::Nonlinearities::rectify),
+                    _algorithm("cntk")
             {}
 
-        public:
-
             // Define the getters and setters for the individual class members
 
-            MAKE_GETTER(poolSize, _poolSize)
-            MAKE_SETTER(poolSize, _poolSize)
+            MAKE_GETTER(numFilters, _numFilters)
+            MAKE_SETTER(numFilters, _numFilters)
+
+            MAKE_GETTER(filterSize, _filterSize)
+            MAKE_SETTER(filterSize, _filterSize)
 
             MAKE_GETTER(pad, _pad)
             MAKE_SETTER(pad, _pad)
@@ -395,6 +517,21 @@ namespace Chianti
             MAKE_GETTER(stride, _stride)
             MAKE_SETTER(stride, _stride)
 
+            MAKE_GETTER(dilation, _dilation)
+            MAKE_SETTER(dilation, _dilation)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(b, _b)
+            MAKE_SETTER(b, _b)
+
+            MAKE_GETTER(nonLinearity, _nonLinearity)
+            MAKE_SETTER(nonLinearity, _nonLinearity)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
             /*!
              * Converts the Chianti layer into a CNTK node.
              *
@@ -402,229 +539,1818 @@ namespace Chianti
              */
             CNTK::FunctionPtr build() const
             {
+                Exception::assertArgument(this->input.Shape().Rank() == 2, "A 1D convolution requires an input of shape (length, channels).");
+                Exception::assertArgument(this->_filterSize > 0 && this->_dilation > 0, "The filter size and the dilation must be positive.");
+
+                const size_t dilatedSize = (this->_filterSize - 1) * this->_dilation + 1;
+
                 // Determine the correct amount of padding
-                CNTK::NDShape lowerPad = {0};
-                CNTK::NDShape upperPad = {0};
-                std::vector<bool> autoPadding = {true};
+                bool autoPadding = true;
+                size_t lowerPad = 0;
+                size_t upperPad = 0;
 
-                if (Values::isActive<0>(_pad))
+                if (Values::isActive<0>(this->_pad))
                 {
                     // The padding has been manually specified
-                    const auto & padding = Values::get<0>(_pad);
-
-                    autoPadding = {false, false, false};
-                    lowerPad = {padding[0], padding[1], 0};
-                    upperPad = {padding[0], padding[1], 0};
+                    autoPadding = false;
+                    lowerPad = Values::get<0>(this->_pad);
+                    upperPad = Values::get<0>(this->_pad);
                 }
-                else if (Values::isActive<1>(_pad))
+                else
                 {
-                    // Padding is given as string
-                    const auto & padding = Values::get<1>(_pad);
+                    const auto & padding = Values::get<1>(this->_pad);
 
-                    if (padding == "auto")
+                    if (padding == "full")
                     {
-                        // Nothing to do here
+                        // Pad the filter size on both sides like <Conv2DLayer>
+                        autoPadding = false;
+                        lowerPad = dilatedSize;
+                        upperPad = dilatedSize;
                     }
-                    else if (padding == "none")
+                    else if (padding == "valid")
                     {
-                        // Use no padding
-                        autoPadding = {false, false, false};
-                        lowerPad = {0, 0, 0};
-                        upperPad = {0, 0, 0};
+                        // Only compute activations where the input and the filter fully overlap
+                        autoPadding = false;
                     }
-                    else
+                    else if (padding != "same")
                     {
-                        // Unrecognized option
-                        throw Exception::IllegalArgumentException("Invalid string value for pad.");
+                        throw Exception::IllegalArgumentException("Illegal string value for parameter 'pad'.");
                     }
                 }
-                else if (Values::isActive<2>(_pad) && !Values::get<2>(_pad))
+
+                const size_t numInputChannels = this->input.Shape()[1];
+
+                // Set up the parameters
+                // ---------------------
+                auto convParams = resolveParameter<3>(this->_W, { this->_filterSize, numInputChannels, this->_numFilters }, this->device);
+
+                std::vector<CNTK::Variable> biasParams;
+                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
                 {
-                    // The user indicated that no padding shall be performed
-                    autoPadding = {false, false, false};
-                    lowerPad = {0, 0, 0};
-                    upperPad = {0, 0, 0};
+                    CNTK::NDShape biasShape = { 1, this->_numFilters };
+
+                    if (Values::isActive<2>(this->_b))
+                    {
+                        // Create a 0 initialized parameter
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
+                    }
+                    else
+                    {
+                        if (Values::isActive<0>(this->_b))
+                        {
+                            Exception::assertArgument(Values::get<0>(this->_b).dimensions()[0] == 1, "Bias must have shape (1, numFilters).");
+                        }
+
+                        // The user specified the bias
+                        biasParams.push_back(resolveParameter<2>(this->_b, biasShape, this->device));
+                    }
                 }
 
-                CNTK::FunctionPtr network = CNTK::Pooling(
-                        this->input,
-                        this->poolingType,
-                        {_poolSize[0], _poolSize[1]},
-                        {_stride[0], _stride[1]},
-                        autoPadding,
-                        lowerPad,
-                        upperPad);
+                Exception::assertArgument(this->_algorithm == "cntk" || this->_algorithm == "direct" || this->_algorithm == "auto", "Unknown 1D convolution algorithm. Must be cntk, direct or auto.");
 
-                return network;
+                CNTK::FunctionPtr network;
+                bool fused = false;
+
+                if (this->_algorithm == "cntk")
+                {
+                    // Insert dilation - 1 zeros between the taps, such that the dilated filter remains trainable
+                    CNTK::Variable filter = convParams;
+                    if (this->_dilation > 1)
+                    {
+                        auto zeros = CNTK::Constant(CNTK::NDShape({ this->_dilation - 1, numInputChannels, this->_numFilters }), 0.0f, this->device);
+                        std::vector<CNTK::Variable> taps;
+                        for (size_t k = 0; k < this->_filterSize; k++)
+                        {
+                            if (k > 0)
+                            {
+                                taps.push_back(zeros);
+                            }
+                            taps.push_back(CNTK::Slice(convParams, CNTK::Axis(0), static_cast<int>(k), static_cast<int>(k + 1)));
+                        }
+                        filter = CNTK::Splice(taps, CNTK::Axis(0));
+                    }
+
+                    network = Convolution(
+                            filter,
+                            this->input,
+                            { this->_stride, numInputChannels },
+                            { true },
+                            { autoPadding, false },
+                            { lowerPad, 0 },
+                            { upperPad, 0 });
+
+                    for (const auto & biasParam : biasParams)
+                    {
+                        network = CNTK::Plus(network, biasParam);
+                    }
+                }
+                else
+                {
+                    Kernels::Activation activation = Kernels::Activation::Identity;
+                    fused = Functions::fusedActivation(this->_nonLinearity, activation);
+
+                    const size_t numFilters = this->_numFilters;
+                    const size_t filterSize = this->_filterSize;
+                    const size_t stride = this->_stride;
+                    const size_t dilation = this->_dilation;
+                    Functions::Internal::KernelFactory<Functions::Conv1DExecutor> factory = [=](const CNTK::NDShape & shape) {
+                        auto config = Kernels::makeConv1DConfig(shape[0], shape[1], numFilters, filterSize, stride, dilation, autoPadding, lowerPad, upperPad);
+                        config.activation = activation;
+                        return std::make_shared<Functions::Conv1DExecutor>(config);
+                    };
+
+                    std::vector<CNTK::Variable> inputs = { this->input, convParams };
+                    inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                    network = Functions::Conv1DFunction::create(inputs, factory);
+                }
+
+                return fused ? network : this->_nonLinearity(network);
             }
         };
 
         /**
-         * Max pooling layer.
+         * This layer adds a 3D convolution of a (width, height, depth, channels) input followed by a bias-term
+         * (optional) and a non-linearity (optional), e.g. for CT volumes or video clips. Volumetric activations are
+         * large: a 128 x 128 x 64 volume with 32 channels takes 128 MB per sample, see
+         * <Inference::estimateActivationBytes>.
          */
-        class MaxPool2DLayer : public AbstractPool2DLayer
+        class Conv3DLayer : public AbstractSingleInputLayer
         {
         public:
+            typedef Conv3DLayer Self;
+
             /*!
-             * Initializes a new instance of the <Conv2DLayer> class.
-             *
-             * @param input The layer's input variables.
-             * @param device The device where the parameters of the layer shall be stored.
+             * The number of filter kernels.
              */
-            explicit MaxPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool2DLayer(input, device, CNTK::PoolingType::Max) {}
-        };
-
-        /**
-         * Average pooling layer.
-         */
-        class AveragePool2DLayer : public AbstractPool2DLayer
-        {
-        public:
+            uint64_t _numFilters;
             /*!
-             * Initializes a new instance of the <Conv2DLayer> class.
-             *
-             * @param input The layer's input variables.
-             * @param device The device where the parameters of the layer shall be stored.
+             * The width, height and depth of the filters.
              */
-            explicit AveragePool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool2DLayer(input, device, CNTK::PoolingType::Average) {}
-        };
-
-        /**
-         * This layer upscales a tensor with two spatial dimensions. By default, it upscales by repeating the values
-         * along the spatial axes. However, it also support bilinear interpolation, which is more expensive.
-         */
-        class Upscale2DLayer : public AbstractSingleInputLayer {
-        private:
-            typedef Upscale2DLayer Self;
+            Values::ArrayValue<uint64_t, 3> _filterSize;
             /*!
-             * The upscale factor
+             * The amount of padding on each side or "same", "valid" and "full".
              */
-            Values::ArrayValue<uint64_t, 2> _scaleFactor;
+            Values::CompositeValue<Values::ArrayValue<uint64_t, 3>, std::string> _pad;
+            /*!
+             * The filter stride.
+             */
+            Values::ArrayValue<uint64_t, 3> _stride;
+            /*!
+             * Filter kernel of shape (width, height, depth, channels, numFilters).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 5>, CNTK::ParameterInitializer> _W;
+            /*!
+             * Bias parameter
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 4>, CNTK::ParameterInitializer, bool> _b;
+            /*!
+             * Non-linearity
+             */
+            std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            /*!
+             * The convolution algorithm. "cntk" uses CNTK's convolution. "im2col" and "auto" use a CPU kernel that is
+             * tiled over the depth and only unrolls a small block of voxels at a time, see <Kernels::Conv3DPlan>. It
+             * fuses the bias and (if possible) the non-linearity and only supports inference.
+             */
+            std::string _algorithm;
 
         public:
             /*!
-             * Initializes a new instance of the <Conv2DLayer> class.
+             * Initializes a new instance of the <Conv3DLayer> class.
              *
              * @param input The layer's input variables.
              * @param device The device where the parameters of the layer shall be stored.
              */
-            explicit Upscale2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
-            AbstractSingleInputLayer(input, device),
-            _scaleFactor{2, 2}
+            explicit Conv3DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractSingleInputLayer(input, device),
+                    _numFilters(1),
+                    _filterSize{3, 3, 3},
+                    _pad("same"),
+                    _stride{1, 1, 1},
+                    _W(CNTK::HeNormalInitializer()),
+                    _b(CNTK::ConstantInitializer(0)),
+                    _nonLinearity(Chianti::Nonlinearities::rectify),
+                    _algorithm("cntk")
             {}
 
             // Define the getters and setters for the individual class members
 
-            MAKE_GETTER(scaleFactor, _scaleFactor)
-            MAKE_SETTER(scaleFactor, _scaleFactor)
+            MAKE_GETTER(numFilters, _numFilters)
+            MAKE_SETTER(numFilters, _numFilters)
 
-            /*!
-             * Converts the Chianti layer into a CNTK node.
-             *
+            MAKE_GETTER(filterSize, _filterSize)
+            MAKE_SETTER(filterSize, _filterSize)
+
+            MAKE_GETTER(pad, _pad)
+            MAKE_SETTER(pad, _pad)
+
+            MAKE_GETTER(stride, _stride)
+            MAKE_SETTER(stride, _stride)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(b, _b)
+            MAKE_SETTER(b, _b)
+
+            MAKE_GETTER(nonLinearity, _nonLinearity)
+            MAKE_SETTER(nonLinearity, _nonLinearity)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(this->input.Shape().Rank() == 4, "A 3D convolution requires an input of shape (width, height, depth, channels).");
+
+                // Determine the correct amount of padding
+                bool autoPadding = true;
+                std::vector<size_t> lowerPad = {0, 0, 0};
+                std::vector<size_t> upperPad = {0, 0, 0};
+
+                if (Values::isActive<0>(this->_pad))
+                {
+                    // The padding has been manually specified
+                    const auto padding = Values::get<0>(this->_pad);
+
+                    autoPadding = false;
+                    lowerPad = {padding[0], padding[1], padding[2]};
+                    upperPad = {padding[0], padding[1], padding[2]};
+                }
+                else
+                {
+                    const auto & padding = Values::get<1>(this->_pad);
+
+                    if (padding == "full")
+                    {
+                        // Pad the filter size on both sides like <Conv2DLayer>
+                        autoPadding = false;
+                        lowerPad = {this->_filterSize[0], this->_filterSize[1], this->_filterSize[2]};
+                        upperPad = lowerPad;
+                    }
+                    else if (padding == "valid")
+                    {
+                        // Only compute activations where the input and the filter fully overlap
+                        autoPadding = false;
+                    }
+                    else if (padding != "same")
+                    {
+                        throw Exception::IllegalArgumentException("Illegal string value for parameter 'pad'.");
+                    }
+                }
+
+                const size_t numInputChannels = this->input.Shape()[3];
+
+                // Set up the parameters
+                // ---------------------
+                CNTK::NDShape filterShape = { this->_filterSize[0], this->_filterSize[1], this->_filterSize[2], numInputChannels, this->_numFilters };
+                auto convParams = resolveParameter<5>(this->_W, filterShape, this->device);
+
+                std::vector<CNTK::Variable> biasParams;
+                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
+                {
+                    CNTK::NDShape biasShape = { 1, 1, 1, this->_numFilters };
+
+                    if (Values::isActive<2>(this->_b))
+                    {
+                        // Create a 0 initialized parameter
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
+                    }
+                    else
+                    {
+                        if (Values::isActive<0>(this->_b))
+                        {
+                            const auto & dimensions = Values::get<0>(this->_b).dimensions();
+                            Exception::assertArgument(dimensions[0] == 1 && dimensions[1] == 1 && dimensions[2] == 1, "Bias must have shape (1, 1, 1, numFilters).");
+                        }
+
+                        // The user specified the bias
+                        biasParams.push_back(resolveParameter<4>(this->_b, biasShape, this->device));
+                    }
+                }
+
+                Exception::assertArgument(this->_algorithm == "cntk" || this->_algorithm == "im2col" || this->_algorithm == "auto", "Unknown 3D convolution algorithm. Must be cntk, im2col or auto.");
+
+                CNTK::FunctionPtr network;
+                bool fused = false;
+
+                if (this->_algorithm == "cntk")
+                {
+                    network = Convolution(
+                            convParams,
+                            this->input,
+                            { this->_stride[0], this->_stride[1], this->_stride[2], numInputChannels },
+                            { true },
+                            { autoPadding, autoPadding, autoPadding, false },
+                            { lowerPad[0], lowerPad[1], lowerPad[2], 0 },
+                            { upperPad[0], upperPad[1], upperPad[2], 0 });
+
+                    for (const auto & biasParam : biasParams)
+                    {
+                        network = CNTK::Plus(network, biasParam);
+                    }
+                }
+                else
+                {
+                    Kernels::Activation activation = Kernels::Activation::Identity;
+                    fused = Functions::fusedActivation(this->_nonLinearity, activation);
+
+                    const size_t numFilters = this->_numFilters;
+                    const std::vector<size_t> filterSize = { this->_filterSize[0], this->_filterSize[1], this->_filterSize[2] };
+                    const std::vector<size_t> stride = { this->_stride[0], this->_stride[1], this->_stride[2] };
+                    Functions::Internal::KernelFactory<Functions::Conv3DExecutor> factory = [=](const CNTK::NDShape & shape) {
+                        auto config = Kernels::makeConv3DConfig(shape[0], shape[1], shape[2], shape[3], numFilters, filterSize, stride, autoPadding, lowerPad, upperPad);
+                        config.activation = activation;
+                        return std::make_shared<Functions::Conv3DExecutor>(config);
+                    };
+
+                    std::vector<CNTK::Variable> inputs = { this->input, convParams };
+                    inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                    network = Functions::Conv3DFunction::create(inputs, factory);
+                }
+
+                return fused ? network : this->_nonLinearity(network);
+            }
+        };
+
+        /**
+         * Abstract pooling layer. Can do max pooling and average pooling.
+         */
+        class AbstractPool2DLayer : public AbstractSingleInputLayer
+        {
+        protected:
+            typedef AbstractPool2DLayer Self;
+
+            /*!
+             * The size of the pooling region.
+             */
+            Values::ArrayValue<uint64_t, 2> _poolSize;
+            /*!
+             * The amount of padding on each side
+             */
+            Values::CompositeValue<Values::ArrayValue<uint64_t, 2>, std::string, bool> _pad;
+            /*!
+             * The pooling stride.
+             */
+            Values::ArrayValue<uint64_t, 2> _stride;
+            /*!
+             * The pooling algorithm. "cntk" uses CNTK's pooling, any other value selects a CPU kernel by name. Average
+             * pooling supports "integral" (summed-area tables, the cost per output is independent of the window size)
+             * and "auto". Max pooling supports "direct", "vanherk" (separable running maxima, about three comparisons
+             * per output independent of the window size) and "auto", which selects "vanherk" for large overlapping
+             * windows. The CPU kernels only support inference.
+             */
+            std::string _algorithm;
+            /*!
+             * Whether max pooling also returns the positions of the maxima for a <MaxUnpool2DLayer>. The pooled values
+             * are the first output and the positions the second output of the node. The positions are window-local
+             * and take one byte (two bytes for windows of more than 256 pixels) per value. The pooling then always
+             * runs on the CPU kernels.
+             */
+            bool _argMax;
+
+        private:
+            /**
+             * The pooling type.
+             */
+            const CNTK::PoolingType poolingType;
+
+        protected:
+            /*!
+             * Initializes a new instance of the <Conv2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit AbstractPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device, const CNTK::PoolingType poolingType) :
+            AbstractSingleInputLayer(input, device),
+            _poolSize{2, 2},
+            _pad("auto"),
+            _stride{2, 2},
+            _algorithm("cntk"),
+            _argMax(false),
+            poolingType(poolingType)
+            {}
+
+        public:
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(poolSize, _poolSize)
+            MAKE_SETTER(poolSize, _poolSize)
+
+            MAKE_GETTER(pad, _pad)
+            MAKE_SETTER(pad, _pad)
+
+            MAKE_GETTER(stride, _stride)
+            MAKE_SETTER(stride, _stride)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(argMax, _argMax)
+            MAKE_SETTER(argMax, _argMax)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(!this->_argMax || this->poolingType == CNTK::PoolingType::Max, "Only max pooling can return the positions of the maxima.");
+
+                // Determine the correct amount of padding
+                CNTK::NDShape lowerPad = {0};
+                CNTK::NDShape upperPad = {0};
+                std::vector<bool> autoPadding = {true};
+
+                if (Values::isActive<0>(_pad))
+                {
+                    // The padding has been manually specified
+                    const auto & padding = Values::get<0>(_pad);
+
+                    autoPadding = {false, false, false};
+                    lowerPad = {padding[0], padding[1], 0};
+                    upperPad = {padding[0], padding[1], 0};
+                }
+                else if (Values::isActive<1>(_pad))
+                {
+                    // Padding is given as string
+                    const auto & padding = Values::get<1>(_pad);
+
+                    if (padding == "auto")
+                    {
+                        // Nothing to do here
+                    }
+                    else if (padding == "none")
+                    {
+                        // Use no padding
+                        autoPadding = {false, false, false};
+                        lowerPad = {0, 0, 0};
+                        upperPad = {0, 0, 0};
+                    }
+                    else
+                    {
+                        // Unrecognized option
+                        throw Exception::IllegalArgumentException("Invalid string value for pad.");
+                    }
+                }
+                else if (Values::isActive<2>(_pad) && !Values::get<2>(_pad))
+                {
+                    // The user indicated that no padding shall be performed
+                    autoPadding = {false, false, false};
+                    lowerPad = {0, 0, 0};
+                    upperPad = {0, 0, 0};
+                }
+
+                if (this->_algorithm != "cntk" || this->_argMax)
+                {
+                    // Run the pooling on the CPU kernels
+                    // ----------------------------------
+                    Exception::assertArgument(this->input.Shape().Rank() == 3, "The CPU pooling kernels require an input of shape (width, height, channels).");
+
+                    const size_t poolWidth = this->_poolSize[0];
+                    const size_t poolHeight = this->_poolSize[1];
+                    const size_t strideX = this->_stride[0];
+                    const size_t strideY = this->_stride[1];
+                    const bool centered = autoPadding[0];
+                    const std::vector<size_t> lower = { lowerPad[0], centered ? 0 : lowerPad[1] };
+                    const std::vector<size_t> upper = { upperPad[0], centered ? 0 : upperPad[1] };
+                    const auto poolingType = this->poolingType;
+                    const auto algorithm = this->_algorithm;
+
+                    const auto makeConfig = [=](const CNTK::NDShape & shape) {
+                        return Kernels::makePool2DConfig(shape[0], shape[1], shape[2], poolWidth, poolHeight, strideX, strideY, centered, lower, upper);
+                    };
+
+                    if (this->_argMax)
+                    {
+                        return Functions::ArgMaxPool2DFunction::create(this->input, [=](const CNTK::NDShape & shape) {
+                            return std::make_shared<Kernels::ArgMaxPool2DPlan>(makeConfig(shape));
+                        });
+                    }
+                    return Functions::Pool2DFunction::create(this->input, [=](const CNTK::NDShape & shape) {
+                        return createPlan(poolingType, algorithm, makeConfig(shape));
+                    });
+                }
+
+                CNTK::FunctionPtr network = CNTK::Pooling(
+                        this->input,
+                        this->poolingType,
+                        {_poolSize[0], _poolSize[1]},
+                        {_stride[0], _stride[1]},
+                        autoPadding,
+                        lowerPad,
+                        upperPad);
+
+                return network;
+            }
+
+        private:
+            /*!
+             * Creates the CPU kernel for the selected algorithm.
+             *
+             * @param poolingType The type of the pooling
+             * @param algorithm The selected algorithm
+             * @param config The geometry of the pooling
+             * @return The plan
+             */
+            static std::shared_ptr<Kernels::Pool2DPlan> createPlan(CNTK::PoolingType poolingType, const std::string & algorithm, const Kernels::Pool2DConfig & config)
+            {
+                if (poolingType == CNTK::PoolingType::Average)
+                {
+                    Exception::assertArgument(algorithm == "integral" || algorithm == "auto", "Unknown average pooling algorithm. Must be cntk, integral or auto.");
+                    return std::make_shared<Kernels::IntegralAveragePool2DPlan>(config);
+                }
+
+                if (algorithm == "vanherk" || (algorithm == "auto" && Kernels::VanHerkMaxPool2DPlan::preferred(config)))
+                {
+                    return std::make_shared<Kernels::VanHerkMaxPool2DPlan>(config);
+                }
+                Exception::assertArgument(algorithm == "direct" || algorithm == "auto", "Unknown max pooling algorithm. Must be cntk, direct, vanherk or auto.");
+                return std::make_shared<Kernels::DirectMaxPool2DPlan>(config);
+            }
+        };
+
+        /**
+         * Max pooling layer.
+         */
+        class MaxPool2DLayer : public AbstractPool2DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Conv2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit MaxPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool2DLayer(input, device, CNTK::PoolingType::Max) {}
+        };
+
+        /**
+         * Average pooling layer.
+         */
+        class AveragePool2DLayer : public AbstractPool2DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Conv2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit AveragePool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool2DLayer(input, device, CNTK::PoolingType::Average) {}
+        };
+
+        /**
+         * Abstract 3D pooling layer. Can do max pooling and average pooling.
+         */
+        class AbstractPool3DLayer : public AbstractSingleInputLayer
+        {
+        protected:
+            typedef AbstractPool3DLayer Self;
+
+            /*!
+             * The width, height and depth of the pooling region.
+             */
+            Values::ArrayValue<uint64_t, 3> _poolSize;
+            /*!
+             * The amount of padding on each side
+             */
+            Values::CompositeValue<Values::ArrayValue<uint64_t, 3>, std::string, bool> _pad;
+            /*!
+             * The pooling stride.
+             */
+            Values::ArrayValue<uint64_t, 3> _stride;
+            /*!
+             * The pooling algorithm. "cntk" uses CNTK's pooling. "separable" and "auto" use a CPU kernel that reduces
+             * the depth, the height and the width one after another, one output plane at a time, see
+             * <Kernels::MaxPool3DPlan>. The CPU kernel only supports inference.
+             */
+            std::string _algorithm;
+
+        private:
+            /**
+             * The pooling type.
+             */
+            const CNTK::PoolingType poolingType;
+
+        protected:
+            /*!
+             * Initializes a new instance of the <AbstractPool3DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             * @param poolingType The pooling type.
+             */
+            explicit AbstractPool3DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device, const CNTK::PoolingType poolingType) :
+            AbstractSingleInputLayer(input, device),
+            _poolSize{2, 2, 2},
+            _pad("auto"),
+            _stride{2, 2, 2},
+            _algorithm("cntk"),
+            poolingType(poolingType)
+            {}
+
+        public:
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(poolSize, _poolSize)
+            MAKE_SETTER(poolSize, _poolSize)
+
+            MAKE_GETTER(pad, _pad)
+            MAKE_SETTER(pad, _pad)
+
+            MAKE_GETTER(stride, _stride)
+            MAKE_SETTER(stride, _stride)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(this->input.Shape().Rank() == 4, "A 3D pooling requires an input of shape (width, height, depth, channels).");
+
+                // Determine the correct amount of padding
+                bool autoPadding = true;
+                std::vector<size_t> lowerPad = {0, 0, 0};
+                std::vector<size_t> upperPad = {0, 0, 0};
+
+                if (Values::isActive<0>(_pad))
+                {
+                    // The padding has been manually specified
+                    const auto & padding = Values::get<0>(_pad);
+
+                    autoPadding = false;
+                    lowerPad = {padding[0], padding[1], padding[2]};
+                    upperPad = {padding[0], padding[1], padding[2]};
+                }
+                else if (Values::isActive<1>(_pad))
+                {
+                    // Padding is given as string
+                    const auto & padding = Values::get<1>(_pad);
+
+                    if (padding == "none")
+                    {
+                        autoPadding = false;
+                    }
+                    else if (padding != "auto")
+                    {
+                        throw Exception::IllegalArgumentException("Invalid string value for pad.");
+                    }
+                }
+                else if (!Values::get<2>(_pad))
+                {
+                    // The user indicated that no padding shall be performed
+                    autoPadding = false;
+                }
+
+                if (this->_algorithm == "cntk")
+                {
+                    return CNTK::Pooling(
+                            this->input,
+                            this->poolingType,
+                            {_poolSize[0], _poolSize[1], _poolSize[2]},
+                            {_stride[0], _stride[1], _stride[2]},
+                            { autoPadding, autoPadding, autoPadding, false },
+                            { lowerPad[0], lowerPad[1], lowerPad[2], 0 },
+                            { upperPad[0], upperPad[1], upperPad[2], 0 });
+                }
+
+                Exception::assertArgument(this->_algorithm == "separable" || this->_algorithm == "auto", "Unknown 3D pooling algorithm. Must be cntk, separable or auto.");
+
+                const std::vector<size_t> poolSize = { this->_poolSize[0], this->_poolSize[1], this->_poolSize[2] };
+                const std::vector<size_t> stride = { this->_stride[0], this->_stride[1], this->_stride[2] };
+                const bool max = this->poolingType == CNTK::PoolingType::Max;
+
+                return Functions::Pool3DFunction::create(this->input, [=](const CNTK::NDShape & shape) -> std::shared_ptr<Kernels::Pool3DPlan> {
+                    const auto config = Kernels::makePool3DConfig(shape[0], shape[1], shape[2], shape[3], poolSize, stride, autoPadding, lowerPad, upperPad);
+                    if (max)
+                    {
+                        return std::make_shared<Kernels::MaxPool3DPlan>(config);
+                    }
+                    return std::make_shared<Kernels::AveragePool3DPlan>(config);
+                });
+            }
+        };
+
+        /**
+         * 3D max pooling layer.
+         */
+        class MaxPool3DLayer : public AbstractPool3DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <MaxPool3DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit MaxPool3DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool3DLayer(input, device, CNTK::PoolingType::Max) {}
+        };
+
+        /**
+         * 3D average pooling layer.
+         */
+        class AveragePool3DLayer : public AbstractPool3DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <AveragePool3DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit AveragePool3DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractPool3DLayer(input, device, CNTK::PoolingType::Average) {}
+        };
+
+        /**
+         * Abstract global pooling layer. Reduces the spatial axes of every channel to a single value, i.e. the output
+         * has the shape (1, 1, channels).
+         */
+        class AbstractGlobalPool2DLayer : public AbstractSingleInputLayer
+        {
+        protected:
+            typedef AbstractGlobalPool2DLayer Self;
+
+            /*!
+             * The pooling algorithm. "cntk" uses CNTK's reductions, "reduce" and "auto" reduce every channel in a
+             * single vectorized pass on the CPU and only support inference. See <Conv2DLayer::_globalPooling> for
+             * fusing the pooling into a convolution.
+             */
+            std::string _algorithm;
+
+        private:
+            /**
+             * The pooling type.
+             */
+            const Kernels::GlobalPooling pooling;
+
+        protected:
+            /*!
+             * Initializes a new instance of the <AbstractGlobalPool2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             * @param pooling The pooling type.
+             */
+            explicit AbstractGlobalPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device, const Kernels::GlobalPooling pooling) :
+            AbstractSingleInputLayer(input, device),
+            _algorithm("cntk"),
+            pooling(pooling)
+            {}
+
+        public:
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                return Functions::globalPool2D(this->input, this->pooling, this->_algorithm);
+            }
+        };
+
+        /**
+         * Global max pooling layer.
+         */
+        class GlobalMaxPool2DLayer : public AbstractGlobalPool2DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <GlobalMaxPool2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit GlobalMaxPool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractGlobalPool2DLayer(input, device, Kernels::GlobalPooling::Max) {}
+        };
+
+        /**
+         * Global average pooling layer.
+         */
+        class GlobalAveragePool2DLayer : public AbstractGlobalPool2DLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <GlobalAveragePool2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit GlobalAveragePool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractGlobalPool2DLayer(input, device, Kernels::GlobalPooling::Average) {}
+        };
+
+        /**
+         * This layer reverses a max pooling by scattering its input to the positions of the maxima. All other pixels
+         * are zero. The pooling must be a <MaxPool2DLayer> with argMax(true) and the input must have the shape of its
+         * output. This layer only supports inference.
+         */
+        class MaxUnpool2DLayer : public AbstractSingleInputLayer
+        {
+        private:
+            typedef MaxUnpool2DLayer Self;
+
+            /*!
+             * The pooling whose maxima are used.
+             */
+            CNTK::FunctionPtr _pool;
+
+        public:
+            /*!
+             * Initializes a new instance of the <MaxUnpool2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit MaxUnpool2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractSingleInputLayer(input, device),
+                    _pool(nullptr)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(pool, _pool)
+            MAKE_SETTER(pool, _pool)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(this->_pool != nullptr, "The unpooling requires a pooling.");
+
+                const auto pooling = std::dynamic_pointer_cast<Functions::ArgMaxPool2DFunction>(this->_pool->RootFunction());
+                Exception::assertArgument(pooling != nullptr, "The pooling must be a max pooling that returns the positions of the maxima.");
+
+                const auto & pooledShape = this->_pool->Outputs()[0].Shape();
+                Exception::assertArgument(this->input.Shape() == pooledShape, "The input must have the shape of the pooled values.");
+
+                return Functions::MaxUnpool2DFunction::create(this->input, this->_pool->Outputs()[1], pooling->pooling());
+            }
+        };
+
+        /**
+         * This layer upscales a tensor with two spatial dimensions. By default, it upscales by repeating the values
+         * along the spatial axes. However, it also support bilinear interpolation, which is more expensive.
+         */
+        class Upscale2DLayer : public AbstractSingleInputLayer {
+        private:
+            typedef Upscale2DLayer Self;
+            /*!
+             * The upscale factor
+             */
+            Values::ArrayValue<uint64_t, 2> _scaleFactor;
+
+        public:
+            /*!
+             * Initializes a new instance of the <Conv2DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit Upscale2DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+            AbstractSingleInputLayer(input, device),
+            _scaleFactor{2, 2}
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(scaleFactor, _scaleFactor)
+            MAKE_SETTER(scaleFactor, _scaleFactor)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                // Repeat the values by broadcasting them along two new axes of size scaleFactor. This costs a single
+                // addition per output value, whereas the costs of the equivalent transposed convolution grow with the
+                // number of channels. See https://github.com/Microsoft/CNTK/issues/711
+                const auto & inputShape = this->input.Shape();
+                Exception::assertArgument(inputShape.Rank() == 3, "The input must have shape (width, height, channels).");
+
+                auto expanded = CNTK::Reshape(this->input, { 1, inputShape[0], 1, inputShape[1], inputShape[2] });
+                auto zeros = CNTK::Constant(CNTK::NDShape({ this->_scaleFactor[0], 1, this->_scaleFactor[1], 1, 1 }), 0.0f, this->device);
+                CNTK::FunctionPtr network = CNTK::Plus(expanded, zeros);
+
+                return CNTK::Reshape(network, { this->_scaleFactor[0] * inputShape[0], this->_scaleFactor[1] * inputShape[1], inputShape[2] });
+            }
+        };
+
+        /**
+         * This is the base class for non-deterministic layers such as noise layers (DropOut) or normalization layers
+         * (BatchNorm).
+         */
+        class AbstractNonDeterministicLayer : public AbstractSingleInputLayer {
+        protected:
+            typedef AbstractNonDeterministicLayer Self;
+            /*!
+             * Whether or not the output should be deterministic
+             */
+            bool _deterministic;
+
+        public:
+            /*!
+             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit AbstractNonDeterministicLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractSingleInputLayer(input, device),
+                    _deterministic(false)
+                    {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(deterministic, _deterministic)
+            MAKE_SETTER(deterministic, _deterministic)
+        };
+
+        /**
+         * This layer implements DropOut.
+         */
+        class DropOutLayer : public AbstractNonDeterministicLayer {
+        private:
+            typedef DropOutLayer Self;
+            /*!
+             * The dropout rate
+             */
+            double _p;
+
+        public:
+            /*!
+             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit DropOutLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractNonDeterministicLayer(input, device),
+                    _p(0.25)
+                    {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(p, _p)
+            MAKE_SETTER(p, _p)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                CNTK::FunctionPtr network = this->input;
+
+                // If the layer is deterministic or there is no drop-out specified, simply return the input
+                if (!_deterministic && _p > 0.0)
+                {
+                    // Apply the drop-out
+                    network = CNTK::Dropout(network, _p);
+                }
+
+                return network;
+            }
+        };
+
+        /**
+         * Batch normalization layer.
+         * TODO: Make it possible to pass eigen tensors for the parameters of the layer.
+         */
+        class BatchNormLayer : public AbstractNonDeterministicLayer {
+        private:
+            typedef BatchNormLayer Self;
+            /**
+             * Whether or not to use cuDNN
+             */
+            bool _useCuDNN;
+            /**
+             * Determines the smoothing of the running mean and the running std.
+             */
+            double _normalizationTimeConstant;
+            /**
+             * Regularization parameter.
+             */
+            double _epsilon;
+
+        public:
+            /*!
+             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit BatchNormLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+            AbstractNonDeterministicLayer(input, device),
+            _useCuDNN(false),
+            // 5000.0 as recommended here: https://github.com/Microsoft/CNTK/wiki/BatchNormalization
+            _normalizationTimeConstant(5000.0),
+            _epsilon(1e-5)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(useCuDNN, _useCuDNN)
+            MAKE_SETTER(useCuDNN, _useCuDNN)
+
+            MAKE_GETTER(normalizationTimeConstant, _normalizationTimeConstant)
+            MAKE_SETTER(normalizationTimeConstant, _normalizationTimeConstant)
+
+            MAKE_GETTER(epsilon, _epsilon)
+            MAKE_SETTER(epsilon, _epsilon)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                CNTK::FunctionPtr network = this->input;
+
+                CNTK::NDShape parameterShape;
+                // Determine the size of the parameters
+                // If the input tensor has more than one dimension, then this is considered to be a spatial batch-norm
+                if (input.Shape().Rank() > 1)
+                {
+                    // The last dimension determines the number of channels
+                    parameterShape = { input.Shape()[input.Shape().Rank() - 1] };
+                }
+                else
+                {
+                    parameterShape = { input.Shape()[0] };
+                }
+
+                // Create the parameters
+                auto scale = CNTK::Parameter(parameterShape, 1.0f, device);
+                auto bias = CNTK::Parameter(parameterShape, 0.0f, device);
+                auto runningMean = CNTK::Parameter(parameterShape, 0.0f, device);
+                auto runningInvStd = CNTK::Parameter(parameterShape, 1.0f, device);
+
+                network = CNTK::BatchNormalization(
+                        network,
+                        scale,
+                        bias,
+                        runningMean,
+                        runningInvStd,
+                        input.Shape().Rank() > 1,
+                        _normalizationTimeConstant,
+                        0,
+                        _epsilon,
+                        _useCuDNN);
+
+                return network;
+            }
+        };
+
+        /**
+         * Dense layer or fully connected layer.
+         */
+        class DenseLayer : public AbstractSingleInputLayer {
+        public:
+            typedef DenseLayer Self;
+
+            /*!
+             * The number of units/neurons.
+             */
+            uint64_t _numUnits;
+            /*!
+             * Weight matrix.
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer> _W;
+            /*!
+             * Bias parameter
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 1>, CNTK::ParameterInitializer, bool> _b;
+            /*!
+             * Non-linearity
+             */
+            std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            /*!
+             * The algorithm. "cntk" uses CNTK's matrix product. For vector inputs, "packed" and "auto" use the CPU
+             * kernel for small batches on weights that are packed once. Inputs of shape (width, height, channels) are
+             * projected per pixel; any value other than "cntk" runs the projection as a single matrix product on the
+             * convolution kernels. The CPU kernels fuse the bias and (if possible) the non-linearity and only support
+             * inference.
+             */
+            std::string _algorithm;
+
+        public:
+            /*!
+             * Initializes a new instance of the <DenseLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit DenseLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                AbstractSingleInputLayer(input, device),
+                _numUnits(8),
+                _W(CNTK::HeNormalInitializer()),
+                _b(CNTK::ConstantInitializer(0)),
+                _nonLinearity(Chianti::Nonlinearities::rectify),
+                _algorithm("cntk")
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(numUnits, _numUnits)
+            MAKE_SETTER(numUnits, _numUnits)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(b, _b)
+            MAKE_SETTER(b, _b)
+
+            MAKE_GETTER(nonLinearity, _nonLinearity)
+            MAKE_SETTER(nonLinearity, _nonLinearity)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                size_t numInputChannels = this->input.Shape()[this->input.Shape().Rank() - 1];
+
+                // Create the weight parameters
+                CNTK::NDShape weightShape = { _numUnits, numInputChannels };
+                auto weight = resolveParameter<2>(this->_W, weightShape, this->device);
+
+                // Set up the bias term
+                // --------------------
+                std::vector<CNTK::Variable> biasParams;
+                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
+                {
+                    // Add a bias term
+                    CNTK::NDShape biasShape = { this->_numUnits};
+
+                    // Create the parameter
+                    if (Values::isActive<2>(this->_b))
+                    {
+                        // The user didn't define anything
+                        // Create a 0 initialized parameter
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
+                    }
+                    else
+                    {
+                        // The user specified the bias
+                        biasParams.push_back(resolveParameter<1>(this->_b, biasShape, this->device));
+                    }
+                }
+
+                if (this->input.Shape().Rank() == 3)
+                {
+                    return this->buildPerPixel(weight, biasParams);
+                }
+
+                if (this->_algorithm != "cntk")
+                {
+                    return this->buildPacked(weight, biasParams);
+                }
+
+                CNTK::FunctionPtr network = CNTK::Times(weight, this->input);
+                for (const auto & biasParam : biasParams)
+                {
+                    network = CNTK::Plus(network, biasParam);
+                }
+
+                // Apply non-linearity
+                network = this->_nonLinearity(network);
+
+                return network;
+            }
+
+        private:
+            /*!
+             * Runs the layer on a vector input with the packed CPU kernel.
+             *
+             * @param weight The weights of shape (numUnits, inputs)
+             * @param biasParams The bias of shape (numUnits) if there is one
+             * @return The CNTK node
+             */
+            CNTK::FunctionPtr buildPacked(const CNTK::Variable & weight, const std::vector<CNTK::Variable> & biasParams) const
+            {
+                Exception::assertArgument(this->_algorithm == "packed" || this->_algorithm == "auto", "Unknown dense algorithm. Must be cntk, packed or auto.");
+                Exception::assertArgument(this->input.Shape().Rank() == 1, "The packed dense kernel requires a vector input.");
+
+                Kernels::Activation activation = Kernels::Activation::Identity;
+                const bool fused = Functions::fusedActivation(this->_nonLinearity, activation);
+                const size_t numUnits = this->_numUnits;
+
+                Functions::Internal::KernelFactory<Functions::DenseExecutor> factory = [=](const CNTK::NDShape & shape) {
+                    const Kernels::DenseConfig config = { shape[0], numUnits, activation };
+                    return std::make_shared<Functions::DenseExecutor>(config);
+                };
+
+                std::vector<CNTK::Variable> inputs = { this->input, weight };
+                inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                CNTK::FunctionPtr network = Functions::DenseFunction::create(inputs, factory);
+
+                return fused ? network : this->_nonLinearity(network);
+            }
+
+            /*!
+             * Projects every pixel of an input of shape (width, height, channels). This is a 1x1 convolution.
+             *
+             * @param weight The weights of shape (numUnits, channels)
+             * @param biasParams The bias of shape (numUnits) if there is one
+             * @return The CNTK node
+             */
+            CNTK::FunctionPtr buildPerPixel(const CNTK::Variable & weight, const std::vector<CNTK::Variable> & biasParams) const
+            {
+                const auto & inputShape = this->input.Shape();
+                const size_t numInputChannels = inputShape[2];
+                CNTK::FunctionPtr network;
+
+                if (this->_algorithm == "cntk")
+                {
+                    auto filters = CNTK::Reshape(CNTK::Transpose(weight), { 1, 1, numInputChannels, this->_numUnits });
+                    network = CNTK::Convolution(filters, this->input, { 1, 1, numInputChannels }, { true }, { false });
+
+                    for (const auto & biasParam : biasParams)
+                    {
+                        network = CNTK::Plus(network, CNTK::Reshape(biasParam, { 1, 1, this->_numUnits }));
+                    }
+
+                    return this->_nonLinearity(network);
+                }
+
+                Kernels::Activation activation = Kernels::Activation::Identity;
+                const bool fused = Functions::fusedActivation(this->_nonLinearity, activation);
+                const size_t numUnits = this->_numUnits;
+                const std::string algorithm = this->_algorithm == "auto" ? std::string("gemm1x1") : this->_algorithm;
+
+                Functions::Internal::KernelFactory<Functions::Conv2DExecutor> factory = [=](const CNTK::NDShape & shape) {
+                    auto config = Kernels::makeConv2DConfig(shape[0], shape[1], numInputChannels, numUnits, 1, 1, 1, 1, false);
+                    config.activation = activation;
+                    return std::make_shared<Functions::Conv2DExecutor>(config, algorithm, true);
+                };
+
+                std::vector<CNTK::Variable> inputs = { this->input, weight };
+                inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                network = Functions::Conv2DFunction::create(inputs, factory);
+
+                return fused ? network : this->_nonLinearity(network);
+            }
+        };
+
+        /**
+         * Looks up the rows of a table. The input holds integer indices of shape (count), the output has the shape
+         * (numUnits, count) or (numUnits) for a single index. This is the product of the table with one-hot vectors,
+         * hence, a table can be loaded into a <DenseLayer> with a linear non-linearity and vice versa.
+         */
+        class EmbeddingLayer : public AbstractSingleInputLayer
+        {
+        public:
+            typedef EmbeddingLayer Self;
+
+            /*!
+             * The number of rows of the table, i.e. the number of distinct indices.
+             */
+            uint64_t _numRows;
+            /*!
+             * The size of a row.
+             */
+            uint64_t _numUnits;
+            /*!
+             * The table of shape (numUnits, numRows).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer> _W;
+            /*!
+             * The algorithm. "cntk" multiplies the table with sparse one-hot vectors. "gather" and "auto" copy the rows
+             * with the CPU kernel, which keeps the table in main memory regardless of the device. Its gradient only
+             * visits the rows that have been looked up.
+             */
+            std::string _algorithm;
+            /*!
+             * How the gather algorithm trains the table. "learner" hands a dense gradient to the CNTK learners. "sgd"
+             * and "adagrad" update the rows that have been looked up in place during the backward pass (see
+             * <Kernels::SparseRowUpdater>), in which case the table must not be passed to a learner. Requesting the
+             * gradient of the update trigger (see <Functions::EmbeddingFunction::updateTrigger>) runs the update without
+             * a dense gradient of the table.
+             */
+            std::string _update;
+            /*!
+             * The learning rate of the in-place updates.
+             */
+            float _learningRate;
+
+        public:
+            /*!
+             * Initializes a new instance of the <EmbeddingLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit EmbeddingLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                AbstractSingleInputLayer(input, device),
+                _numRows(8),
+                _numUnits(8),
+                _W(CNTK::GlorotUniformInitializer()),
+                _algorithm("cntk"),
+                _update("learner"),
+                _learningRate(0.01f)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(numRows, _numRows)
+            MAKE_SETTER(numRows, _numRows)
+
+            MAKE_GETTER(numUnits, _numUnits)
+            MAKE_SETTER(numUnits, _numUnits)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(update, _update)
+            MAKE_SETTER(update, _update)
+
+            MAKE_GETTER(learningRate, _learningRate)
+            MAKE_SETTER(learningRate, _learningRate)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(this->input.Shape().Rank() == 1, "The embedding requires indices of shape (count).");
+                CNTK::NDShape weightShape = { this->_numUnits, this->_numRows };
+
+                if (this->_algorithm == "cntk")
+                {
+                    Exception::assertArgument(this->_update == "learner", "In-place updates require the gather algorithm.");
+                    auto weight = resolveParameter<2>(this->_W, weightShape, this->device);
+
+                    CNTK::Axis rowAxis(0);
+                    CNTK::FunctionPtr network = CNTK::Times(weight, CNTK::OneHotOp(this->input, this->_numRows, true, rowAxis));
+                    if (this->input.Shape()[0] == 1)
+                    {
+                        network = CNTK::Reshape(network, { this->_numUnits });
+                    }
+                    return network;
+                }
+
+                Exception::assertArgument(this->_algorithm == "gather" || this->_algorithm == "auto", "Unknown embedding algorithm. Must be cntk, gather or auto.");
+                auto weight = resolveParameter<2>(this->_W, weightShape, CNTK::DeviceDescriptor::CPUDevice());
+
+                std::shared_ptr<Kernels::SparseRowUpdater> updater;
+                if (this->_update != "learner")
+                {
+                    Exception::assertArgument(this->_update == "sgd" || this->_update == "adagrad", "Unknown embedding update. Must be learner, sgd or adagrad.");
+                    updater = std::make_shared<Kernels::SparseRowUpdater>(
+                            Kernels::EmbeddingConfig{ this->_numRows, this->_numUnits },
+                            this->_update == "sgd" ? Kernels::SparseUpdateRule::SGD : Kernels::SparseUpdateRule::AdaGrad,
+                            this->_learningRate);
+                }
+
+                return Functions::EmbeddingFunction::create(this->input, weight, updater);
+            }
+        };
+
+        /**
+         * This is the base class for recurrent layers. The layer maps a sequence of vectors to the sequence of its
+         * hidden states, starting from zero states. See <Kernels::RecurrentCell> for the equations and the order of
+         * the gates in the weights.
+         */
+        class AbstractRecurrentLayer : public AbstractSingleInputLayer
+        {
+        protected:
+            typedef AbstractRecurrentLayer Self;
+
+            /*!
+             * The number of units/neurons.
+             */
+            uint64_t _numUnits;
+            /*!
+             * Input weights of shape (numGates * numUnits, inputs).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer> _W;
+            /*!
+             * Recurrent weights of shape (numGates * numUnits, numUnits).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer> _H;
+            /*!
+             * Bias parameter of shape (numGates * numUnits).
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 1>, CNTK::ParameterInitializer, bool> _b;
+            /*!
+             * The algorithm. "cntk" composes the cell from CNTK operations and supports training. "fused" and "auto"
+             * compute the input projections of the whole sequence in one matrix product and the recurrent
+             * projections of all gates in one matrix product per time step, followed by a single pass over the gates.
+             * They only support inference.
+             */
+            std::string _algorithm;
+            /*!
+             * If true, the layer carries its states across evaluations, such that a stream can be fed in chunks, see
+             * <Inference::Session::reset>. This forces the CPU kernel. All sequences of a chunk must have the same
+             * length.
+             */
+            bool _streaming;
+
+        private:
+            /**
+             * The recurrent cell.
+             */
+            const Kernels::RecurrentCell cell;
+
+        protected:
+            /*!
+             * Initializes a new instance of the <AbstractRecurrentLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             * @param cell The recurrent cell.
+             */
+            explicit AbstractRecurrentLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device, const Kernels::RecurrentCell cell) :
+                AbstractSingleInputLayer(input, device),
+                _numUnits(8),
+                _W(CNTK::GlorotUniformInitializer()),
+                _H(CNTK::GlorotUniformInitializer()),
+                _b(CNTK::ConstantInitializer(0)),
+                _algorithm("cntk"),
+                _streaming(false),
+                cell(cell)
+            {}
+
+        public:
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(numUnits, _numUnits)
+            MAKE_SETTER(numUnits, _numUnits)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(H, _H)
+            MAKE_SETTER(H, _H)
+
+            MAKE_GETTER(b, _b)
+            MAKE_SETTER(b, _b)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(streaming, _streaming)
+            MAKE_SETTER(streaming, _streaming)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                Exception::assertArgument(this->input.Shape().Rank() == 1, "A recurrent layer requires a sequence of vectors.");
+
+                const Kernels::RecurrentConfig config = { this->input.Shape()[0], this->_numUnits, this->cell };
+                const size_t numRows = config.numGates() * config.numUnits;
+
+                // Create the weight parameters
+                auto inputWeight = resolveParameter<2>(this->_W, { numRows, config.inputSize }, this->device);
+                auto recurrentWeight = resolveParameter<2>(this->_H, { numRows, config.numUnits }, this->device);
+
+                // Set up the bias term
+                // --------------------
+                std::vector<CNTK::Variable> biasParams;
+                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
+                {
+                    CNTK::NDShape biasShape = { numRows };
+
+                    if (Values::isActive<2>(this->_b))
+                    {
+                        // Create a 0 initialized parameter
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
+                    }
+                    else
+                    {
+                        // The user specified the bias
+                        biasParams.push_back(resolveParameter<1>(this->_b, biasShape, this->device));
+                    }
+                }
+
+                Exception::assertArgument(this->_algorithm == "cntk" || this->_algorithm == "fused" || this->_algorithm == "auto", "Unknown recurrent algorithm. Must be cntk, fused or auto.");
+                if (this->_algorithm == "cntk" && !this->_streaming)
+                {
+                    return this->buildCNTK(inputWeight, recurrentWeight, biasParams);
+                }
+
+                std::vector<CNTK::Variable> inputs = { this->input, inputWeight, recurrentWeight };
+                inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                return Functions::RecurrentFunction::create(inputs, std::make_shared<Functions::RecurrentExecutor>(config), this->_streaming);
+            }
+
+        private:
+            /*!
+             * Composes the cell from CNTK operations. The previous states are placeholders that are replaced by the
+             * past values of the states once the cell is complete.
+             *
+             * @param inputWeight The input weights
+             * @param recurrentWeight The recurrent weights
+             * @param biasParams The bias if there is one
+             * @return The CNTK node
+             */
+            CNTK::FunctionPtr buildCNTK(const CNTK::Variable & inputWeight, const CNTK::Variable & recurrentWeight, const std::vector<CNTK::Variable> & biasParams) const
+            {
+                const int units = static_cast<int>(this->_numUnits);
+                auto previousState = CNTK::PlaceholderVariable({ this->_numUnits }, this->input.DynamicAxes());
+
+                CNTK::FunctionPtr projection = CNTK::Times(inputWeight, this->input);
+                for (const auto & biasParam : biasParams)
+                {
+                    projection = CNTK::Plus(projection, biasParam);
+                }
+                CNTK::FunctionPtr recurrent = CNTK::Times(recurrentWeight, previousState);
+
+                auto gate = [&](const CNTK::Variable & operand, int index) {
+                    return CNTK::Slice(operand, CNTK::Axis(0), index * units, (index + 1) * units);
+                };
+
+                if (this->cell == Kernels::RecurrentCell::LSTM)
+                {
+                    auto previousCell = CNTK::PlaceholderVariable({ this->_numUnits }, this->input.DynamicAxes());
+                    auto gates = CNTK::Plus(projection, recurrent);
+
+                    auto cellState = CNTK::Plus(
+                            CNTK::ElementTimes(CNTK::Sigmoid(gate(gates, 1)), previousCell),
+                            CNTK::ElementTimes(CNTK::Sigmoid(gate(gates, 0)), CNTK::Tanh(gate(gates, 2))));
+                    auto state = CNTK::ElementTimes(CNTK::Sigmoid(gate(gates, 3)), CNTK::Tanh(cellState));
+
+                    return state->ReplacePlaceholders({{previousState, CNTK::PastValue(state)}, {previousCell, CNTK::PastValue(cellState)}});
+                }
+
+                auto update = CNTK::Sigmoid(CNTK::Plus(gate(projection, 0), gate(recurrent, 0)));
+                auto reset = CNTK::Sigmoid(CNTK::Plus(gate(projection, 1), gate(recurrent, 1)));
+                auto candidate = CNTK::Tanh(CNTK::Plus(gate(projection, 2), CNTK::ElementTimes(reset, gate(recurrent, 2))));
+                auto state = CNTK::Plus(candidate, CNTK::ElementTimes(update, CNTK::Minus(previousState, candidate)));
+
+                return state->ReplacePlaceholders({{previousState, CNTK::PastValue(state)}});
+            }
+        };
+
+        /**
+         * Long short-term memory layer.
+         */
+        class LSTMLayer : public AbstractRecurrentLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <LSTMLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit LSTMLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractRecurrentLayer(input, device, Kernels::RecurrentCell::LSTM) {}
+        };
+
+        /**
+         * Gated recurrent unit layer.
+         */
+        class GRULayer : public AbstractRecurrentLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <GRULayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit GRULayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) : AbstractRecurrentLayer(input, device, Kernels::RecurrentCell::GRU) {}
+        };
+
+        /**
+         * This layer adds a causal 1D convolution over the sequence axis followed by a bias-term (optional) and a
+         * non-linearity (optional). Every output frame only depends on the current and past input frames, see
+         * <Kernels::CausalConv1DConfig>. Use this layer for streaming audio features.
+         */
+        class CausalConv1DLayer : public AbstractSingleInputLayer
+        {
+        public:
+            typedef CausalConv1DLayer Self;
+
+            /*!
+             * The number of filter kernels.
+             */
+            uint64_t _numFilters;
+            /*!
+             * The number of frames per filter.
+             */
+            uint64_t _filterSize;
+            /*!
+             * The distance between the frames of a filter.
+             */
+            uint64_t _dilation;
+            /*!
+             * Filter kernel of shape (numFilters, channels, filterSize). The last tap belongs to the current frame.
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 3>, CNTK::ParameterInitializer> _W;
+            /*!
+             * Bias parameter
+             */
+            Values::CompositeValue<Eigen::Tensor<float, 1>, CNTK::ParameterInitializer, bool> _b;
+            /*!
+             * Non-linearity
+             */
+            std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            /*!
+             * The algorithm. "cntk" sums the taps over past values of the input and supports training. "direct" and
+             * "auto" run one matrix product per tap over all frames of a sequence on the CPU. They fuse the bias and
+             * (if possible) the non-linearity and only support inference.
+             */
+            std::string _algorithm;
+            /*!
+             * If true, the layer keeps the last input frames across evaluations, such that a stream can be fed in
+             * chunks, see <Inference::Session::reset>. This forces the CPU kernel. All sequences of a chunk must have
+             * the same length.
+             */
+            bool _streaming;
+
+        public:
+            /*!
+             * Initializes a new instance of the <CausalConv1DLayer> class.
+             *
+             * @param input The layer's input variables.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            explicit CausalConv1DLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                    AbstractSingleInputLayer(input, device),
+                    _numFilters(1),
+                    _filterSize(3),
+                    _dilation(1),
+                    _W(CNTK::HeNormalInitializer()),
+                    _b(CNTK::ConstantInitializer(0)),
+                    _nonLinearity(Chianti::Nonlinearities::rectify),
+                    _algorithm("cntk"),
+                    _streaming(false)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(numFilters, _numFilters)
+            MAKE_SETTER(numFilters, _numFilters)
+
+            MAKE_GETTER(filterSize, _filterSize)
+            MAKE_SETTER(filterSize, _filterSize)
+
+            MAKE_GETTER(dilation, _dilation)
+            MAKE_SETTER(dilation, _dilation)
+
+            MAKE_GETTER(W, _W)
+            MAKE_SETTER(W, _W)
+
+            MAKE_GETTER(b, _b)
+            MAKE_SETTER(b, _b)
+
+            MAKE_GETTER(nonLinearity, _nonLinearity)
+            MAKE_SETTER(nonLinearity, _nonLinearity)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(streaming, _streaming)
+            MAKE_SETTER(streaming, _streaming)
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
              * @return The CNTK node.
              */
             CNTK::FunctionPtr build() const
             {
-                // We implement the unpooling as the backwards pass of the convolution.
-                // TODO: This can be implemented more efficiently. For example: https://github.com/Microsoft/CNTK/issues/711
+                Exception::assertArgument(this->input.Shape().Rank() == 1, "A causal convolution requires a sequence of vectors.");
+                Exception::assertArgument(this->_filterSize > 0 && this->_dilation > 0, "The filter size and the dilation must be positive.");
 
-                // Create the filter kernel for the unpooling operation
-                size_t numInputChannels = this->input.Shape()[this->input.Shape().Rank() - 1];
+                const size_t numChannels = this->input.Shape()[0];
+                auto weight = resolveParameter<3>(this->_W, { this->_numFilters, numChannels, this->_filterSize }, this->device);
 
-                CNTK::NDShape filterShape = { this->_scaleFactor[0], this->_scaleFactor[1], numInputChannels, numInputChannels };
+                // Set up the bias term
+                // --------------------
+                std::vector<CNTK::Variable> biasParams;
+                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
+                {
+                    CNTK::NDShape biasShape = { this->_numFilters };
 
-                Eigen::Tensor<float, 4> W(static_cast<int>(_scaleFactor[0]), static_cast<int>(_scaleFactor[1]), static_cast<int>(numInputChannels), static_cast<int>(numInputChannels));
-                W.setConstant(0.0f);
+                    if (Values::isActive<2>(this->_b))
+                    {
+                        // Create a 0 initialized parameter
+                        biasParams.push_back(CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device));
+                    }
+                    else
+                    {
+                        // The user specified the bias
+                        biasParams.push_back(resolveParameter<1>(this->_b, biasShape, this->device));
+                    }
+                }
 
-                for (int i = 0; i < static_cast<int>(_scaleFactor[0]); i++)
+                Exception::assertArgument(this->_algorithm == "cntk" || this->_algorithm == "direct" || this->_algorithm == "auto", "Unknown causal convolution algorithm. Must be cntk, direct or auto.");
+                if (this->_algorithm == "cntk" && !this->_streaming)
                 {
-                    for (int j = 0; j < static_cast<int>(_scaleFactor[1]); j++)
+                    CNTK::FunctionPtr network;
+                    for (size_t k = 0; k < this->_filterSize; k++)
                     {
-                        for (int c = 0; c < static_cast<int>(numInputChannels); c++)
-                        {
-                            // A value of 1.0f means that each value is simply repeated
-                            W(i, j, c, c) = 1.0f;
-                        }
+                        const size_t offset = (this->_filterSize - 1 - k) * this->_dilation;
+                        auto tap = CNTK::Reshape(CNTK::Slice(weight, CNTK::Axis(2), static_cast<int>(k), static_cast<int>(k + 1)), { this->_numFilters, numChannels });
+                        auto frame = offset == 0 ? this->input : CNTK::Variable(CNTK::PastValue(this->input, offset));
+                        auto product = CNTK::Times(tap, frame);
+                        network = network ? CNTK::Plus(network, product) : product;
+                    }
+
+                    for (const auto & biasParam : biasParams)
+                    {
+                        network = CNTK::Plus(network, biasParam);
                     }
+
+                    return this->_nonLinearity(network);
                 }
 
-                // Convert the Eigen tensor to a CNTK parameter
-                auto view = Util::tensorToView<4, float>(W);
-                auto params = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, filterShape, device);
-                params->CopyFrom(*view);
+                Kernels::CausalConv1DConfig config = { numChannels, this->_numFilters, this->_filterSize, this->_dilation, Kernels::Activation::Identity };
+                const bool fused = Functions::fusedActivation(this->_nonLinearity, config.activation);
 
-                // Create the convolution/deconvolution
-                CNTK::FunctionPtr network = Convolution(
-                        CNTK::Constant(params),
-                        this->input,
-                        { _scaleFactor[0], _scaleFactor[1], numInputChannels },
-                        { true },
-                        { false, false, false },
-                        { 0, 0, 0 },
-                        { 0, 0, 0 },
-                        true);
+                std::vector<CNTK::Variable> inputs = { this->input, weight };
+                inputs.insert(inputs.end(), biasParams.begin(), biasParams.end());
+                CNTK::FunctionPtr network = Functions::CausalConv1DFunction::create(inputs, std::make_shared<Functions::CausalConv1DExecutor>(config), this->_streaming);
 
-                return network;
+                return fused ? network : this->_nonLinearity(network);
             }
         };
 
         /**
-         * This is the base class for non-deterministic layers such as noise layers (DropOut) or normalization layers
-         * (BatchNorm).
+         * Softmax output layer. It can return the classes with the highest scores instead of the probabilities.
          */
-        class AbstractNonDeterministicLayer : public AbstractSingleInputLayer {
-        protected:
-            typedef AbstractNonDeterministicLayer Self;
-            /*!
-             * Whether or not the output should be deterministic
-             */
-            bool _deterministic;
-
+        class SoftmaxLayer : public AbstractSingleInputLayer
+        {
         public:
+            typedef SoftmaxLayer Self;
+
             /*!
-             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
-             *
-             * @param input The layer's input variables.
-             * @param device The device where the parameters of the layer shall be stored.
+             * The algorithm. "cntk" uses CNTK's softmax, "fused" and "auto" compute the exponentials and the
+             * normalization in a single vectorized pass per sample on the CPU and only support inference.
              */
-            explicit AbstractNonDeterministicLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
-                    AbstractSingleInputLayer(input, device),
-                    _deterministic(false)
-                    {}
-
-            // Define the getters and setters for the individual class members
-
-            MAKE_GETTER(deterministic, _deterministic)
-            MAKE_SETTER(deterministic, _deterministic)
-        };
-
-        /**
-         * This layer implements DropOut.
-         */
-        class DropOutLayer : public AbstractNonDeterministicLayer {
-        private:
-            typedef DropOutLayer Self;
+            std::string _algorithm;
             /*!
-             * The dropout rate
+             * If positive, the layer returns the indices of the topK classes with the highest scores in descending
+             * order instead of the probabilities. The softmax is not computed, because it does not change the order.
+             * This always uses the CPU kernel.
              */
-            double _p;
+            uint64_t _topK;
 
         public:
             /*!
-             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
+             * Initializes a new instance of the <SoftmaxLayer> class.
              *
              * @param input The layer's input variables.
              * @param device The device where the parameters of the layer shall be stored.
              */
-            explicit DropOutLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
-                    AbstractNonDeterministicLayer(input, device),
-                    _p(0.25)
-                    {}
+            explicit SoftmaxLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+                AbstractSingleInputLayer(input, device),
+                _algorithm("cntk"),
+                _topK(0)
+            {}
 
             // Define the getters and setters for the individual class members
 
-            MAKE_GETTER(p, _p)
-            MAKE_SETTER(p, _p)
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
+
+            MAKE_GETTER(topK, _topK)
+            MAKE_SETTER(topK, _topK)
 
             /*!
              * Converts the Chianti layer into a CNTK node.
@@ -633,64 +2359,59 @@ namespace Chianti
              */
             CNTK::FunctionPtr build() const
             {
-                CNTK::FunctionPtr network = this->input;
-
-                // If the layer is deterministic or there is no drop-out specified, simply return the input
-                if (!_deterministic && _p > 0.0)
+                if (this->_topK > 0)
                 {
-                    // Apply the drop-out
-                    network = CNTK::Dropout(network, _p);
+                    return Functions::SoftmaxFunction::create(this->input, this->_topK);
+                }
+                else if (this->_algorithm == "cntk")
+                {
+                    return CNTK::Softmax(this->input);
                 }
 
-                return network;
+                Exception::assertArgument(this->_algorithm == "fused" || this->_algorithm == "auto", "Unknown softmax algorithm. Must be cntk, fused or auto.");
+                return Functions::SoftmaxFunction::create(this->input, 0);
             }
         };
 
         /**
-         * Batch normalization layer.
-         * TODO: Make it possible to pass eigen tensors for the parameters of the layer.
+         * Cross entropy between labels and the softmax of the input. The softmax is never materialized, which keeps
+         * the loss finite for large scores.
          */
-        class BatchNormLayer : public AbstractNonDeterministicLayer {
-        private:
-            typedef BatchNormLayer Self;
-            /**
-             * Whether or not to use cuDNN
-             */
-            bool _useCuDNN;
-            /**
-             * Determines the smoothing of the running mean and the running std.
+        class SoftmaxCrossEntropyLayer : public AbstractSingleInputLayer
+        {
+        public:
+            typedef SoftmaxCrossEntropyLayer Self;
+
+            /*!
+             * The algorithm. "cntk" uses CNTK's fused cross entropy, which supports training. "fused" and "auto"
+             * compute the loss in two vectorized passes per sample on the CPU and only support inference.
              */
-            double _normalizationTimeConstant;
-            /**
-             * Regularization parameter.
+            std::string _algorithm;
+
+        private:
+            /*!
+             * The labels. They may be one-hot vectors, distributions or sparse.
              */
-            double _epsilon;
+            CNTK::Variable labels;
 
         public:
             /*!
-             * Initializes a new instance of the <AbstractNonDeterministicLayer> class.
+             * Initializes a new instance of the <SoftmaxCrossEntropyLayer> class.
              *
-             * @param input The layer's input variables.
+             * @param input The layer's input variables, i.e. the scores.
+             * @param labels The labels of the same shape as the input.
              * @param device The device where the parameters of the layer shall be stored.
              */
-            explicit BatchNormLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
-            AbstractNonDeterministicLayer(input, device),
-            _useCuDNN(false),
-            // 5000.0 as recommended here: https://github.com/Microsoft/CNTK/wiki/BatchNormalization
-            _normalizationTimeConstant(5000.0),
-            _epsilon(1e-5)
+            explicit SoftmaxCrossEntropyLayer(CNTK::Variable input, CNTK::Variable labels, const CNTK::DeviceDescriptor & device) :
+                AbstractSingleInputLayer(input, device),
+                _algorithm("cntk"),
+                labels(labels)
             {}
 
             // Define the getters and setters for the individual class members
 
-            MAKE_GETTER(useCuDNN, _useCuDNN)
-            MAKE_SETTER(useCuDNN, _useCuDNN)
-
-            MAKE_GETTER(normalizationTimeConstant, _normalizationTimeConstant)
-            MAKE_SETTER(normalizationTimeConstant, _normalizationTimeConstant)
-
-            MAKE_GETTER(epsilon, _epsilon)
-            MAKE_SETTER(epsilon, _epsilon)
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
 
             /*!
              * Converts the Chianti layer into a CNTK node.
@@ -699,80 +2420,94 @@ namespace Chianti
              */
             CNTK::FunctionPtr build() const
             {
-                CNTK::FunctionPtr network = this->input;
-
-                CNTK::NDShape parameterShape;
-                // Determine the size of the parameters
-                // If the input tensor has more than one dimension, then this is considered to be a spatial batch-norm
-                if (input.Shape().Rank() > 1)
-                {
-                    // The last dimension determines the number of channels
-                    parameterShape = { input.Shape()[input.Shape().Rank() - 1] };
-                }
-                else
+                if (this->_algorithm == "cntk")
                 {
-                    parameterShape = { input.Shape()[0] };
+                    return CNTK::CrossEntropyWithSoftmax(this->input, this->labels);
                 }
 
-                // Create the parameters
-                auto scale = CNTK::Parameter(parameterShape, 1.0f, device);
-                auto bias = CNTK::Parameter(parameterShape, 0.0f, device);
-                auto runningMean = CNTK::Parameter(parameterShape, 0.0f, device);
-                auto runningInvStd = CNTK::Parameter(parameterShape, 1.0f, device);
-
-                network = CNTK::BatchNormalization(
-                        network,
-                        scale,
-                        bias,
-                        runningMean,
-                        runningInvStd,
-                        input.Shape().Rank() > 1,
-                        _normalizationTimeConstant,
-                        0,
-                        _epsilon,
-                        _useCuDNN);
-
-                return network;
+                Exception::assertArgument(this->_algorithm == "fused" || this->_algorithm == "auto", "Unknown cross entropy algorithm. Must be cntk, fused or auto.");
+                return Functions::SoftmaxCrossEntropyFunction::create(this->input, this->labels);
             }
         };
 
         /**
-         * Dense layer or fully connected layer.
+         * Softmax output layer for very large numbers of classes. During training, the cross entropy is estimated from
+         * the label and a few classes that are drawn from a proposal distribution per minibatch (sampled softmax with
+         * the logQ correction). Only the rows of the weights and the bias that belong to these classes are touched.
+         * For inference, the layer computes the full softmax or the best classes. The parameters are those of a
+         * <DenseLayer> with a linear non-linearity, hence, trained weights can be loaded into either layer.
          */
-        class DenseLayer : public AbstractSingleInputLayer {
+        class SampledSoftmaxLayer : public AbstractSingleInputLayer
+        {
         public:
-            typedef DenseLayer Self;
+            typedef SampledSoftmaxLayer Self;
 
             /*!
-             * The number of units/neurons.
+             * The number of classes.
              */
             uint64_t _numUnits;
             /*!
-             * Weight matrix.
+             * Weight matrix of shape (numUnits, inputs), see <DenseLayer::_W>.
              */
             Values::CompositeValue<Eigen::Tensor<float, 2>, CNTK::ParameterInitializer> _W;
             /*!
-             * Bias parameter
+             * Bias parameter, see <DenseLayer::_b>.
              */
             Values::CompositeValue<Eigen::Tensor<float, 1>, CNTK::ParameterInitializer, bool> _b;
             /*!
-             * Non-linearity
+             * "sampled" builds the training loss per sample, "full" builds the probabilities of all classes.
              */
-            std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> _nonLinearity;
+            std::string _mode;
+            /*!
+             * The number of classes that are drawn per minibatch.
+             */
+            uint64_t _numSampled;
+            /*!
+             * The unnormalized proposal distribution. If it is empty, the log-uniform distribution is used, which
+             * assumes that the classes are sorted by decreasing frequency. All weights must be positive, every class
+             * may be a label.
+             */
+            std::vector<double> _classWeights;
+            /*!
+             * The seed of the sampler.
+             */
+            uint64_t _seed;
+            /*!
+             * If positive, the full mode returns the indices of the topK best classes instead of the probabilities,
+             * see <SoftmaxLayer::_topK>.
+             */
+            uint64_t _topK;
+            /*!
+             * The algorithm of the full mode. "cntk" uses CNTK's matrix product and softmax, "auto" uses the packed
+             * dense kernel and the fused softmax, which only support inference.
+             */
+            std::string _algorithm;
+
+        private:
+            /*!
+             * The labels. They must be one-hot vectors, which may be sparse.
+             */
+            CNTK::Variable labels;
 
         public:
             /*!
-             * Initializes a new instance of the <DenseLayer> class.
+             * Initializes a new instance of the <SampledSoftmaxLayer> class.
              *
              * @param input The layer's input variables.
+             * @param labels The one-hot labels of shape (numUnits). They are only used by the sampled mode.
              * @param device The device where the parameters of the layer shall be stored.
              */
-            explicit DenseLayer(CNTK::Variable input, const CNTK::DeviceDescriptor & device) :
+            explicit SampledSoftmaxLayer(CNTK::Variable input, CNTK::Variable labels, const CNTK::DeviceDescriptor & device) :
                 AbstractSingleInputLayer(input, device),
                 _numUnits(8),
                 _W(CNTK::HeNormalInitializer()),
                 _b(CNTK::ConstantInitializer(0)),
-                _nonLinearity(Chianti::Nonlinearities::rectify)
+                _mode("sampled"),
+                _numSampled(64),
+                _seed(0),
+                _topK(0),
+                _algorithm("cntk"),
+                labels(labels)
             {}
 
             // Define the getters and setters for the individual class members
@@ -786,8 +2521,23 @@ namespace Chianti
             MAKE_GETTER(b, _b)
             MAKE_SETTER(b, _b)
 
-            MAKE_GETTER(nonLinearity, _nonLinearity)
-            MAKE_SETTER(nonLinearity, _nonLinearity)
+            MAKE_GETTER(mode, _mode)
+            MAKE_SETTER(mode, _mode)
+
+            MAKE_GETTER(numSampled, _numSampled)
+            MAKE_SETTER(numSampled, _numSampled)
+
+            MAKE_GETTER(classWeights, _classWeights)
+            MAKE_SETTER(classWeights, _classWeights)
+
+            MAKE_GETTER(seed, _seed)
+            MAKE_SETTER(seed, _seed)
+
+            MAKE_GETTER(topK, _topK)
+            MAKE_SETTER(topK, _topK)
+
+            MAKE_GETTER(algorithm, _algorithm)
+            MAKE_SETTER(algorithm, _algorithm)
 
             /*!
              * Converts the Chianti layer into a CNTK node.
@@ -796,42 +2546,62 @@ namespace Chianti
              */
             CNTK::FunctionPtr build() const
             {
-                size_t numInputChannels = this->input.Shape()[this->input.Shape().Rank() - 1];
-
-                // Create the weight parameters
-                CNTK::NDShape weightShape = { _numUnits, numInputChannels };
-                auto weight = resolveParameter<2>(this->_W, weightShape, this->device);
+                Exception::assertArgument(this->_algorithm == "cntk" || this->_algorithm == "auto", "Unknown sampled softmax algorithm. Must be cntk or auto.");
 
-                CNTK::FunctionPtr network = CNTK::Times(weight, this->input);
+                // The dense layer resolves the parameters
+                CNTK::FunctionPtr logits = DenseLayer(this->input, this->device)
+                        .numUnits(this->_numUnits)
+                        .W(this->_W)
+                        .b(this->_b)
+                        .nonLinearity(Nonlinearities::linear)
+                        .algorithm(this->_mode == "full" ? this->_algorithm : std::string("cntk"));
 
-                // Set up the bias term
-                // --------------------
-                if (!Values::isActive<2>(this->_b) || Values::get<2>(this->_b))
+                if (this->_mode == "full")
                 {
-                    // Add a bias term
-                    CNTK::NDShape biasShape = { this->_numUnits};
+                    return SoftmaxLayer(logits, this->device).algorithm(this->_algorithm).topK(this->_topK);
+                }
 
-                    // Create the parameter
-                    if (Values::isActive<2>(this->_b))
+                Exception::assertArgument(this->_mode == "sampled", "Unknown sampled softmax mode. Must be sampled or full.");
+                Exception::assertArgument(this->input.Shape().Rank() == 1, "The sampled softmax requires a vector input.");
+                Exception::assertArgument(this->_classWeights.empty() || this->_classWeights.size() == this->_numUnits, "There must be one class weight per unit.");
+
+                CNTK::Variable weight;
+                std::vector<CNTK::Variable> biasParams;
+                for (const auto & parameter : logits->Parameters())
+                {
+                    if (parameter.Shape().Rank() == 2)
                     {
-                        // The user didn't define anything
-                        // Create a 0 initialized parameter
-                        auto biasParams = CNTK::Parameter(biasShape, CNTK::DataType::Float, CNTK::ConstantInitializer(0), this->device);
-                        network = CNTK::Plus(network, biasParams);
+                        weight = parameter;
                     }
                     else
                     {
-                        // The user specified the bias
-                        auto biasParms = resolveParameter<1>(this->_b, biasShape, this->device);
-                        network = CNTK::Plus(network, biasParms);
+                        biasParams.push_back(parameter);
                     }
                 }
 
-                // Apply non-linearity
-                network = this->_nonLinearity(network);
+                auto sampler = std::make_shared<Kernels::AliasSampler>(this->_classWeights.empty() ? Kernels::logUniformWeights(this->_numUnits) : this->_classWeights);
+                auto sampling = Functions::SampleClassesFunction::create(this->labels, sampler, this->_numSampled, this->_seed);
 
-                return network;
+                // The sparse selectors of shape (numUnits, numSampled) and (numUnits, 1) gather the rows of the sampled
+                // classes and of the label, such that dense labels never cause a product with the whole table
+                CNTK::Axis classAxis(0);
+                auto selector = CNTK::OneHotOp(sampling->Outputs()[0], this->_numUnits, true, classAxis);
+                auto labelSelector = CNTK::OneHotOp(sampling->Outputs()[3], this->_numUnits, true, classAxis);
+
+                CNTK::FunctionPtr sampledLogits = CNTK::TransposeTimes(CNTK::TransposeTimes(weight, selector), this->input);
+                CNTK::FunctionPtr labelLogit = CNTK::TransposeTimes(CNTK::TransposeTimes(weight, labelSelector), this->input);
+                for (const auto & biasParam : biasParams)
+                {
+                    auto column = CNTK::Reshape(biasParam, { this->_numUnits, 1 });
+                    sampledLogits = CNTK::Plus(sampledLogits, CNTK::Reshape(CNTK::TransposeTimes(column, selector), { this->_numSampled }));
+                    labelLogit = CNTK::Plus(labelLogit, CNTK::Reshape(CNTK::TransposeTimes(column, labelSelector), { 1 }));
+                }
+                sampledLogits = CNTK::Plus(sampledLogits, sampling->Outputs()[1]);
+                labelLogit = CNTK::Plus(labelLogit, sampling->Outputs()[2]);
+
+                // -log(exp(label) / (exp(label) + sum(exp(sampled))))
+                return CNTK::Minus(CNTK::LogAddExp(labelLogit, CNTK::ReduceLogSum(sampledLogits, CNTK::Axis(0))), labelLogit);
             }
         };
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 namespace Chianti
 {
     namespace Nonlinearities
@@ -19,5 +21,74 @@ namespace Chianti
         {
             return x;
         }
+
+        /*!
+         * The logistic sigmoid 1 / (1 + exp(-x)).
+         */
+        inline CNTK::FunctionPtr sigmoid(CNTK::FunctionPtr x)
+        {
+            return CNTK::Sigmoid(x);
+        }
+
+        /*!
+         * The hyperbolic tangent.
+         */
+        inline CNTK::FunctionPtr tanh(CNTK::FunctionPtr x)
+        {
+            return CNTK::Tanh(x);
+        }
+
+        /*!
+         * The exponential linear unit: x for x > 0 and exp(x) - 1 otherwise.
+         */
+        inline CNTK::FunctionPtr elu(CNTK::FunctionPtr x)
+        {
+            return CNTK::ELU(x);
+        }
+
+        /*!
+         * The Gaussian error linear unit in its tanh formulation 0.5 x (1 + tanh(sqrt(2 / pi) (x + 0.044715 x^3))).
+         * It is computed as x * sigmoid(2 sqrt(2 / pi) (x + 0.044715 x^3)), which is the same function.
+         */
+        inline CNTK::FunctionPtr gelu(CNTK::FunctionPtr x)
+        {
+            auto cube = CNTK::ElementTimes(x, CNTK::ElementTimes(x, x));
+            auto inner = CNTK::Plus(x, CNTK::ElementTimes(CNTK::Constant::Scalar(0.044715f), cube));
+            return CNTK::ElementTimes(x, CNTK::Sigmoid(CNTK::ElementTimes(CNTK::Constant::Scalar(1.5957691216057308f), inner)));
+        }
+
+        /*!
+         * The swish (SiLU) non-linearity x * sigmoid(x).
+         */
+        inline CNTK::FunctionPtr swish(CNTK::FunctionPtr x)
+        {
+            return CNTK::ElementTimes(x, CNTK::Sigmoid(x));
+        }
+
+        /*!
+         * Returns the leaky ReLU non-linearity max(x, 0) + alpha * min(x, 0).
+         *
+         * @param alpha The slope for negative values
+         * @return The non-linearity
+         */
+        inline std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> leakyRectify(float alpha = 0.01f)
+        {
+            return [alpha](CNTK::FunctionPtr x) {
+                return CNTK::Minus(CNTK::ReLU(x), CNTK::ElementTimes(CNTK::Constant::Scalar(alpha), CNTK::ReLU(CNTK::Negate(x))));
+            };
+        }
+
+        /*!
+         * Returns the parametric ReLU non-linearity max(x, 0) + alpha * min(x, 0) with learned slopes.
+         *
+         * @param alpha The slopes for negative values, e.g. a parameter of shape (1, 1, channels) for convolutions
+         * @return The non-linearity
+         */
+        inline std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> parametricRectify(const CNTK::Variable & alpha)
+        {
+            return [alpha](CNTK::FunctionPtr x) {
+                return CNTK::Minus(CNTK::ReLU(x), CNTK::ElementTimes(alpha, CNTK::ReLU(CNTK::Negate(x))));
+            };
+        }
     }
 }
\ No newline at end of file
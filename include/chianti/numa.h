@@ -0,0 +1,413 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "util.h"
+#include "exception.h"
+#include "threading.h"
+#include "inference.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef CHIANTI_WITH_NUMA
+#include <numa.h>
+#endif
+
+namespace Chianti
+{
+    namespace Numa
+    {
+        /*!
+         * A memory node together with the CPUs that are attached to it.
+         */
+        struct Node
+        {
+            /*!
+             * The node id as reported by the operating system. Emulated nodes are numbered consecutively.
+             */
+            int id;
+            /*!
+             * The CPUs that belong to the node.
+             */
+            std::vector<int> cpus;
+        };
+
+        /*!
+         * Returns the CPUs the process may run on.
+         */
+        inline std::vector<int> allowedCpus()
+        {
+            std::vector<int> cpus;
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            {
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                {
+                    if (CPU_ISSET(cpu, &set))
+                    {
+                        cpus.push_back(cpu);
+                    }
+                }
+            }
+#endif
+            if (cpus.empty())
+            {
+                for (size_t cpu = 0; cpu < Threading::defaultNumThreads(); cpu++)
+                {
+                    cpus.push_back(static_cast<int>(cpu));
+                }
+            }
+            return cpus;
+        }
+
+        /*!
+         * The NUMA topology of the machine.
+         */
+        class Topology
+        {
+        public:
+            /*!
+             * Detects the topology. Without libnuma support (CHIANTI_WITH_NUMA) the machine is reported as a single
+             * node.
+             */
+            static Topology detect()
+            {
+                Topology topology;
+                const std::vector<int> cpus = allowedCpus();
+
+#ifdef CHIANTI_WITH_NUMA
+                if (numa_available() >= 0)
+                {
+                    for (int node = 0; node <= numa_max_node(); node++)
+                    {
+                        Node entry = {node, {}};
+                        for (int cpu : cpus)
+                        {
+                            if (numa_node_of_cpu(cpu) == node)
+                            {
+                                entry.cpus.push_back(cpu);
+                            }
+                        }
+
+                        if (!entry.cpus.empty())
+                        {
+                            topology._nodes.push_back(entry);
+                        }
+                    }
+                }
+#endif
+
+                if (topology._nodes.empty())
+                {
+                    topology._nodes.push_back({0, cpus});
+                }
+
+                return topology;
+            }
+
+            /*!
+             * Creates a synthetic topology by distributing the available CPUs round-robin over a number of nodes. If
+             * there are less CPUs than nodes, the nodes share CPUs. Memory placement is not affected by emulated nodes,
+             * only the partitioning of workers and parameter replicas is.
+             *
+             * @param numNodes The number of nodes
+             */
+            static Topology emulate(size_t numNodes)
+            {
+                Exception::assertArgument(numNodes > 0, "The number of nodes must be positive.");
+
+                Topology topology;
+                topology._emulated = true;
+                const std::vector<int> cpus = allowedCpus();
+
+                for (size_t node = 0; node < numNodes; node++)
+                {
+                    topology._nodes.push_back({static_cast<int>(node), {}});
+                }
+
+                for (size_t n = 0; n < std::max(numNodes, cpus.size()); n++)
+                {
+                    topology._nodes[n % numNodes].cpus.push_back(cpus[n % cpus.size()]);
+                }
+
+                return topology;
+            }
+
+            /*!
+             * Returns the nodes.
+             */
+            const std::vector<Node> & nodes() const
+            {
+                return this->_nodes;
+            }
+
+            /*!
+             * Returns true if the topology has been emulated.
+             */
+            bool emulated() const
+            {
+                return this->_emulated;
+            }
+
+            /*!
+             * Returns the index of the node the calling thread currently runs on.
+             */
+            size_t currentNode() const
+            {
+#ifdef __linux__
+                const int cpu = sched_getcpu();
+                for (size_t node = 0; node < this->_nodes.size(); node++)
+                {
+                    for (int candidate : this->_nodes[node].cpus)
+                    {
+                        if (candidate == cpu)
+                        {
+                            return node;
+                        }
+                    }
+                }
+#endif
+                return 0;
+            }
+
+            /*!
+             * Runs a function on a thread that is pinned to a node. On a real topology, all memory that is allocated
+             * by the function is placed on that node. With interleaving, the memory is spread over all nodes instead.
+             *
+             * @param node The index of the node
+             * @param interleave Whether to interleave the allocations over all nodes
+             * @param f The function
+             */
+            void runOnNode(size_t node, bool interleave, const std::function<void()> & f) const
+            {
+                Exception::assertArgument(node < this->_nodes.size(), "Invalid node index.");
+
+                std::exception_ptr error;
+                const bool emulated = this->_emulated;
+                const Node & target = this->_nodes[node];
+
+                std::thread thread([&]() {
+                    Threading::pinCurrentThread(target.cpus);
+#ifdef CHIANTI_WITH_NUMA
+                    if (!emulated && numa_available() >= 0)
+                    {
+                        if (interleave)
+                        {
+                            numa_set_interleave_mask(numa_all_nodes_ptr);
+                        }
+                        else
+                        {
+                            numa_set_preferred(target.id);
+                        }
+                    }
+#else
+                    (void) emulated;
+                    (void) interleave;
+#endif
+                    try
+                    {
+                        f();
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                });
+                thread.join();
+
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+
+        private:
+            Topology() :
+                    _emulated(false)
+            {}
+
+            /*!
+             * The nodes.
+             */
+            std::vector<Node> _nodes;
+            /*!
+             * Whether the topology has been emulated.
+             */
+            bool _emulated;
+        };
+
+        /*!
+         * A model that places its parameters according to the NUMA topology and routes every evaluation to the
+         * node-local parameters. The following placements are supported:
+         *
+         * - "replicate": Every node gets its own copy of the parameters, first-touched by a thread on that node.
+         * - "interleave": One copy of the parameters is interleaved page-wise over all nodes.
+         * - "none": The parameters are left where they have been allocated.
+         *
+         * Every node has its own execution context whose workers are pinned to the CPUs of that node.
+         */
+        class ReplicatedModel
+        {
+        public:
+            typedef ReplicatedModel Self;
+
+            /*!
+             * The parameter placement.
+             */
+            std::string _placement;
+            /*!
+             * The number of threads per node (0 means one thread per CPU).
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <ReplicatedModel> class.
+             *
+             * @param network The network
+             * @param device The device to compute on
+             * @param topology The topology
+             */
+            ReplicatedModel(const CNTK::FunctionPtr & network, const CNTK::DeviceDescriptor & device, const Topology & topology) :
+                    _placement("replicate"),
+                    _numThreads(0),
+                    network(network),
+                    device(device),
+                    topology(topology)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(placement, _placement)
+            MAKE_SETTER(placement, _placement)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Evaluates the network on the parameters of the node the calling thread runs on. This method can be
+             * called from several threads concurrently.
+             *
+             * @param input The input batch of shape (input shape, sequence, batch)
+             * @return The output batch of shape (output shape, sequence, batch)
+             */
+            Eigen::Tensor<float, 5> evaluate(const Eigen::Tensor<float, 5> & input)
+            {
+                return this->evaluate(input, this->topology.currentNode());
+            }
+
+            /*!
+             * Evaluates the network on the parameters of a specific node. This method can be called from several
+             * threads concurrently.
+             *
+             * @param input The input batch of shape (input shape, sequence, batch)
+             * @param node The index of the node
+             * @return The output batch of shape (output shape, sequence, batch)
+             */
+            Eigen::Tensor<float, 5> evaluate(const Eigen::Tensor<float, 5> & input, size_t node)
+            {
+                this->initialize();
+                Exception::assertArgument(node < this->models.size(), "Invalid node index.");
+                return this->models[node]->evaluate(input);
+            }
+
+            /*!
+             * Returns the networks that hold the parameters of the individual nodes.
+             */
+            std::vector<CNTK::FunctionPtr> networks()
+            {
+                this->initialize();
+
+                std::vector<CNTK::FunctionPtr> result;
+                for (const auto & network : this->replicas)
+                {
+                    result.push_back(network);
+                }
+                return result;
+            }
+
+        private:
+            /*!
+             * Places the parameters and creates the per-node models on first use.
+             */
+            void initialize()
+            {
+                std::call_once(this->initialized, [this]() {
+                    const auto & nodes = this->topology.nodes();
+                    this->replicas.resize(nodes.size());
+
+                    if (this->_placement == "replicate")
+                    {
+                        for (size_t node = 0; node < nodes.size(); node++)
+                        {
+                            this->topology.runOnNode(node, false, [this, node]() {
+                                this->replicas[node] = this->network->Clone(CNTK::ParameterCloningMethod::Clone);
+                            });
+                        }
+                    }
+                    else if (this->_placement == "interleave")
+                    {
+                        CNTK::FunctionPtr interleaved;
+                        this->topology.runOnNode(0, true, [this, &interleaved]() {
+                            interleaved = this->network->Clone(CNTK::ParameterCloningMethod::Clone);
+                        });
+                        std::fill(this->replicas.begin(), this->replicas.end(), interleaved);
+                    }
+                    else if (this->_placement == "none")
+                    {
+                        std::fill(this->replicas.begin(), this->replicas.end(), this->network);
+                    }
+                    else
+                    {
+                        throw Exception::IllegalArgumentException("Invalid placement. Must be replicate, interleave or none.");
+                    }
+
+                    for (size_t node = 0; node < nodes.size(); node++)
+                    {
+                        const size_t numThreads = this->_numThreads == 0 ? nodes[node].cpus.size() : this->_numThreads;
+                        std::unique_ptr<Inference::Model> model(new Inference::Model(this->replicas[node], this->device));
+                        model->context(std::make_shared<Threading::Context>(numThreads, nodes[node].cpus));
+                        this->models.push_back(std::move(model));
+                    }
+                });
+            }
+
+            /*!
+             * The original network.
+             */
+            CNTK::FunctionPtr network;
+            /*!
+             * The device to compute on.
+             */
+            CNTK::DeviceDescriptor device;
+            /*!
+             * The topology.
+             */
+            Topology topology;
+            /*!
+             * The networks that hold the parameters of the individual nodes.
+             */
+            std::vector<CNTK::FunctionPtr> replicas;
+            /*!
+             * The models of the individual nodes.
+             */
+            std::vector<std::unique_ptr<Inference::Model>> models;
+            /*!
+             * Guards the initialization.
+             */
+            std::once_flag initialized;
+        };
+    }
+}
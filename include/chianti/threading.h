@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unsupported/Eigen/CXX11/ThreadPool>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Chianti
+{
+    namespace Threading
+    {
+        /*!
+         * Returns the number of threads that is used when the caller does not specify anything.
+         *
+         * @return The number of hardware threads (at least 1)
+         */
+        inline size_t defaultNumThreads()
+        {
+            return std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+
+        /*!
+         * Restricts the calling thread to a set of CPUs. Pinning is a performance hint, hence, failures are ignored and
+         * platforms without affinity support leave the thread untouched.
+         *
+         * @param cpus The CPU ids. An empty list leaves the thread untouched.
+         * @return True if the thread has been pinned
+         */
+        inline bool pinCurrentThread(const std::vector<int> & cpus)
+        {
+#ifdef __linux__
+            if (cpus.empty())
+            {
+                return false;
+            }
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus)
+            {
+                CPU_SET(cpu, &set);
+            }
+            return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+            return false;
+#endif
+        }
+
+        namespace Internal
+        {
+            /*!
+             * A thread environment for the Eigen thread pool that pins every worker to a set of CPUs.
+             */
+            struct PinnedThreadEnvironment : public Eigen::StlThreadEnvironment
+            {
+                std::vector<int> cpus;
+
+                EnvThread * CreateThread(std::function<void()> f)
+                {
+                    const std::vector<int> cpus = this->cpus;
+                    return new EnvThread([cpus, f]() {
+                        pinCurrentThread(cpus);
+                        f();
+                    });
+                }
+            };
+        }
+
+        /*!
+         * An execution context owns a work-stealing thread pool on which all CPU work is scheduled. Several models that
+         * share one context do not oversubscribe the cores, no matter how many of them run concurrently.
+         */
+        class Context
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Context> class.
+             *
+             * @param numThreads The number of threads including the calling thread
+             * @param cpus The CPUs the workers are pinned to. If empty, the workers are not pinned.
+             */
+            explicit Context(size_t numThreads = defaultNumThreads(), const std::vector<int> & cpus = {}) :
+                    _numThreads(std::max<size_t>(1, numThreads))
+            {
+                // The calling thread always takes part in the work, so the pool needs one thread less
+                if (this->_numThreads > 1)
+                {
+                    Internal::PinnedThreadEnvironment environment;
+                    environment.cpus = cpus;
+                    this->pool.reset(new Eigen::NonBlockingThreadPoolTempl<Internal::PinnedThreadEnvironment>(static_cast<int>(this->_numThreads - 1), environment));
+                }
+            }
+
+            /*!
+             * Returns the number of threads including the calling thread.
+             */
+            size_t numThreads() const
+            {
+                return this->_numThreads;
+            }
+
+            /*!
+             * Returns true if the calling thread is a worker of this context.
+             */
+            bool isWorker() const
+            {
+                return this->pool && this->pool->CurrentThreadId() >= 0;
+            }
+
+            /*!
+             * Splits the range [0, n) into contiguous blocks and processes them on up to numThreads threads. The calling
+             * thread processes the first block itself. Exceptions thrown by any block are re-thrown on the calling
+             * thread. Calls from within a worker of this context are processed serially in order to avoid deadlocks.
+             *
+             * @param n The number of work items
+             * @param numThreads The maximum number of threads to use
+             * @param f The work function. It is called with a half-open range [begin, end).
+             */
+            void parallelFor(size_t n, size_t numThreads, const std::function<void(size_t, size_t)> & f)
+            {
+                numThreads = std::min(std::min(std::max<size_t>(1, numThreads), this->_numThreads), n);
+
+                if (numThreads <= 1 || this->isWorker())
+                {
+                    if (n > 0)
+                    {
+                        f(0, n);
+                    }
+                    return;
+                }
+
+                // Distribute the remainder over the first blocks
+                const size_t blockSize = n / numThreads;
+                const size_t remainder = n % numThreads;
+
+                std::vector<std::exception_ptr> errors(numThreads);
+                std::mutex mutex;
+                std::condition_variable done;
+                size_t pending = numThreads - 1;
+
+                size_t begin = blockSize + (remainder > 0 ? 1 : 0);
+                for (size_t t = 1; t < numThreads; t++)
+                {
+                    const size_t end = begin + blockSize + (t < remainder ? 1 : 0);
+                    this->pool->Schedule([&f, &errors, &mutex, &done, &pending, t, begin, end]() {
+                        try
+                        {
+                            f(begin, end);
+                        }
+                        catch (...)
+                        {
+                            errors[t] = std::current_exception();
+                        }
+
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (--pending == 0)
+                        {
+                            done.notify_one();
+                        }
+                    });
+                    begin = end;
+                }
+
+                try
+                {
+                    f(0, blockSize + (remainder > 0 ? 1 : 0));
+                }
+                catch (...)
+                {
+                    errors[0] = std::current_exception();
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    done.wait(lock, [&pending]() { return pending == 0; });
+                }
+
+                for (auto & error : errors)
+                {
+                    if (error)
+                    {
+                        std::rethrow_exception(error);
+                    }
+                }
+            }
+
+            /*!
+             * Returns the process-wide context that is used when no other context has been selected.
+             */
+            static std::shared_ptr<Context> global()
+            {
+                static std::shared_ptr<Context> context = std::make_shared<Context>();
+                return context;
+            }
+
+        private:
+            /*!
+             * The number of threads including the calling thread.
+             */
+            size_t _numThreads;
+            /*!
+             * The worker threads.
+             */
+            std::unique_ptr<Eigen::ThreadPoolInterface> pool;
+        };
+
+        namespace Internal
+        {
+            /*!
+             * The execution settings of the calling thread.
+             */
+            struct ScopeState
+            {
+                Context * context;
+                size_t numThreads;
+            };
+
+            /*!
+             * Returns the execution settings of the calling thread.
+             */
+            inline ScopeState & scopeState()
+            {
+                static thread_local ScopeState state = {nullptr, 0};
+                return state;
+            }
+        }
+
+        /*!
+         * Selects the context and the thread limit for all parallel work that is launched by the calling thread for the
+         * lifetime of the scope. Scopes can be nested, the innermost scope wins.
+         */
+        class Scope
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <Scope> class.
+             *
+             * @param context The context to run on. It must outlive the scope.
+             * @param numThreads The maximum number of threads that may be used (0 means all threads of the context)
+             */
+            Scope(Context & context, size_t numThreads = 0) :
+                    previous(Internal::scopeState())
+            {
+                Internal::scopeState() = {&context, numThreads == 0 ? context.numThreads() : numThreads};
+            }
+
+            ~Scope()
+            {
+                Internal::scopeState() = this->previous;
+            }
+
+            Scope(const Scope &) = delete;
+            Scope & operator=(const Scope &) = delete;
+
+        private:
+            /*!
+             * The settings that were active before the scope was entered.
+             */
+            Internal::ScopeState previous;
+        };
+
+        /*!
+         * Returns the context of the innermost scope or the global context if there is none.
+         */
+        inline Context & currentContext()
+        {
+            Context * context = Internal::scopeState().context;
+            return context != nullptr ? *context : *Context::global();
+        }
+
+        /*!
+         * Returns the thread limit of the innermost scope or the size of the global context if there is none.
+         */
+        inline size_t currentNumThreads()
+        {
+            return Internal::scopeState().context != nullptr ? Internal::scopeState().numThreads : Context::global()->numThreads();
+        }
+
+        /*!
+         * Runs a parallel loop on the current context. The number of threads is additionally limited by the current
+         * scope.
+         *
+         * @param n The number of work items
+         * @param numThreads The maximum number of threads to use
+         * @param f The work function. It is called with a half-open range [begin, end).
+         */
+        inline void parallelFor(size_t n, size_t numThreads, const std::function<void(size_t, size_t)> & f)
+        {
+            currentContext().parallelFor(n, std::min(numThreads, currentNumThreads()), f);
+        }
+
+        /*!
+         * Runs a parallel loop on the current context using as many threads as the current scope permits.
+         *
+         * @param n The number of work items
+         * @param f The work function. It is called with a half-open range [begin, end).
+         */
+        inline void parallelFor(size_t n, const std::function<void(size_t, size_t)> & f)
+        {
+            parallelFor(n, currentNumThreads(), f);
+        }
+    }
+}
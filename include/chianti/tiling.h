@@ -0,0 +1,471 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "layers.h"
+#include "util.h"
+#include "values.h"
+#include "exception.h"
+#include "threading.h"
+
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Tiling
+    {
+        /*!
+         * Describes how the output of a layer stack depends on its input along one spatial axis.
+         *
+         * Output pixel o depends at most on the input pixels [o * step - lower, o * step + upper] where
+         * step = numerator / denominator is the number of input pixels per output pixel. The bounds are conservative.
+         */
+        class AxisGeometry
+        {
+        public:
+            /*!
+             * Initializes the geometry of the identity mapping.
+             */
+            AxisGeometry() : numerator(1), denominator(1), lower(0), upper(0), alignment(1) {}
+
+            /*!
+             * The number of input pixels per output pixel (numerator / denominator).
+             */
+            int64_t numerator, denominator;
+            /*!
+             * The receptive field extent below and above the anchor of an output pixel (in input pixels).
+             */
+            double lower, upper;
+            /*!
+             * Tiles must start at multiples of this value such that every intermediate feature map of a tile is an
+             * integer aligned window of the feature map of the whole image.
+             */
+            int64_t alignment;
+
+            /*!
+             * Returns the number of input pixels per output pixel.
+             */
+            double step() const
+            {
+                return static_cast<double>(this->numerator) / this->denominator;
+            }
+
+            /*!
+             * Adds a sliding window operation (convolution or pooling).
+             *
+             * @param size The window size
+             * @param stride The window stride
+             * @param minLowerPad The smallest possible amount of padding before the first pixel
+             * @param maxLowerPad The largest possible amount of padding before the first pixel
+             */
+            void addWindow(int64_t size, int64_t stride, int64_t minLowerPad, int64_t maxLowerPad)
+            {
+                const double J = this->step();
+                this->lower += maxLowerPad * J;
+                this->upper += (size - 1 - minLowerPad) * J;
+                this->numerator *= stride;
+                this->normalize();
+                this->alignment = lcm(this->alignment, this->numerator);
+            }
+
+            /*!
+             * Adds a nearest neighbour upscaling operation.
+             *
+             * @param factor The upscale factor
+             */
+            void addUpscale(int64_t factor)
+            {
+                // Output pixel q reads input pixel floor(q / factor), which is at most (factor - 1) / factor below q / factor
+                this->lower += this->step() * (factor - 1) / factor;
+                this->denominator *= factor;
+                this->normalize();
+            }
+
+        private:
+            /*!
+             * Brings the step into lowest terms.
+             */
+            void normalize()
+            {
+                const int64_t d = gcd(this->numerator, this->denominator);
+                this->numerator /= d;
+                this->denominator /= d;
+            }
+
+            /*!
+             * Greatest common divisor.
+             */
+            static int64_t gcd(int64_t a, int64_t b)
+            {
+                while (b != 0)
+                {
+                    const int64_t t = a % b;
+                    a = b;
+                    b = t;
+                }
+                return a;
+            }
+
+            /*!
+             * Least common multiple.
+             */
+            static int64_t lcm(int64_t a, int64_t b)
+            {
+                return a / gcd(a, b) * b;
+            }
+        };
+
+        /*!
+         * A tile along one axis.
+         */
+        struct AxisTile
+        {
+            /*!
+             * The input range [inputBegin, inputEnd) that is fed to the network.
+             */
+            int64_t inputBegin, inputEnd;
+            /*!
+             * The output range [outputBegin, outputEnd) that this tile contributes to the stitched result.
+             */
+            int64_t outputBegin, outputEnd;
+            /*!
+             * The index of the first output pixel of the tile in the stitched result.
+             */
+            int64_t outputOffset;
+        };
+
+        /*!
+         * Splits an axis into overlapping tiles.
+         *
+         * @param geometry The geometry of the network along the axis
+         * @param inputSize The size of the whole input
+         * @param outputSize The size of the whole output
+         * @param tileSize The (approximate) number of input pixels that each tile contributes to the output
+         * @return The tiles
+         */
+        inline std::vector<AxisTile> planAxis(const AxisGeometry & geometry, int64_t inputSize, int64_t outputSize, int64_t tileSize)
+        {
+            Exception::assertArgument(tileSize > 0, "The tile size must be positive.");
+
+            // The core of every tile spans a multiple of the alignment. Hence, all interior tiles have the same shape.
+            const int64_t A = geometry.alignment;
+            const int64_t inputStep = std::max<int64_t>(1, tileSize / A) * A;
+            const int64_t outputStep = inputStep * geometry.denominator / geometry.numerator;
+            const double J = geometry.step();
+
+            std::vector<AxisTile> tiles;
+            for (int64_t q0 = 0; q0 < outputSize; q0 += outputStep)
+            {
+                const int64_t q1 = std::min(q0 + outputStep, outputSize);
+
+                AxisTile tile;
+                const int64_t begin = static_cast<int64_t>(std::floor(q0 * J - geometry.lower));
+                const int64_t end = static_cast<int64_t>(std::ceil((q1 - 1) * J + geometry.upper)) + 1;
+
+                // Align the start such that all intermediate feature maps are aligned to the whole image. The length
+                // is made congruent to the input size modulo the alignment such that automatic padding, which may
+                // depend on the length, is the same as for the whole image.
+                tile.inputBegin = begin > 0 ? begin / A * A : 0;
+                const int64_t length = end - tile.inputBegin;
+                const int64_t residue = ((inputSize - length) % A + A) % A;
+                tile.inputEnd = std::min(inputSize, tile.inputBegin + length + residue);
+                tile.outputBegin = q0;
+                tile.outputEnd = q1;
+                tile.outputOffset = tile.inputBegin * geometry.denominator / geometry.numerator;
+                tiles.push_back(tile);
+            }
+
+            return tiles;
+        }
+
+        /*!
+         * Records the spatial geometry of a layer stack from the layer configurations.
+         */
+        class Geometry
+        {
+        public:
+            /*!
+             * Returns the geometry along an axis (0: width, 1: height).
+             */
+            const AxisGeometry & axis(size_t i) const
+            {
+                return this->axes[i];
+            }
+
+            /*!
+             * Adds a convolution layer.
+             */
+            Geometry & add(const Layers::Conv2DLayer & layer)
+            {
+                for (size_t i = 0; i < 2; i++)
+                {
+                    const int64_t k = static_cast<int64_t>(layer.filterSize()[i]);
+                    const int64_t s = static_cast<int64_t>(layer.stride()[i]);
+                    const auto pad = layer.pad();
+
+                    if (Values::isActive<0>(pad))
+                    {
+                        const int64_t p = static_cast<int64_t>(Values::get<0>(pad)[i]);
+                        this->axes[i].addWindow(k, s, p, p);
+                    }
+                    else if (Values::get<1>(pad) == "full")
+                    {
+                        this->axes[i].addWindow(k, s, k, k);
+                    }
+                    else if (Values::get<1>(pad) == "valid")
+                    {
+                        this->axes[i].addWindow(k, s, 0, 0);
+                    }
+                    else
+                    {
+                        // Automatic padding centers the filter
+                        this->axes[i].addWindow(k, s, (k - 1) / 2, k / 2);
+                    }
+                }
+                return *this;
+            }
+
+            /*!
+             * Adds a pooling layer.
+             */
+            Geometry & add(const Layers::AbstractPool2DLayer & layer)
+            {
+                for (size_t i = 0; i < 2; i++)
+                {
+                    const int64_t k = static_cast<int64_t>(layer.poolSize()[i]);
+                    const int64_t s = static_cast<int64_t>(layer.stride()[i]);
+                    const auto pad = layer.pad();
+
+                    if (Values::isActive<0>(pad))
+                    {
+                        const int64_t p = static_cast<int64_t>(Values::get<0>(pad)[i]);
+                        this->axes[i].addWindow(k, s, p, p);
+                    }
+                    else if ((Values::isActive<1>(pad) && Values::get<1>(pad) == "none") || (Values::isActive<2>(pad) && !Values::get<2>(pad)))
+                    {
+                        this->axes[i].addWindow(k, s, 0, 0);
+                    }
+                    else
+                    {
+                        this->axes[i].addWindow(k, s, 0, k / 2);
+                    }
+                }
+                return *this;
+            }
+
+            /*!
+             * Adds an upscale layer.
+             */
+            Geometry & add(const Layers::Upscale2DLayer & layer)
+            {
+                for (size_t i = 0; i < 2; i++)
+                {
+                    this->axes[i].addUpscale(static_cast<int64_t>(layer.scaleFactor()[i]));
+                }
+                return *this;
+            }
+
+            /*!
+             * Adds a point-wise layer (drop-out, batch normalization). These do not change the geometry.
+             */
+            Geometry & add(const Layers::AbstractNonDeterministicLayer &)
+            {
+                return *this;
+            }
+
+            /*!
+             * Adds a layer and returns it. This allows recording layers while the network is defined:
+             *
+             *     network = geometry.record(Conv2DLayer(network, device).filterSize({3, 3}));
+             *
+             * @param layer The layer
+             * @return The layer
+             */
+            template <class Layer>
+            const Layer & record(const Layer & layer)
+            {
+                this->add(layer);
+                return layer;
+            }
+
+        private:
+            /*!
+             * The geometry of the width and the height axis.
+             */
+            AxisGeometry axes[2];
+        };
+
+        /*!
+         * Runs a fully convolutional network on images that are too large to be processed at once. The image is split
+         * into overlapping tiles with exactly the halo that the receptive field requires. Tiles of the same shape are
+         * processed in batches and the outputs are stitched such that the result equals whole-image inference.
+         *
+         * The network is defined by a factory that receives the input variable and a <Geometry> object in which all
+         * spatial layers must be recorded. The factory is called once per distinct tile shape.
+         */
+        class TiledInference
+        {
+        public:
+            typedef TiledInference Self;
+            typedef std::function<CNTK::FunctionPtr(CNTK::Variable, Geometry &)> NetworkFactory;
+
+            /*!
+             * The (approximate) size (width, height) of the input region that each tile contributes.
+             */
+            Values::ArrayValue<uint64_t, 2> _tileSize;
+            /*!
+             * The maximum number of tiles per forward pass.
+             */
+            size_t _batchSize;
+            /*!
+             * The number of threads that cut and stitch tiles.
+             */
+            size_t _numThreads;
+
+        public:
+            /*!
+             * Initializes a new instance of the <TiledInference> class.
+             *
+             * @param factory The network factory
+             * @param device The device on which the network is evaluated
+             */
+            TiledInference(const NetworkFactory & factory, const CNTK::DeviceDescriptor & device) :
+                    _tileSize{512, 512},
+                    _batchSize(4),
+                    _numThreads(Threading::defaultNumThreads()),
+                    factory(factory),
+                    device(device)
+            {}
+
+            // Define the getters and setters for the individual class members
+
+            MAKE_GETTER(tileSize, _tileSize)
+            MAKE_SETTER(tileSize, _tileSize)
+
+            MAKE_GETTER(batchSize, _batchSize)
+            MAKE_SETTER(batchSize, _batchSize)
+
+            MAKE_GETTER(numThreads, _numThreads)
+            MAKE_SETTER(numThreads, _numThreads)
+
+            /*!
+             * Runs the network on an image.
+             *
+             * @param image The image. Shape: (width, height, channels)
+             * @return The network output. Shape: (width, height, channels)
+             */
+            Eigen::Tensor<float, 3> run(const Eigen::Tensor<float, 3> & image)
+            {
+                const int64_t width = image.dimension(0);
+                const int64_t height = image.dimension(1);
+                const int64_t numChannels = image.dimension(2);
+
+                // Building the graph for the whole image only infers shapes. No activations are allocated.
+                Geometry geometry;
+                auto X = CNTK::InputVariable({static_cast<size_t>(width), static_cast<size_t>(height), static_cast<size_t>(numChannels)}, CNTK::DataType::Float);
+                const CNTK::NDShape wholeShape = this->factory(X, geometry)->Output().Shape();
+                Exception::assertArgument(wholeShape.Rank() == 3, "The network output must have rank 3.");
+
+                const int64_t outputWidth = static_cast<int64_t>(wholeShape[0]);
+                const int64_t outputHeight = static_cast<int64_t>(wholeShape[1]);
+                const int64_t numOutputChannels = static_cast<int64_t>(wholeShape[2]);
+
+                const auto xTiles = planAxis(geometry.axis(0), width, outputWidth, static_cast<int64_t>(this->_tileSize[0]));
+                const auto yTiles = planAxis(geometry.axis(1), height, outputHeight, static_cast<int64_t>(this->_tileSize[1]));
+
+                // Group the tiles by their shape
+                std::map<std::pair<int64_t, int64_t>, std::vector<std::pair<AxisTile, AxisTile>>> groups;
+                for (const auto & yTile : yTiles)
+                {
+                    for (const auto & xTile : xTiles)
+                    {
+                        groups[{xTile.inputEnd - xTile.inputBegin, yTile.inputEnd - yTile.inputBegin}].push_back({xTile, yTile});
+                    }
+                }
+
+                Eigen::Tensor<float, 3> result(outputWidth, outputHeight, numOutputChannels);
+
+                for (const auto & group : groups)
+                {
+                    const int64_t tileWidth = group.first.first;
+                    const int64_t tileHeight = group.first.second;
+                    const auto & tiles = group.second;
+
+                    Geometry unused;
+                    auto tileX = CNTK::InputVariable({static_cast<size_t>(tileWidth), static_cast<size_t>(tileHeight), static_cast<size_t>(numChannels)}, CNTK::DataType::Float);
+                    CNTK::FunctionPtr network = this->factory(tileX, unused);
+                    auto outputVar = network->Output();
+                    const int64_t tileOutputWidth = static_cast<int64_t>(outputVar.Shape()[0]);
+                    const int64_t tileOutputHeight = static_cast<int64_t>(outputVar.Shape()[1]);
+
+                    for (size_t first = 0; first < tiles.size(); first += this->_batchSize)
+                    {
+                        const size_t count = std::min(this->_batchSize, tiles.size() - first);
+
+                        // Cut the tiles out of the image
+                        Eigen::Tensor<float, 5> input(tileWidth, tileHeight, numChannels, 1, static_cast<int64_t>(count));
+                        Threading::parallelFor(count, this->_numThreads, [&](size_t begin, size_t end) {
+                            for (size_t n = begin; n < end; n++)
+                            {
+                                const AxisTile & xTile = tiles[first + n].first;
+                                const AxisTile & yTile = tiles[first + n].second;
+
+                                for (int64_t c = 0; c < numChannels; c++)
+                                {
+                                    for (int64_t y = 0; y < tileHeight; y++)
+                                    {
+                                        const float* in = &image(xTile.inputBegin, yTile.inputBegin + y, c);
+                                        std::copy(in, in + tileWidth, &input(0, y, c, 0, static_cast<int64_t>(n)));
+                                    }
+                                }
+                            }
+                        });
+
+                        Eigen::Tensor<float, 5> output(tileOutputWidth, tileOutputHeight, numOutputChannels, 1, static_cast<int64_t>(count));
+                        auto inputValue = Util::tensorToValue(input);
+                        auto outputValue = Util::tensorToValue(output);
+                        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+                        network->Forward({{tileX, inputValue}}, outputs, this->device);
+
+                        // Stitch the cores of the tiles into the result
+                        Threading::parallelFor(count, this->_numThreads, [&](size_t begin, size_t end) {
+                            for (size_t n = begin; n < end; n++)
+                            {
+                                const AxisTile & xTile = tiles[first + n].first;
+                                const AxisTile & yTile = tiles[first + n].second;
+                                const int64_t coreWidth = xTile.outputEnd - xTile.outputBegin;
+
+                                for (int64_t c = 0; c < numOutputChannels; c++)
+                                {
+                                    for (int64_t y = yTile.outputBegin; y < yTile.outputEnd; y++)
+                                    {
+                                        const float* out = &output(xTile.outputBegin - xTile.outputOffset, y - yTile.outputOffset, c, 0, static_cast<int64_t>(n));
+                                        std::copy(out, out + coreWidth, &result(xTile.outputBegin, y, c));
+                                    }
+                                }
+                            }
+                        });
+                    }
+                }
+
+                return result;
+            }
+
+        private:
+            /*!
+             * The network factory.
+             */
+            NetworkFactory factory;
+            /*!
+             * The device on which the network is evaluated.
+             */
+            CNTK::DeviceDescriptor device;
+        };
+    }
+}
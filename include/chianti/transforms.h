@@ -0,0 +1,296 @@
+#pragma once
+
+#include "CNTKLibrary.h"
+#include "layers.h"
+#include "util.h"
+#include "values.h"
+#include "exception.h"
+#include "nonlinearities.h"
+
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <string>
+#include <vector>
+
+namespace Chianti
+{
+    namespace Transforms
+    {
+        /*!
+         * A Conv2DLayer whose weights absorbed a per-channel input normalization (x * inputScale - mean) / std.
+         *
+         * Zero padding is applied to the raw input instead of the normalized input. Wherever this matters (i.e. at
+         * the image borders), a constant correction map is added to the convolution output such that the result is
+         * identical to the original layer applied to normalized inputs. If the padding geometry cannot be determined
+         * exactly (automatic padding with strides or even filter sizes), no correction is added and <exact> returns
+         * false; the output is then only exact away from the borders.
+         */
+        class FoldedConv2DLayer : public Layers::AbstractLayer
+        {
+        public:
+            /*!
+             * Initializes a new instance of the <FoldedConv2DLayer> class.
+             *
+             * @param layer The convolution layer with the folded weights and bias.
+             * @param borderCorrection The correction map of shape (outputWidth, outputHeight, numFilters). May be empty.
+             * @param exact Whether or not the folded layer is exact everywhere.
+             * @param device The device where the parameters of the layer shall be stored.
+             */
+            FoldedConv2DLayer(const Layers::Conv2DLayer & layer, const Eigen::Tensor<float, 3> & borderCorrection, bool exact, const CNTK::DeviceDescriptor & device) :
+                    AbstractLayer(device),
+                    _layer(layer),
+                    _borderCorrection(borderCorrection),
+                    _exact(exact)
+            {}
+
+            /*!
+             * Returns the convolution layer with the folded parameters.
+             */
+            const Layers::Conv2DLayer & layer() const
+            {
+                return this->_layer;
+            }
+
+            /*!
+             * Returns the constant map that is added to the convolution output (empty if there is none).
+             */
+            const Eigen::Tensor<float, 3> & borderCorrection() const
+            {
+                return this->_borderCorrection;
+            }
+
+            /*!
+             * Returns whether or not the folded layer reproduces the original layer everywhere.
+             */
+            bool exact() const
+            {
+                return this->_exact;
+            }
+
+            /*!
+             * Converts the Chianti layer into a CNTK node.
+             *
+             * @return The CNTK node.
+             */
+            CNTK::FunctionPtr build() const
+            {
+                if (this->_borderCorrection.size() == 0)
+                {
+                    return this->_layer.build();
+                }
+
+                // The correction has to be added before the non-linearity and the global pooling are applied
+                Layers::Conv2DLayer linearLayer = this->_layer;
+                linearLayer.nonLinearity(Nonlinearities::linear);
+                linearLayer.globalPooling("none");
+                CNTK::FunctionPtr network = linearLayer.build();
+
+                const auto & dimensions = this->_borderCorrection.dimensions();
+                CNTK::NDShape correctionShape = {static_cast<size_t>(dimensions[0]), static_cast<size_t>(dimensions[1]), static_cast<size_t>(dimensions[2])};
+                auto view = Util::tensorToView<3, float>(this->_borderCorrection);
+                auto correction = CNTK::MakeSharedObject<CNTK::NDArrayView>(CNTK::DataType::Float, correctionShape, this->device);
+                correction->CopyFrom(*view);
+
+                network = CNTK::Plus(network, CNTK::Constant(correction));
+                network = this->_layer.nonLinearity()(network);
+
+                const std::string globalPooling = this->_layer.globalPooling();
+                if (globalPooling != "none")
+                {
+                    const std::string algorithm = this->_layer.algorithm() == "cntk" ? "cntk" : "reduce";
+                    network = Functions::globalPool2D(network, Kernels::parseGlobalPooling(globalPooling), algorithm);
+                }
+
+                return network;
+            }
+
+        private:
+            /*!
+             * The convolution layer with the folded parameters.
+             */
+            Layers::Conv2DLayer _layer;
+            /*!
+             * The correction map for the image borders.
+             */
+            Eigen::Tensor<float, 3> _borderCorrection;
+            /*!
+             * Whether or not the layer is exact everywhere.
+             */
+            bool _exact;
+        };
+
+        /*!
+         * Folds a per-channel input normalization into the first convolution layer of a network. The original layer
+         * computes conv(W, (x * inputScale - mean) / std) + b. The folded layer computes the same function directly on
+         * the raw input x, which saves one full-resolution pass over every image.
+         *
+         * The layer's filter kernel must be given as Eigen tensor. The bias must either be given as Eigen tensor or be
+         * disabled.
+         *
+         * @param layer The original convolution layer
+         * @param mean The per-channel mean
+         * @param std The per-channel standard deviation
+         * @param inputScale A scale factor that is applied to the raw input before normalization (e.g. 1/255 for uint8 images)
+         * @param device The device where the parameters of the layer shall be stored.
+         * @return The folded layer
+         */
+        inline FoldedConv2DLayer foldInputNormalization(
+                const Layers::Conv2DLayer & layer,
+                const std::vector<float> & mean,
+                const std::vector<float> & std,
+                float inputScale,
+                const CNTK::DeviceDescriptor & device)
+        {
+            Exception::assertArgument(Values::isActive<0>(layer.W()), "Folding requires the filter kernel to be given as tensor.");
+            Exception::assertArgument(!Values::isActive<1>(layer.b()), "Folding requires the bias to be given as tensor or to be disabled.");
+
+            const Eigen::Tensor<float, 4> W = Values::get<0>(layer.W());
+            const int filterWidth = static_cast<int>(W.dimension(0));
+            const int filterHeight = static_cast<int>(W.dimension(1));
+            const int numChannels = static_cast<int>(W.dimension(2));
+            const int numFilters = static_cast<int>(W.dimension(3));
+
+            Exception::assertArgument(mean.size() == static_cast<size_t>(numChannels), "There must be one mean per input channel.");
+            Exception::assertArgument(std.size() == static_cast<size_t>(numChannels), "There must be one standard deviation per input channel.");
+
+            // Fold the scaling into the filter kernel and the shift into the bias
+            // -------------------------------------------------------------------
+            Eigen::Tensor<float, 4> foldedW(filterWidth, filterHeight, numChannels, numFilters);
+            // shift(i, j, f) is the contribution of the mean of a single filter tap
+            Eigen::Tensor<float, 3> shift(filterWidth, filterHeight, numFilters);
+            shift.setZero();
+
+            for (int f = 0; f < numFilters; f++)
+            {
+                for (int c = 0; c < numChannels; c++)
+                {
+                    for (int j = 0; j < filterHeight; j++)
+                    {
+                        for (int i = 0; i < filterWidth; i++)
+                        {
+                            foldedW(i, j, c, f) = W(i, j, c, f) * inputScale / std[c];
+                            shift(i, j, f) += W(i, j, c, f) * mean[c] / std[c];
+                        }
+                    }
+                }
+            }
+
+            Eigen::Tensor<float, 3> foldedB(1, 1, numFilters);
+            if (Values::isActive<0>(layer.b()))
+            {
+                foldedB = Values::get<0>(layer.b());
+            }
+            else
+            {
+                foldedB.setZero();
+            }
+
+            for (int f = 0; f < numFilters; f++)
+            {
+                for (int j = 0; j < filterHeight; j++)
+                {
+                    for (int i = 0; i < filterWidth; i++)
+                    {
+                        foldedB(0, 0, f) -= shift(i, j, f);
+                    }
+                }
+            }
+
+            Layers::Conv2DLayer folded = layer;
+            folded.W(foldedW).b(foldedB);
+
+            // Determine the padding geometry
+            // ------------------------------
+            bool known = true;
+            int padX = 0;
+            int padY = 0;
+
+            if (Values::isActive<0>(layer.pad()))
+            {
+                padX = static_cast<int>(Values::get<0>(layer.pad())[0]);
+                padY = static_cast<int>(Values::get<0>(layer.pad())[1]);
+            }
+            else
+            {
+                const auto & padding = Values::get<1>(layer.pad());
+
+                if (padding == "full")
+                {
+                    padX = filterWidth;
+                    padY = filterHeight;
+                }
+                else if (padding == "same")
+                {
+                    // Automatic padding is only symmetric and independent of the input size for odd filters and unit strides
+                    known = filterWidth % 2 == 1 && filterHeight % 2 == 1 && layer.stride()[0] == 1 && layer.stride()[1] == 1;
+                    padX = (filterWidth - 1) / 2;
+                    padY = (filterHeight - 1) / 2;
+                }
+            }
+
+            Eigen::Tensor<float, 3> correction;
+
+            if (padX == 0 && padY == 0)
+            {
+                // Without padding the folding is always exact
+                return FoldedConv2DLayer(folded, correction, true, device);
+            }
+
+            if (!known)
+            {
+                return FoldedConv2DLayer(folded, correction, false, device);
+            }
+
+            // Compute the border correction
+            // -----------------------------
+            // In the original layer, padded taps contribute nothing. In the folded layer, the folded bias still
+            // subtracts their share of the mean. Hence, this share has to be added back at the borders.
+            const auto & inputShape = layer.inputVariable().Shape();
+            const int width = static_cast<int>(inputShape[0]);
+            const int height = static_cast<int>(inputShape[1]);
+            const int strideX = static_cast<int>(layer.stride()[0]);
+            const int strideY = static_cast<int>(layer.stride()[1]);
+            const int outputWidth = (width + 2 * padX - filterWidth) / strideX + 1;
+            const int outputHeight = (height + 2 * padY - filterHeight) / strideY + 1;
+
+            correction.resize(outputWidth, outputHeight, numFilters);
+            correction.setZero();
+
+            for (int oy = 0; oy < outputHeight; oy++)
+            {
+                const int y0 = oy * strideY - padY;
+
+                for (int ox = 0; ox < outputWidth; ox++)
+                {
+                    const int x0 = ox * strideX - padX;
+
+                    if (x0 >= 0 && y0 >= 0 && x0 + filterWidth <= width && y0 + filterHeight <= height)
+                    {
+                        // The filter lies completely inside the image
+                        continue;
+                    }
+
+                    for (int j = 0; j < filterHeight; j++)
+                    {
+                        for (int i = 0; i < filterWidth; i++)
+                        {
+                            const int x = x0 + i;
+                            const int y = y0 + j;
+
+                            if (x >= 0 && y >= 0 && x < width && y < height)
+                            {
+                                continue;
+                            }
+
+                            for (int f = 0; f < numFilters; f++)
+                            {
+                                correction(ox, oy, f) += shift(i, j, f);
+                            }
+                        }
+                    }
+                }
+            }
+
+            return FoldedConv2DLayer(folded, correction, true, device);
+        }
+    }
+}
@@ -6,6 +6,17 @@
 #include "CNTKLibrary.h"
 #include <unsupported/Eigen/CXX11/Tensor>
 
+#define MAKE_SETTER(functionName, parameterName) \
+Self & functionName(const decltype(parameterName) & parameterName) {\
+    this->parameterName = parameterName; \
+    return *this; \
+}
+
+#define MAKE_GETTER(functionName, parameterName) \
+decltype(parameterName) functionName() const {\
+    return this->parameterName; \
+}
+
 namespace Chianti
 {
     namespace Util
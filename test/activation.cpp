@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/activation.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    using Chianti::Kernels::Activation;
+    using Chianti::Kernels::ActivationAccuracy;
+
+    /*!
+     * Returns the number of representable floats between two values.
+     */
+    int64_t ulpDistance(float a, float b)
+    {
+        auto ordered = [](float value) {
+            int32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits < 0 ? static_cast<int64_t>(INT32_MIN) - bits : static_cast<int64_t>(bits);
+        };
+        return std::abs(ordered(a) - ordered(b));
+    }
+
+    /*!
+     * The activation functions in long double precision.
+     */
+    long double reference(Activation activation, long double x)
+    {
+        switch (activation)
+        {
+            case Activation::Identity:
+                return x;
+            case Activation::ReLU:
+                return x > 0 ? x : 0;
+            case Activation::Sigmoid:
+                return 1 / (1 + std::exp(-x));
+            case Activation::Tanh:
+                return std::tanh(x);
+            case Activation::ELU:
+                return x > 0 ? x : std::expm1(x);
+            case Activation::GELU:
+                // 0.5 x (1 + tanh(z)) = x / (1 + exp(-2 z)) does not cancel for negative values
+                return x / (1 + std::exp(-2 * std::sqrt(2 / 3.14159265358979323846L) * (x + 0.044715L * x * x * x)));
+            case Activation::Swish:
+                return x / (1 + std::exp(-x));
+        }
+        return x;
+    }
+
+    /*!
+     * Returns the maximum error in ULP over a range of inputs. Results below the normal range are skipped, the
+     * approximations are not accurate for denormals.
+     */
+    template<typename Apply>
+    int64_t maxUlpError(Activation activation, Apply apply, float low, float high)
+    {
+        const size_t size = 200001;
+        std::vector<float> values(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            values[i] = low + (high - low) * static_cast<float>(i) / static_cast<float>(size - 1);
+        }
+
+        auto results = values;
+        apply(results.data(), results.size());
+
+        int64_t error = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            const float expected = static_cast<float>(reference(activation, values[i]));
+            if (std::abs(expected) < std::numeric_limits<float>::min())
+            {
+                continue;
+            }
+            error = std::max(error, ulpDistance(expected, results[i]));
+        }
+        return error;
+    }
+
+    int64_t maxUlpError(Activation activation, ActivationAccuracy accuracy, float low, float high)
+    {
+        return maxUlpError(activation, [=](float * data, size_t size) {
+            Chianti::Kernels::applyActivation(activation, accuracy, data, size);
+        }, low, high);
+    }
+}
+
+TEST(Activation, exact_within_1_ulp)
+{
+    for (Activation activation : {Activation::ReLU, Activation::Sigmoid, Activation::Tanh, Activation::ELU, Activation::GELU, Activation::Swish})
+    {
+        ASSERT_LE(maxUlpError(activation, ActivationAccuracy::Exact, -20.0f, 20.0f), 1) << Chianti::Kernels::activationName(activation);
+    }
+}
+
+TEST(Activation, fast_error_bounds)
+{
+    // The error of GELU grows with the magnitude of the argument of exp, which is rounded to float
+    const std::vector<std::pair<Activation, int64_t>> bounds = {
+            {Activation::ReLU, 0},
+            {Activation::Sigmoid, 8},
+            {Activation::Tanh, 8},
+            {Activation::ELU, 8},
+            {Activation::GELU, 256},
+            {Activation::Swish, 8}
+    };
+
+    for (const auto & bound : bounds)
+    {
+        ASSERT_LE(maxUlpError(bound.first, ActivationAccuracy::Fast, -20.0f, 20.0f), bound.second) << Chianti::Kernels::activationName(bound.first);
+    }
+    ASSERT_LE(maxUlpError(Activation::GELU, ActivationAccuracy::Fast, -5.0f, 5.0f), 64);
+}
+
+TEST(Activation, fast_tiers_error_bounds)
+{
+    // The vectorized variants compute the approximations of the portable variant, with the same error bounds
+    const std::vector<std::pair<Activation, int64_t>> bounds = {
+            {Activation::Sigmoid, 8},
+            {Activation::Tanh, 8},
+            {Activation::ELU, 8},
+            {Activation::GELU, 256},
+            {Activation::Swish, 8}
+    };
+
+    const auto & kernels = Chianti::Kernels::fastActivationKernels();
+    for (auto tier : kernels.tiers())
+    {
+        if (tier > Chianti::Kernels::detectCpuTier())
+        {
+            continue;
+        }
+        const auto kernel = kernels.select(tier);
+        for (const auto & bound : bounds)
+        {
+            const Activation activation = bound.first;
+            const auto apply = [=](float * data, size_t size) { kernel(activation, data, size); };
+            ASSERT_LE(maxUlpError(activation, apply, -20.0f, 20.0f), bound.second) << Chianti::Kernels::activationName(activation) << " " << Chianti::Kernels::cpuTierName(tier);
+        }
+    }
+}
+
+TEST(Activation, fast_tiers_handle_remainders)
+{
+    // Arrange
+    const std::vector<float> input = {-3.0f, -0.5f, 0.0f, 0.25f, 7.0f, -1.0f, 2.0f, 0.5f, -9.5f, 30.0f, -100.0f, 1e-3f, 4.0f, -4.0f, 0.75f, 1.5f, -2.5f, 11.0f, -0.125f};
+
+    for (auto tier : Chianti::Kernels::fastActivationKernels().tiers())
+    {
+        if (tier > Chianti::Kernels::detectCpuTier())
+        {
+            continue;
+        }
+        for (size_t size = 0; size <= input.size(); size++)
+        {
+            // Act
+            auto expected = input;
+            auto actual = input;
+            Chianti::Kernels::applyActivation(Activation::GELU, ActivationAccuracy::Exact, expected.data(), size);
+            Chianti::Kernels::fastActivationKernels().select(tier)(Activation::GELU, actual.data(), size);
+
+            // Assert
+            for (size_t i = 0; i < input.size(); i++)
+            {
+                ASSERT_NEAR(expected[i], actual[i], 1e-5f) << Chianti::Kernels::cpuTierName(tier) << " at " << i << " of " << size;
+            }
+        }
+    }
+}
+
+TEST(Activation, fast_matches_exact_on_short_arrays)
+{
+    // Arrange
+    std::vector<float> exact = {-3.0f, -0.5f, 0.0f, 0.25f, 7.0f};
+    auto fast = exact;
+
+    // Act
+    Chianti::Kernels::applyActivation(Activation::Swish, ActivationAccuracy::Exact, exact.data(), exact.size());
+    Chianti::Kernels::applyActivation(Activation::Swish, ActivationAccuracy::Fast, fast.data(), fast.size());
+
+    // Assert
+    for (size_t i = 0; i < exact.size(); i++)
+    {
+        ASSERT_NEAR(exact[i], fast[i], 1e-6f);
+    }
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "chianti/augmentation.h"
+
+TEST(Augmenter, crop_no_jitter)
+{
+    // Arrange
+    Eigen::Tensor<float, 5> input(4, 4, 1, 1, 1);
+    Eigen::Tensor<float, 5> output(2, 2, 1, 1, 1);
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            input(i, j, 0, 0, 0) = 4 * j + i;
+        }
+    }
+
+    // Act
+    Chianti::Augmentation::Augmenter()
+            .cropSize({2, 2})
+            .randomCrop(false)
+            .flipProbability(0.0)
+            .apply(input, output);
+
+    // Assert
+    ASSERT_FLOAT_EQ(5.0f, output(0, 0, 0, 0, 0));
+    ASSERT_FLOAT_EQ(6.0f, output(1, 0, 0, 0, 0));
+    ASSERT_FLOAT_EQ(9.0f, output(0, 1, 0, 0, 0));
+    ASSERT_FLOAT_EQ(10.0f, output(1, 1, 0, 0, 0));
+}
+
+TEST(Augmenter, flip)
+{
+    // Arrange
+    Eigen::Tensor<float, 5> input(3, 2, 1, 1, 1);
+    Eigen::Tensor<float, 5> output(3, 2, 1, 1, 1);
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            input(i, j, 0, 0, 0) = 3 * j + i;
+        }
+    }
+
+    // Act
+    Chianti::Augmentation::Augmenter()
+            .cropSize({3, 2})
+            .flipProbability(1.0)
+            .apply(input, output);
+
+    // Assert
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            ASSERT_FLOAT_EQ(input(2 - i, j, 0, 0, 0), output(i, j, 0, 0, 0));
+        }
+    }
+}
+
+TEST(Augmenter, normalization)
+{
+    // Arrange
+    Eigen::Tensor<float, 5> input(2, 2, 2, 1, 1);
+    Eigen::Tensor<float, 5> output(2, 2, 2, 1, 1);
+    input.chip(0, 2).setConstant(3.0f);
+    input.chip(1, 2).setConstant(10.0f);
+
+    // Act
+    Chianti::Augmentation::Augmenter()
+            .cropSize({2, 2})
+            .flipProbability(0.0)
+            .mean({1.0f, 4.0f})
+            .std({2.0f, 3.0f})
+            .apply(input, output);
+
+    // Assert
+    ASSERT_FLOAT_EQ(1.0f, output(0, 0, 0, 0, 0));
+    ASSERT_FLOAT_EQ(2.0f, output(1, 1, 1, 0, 0));
+}
+
+TEST(Augmenter, deterministic_across_thread_counts)
+{
+    // Arrange
+    Eigen::Tensor<float, 5> input(32, 24, 3, 1, 16);
+    Eigen::Tensor<float, 5> output1(16, 16, 3, 1, 16);
+    Eigen::Tensor<float, 5> output2(16, 16, 3, 1, 16);
+    input.setRandom();
+
+    auto augmenter = Chianti::Augmentation::Augmenter()
+            .cropSize({16, 16})
+            .scale({0.8, 1.4})
+            .brightness(0.2f)
+            .contrast(0.3f)
+            .seed(42);
+
+    // Act
+    augmenter.numThreads(1).apply(input, output1, 1000);
+    augmenter.numThreads(7).apply(input, output2, 1000);
+
+    // Assert
+    for (long i = 0; i < output1.size(); i++)
+    {
+        ASSERT_EQ(output1.data()[i], output2.data()[i]);
+    }
+}
+
+TEST(Augmenter, sample_depends_on_sample_id)
+{
+    // Arrange
+    auto augmenter = Chianti::Augmentation::Augmenter()
+            .cropSize({16, 16})
+            .brightness(0.5f)
+            .seed(1);
+
+    // Act
+    auto p1 = augmenter.sample(7, 64, 64);
+    auto p2 = augmenter.sample(7, 64, 64);
+    auto p3 = augmenter.sample(8, 64, 64);
+
+    // Assert
+    ASSERT_EQ(p1.offsetX, p2.offsetX);
+    ASSERT_EQ(p1.brightness, p2.brightness);
+    ASSERT_NE(p1.brightness, p3.brightness);
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "chianti/autotune.h"
+
+#include <cstdio>
+#include <sstream>
+#include <thread>
+
+TEST(Autotuner, selects_fastest)
+{
+    // Arrange
+    Chianti::Autotune::Autotuner autotuner("");
+    int numSlowRuns = 0;
+
+    // Act
+    auto selection = autotuner.select("layer", "key", {"slow", "fast"}, [&](const std::string & name) {
+        if (name == "slow")
+        {
+            numSlowRuns++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+
+    // Assert
+    ASSERT_EQ("fast", selection);
+    ASSERT_EQ(4, numSlowRuns);
+    ASSERT_EQ(1, autotuner.report().size());
+    ASSERT_FALSE(autotuner.report()[0].cached);
+}
+
+TEST(Autotuner, persists_selection)
+{
+    // Arrange
+    const std::string path = "chianti-autotune-test.tsv";
+    std::remove(path.c_str());
+    auto slowFirst = [](const std::string & name) {
+        if (name == "a")
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    };
+    Chianti::Autotune::Autotuner(path).select("layer", "key", {"a", "b"}, slowFirst);
+
+    // Act
+    Chianti::Autotune::Autotuner autotuner(path);
+    int numRuns = 0;
+    auto selection = autotuner.select("layer", "key", {"a", "b"}, [&](const std::string &) { numRuns++; });
+    auto fallback = autotuner.select("layer", "key", {"a"}, [&](const std::string &) { numRuns++; });
+
+    // Assert
+    ASSERT_EQ("b", selection);
+    ASSERT_EQ("a", fallback);
+    ASSERT_EQ(4, numRuns);
+    ASSERT_TRUE(autotuner.report()[0].cached);
+
+    std::ostringstream report;
+    autotuner.printReport(report);
+    ASSERT_NE(std::string::npos, report.str().find("(cached)"));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/conv1d.h"
+#include "util.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+    /*!
+     * Computes a causal convolution frame by frame.
+     */
+    std::vector<float> referenceCausalConv1D(
+            const Chianti::Kernels::CausalConv1DConfig & c,
+            const std::vector<float> & input,
+            const std::vector<float> & weights,
+            const std::vector<float> & bias,
+            size_t length,
+            size_t numSequences)
+    {
+        std::vector<float> output(c.numFilters * length * numSequences);
+        for (size_t n = 0; n < numSequences; n++)
+        {
+            for (size_t t = 0; t < length; t++)
+            {
+                for (size_t f = 0; f < c.numFilters; f++)
+                {
+                    double sum = bias[f];
+                    for (size_t k = 0; k < c.filterSize; k++)
+                    {
+                        const size_t offset = (c.filterSize - 1 - k) * c.dilation;
+                        if (t < offset)
+                        {
+                            continue;
+                        }
+                        for (size_t j = 0; j < c.channels; j++)
+                        {
+                            sum += weights[f + c.numFilters * (j + c.channels * k)] * input[(n * length + t - offset) * c.channels + j];
+                        }
+                    }
+                    output[(n * length + t) * c.numFilters + f] = std::max(static_cast<float>(sum), 0.0f);
+                }
+            }
+        }
+        return output;
+    }
+    /*!
+     * Computes a 1D convolution over a static axis sample by sample.
+     */
+    std::vector<float> referenceConv1D(
+            const Chianti::Kernels::Conv1DConfig & c,
+            const std::vector<float> & input,
+            const std::vector<float> & weights,
+            const std::vector<float> & bias,
+            size_t numSamples)
+    {
+        std::vector<float> output(c.outputSize() * numSamples);
+        for (size_t n = 0; n < numSamples; n++)
+        {
+            for (size_t f = 0; f < c.numFilters; f++)
+            {
+                for (size_t x = 0; x < c.outputLength; x++)
+                {
+                    double sum = bias[f];
+                    for (size_t j = 0; j < c.channels; j++)
+                    {
+                        for (size_t k = 0; k < c.filterSize; k++)
+                        {
+                            const int64_t position = static_cast<int64_t>(x * c.stride + k * c.dilation) - c.pad;
+                            if (position >= 0 && position < static_cast<int64_t>(c.inputLength))
+                            {
+                                sum += weights[k + c.filterSize * (j + c.channels * f)] * input[n * c.inputSize() + j * c.inputLength + position];
+                            }
+                        }
+                    }
+                    output[n * c.outputSize() + f * c.outputLength + x] = std::max(static_cast<float>(sum), 0.0f);
+                }
+            }
+        }
+        return output;
+    }
+}
+
+TEST(CausalConv1DPlan, matches_reference)
+{
+    // Arrange
+    const Chianti::Kernels::CausalConv1DConfig config = { 3, 5, 4, 2, Chianti::Kernels::Activation::ReLU };
+    const size_t length = 20;
+    const size_t numSequences = 3;
+    const auto input = TestUtil::randomVector(config.channels * length * numSequences, 1);
+    const auto weights = TestUtil::randomVector(config.numFilters * config.channels * config.filterSize, 2);
+    const auto bias = TestUtil::randomVector(config.numFilters, 3);
+    std::vector<float> output(config.numFilters * length * numSequences);
+
+    Chianti::Kernels::CausalConv1DPlan plan(config, weights.data());
+
+    // Act
+    plan.run(input.data(), bias.data(), output.data(), length, numSequences);
+
+    // Assert
+    const auto expected = referenceCausalConv1D(config, input, weights, bias, length, numSequences);
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        ASSERT_NEAR(expected[i], output[i], 1e-5f);
+    }
+}
+
+TEST(CausalConv1DPlan, streaming_matches_offline)
+{
+    // Arrange
+    const Chianti::Kernels::CausalConv1DConfig config = { 3, 5, 3, 3, Chianti::Kernels::Activation::ReLU };
+    const size_t length = 23;
+    const size_t numSequences = 2;
+    const auto input = TestUtil::randomVector(config.channels * length * numSequences, 1);
+    const auto weights = TestUtil::randomVector(config.numFilters * config.channels * config.filterSize, 2);
+    const auto bias = TestUtil::randomVector(config.numFilters, 3);
+
+    Chianti::Kernels::CausalConv1DPlan plan(config, weights.data());
+    std::vector<float> expected(config.numFilters * length * numSequences);
+    plan.run(input.data(), bias.data(), expected.data(), length, numSequences);
+
+    // Act
+    Chianti::Kernels::CausalConv1DState state;
+    std::vector<float> actual(expected.size());
+    size_t first = 0;
+
+    // The chunks are shorter and longer than the history of 6 frames
+    for (size_t chunk : {2, 1, 0, 9, 4, 7})
+    {
+        std::vector<float> chunkInput(config.channels * chunk * numSequences);
+        std::vector<float> chunkOutput(config.numFilters * chunk * numSequences);
+        for (size_t n = 0; n < numSequences; n++)
+        {
+            std::copy_n(input.data() + (n * length + first) * config.channels, chunk * config.channels, chunkInput.data() + n * chunk * config.channels);
+        }
+
+        plan.run(chunkInput.data(), bias.data(), chunkOutput.data(), chunk, numSequences, &state);
+
+        for (size_t n = 0; n < numSequences; n++)
+        {
+            std::copy_n(chunkOutput.data() + n * chunk * config.numFilters, chunk * config.numFilters, actual.data() + (n * length + first) * config.numFilters);
+        }
+        first += chunk;
+    }
+
+    // Assert
+    ASSERT_EQ(length, first);
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected[i], actual[i], 1e-6f);
+    }
+}
+
+TEST(Conv1DPlan, matches_reference)
+{
+    // Arrange
+    struct Case
+    {
+        size_t inputLength, filterSize, stride, dilation;
+        bool autoPadding;
+        size_t lowerPad, upperPad;
+    };
+    const std::vector<Case> cases = {
+        {700, 5, 1, 1, true, 0, 0},
+        {700, 4, 1, 1, true, 0, 0},
+        {700, 3, 2, 1, true, 0, 0},
+        {700, 3, 1, 4, true, 0, 0},
+        {513, 3, 3, 2, false, 0, 0},
+        {513, 2, 2, 1, false, 3, 1},
+        {9, 4, 1, 2, false, 1, 1},
+        {40, 3, 1, 2, false, 5, 5}
+    };
+
+    // Few channels are unrolled, many channels run one product per tap
+    for (size_t channels : {3, 20})
+    {
+        for (const auto & t : cases)
+        {
+            auto config = Chianti::Kernels::makeConv1DConfig(t.inputLength, channels, 6, t.filterSize, t.stride, t.dilation, t.autoPadding, t.lowerPad, t.upperPad);
+            config.activation = Chianti::Kernels::Activation::ReLU;
+            const size_t numSamples = 2;
+            const auto input = TestUtil::randomVector(config.inputSize() * numSamples, 1);
+            const auto weights = TestUtil::randomVector(config.filterSize * config.channels * config.numFilters, 2);
+            const auto bias = TestUtil::randomVector(config.numFilters, 3);
+            std::vector<float> output(config.outputSize() * numSamples);
+
+            Chianti::Kernels::Conv1DPlan plan(config, weights.data());
+
+            // Act
+            plan.run(input.data(), bias.data(), output.data(), numSamples);
+
+            // Assert
+            const auto expected = referenceConv1D(config, input, weights, bias, numSamples);
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                ASSERT_NEAR(expected[i], output[i], 1e-4f);
+            }
+        }
+    }
+}
+
+TEST(Conv1DPlan, matches_height_one_conv2d)
+{
+    // Arrange
+    const auto config = Chianti::Kernels::makeConv1DConfig(1000, 4, 8, 5, 2, 1, true);
+    const auto config2D = Chianti::Kernels::makeConv2DConfig(1000, 1, 4, 8, 5, 1, 2, 1, true);
+    const auto input = TestUtil::randomVector(config.inputSize(), 1);
+    const auto weights = TestUtil::randomVector(config.filterSize * config.channels * config.numFilters, 2);
+    const auto bias = TestUtil::randomVector(config.numFilters, 3);
+    std::vector<float> output(config.outputSize());
+    std::vector<float> expected(config2D.outputSize());
+
+    // Act
+    Chianti::Kernels::Conv1DPlan(config, weights.data()).run(input.data(), bias.data(), output.data(), 1);
+    Chianti::Kernels::DirectConv2DPlan(config2D, weights.data()).run(input.data(), bias.data(), expected.data(), 1);
+
+    // Assert
+    ASSERT_EQ(expected.size(), output.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected[i], output[i], 1e-4f);
+    }
+}
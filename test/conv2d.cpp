@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/conv2d.h"
+#include "util.h"
+
+#include <random>
+
+namespace
+{
+    /*!
+     * Straightforward reference implementation of the CNTK convolution.
+     */
+    std::vector<float> referenceConv2D(const Chianti::Kernels::Conv2DConfig & c, const std::vector<float> & input, const std::vector<float> & weights, const std::vector<float> & bias, size_t numSamples)
+    {
+        std::vector<float> output(numSamples * c.outputSize());
+        for (size_t n = 0; n < numSamples; n++)
+        {
+            for (size_t f = 0; f < c.numFilters; f++)
+            {
+                for (size_t y = 0; y < c.outputHeight; y++)
+                {
+                    for (size_t x = 0; x < c.outputWidth; x++)
+                    {
+                        double sum = bias[f];
+                        for (size_t ch = 0; ch < c.inputChannels; ch++)
+                        {
+                            for (size_t j = 0; j < c.filterHeight; j++)
+                            {
+                                for (size_t i = 0; i < c.filterWidth; i++)
+                                {
+                                    const int64_t ix = static_cast<int64_t>(x * c.strideX + i) - c.padX;
+                                    const int64_t iy = static_cast<int64_t>(y * c.strideY + j) - c.padY;
+                                    if (ix < 0 || iy < 0 || ix >= static_cast<int64_t>(c.inputWidth) || iy >= static_cast<int64_t>(c.inputHeight))
+                                    {
+                                        continue;
+                                    }
+                                    sum += weights[i + c.filterWidth * (j + c.filterHeight * (ch + c.inputChannels * f))]
+                                           * input[n * c.inputSize() + ix + c.inputWidth * (iy + c.inputHeight * ch)];
+                                }
+                            }
+                        }
+                        output[n * c.outputSize() + x + c.outputWidth * (y + c.outputHeight * f)] = static_cast<float>(sum);
+                    }
+                }
+            }
+        }
+        return output;
+    }
+
+    /*!
+     * Runs every algorithm that supports a geometry and compares it to the reference.
+     */
+    void checkAllAlgorithms(const Chianti::Kernels::Conv2DConfig & config, size_t numSamples, size_t expectedAlgorithms)
+    {
+        std::mt19937 generator(42);
+        const auto input = TestUtil::randomVector(numSamples * config.inputSize(), generator);
+        const auto weights = TestUtil::randomVector(config.weightSize(), generator);
+        const auto bias = TestUtil::randomVector(config.numFilters, generator);
+        const auto expected = referenceConv2D(config, input, weights, bias, numSamples);
+
+        size_t numChecked = 0;
+        for (const auto & algorithm : Chianti::Kernels::conv2DAlgorithms())
+        {
+            if (!algorithm.supports(config))
+            {
+                continue;
+            }
+
+            std::vector<float> actual(expected.size());
+            algorithm.create(config, weights.data())->run(input.data(), bias.data(), actual.data(), numSamples);
+            numChecked++;
+
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                ASSERT_NEAR(expected[i], actual[i], 1e-3f) << algorithm.name << " at " << i;
+            }
+        }
+
+        ASSERT_EQ(expectedAlgorithms, numChecked);
+    }
+}
+
+TEST(makeConv2DConfig, auto_padding)
+{
+    // Act
+    auto same = Chianti::Kernels::makeConv2DConfig(7, 6, 3, 4, 3, 4, 1, 1, true);
+    auto strided = Chianti::Kernels::makeConv2DConfig(8, 8, 3, 4, 3, 3, 2, 2, true);
+
+    // Assert
+    ASSERT_EQ(7, same.outputWidth);
+    ASSERT_EQ(6, same.outputHeight);
+    ASSERT_EQ(1, same.padX);
+    ASSERT_EQ(2, same.padY);
+    ASSERT_EQ(4, strided.outputWidth);
+    ASSERT_EQ(1, strided.padX);
+}
+
+TEST(makeConv2DConfig, explicit_padding)
+{
+    // Act
+    auto config = Chianti::Kernels::makeConv2DConfig(10, 9, 3, 4, 3, 3, 2, 1, false, {1, 0}, {1, 0});
+
+    // Assert
+    ASSERT_EQ(5, config.outputWidth);
+    ASSERT_EQ(7, config.outputHeight);
+    ASSERT_EQ(1, config.padX);
+    ASSERT_EQ(0, config.padY);
+}
+
+TEST(Conv2DAlgorithms, same_3x3)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(13, 10, 5, 6, 3, 3, 1, 1, true), 2, 3);
+}
+
+TEST(Conv2DAlgorithms, valid_3x3)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(9, 12, 3, 4, 3, 3, 1, 1, false), 1, 3);
+}
+
+TEST(Conv2DAlgorithms, strided_even_filter)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(11, 9, 4, 3, 4, 2, 2, 3, true), 2, 2);
+}
+
+TEST(Conv2DAlgorithms, pointwise)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(17, 23, 8, 5, 1, 1, 1, 1, true), 3, 3);
+}
+
+TEST(Conv2DAlgorithms, strided_pointwise)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(17, 23, 8, 5, 1, 1, 2, 2, true), 1, 3);
+}
+
+TEST(Conv2DAlgorithms, full_padding)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(6, 5, 2, 3, 3, 3, 1, 1, false, {3, 3}, {3, 3}), 1, 3);
+}
+
+TEST(Conv2DAlgorithms, same_7x7)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(21, 18, 3, 4, 7, 7, 1, 1, true), 2, 3);
+}
+
+TEST(Conv2DAlgorithms, tiled_11x11)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(75, 61, 2, 3, 11, 11, 1, 1, false), 1, 3);
+}
+
+TEST(Conv2DAlgorithms, rectangular_large_filter)
+{
+    checkAllAlgorithms(Chianti::Kernels::makeConv2DConfig(40, 13, 2, 2, 9, 4, 1, 1, false, {5, 3}, {5, 3}), 2, 3);
+}
+
+TEST(Conv2DAlgorithms, fused_activations)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makeConv2DConfig(8, 6, 3, 4, 3, 3, 1, 1, true);
+    std::mt19937 generator(7);
+    const auto input = TestUtil::randomVector(2 * config.inputSize(), generator);
+    const auto weights = TestUtil::randomVector(config.weightSize(), generator);
+    const auto bias = TestUtil::randomVector(config.numFilters, generator);
+    const auto expected = referenceConv2D(config, input, weights, bias, 2);
+
+    for (auto activation : {Chianti::Kernels::Activation::ReLU, Chianti::Kernels::Activation::Sigmoid, Chianti::Kernels::Activation::GELU})
+    {
+        config.activation = activation;
+
+        for (const auto & algorithm : Chianti::Kernels::conv2DAlgorithms())
+        {
+            if (!algorithm.supports(config))
+            {
+                continue;
+            }
+
+            // Act
+            std::vector<float> actual(expected.size());
+            algorithm.create(config, weights.data())->run(input.data(), bias.data(), actual.data(), 2);
+
+            // Assert
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                ASSERT_NEAR(Chianti::Kernels::activate(activation, expected[i]), actual[i], 1e-3f) << algorithm.name << " at " << i;
+            }
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/conv3d.h"
+#include "util.h"
+
+#include <random>
+#include <vector>
+
+namespace
+{
+    /*!
+     * Computes the convolution voxel by voxel.
+     */
+    std::vector<float> referenceConv3D(
+            const Chianti::Kernels::Conv3DConfig & c,
+            const std::vector<float> & input,
+            const std::vector<float> & weights,
+            const std::vector<float> & bias,
+            size_t numSamples)
+    {
+        std::vector<float> output(c.outputSize() * numSamples);
+        for (size_t n = 0; n < numSamples; n++)
+        {
+            for (size_t f = 0; f < c.numFilters; f++)
+            {
+                for (size_t z = 0; z < c.outputDepth; z++)
+                {
+                    for (size_t y = 0; y < c.outputHeight; y++)
+                    {
+                        for (size_t x = 0; x < c.outputWidth; x++)
+                        {
+                            double sum = bias[f];
+                            for (size_t ch = 0; ch < c.inputChannels; ch++)
+                            {
+                                for (size_t k = 0; k < c.filterDepth; k++)
+                                {
+                                    for (size_t j = 0; j < c.filterHeight; j++)
+                                    {
+                                        for (size_t i = 0; i < c.filterWidth; i++)
+                                        {
+                                            const int64_t ix = static_cast<int64_t>(x * c.strideX + i) - c.padX;
+                                            const int64_t iy = static_cast<int64_t>(y * c.strideY + j) - c.padY;
+                                            const int64_t iz = static_cast<int64_t>(z * c.strideZ + k) - c.padZ;
+                                            if (ix < 0 || iy < 0 || iz < 0 || ix >= static_cast<int64_t>(c.inputWidth) || iy >= static_cast<int64_t>(c.inputHeight) || iz >= static_cast<int64_t>(c.inputDepth))
+                                            {
+                                                continue;
+                                            }
+                                            const float w = weights[i + c.filterWidth * (j + c.filterHeight * (k + c.filterDepth * (ch + c.inputChannels * f)))];
+                                            sum += w * input[n * c.inputSize() + ix + c.inputWidth * (iy + c.inputHeight * (iz + c.inputDepth * ch))];
+                                        }
+                                    }
+                                }
+                            }
+                            output[n * c.outputSize() + x + c.outputWidth * (y + c.outputHeight * (z + c.outputDepth * f))] = std::max(static_cast<float>(sum), 0.0f);
+                        }
+                    }
+                }
+            }
+        }
+        return output;
+    }
+}
+
+TEST(Conv3DPlan, matches_reference)
+{
+    // Arrange
+    struct Case
+    {
+        std::vector<size_t> filterSize, stride;
+        bool autoPadding;
+        std::vector<size_t> lowerPad, upperPad;
+    };
+    const std::vector<Case> cases = {
+        {{3, 3, 3}, {1, 1, 1}, true, {0, 0, 0}, {0, 0, 0}},
+        {{3, 2, 4}, {2, 1, 2}, true, {0, 0, 0}, {0, 0, 0}},
+        {{3, 3, 3}, {1, 2, 1}, false, {0, 0, 0}, {0, 0, 0}},
+        {{2, 3, 3}, {1, 1, 2}, false, {1, 2, 1}, {0, 1, 2}},
+        {{2, 3, 3}, {1, 1, 1}, false, {2, 3, 3}, {2, 3, 3}},
+        {{1, 1, 1}, {1, 1, 1}, false, {0, 0, 0}, {0, 0, 0}}
+    };
+
+    for (const auto & t : cases)
+    {
+        auto config = Chianti::Kernels::makeConv3DConfig(17, 9, 6, 3, 5, t.filterSize, t.stride, t.autoPadding, t.lowerPad, t.upperPad);
+        config.activation = Chianti::Kernels::Activation::ReLU;
+        const size_t numSamples = 2;
+        const auto input = TestUtil::randomVector(config.inputSize() * numSamples, 1);
+        const auto weights = TestUtil::randomVector(config.numTaps() * config.numFilters, 2);
+        const auto bias = TestUtil::randomVector(config.numFilters, 3);
+        std::vector<float> output(config.outputSize() * numSamples);
+
+        Chianti::Kernels::Conv3DPlan plan(config, weights.data());
+
+        // Act
+        plan.run(input.data(), bias.data(), output.data(), numSamples);
+
+        // Assert
+        const auto expected = referenceConv3D(config, input, weights, bias, numSamples);
+        ASSERT_EQ(expected.size(), output.size());
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected[i], output[i], 1e-4f);
+        }
+    }
+}
+
+TEST(Conv3DPlan, depth_one_matches_conv2d)
+{
+    // Arrange
+    const auto config = Chianti::Kernels::makeConv3DConfig(20, 13, 1, 4, 6, {3, 3, 1}, {1, 2, 1}, true);
+    const auto config2D = Chianti::Kernels::makeConv2DConfig(20, 13, 4, 6, 3, 3, 1, 2, true);
+    const auto input = TestUtil::randomVector(config.inputSize(), 1);
+    const auto weights = TestUtil::randomVector(config.numTaps() * config.numFilters, 2);
+    const auto bias = TestUtil::randomVector(config.numFilters, 3);
+    std::vector<float> output(config.outputSize());
+    std::vector<float> expected(config2D.outputSize());
+
+    // Act
+    Chianti::Kernels::Conv3DPlan(config, weights.data()).run(input.data(), bias.data(), output.data(), 1);
+    Chianti::Kernels::DirectConv2DPlan(config2D, weights.data()).run(input.data(), bias.data(), expected.data(), 1);
+
+    // Assert
+    ASSERT_EQ(expected.size(), output.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected[i], output[i], 1e-4f);
+    }
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include "chianti/chianti.h"
+#include "chianti/conversion.h"
+
+TEST(ImageConverter, uint8_bgr_to_rgb)
+{
+    // Arrange
+    cv::Mat image(2, 3, CV_8UC3);
+    for (int y = 0; y < 2; y++)
+    {
+        for (int x = 0; x < 3; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                image.ptr<uint8_t>(y)[3 * x + c] = static_cast<uint8_t>(100 * c + 10 * y + x);
+            }
+        }
+    }
+
+    Eigen::Tensor<float, 3> output(3, 2, 3);
+
+    // Act
+    Chianti::Conversion::ImageConverter()
+            .swapRB(true)
+            .scale(0.5f)
+            .toBuffer(image, output.data(), 3, 2);
+
+    // Assert
+    for (int y = 0; y < 2; y++)
+    {
+        for (int x = 0; x < 3; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_FLOAT_EQ(0.5f * (100 * (2 - c) + 10 * y + x), output(x, y, c));
+            }
+        }
+    }
+}
+
+TEST(ImageConverter, uint16_single_channel)
+{
+    // Arrange
+    cv::Mat image(3, 2, CV_16UC1);
+    for (int y = 0; y < 3; y++)
+    {
+        for (int x = 0; x < 2; x++)
+        {
+            image.ptr<uint16_t>(y)[x] = static_cast<uint16_t>(1000 * y + x);
+        }
+    }
+
+    Eigen::Tensor<float, 3> output(2, 3, 1);
+
+    // Act
+    Chianti::Conversion::ImageConverter().toBuffer(image, output.data(), 2, 3);
+
+    // Assert
+    for (int y = 0; y < 3; y++)
+    {
+        for (int x = 0; x < 2; x++)
+        {
+            ASSERT_FLOAT_EQ(1000.0f * y + x, output(x, y, 0));
+        }
+    }
+}
+
+TEST(ImageConverter, resize_constant)
+{
+    // Arrange
+    cv::Mat image(5, 7, CV_32FC3);
+    for (int y = 0; y < 5; y++)
+    {
+        for (int x = 0; x < 7; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                image.ptr<float>(y)[3 * x + c] = static_cast<float>(c + 1);
+            }
+        }
+    }
+
+    Eigen::Tensor<float, 3> output(4, 9, 3);
+
+    // Act
+    Chianti::Conversion::ImageConverter().numThreads(3).toBuffer(image, output.data(), 4, 9);
+
+    // Assert
+    for (int y = 0; y < 9; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_FLOAT_EQ(c + 1.0f, output(x, y, c));
+            }
+        }
+    }
+}
+
+TEST(ImageConverter, resize_downscale_by_2)
+{
+    // Arrange
+    cv::Mat image(2, 4, CV_8UC1);
+    for (int x = 0; x < 4; x++)
+    {
+        image.ptr<uint8_t>(0)[x] = static_cast<uint8_t>(10 * x);
+        image.ptr<uint8_t>(1)[x] = static_cast<uint8_t>(10 * x + 20);
+    }
+
+    Eigen::Tensor<float, 3> output(2, 1, 1);
+
+    // Act
+    Chianti::Conversion::ImageConverter().toBuffer(image, output.data(), 2, 1);
+
+    // Assert
+    ASSERT_FLOAT_EQ(15.0f, output(0, 0, 0));
+    ASSERT_FLOAT_EQ(35.0f, output(1, 0, 0));
+}
+
+TEST(ImageConverter, value_slot_round_trip)
+{
+    // Arrange
+    cv::Mat image(4, 5, CV_8UC3);
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 5; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                image.ptr<uint8_t>(y)[3 * x + c] = static_cast<uint8_t>(50 * c + 5 * y + x);
+            }
+        }
+    }
+
+    Eigen::Tensor<float, 5> batch(5, 4, 3, 1, 2);
+    batch.setZero();
+    auto value = Chianti::Util::tensorToValue(batch);
+
+    // Act
+    Chianti::Conversion::ImageConverter().toValue(image, value, 1);
+    cv::Mat result = Chianti::Conversion::toMat(value, 1, CV_8U);
+
+    // Assert
+    ASSERT_FLOAT_EQ(0.0f, batch(4, 3, 2, 0, 0));
+    ASSERT_FLOAT_EQ(50.0f * 2 + 5 * 3 + 4, batch(4, 3, 2, 0, 1));
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 5; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_EQ(image.ptr<uint8_t>(y)[3 * x + c], result.ptr<uint8_t>(y)[3 * x + c]);
+            }
+        }
+    }
+}
+
+TEST(toLabelMat, argmax)
+{
+    // Arrange
+    Eigen::Tensor<float, 5> scores(2, 2, 3, 1, 1);
+    scores.setZero();
+    scores(0, 0, 0, 0, 0) = 1.0f;
+    scores(1, 0, 1, 0, 0) = 1.0f;
+    scores(0, 1, 2, 0, 0) = 1.0f;
+    scores(1, 1, 2, 0, 0) = 1.0f;
+    scores(1, 1, 1, 0, 0) = 2.0f;
+    auto value = Chianti::Util::tensorToValue(scores);
+
+    // Act
+    cv::Mat labels = Chianti::Conversion::toLabelMat(value, 0);
+
+    // Assert
+    ASSERT_EQ(CV_8UC1, labels.type());
+    ASSERT_EQ(0, labels.ptr<uint8_t>(0)[0]);
+    ASSERT_EQ(1, labels.ptr<uint8_t>(0)[1]);
+    ASSERT_EQ(2, labels.ptr<uint8_t>(1)[0]);
+    ASSERT_EQ(1, labels.ptr<uint8_t>(1)[1]);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/dense.h"
+#include "util.h"
+
+#include <random>
+
+namespace
+{
+    /*!
+     * Runs the packed kernel and compares it to a straightforward matrix-vector product.
+     */
+    void checkPackedDense(size_t inputSize, size_t numUnits, size_t numSamples, Chianti::Kernels::Activation activation)
+    {
+        std::mt19937 generator(42);
+        const auto input = TestUtil::randomVector(inputSize * numSamples, generator);
+        const auto weights = TestUtil::randomVector(inputSize * numUnits, generator);
+        const auto bias = TestUtil::randomVector(numUnits, generator);
+
+        Chianti::Kernels::DenseConfig config = {inputSize, numUnits, activation};
+        std::vector<float> actual(numUnits * numSamples);
+        Chianti::Kernels::PackedDensePlan(config, weights.data()).run(input.data(), bias.data(), actual.data(), numSamples);
+
+        for (size_t n = 0; n < numSamples; n++)
+        {
+            for (size_t u = 0; u < numUnits; u++)
+            {
+                double sum = bias[u];
+                for (size_t k = 0; k < inputSize; k++)
+                {
+                    sum += weights[u + numUnits * k] * input[k + inputSize * n];
+                }
+                const float expected = Chianti::Kernels::activate(activation, static_cast<float>(sum));
+                ASSERT_NEAR(expected, actual[u + numUnits * n], 1e-4f) << "unit " << u << " sample " << n;
+            }
+        }
+    }
+}
+
+TEST(PackedDensePlan, single_sample)
+{
+    checkPackedDense(37, 50, 1, Chianti::Kernels::Activation::Identity);
+}
+
+TEST(PackedDensePlan, batch_sizes)
+{
+    for (size_t numSamples = 2; numSamples <= 9; numSamples++)
+    {
+        checkPackedDense(19, 33, numSamples, Chianti::Kernels::Activation::ReLU);
+    }
+}
+
+TEST(PackedDensePlan, empty_batch)
+{
+    // Arrange
+    Chianti::Kernels::DenseConfig config = {2, 2, Chianti::Kernels::Activation::Identity};
+    const std::vector<float> weights = {1, 2, 3, 4};
+    const std::vector<float> input;
+    std::vector<float> output(2, -1.0f);
+
+    // Act
+    Chianti::Kernels::PackedDensePlan(config, weights.data()).run(input.data(), nullptr, output.data(), 0);
+
+    // Assert
+    ASSERT_EQ(-1.0f, output[0]);
+    ASSERT_EQ(-1.0f, output[1]);
+}
+
+TEST(PackedDensePlan, less_units_than_a_panel)
+{
+    checkPackedDense(64, 3, 5, Chianti::Kernels::Activation::Identity);
+}
+
+TEST(PackedDensePlan, no_bias)
+{
+    // Arrange
+    Chianti::Kernels::DenseConfig config = {2, 2, Chianti::Kernels::Activation::Identity};
+    const std::vector<float> weights = {1, 2, 3, 4};
+    const std::vector<float> input = {1, 1};
+    std::vector<float> output(2);
+
+    // Act
+    Chianti::Kernels::PackedDensePlan(config, weights.data()).run(input.data(), nullptr, output.data(), 1);
+
+    // Assert
+    ASSERT_FLOAT_EQ(4.0f, output[0]);
+    ASSERT_FLOAT_EQ(6.0f, output[1]);
+}
@@ -0,0 +1,317 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/dispatch.h"
+#include "chianti/kernels/activation.h"
+#include "chianti/kernels/dense.h"
+#include "chianti/kernels/elementwise.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace
+{
+    /*!
+     * Returns the tiers of a kernel that can run on this machine.
+     */
+    template<typename Function>
+    std::vector<Chianti::Kernels::CpuTier> runnableTiers(const Chianti::Kernels::KernelRegistry<Function> & registry)
+    {
+        std::vector<Chianti::Kernels::CpuTier> result;
+        for (auto tier : registry.tiers())
+        {
+            if (tier <= Chianti::Kernels::detectCpuTier())
+            {
+                result.push_back(tier);
+            }
+        }
+        return result;
+    }
+}
+
+TEST(CpuTier, parse)
+{
+    // Act & Assert
+    for (auto tier : Chianti::Kernels::allCpuTiers())
+    {
+        ASSERT_EQ(tier, Chianti::Kernels::parseCpuTier(Chianti::Kernels::cpuTierName(tier)));
+    }
+    ASSERT_THROW(Chianti::Kernels::parseCpuTier("neon"), Chianti::Exception::IllegalArgumentException);
+}
+
+TEST(CpuTier, process_tier_is_supported)
+{
+    // Act & Assert
+    ASSERT_LE(Chianti::Kernels::cpuTier(), Chianti::Kernels::detectCpuTier());
+}
+
+TEST(KernelRegistry, selects_best_variant)
+{
+    // Arrange
+    Chianti::Kernels::KernelRegistry<int> registry("test", 0);
+    registry.add(Chianti::Kernels::CpuTier::AVX2, 2);
+
+    // Act & Assert
+    ASSERT_EQ(0, registry.select(Chianti::Kernels::CpuTier::Scalar));
+    ASSERT_EQ(0, registry.select(Chianti::Kernels::CpuTier::SSE42));
+    ASSERT_EQ(2, registry.select(Chianti::Kernels::CpuTier::AVX2));
+    ASSERT_EQ(2, registry.select(Chianti::Kernels::CpuTier::AVX512));
+    ASSERT_THROW(registry.add(Chianti::Kernels::CpuTier::SSE42, 1), Chianti::Exception::IllegalArgumentException);
+}
+
+TEST(KernelRegistry, relu_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    auto input = TestUtil::randomVector(37, generator);
+    input[5] = std::numeric_limits<float>::quiet_NaN();
+
+    for (auto tier : runnableTiers(Chianti::Kernels::reluKernels()))
+    {
+        // Act
+        auto actual = input;
+        Chianti::Kernels::reluKernels().select(tier)(actual.data(), actual.size());
+
+        // Assert
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            if (std::isnan(input[i]))
+            {
+                ASSERT_TRUE(std::isnan(actual[i])) << Chianti::Kernels::cpuTierName(tier);
+            }
+            else
+            {
+                ASSERT_EQ(std::max(input[i], 0.0f), actual[i]) << Chianti::Kernels::cpuTierName(tier) << " at " << i;
+            }
+        }
+    }
+}
+
+TEST(KernelRegistry, packed_dense_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    const size_t inputSize = 29;
+    const auto panel = TestUtil::randomVector(inputSize * 16, generator);
+    const auto input = TestUtil::randomVector(inputSize * 4, generator);
+
+    for (size_t numSamples = 1; numSamples <= 4; numSamples++)
+    {
+        for (auto tier : runnableTiers(Chianti::Kernels::packedDenseKernels()))
+        {
+            // Act
+            std::vector<float> actual(16 * numSamples);
+            Chianti::Kernels::packedDenseKernels().select(tier)(panel.data(), input.data(), inputSize, numSamples, actual.data());
+
+            // Assert
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                for (size_t j = 0; j < 16; j++)
+                {
+                    double expected = 0;
+                    for (size_t k = 0; k < inputSize; k++)
+                    {
+                        expected += panel[k * 16 + j] * input[s * inputSize + k];
+                    }
+                    ASSERT_NEAR(expected, actual[s * 16 + j], 1e-4) << Chianti::Kernels::cpuTierName(tier);
+                }
+            }
+        }
+    }
+}
+
+TEST(KernelRegistry, row_kernel_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    const size_t size = 53;
+    auto a = TestUtil::randomVector(size, generator);
+    const auto b = TestUtil::randomVector(size, generator);
+    a[7] = std::numeric_limits<float>::quiet_NaN();
+
+    for (auto tier : runnableTiers(Chianti::Kernels::maxRowsKernels()))
+    {
+        // Act
+        std::vector<float> maximum(size), sum(size);
+        Chianti::Kernels::maxRowsKernels().select(tier)(a.data(), b.data(), maximum.data(), size);
+        Chianti::Kernels::addRowsKernels().select(tier)(a.data(), b.data(), sum.data(), size);
+
+        // Assert
+        for (size_t i = 0; i < size; i++)
+        {
+            const float expected = std::max(a[i], b[i]);
+            ASSERT_TRUE(expected == maximum[i] || (std::isnan(expected) && std::isnan(maximum[i]))) << Chianti::Kernels::cpuTierName(tier) << " at " << i;
+            if (!std::isnan(a[i]))
+            {
+                ASSERT_EQ(a[i] + b[i], sum[i]) << Chianti::Kernels::cpuTierName(tier) << " at " << i;
+            }
+        }
+    }
+}
+
+TEST(KernelRegistry, affine_row_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    const float alpha = 1.75f;
+    const float beta = -0.25f;
+
+    for (size_t size : {0, 1, 7, 16, 37})
+    {
+        const auto input = TestUtil::randomVector(size, generator);
+
+        for (auto tier : runnableTiers(Chianti::Kernels::affineRowKernels()))
+        {
+            // Act
+            std::vector<float> forward(size), reversed(size);
+            Chianti::Kernels::affineRowKernels().select(tier)(input.data(), alpha, beta, forward.data(), size);
+            Chianti::Kernels::reversedAffineRowKernels().select(tier)(input.data(), alpha, beta, reversed.data(), size);
+
+            // Assert
+            for (size_t i = 0; i < size; i++)
+            {
+                ASSERT_NEAR(alpha * input[i] + beta, forward[i], 1e-6f) << Chianti::Kernels::cpuTierName(tier) << " at " << i;
+                ASSERT_NEAR(alpha * input[size - 1 - i] + beta, reversed[i], 1e-6f) << Chianti::Kernels::cpuTierName(tier) << " at " << i;
+            }
+        }
+    }
+}
+
+TEST(KernelRegistry, deinterleave_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    const size_t width = 77;
+    const float scale = 1.0f / 255.0f;
+
+    for (size_t numChannels : {1, 3, 4})
+    {
+        std::vector<uint8_t> pixels(width * numChannels);
+        for (auto & pixel : pixels)
+        {
+            pixel = static_cast<uint8_t>(distribution(generator));
+        }
+
+        for (auto tier : runnableTiers(Chianti::Kernels::deinterleaveKernels()))
+        {
+            // Act
+            std::vector<float> output(width * numChannels);
+            std::vector<float *> planes;
+            for (size_t c = 0; c < numChannels; c++)
+            {
+                planes.push_back(output.data() + c * width);
+            }
+            Chianti::Kernels::deinterleaveKernels().select(tier)(pixels.data(), numChannels, scale, planes.data(), width);
+
+            // Assert
+            for (size_t c = 0; c < numChannels; c++)
+            {
+                for (size_t x = 0; x < width; x++)
+                {
+                    ASSERT_EQ(scale * pixels[x * numChannels + c], planes[c][x]) << Chianti::Kernels::cpuTierName(tier) << " channel " << c << " at " << x;
+                }
+            }
+        }
+    }
+}
+
+namespace
+{
+    /*!
+     * Returns the average time of a function in microseconds.
+     */
+    template<typename Function>
+    double benchmark(Function function, size_t repetitions = 200)
+    {
+        function();
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < repetitions; i++)
+        {
+            function();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    }
+
+    /*!
+     * Prints the time of every runnable tier of a kernel.
+     */
+    template<typename Function, typename Run>
+    void benchmarkTiers(const Chianti::Kernels::KernelRegistry<Function> & registry, Run run, const std::string & label = "")
+    {
+        std::cout << std::left << std::setw(28) << (label.empty() ? registry.name() : label);
+        for (auto tier : Chianti::Kernels::allCpuTiers())
+        {
+            const auto tiers = runnableTiers(registry);
+            if (std::find(tiers.begin(), tiers.end(), tier) == tiers.end())
+            {
+                std::cout << std::setw(12) << "-";
+                continue;
+            }
+            const auto kernel = registry.select(tier);
+            std::cout << std::setw(12) << std::setprecision(3) << benchmark([&]() { run(kernel); });
+        }
+        std::cout << std::endl;
+    }
+}
+
+TEST(KernelRegistry, DISABLED_benchmark_tiers)
+{
+    // Arrange
+    std::mt19937 generator(42);
+    const size_t size = 1 << 16;
+    const auto a = TestUtil::randomVector(size, generator, 4.0f);
+    const auto b = TestUtil::randomVector(size, generator, 4.0f);
+    const auto panel = TestUtil::randomVector(256 * 16, generator);
+    std::vector<float> out(size);
+    std::vector<uint8_t> pixels(3 * size / 4);
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        pixels[i] = static_cast<uint8_t>(i * 7);
+    }
+    std::vector<float *> planes = { out.data(), out.data() + size / 4, out.data() + size / 2 };
+
+    // Act & Print the time in microseconds per call
+    std::cout << std::left << std::setw(28) << "kernel";
+    for (auto tier : Chianti::Kernels::allCpuTiers())
+    {
+        std::cout << std::setw(12) << Chianti::Kernels::cpuTierName(tier);
+    }
+    std::cout << std::endl;
+
+    benchmarkTiers(Chianti::Kernels::reluKernels(), [&](void (* kernel)(float *, size_t)) {
+        std::copy(a.begin(), a.end(), out.begin());
+        kernel(out.data(), size);
+    });
+    for (auto activation : {Chianti::Kernels::Activation::Sigmoid, Chianti::Kernels::Activation::Tanh, Chianti::Kernels::Activation::GELU})
+    {
+        benchmarkTiers(Chianti::Kernels::fastActivationKernels(), [&](void (* kernel)(Chianti::Kernels::Activation, float *, size_t)) {
+            std::copy(a.begin(), a.end(), out.begin());
+            kernel(activation, out.data(), size);
+        }, "fast-activation " + Chianti::Kernels::activationName(activation));
+    }
+    benchmarkTiers(Chianti::Kernels::packedDenseKernels(), [&](Chianti::Kernels::Internal::DenseKernel kernel) {
+        kernel(panel.data(), a.data(), 256, 4, out.data());
+    });
+    benchmarkTiers(Chianti::Kernels::maxRowsKernels(), [&](Chianti::Kernels::BinaryRowKernel kernel) {
+        kernel(a.data(), b.data(), out.data(), size);
+    });
+    benchmarkTiers(Chianti::Kernels::addRowsKernels(), [&](Chianti::Kernels::BinaryRowKernel kernel) {
+        kernel(a.data(), b.data(), out.data(), size);
+    });
+    benchmarkTiers(Chianti::Kernels::affineRowKernels(), [&](Chianti::Kernels::AffineRowKernel kernel) {
+        kernel(a.data(), 1.5f, 0.5f, out.data(), size);
+    });
+    benchmarkTiers(Chianti::Kernels::reversedAffineRowKernels(), [&](Chianti::Kernels::AffineRowKernel kernel) {
+        kernel(a.data(), 1.5f, 0.5f, out.data(), size);
+    });
+    benchmarkTiers(Chianti::Kernels::deinterleaveKernels(), [&](Chianti::Kernels::DeinterleaveKernel kernel) {
+        kernel(pixels.data(), 3, 1.0f / 255.0f, planes.data(), size / 4);
+    });
+}
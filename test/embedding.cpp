@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/embedding.h"
+#include "util.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+TEST(Embedding, gathers_rows)
+{
+    // Arrange
+    const Chianti::Kernels::EmbeddingConfig config = { 50, 7 };
+    const auto table = TestUtil::randomVector(config.numRows * config.numUnits, 42);
+    const std::vector<float> indices = { 3, 49, 0, 3, 17 };
+    std::vector<float> output(indices.size() * config.numUnits);
+
+    // Act
+    const auto rows = Chianti::Kernels::embeddingRows(config, indices.data(), indices.size());
+    Chianti::Kernels::gatherRows(config, table.data(), rows.data(), output.data(), rows.size());
+
+    // Assert
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        const size_t row = static_cast<size_t>(indices[i]);
+        for (size_t u = 0; u < config.numUnits; u++)
+        {
+            ASSERT_EQ(table[row * config.numUnits + u], output[i * config.numUnits + u]);
+        }
+    }
+}
+
+TEST(Embedding, rejects_invalid_indices)
+{
+    // Arrange
+    const Chianti::Kernels::EmbeddingConfig config = { 10, 4 };
+    const std::vector<float> outOfRange = { 2, 10 };
+    const std::vector<float> negative = { -1 };
+    const std::vector<float> fractional = { 2.5f };
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Kernels::embeddingRows(config, outOfRange.data(), outOfRange.size()), Chianti::Exception::IllegalArgumentException);
+    ASSERT_THROW(Chianti::Kernels::embeddingRows(config, negative.data(), negative.size()), Chianti::Exception::IllegalArgumentException);
+    ASSERT_THROW(Chianti::Kernels::embeddingRows(config, fractional.data(), fractional.size()), Chianti::Exception::IllegalArgumentException);
+}
+
+TEST(Embedding, sparse_updates_match_dense_updates)
+{
+    // Arrange
+    const Chianti::Kernels::EmbeddingConfig config = { 100, 6 };
+    const std::vector<size_t> rows = { 7, 91, 7, 0, 42, 7, 91 };
+    const auto gradient = TestUtil::randomVector(rows.size() * config.numUnits, 7);
+    const auto initial = TestUtil::randomVector(config.numRows * config.numUnits, 42);
+
+    for (auto rule : {Chianti::Kernels::SparseUpdateRule::SGD, Chianti::Kernels::SparseUpdateRule::AdaGrad})
+    {
+        // The dense reference scatters every lookup into a gradient of the whole table
+        std::vector<float> dense(config.numRows * config.numUnits, 0.0f);
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            for (size_t u = 0; u < config.numUnits; u++)
+            {
+                dense[rows[i] * config.numUnits + u] += gradient[i * config.numUnits + u];
+            }
+        }
+
+        std::vector<float> expected = initial;
+        std::vector<float> accumulators(config.numRows, 0.0f);
+        for (size_t step = 0; step < 2; step++)
+        {
+            for (size_t r = 0; r < config.numRows; r++)
+            {
+                double squares = 0.0;
+                for (size_t u = 0; u < config.numUnits; u++)
+                {
+                    squares += dense[r * config.numUnits + u] * dense[r * config.numUnits + u];
+                }
+                accumulators[r] += static_cast<float>(squares / config.numUnits);
+                const float scale = rule == Chianti::Kernels::SparseUpdateRule::SGD ? 0.1f : 0.1f / (std::sqrt(accumulators[r]) + 1e-8f);
+                for (size_t u = 0; u < config.numUnits; u++)
+                {
+                    expected[r * config.numUnits + u] -= scale * dense[r * config.numUnits + u];
+                }
+            }
+        }
+
+        // Act
+        Chianti::Kernels::SparseRowGradient sparse;
+        Chianti::Kernels::accumulateRowGradients(config, rows.data(), gradient.data(), rows.size(), sparse);
+
+        std::vector<float> scattered(config.numRows * config.numUnits, 0.0f);
+        Chianti::Kernels::scatterRowGradients(config, sparse, scattered.data());
+
+        Chianti::Kernels::SparseRowUpdater updater(config, rule, 0.1f);
+        std::vector<float> actual = initial;
+        updater.apply(actual.data(), sparse);
+        updater.apply(actual.data(), sparse);
+
+        // Assert
+        ASSERT_EQ(std::vector<size_t>({ 0, 7, 42, 91 }), sparse.rows);
+        for (size_t i = 0; i < dense.size(); i++)
+        {
+            ASSERT_NEAR(dense[i], scattered[i], 1e-6f);
+            ASSERT_NEAR(expected[i], actual[i], 1e-5f);
+        }
+        ASSERT_EQ(rule == Chianti::Kernels::SparseUpdateRule::AdaGrad ? config.numRows * sizeof(float) : 0, updater.stateBytes());
+    }
+}
+
+TEST(SparseRowUpdater, fresh_state)
+{
+    // Arrange
+    const Chianti::Kernels::EmbeddingConfig config = { 8, 3 };
+    Chianti::Kernels::SparseRowGradient gradient;
+    gradient.rows = { 2, 5 };
+    gradient.values = Eigen::MatrixXf::Ones(3, 2);
+
+    Chianti::Kernels::SparseRowUpdater updater(config, Chianti::Kernels::SparseUpdateRule::AdaGrad, 0.1f);
+    std::vector<float> trained(config.numRows * config.numUnits, 0.0f);
+    updater.apply(trained.data(), gradient);
+
+    // Act
+    auto fresh = updater.withFreshState();
+    std::vector<float> expected(trained.size(), 0.0f);
+    std::vector<float> actual(trained.size(), 0.0f);
+    std::vector<float> stale(trained.size(), 0.0f);
+    Chianti::Kernels::SparseRowUpdater(config, Chianti::Kernels::SparseUpdateRule::AdaGrad, 0.1f).apply(expected.data(), gradient);
+    fresh->apply(actual.data(), gradient);
+    updater.apply(stale.data(), gradient);
+
+    // Assert
+    ASSERT_EQ(expected, actual);
+    ASSERT_NE(expected, stale);
+    ASSERT_EQ(updater.stateBytes(), fresh->stateBytes());
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include "chianti/chianti.h"
+#include "chianti/inference.h"
+
+#include <thread>
+
+namespace
+{
+    CNTK::FunctionPtr buildNetwork(CNTK::Variable X, const CNTK::DeviceDescriptor & device)
+    {
+        CNTK::FunctionPtr network = X;
+        network = Chianti::Layers::Conv2DLayer(network, device).filterSize({3, 3}).numFilters(4);
+        network = Chianti::Layers::MaxPool2DLayer(network, device).poolSize({2, 2}).stride({2, 2});
+        network = Chianti::Layers::Conv2DLayer(network, device).filterSize({3, 3}).numFilters(2);
+        return network;
+    }
+}
+
+TEST(ShapeCache, shares_parameters)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    int numBuilds = 0;
+    Chianti::Inference::ShapeCache cache([&](CNTK::Variable X) {
+        numBuilds++;
+        return buildNetwork(X, device);
+    }, { 16, 16, 3 });
+
+    // Act
+    auto small = cache.get({ 8, 10, 3 });
+    auto large = cache.get({ 32, 20, 3 });
+    auto again = cache.get({ 8, 10, 3 });
+
+    // Assert
+    ASSERT_EQ(1, numBuilds);
+    ASSERT_EQ(2, cache.size());
+    ASSERT_EQ(small.network, again.network);
+    ASSERT_EQ(CNTK::NDShape({ 4, 5, 2 }), small.network->Output().Shape());
+    ASSERT_EQ(CNTK::NDShape({ 16, 10, 2 }), large.network->Output().Shape());
+
+    auto prototypeParameters = cache.prototypeNetwork()->Parameters();
+    auto smallParameters = small.network->Parameters();
+    auto largeParameters = large.network->Parameters();
+    ASSERT_EQ(prototypeParameters.size(), smallParameters.size());
+    ASSERT_EQ(prototypeParameters.size(), largeParameters.size());
+    for (size_t i = 0; i < prototypeParameters.size(); i++)
+    {
+        auto prototypeData = prototypeParameters[i].Value()->DataBuffer<float>();
+        bool foundSmall = false;
+        bool foundLarge = false;
+        for (size_t j = 0; j < prototypeParameters.size(); j++)
+        {
+            foundSmall |= smallParameters[j].Value()->DataBuffer<float>() == prototypeData;
+            foundLarge |= largeParameters[j].Value()->DataBuffer<float>() == prototypeData;
+        }
+        ASSERT_TRUE(foundSmall);
+        ASSERT_TRUE(foundLarge);
+    }
+}
+
+TEST(ShapeCache, evicts_least_recently_used)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    Chianti::Inference::ShapeCache cache([&](CNTK::Variable X) {
+        return buildNetwork(X, device);
+    }, { 16, 16, 3 });
+
+    auto probe = Chianti::Inference::estimateActivationBytes(buildNetwork(CNTK::InputVariable({ 16, 16, 3 }, CNTK::DataType::Float), device));
+    cache.memoryBudget(2 * probe);
+
+    // Act
+    auto first = cache.get({ 16, 16, 3 });
+    auto second = cache.get({ 16, 14, 3 });
+    cache.get({ 16, 16, 3 });
+    auto third = cache.get({ 14, 16, 3 });
+    auto secondAgain = cache.get({ 16, 14, 3 });
+
+    // Assert
+    ASSERT_EQ(2, cache.size());
+    ASSERT_LE(cache.bytes(), cache.memoryBudget());
+    ASSERT_NE(second.network, secondAgain.network);
+}
+
+TEST(ShapeCache, cpu_kernels_follow_the_input_shape)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::CPUDevice();
+    Eigen::Tensor<float, 4> W(3, 3, 3, 4);
+    Eigen::Tensor<float, 4> input(8, 10, 3, 1);
+    W.setRandom();
+    input.setRandom();
+
+    auto factory = [&](const std::string & algorithm) {
+        return [&, algorithm](CNTK::Variable X) -> CNTK::FunctionPtr {
+            const bool cntk = algorithm == "cntk";
+            CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device).filterSize({3, 3}).numFilters(4).W(W).algorithm(cntk ? "cntk" : "im2col");
+            network = Chianti::Layers::MaxPool2DLayer(network, device).poolSize({2, 2}).stride({2, 2}).algorithm(cntk ? "cntk" : "direct");
+            return network;
+        };
+    };
+    Chianti::Inference::ShapeCache reference(factory("cntk"), { 16, 16, 3 });
+    Chianti::Inference::ShapeCache cache(factory("cpu"), { 16, 16, 3 });
+
+    auto evaluate = [&](const Chianti::Inference::ShapeVariant & variant) {
+        auto outputVar = variant.network->Output();
+        Eigen::Tensor<float, 4> output(Chianti::Util::convertShape<4>(outputVar.Shape().AppendShape({1})));
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, Chianti::Util::tensorToValue(output)}};
+        variant.network->Forward({{variant.input, Chianti::Util::tensorToValue(input)}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    auto expected = evaluate(reference.get({ 8, 10, 3 }));
+    auto variant = cache.get({ 8, 10, 3 });
+    auto actual = evaluate(variant);
+
+    // Assert
+    ASSERT_EQ(CNTK::NDShape({ 4, 5, 4 }), variant.network->Output().Shape());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f);
+    }
+}
+
+TEST(Model, concurrent_evaluation)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 16, 16, 3 }, CNTK::DataType::Float);
+    Chianti::Inference::Model model(buildNetwork(X, device), device);
+
+    const size_t numThreads = 32;
+    std::vector<Eigen::Tensor<float, 5>> inputs(numThreads);
+    std::vector<Eigen::Tensor<float, 5>> expected(numThreads);
+    auto reference = model.createSession();
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        inputs[i] = Eigen::Tensor<float, 5>(16, 16, 3, 1, 2);
+        inputs[i].setRandom();
+        expected[i] = reference->evaluate(inputs[i]);
+    }
+
+    // Act
+    std::vector<Eigen::Tensor<float, 5>> actual(numThreads);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        threads.emplace_back([&, i]() {
+            for (int repetition = 0; repetition < 10; repetition++)
+            {
+                actual[i] = model.evaluate(inputs[i]);
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    // Assert
+    ASSERT_LE(model.sessionCount(), numThreads);
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        ASSERT_EQ(expected[i].size(), actual[i].size());
+        for (long j = 0; j < actual[i].size(); j++)
+        {
+            ASSERT_FLOAT_EQ(expected[i].data()[j], actual[i].data()[j]);
+        }
+    }
+}
+
+TEST(Model, sessions_share_parameters)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 16, 16, 3 }, CNTK::DataType::Float);
+    auto network = buildNetwork(X, device);
+    Chianti::Inference::Model model(network, device);
+
+    // Act
+    std::vector<std::unique_ptr<Chianti::Inference::Session>> sessions;
+    std::vector<CNTK::FunctionPtr> shared = {network};
+    std::vector<CNTK::FunctionPtr> cloned = {network};
+    for (int i = 0; i < 32; i++)
+    {
+        sessions.push_back(model.createSession());
+        shared.push_back(sessions.back()->sessionNetwork());
+        cloned.push_back(network->Clone(CNTK::ParameterCloningMethod::Clone));
+    }
+
+    // Assert
+    const size_t singleBytes = Chianti::Inference::parameterBytes({network});
+    ASSERT_GT(singleBytes, 0);
+    ASSERT_EQ(singleBytes, Chianti::Inference::parameterBytes(shared));
+    ASSERT_EQ(33 * singleBytes, Chianti::Inference::parameterBytes(cloned));
+}
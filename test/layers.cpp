@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "chianti/chianti.h"
+#include "chianti/inference.h"
 
 
 TEST(Conv2DLayer, pad_shape_same)
@@ -701,6 +702,306 @@ TEST(Conv2DLayer, W_eigen_no_bias)
     ASSERT_FLOAT_EQ(18.0f, output(0, 0, 1, 0, 0));
 }
 
+TEST(Conv2DLayer, algorithms_match_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 7, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(3, 3, 3, 4);
+    Eigen::Tensor<float, 3> b(1, 1, 4);
+    Eigen::Tensor<float, 5> input(9, 7, 3, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device)
+                .filterSize({3, 3})
+                .numFilters(4)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 5> expected = evaluate("cntk");
+
+    // Assert
+    for (const std::string algorithm : {"direct", "im2col", "winograd", "auto"})
+    {
+        Eigen::Tensor<float, 5> actual = evaluate(algorithm);
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f) << algorithm;
+        }
+    }
+}
+
+TEST(Conv2DLayer, fft_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 40, 35, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(7, 7, 3, 4);
+    Eigen::Tensor<float, 3> b(1, 1, 4);
+    Eigen::Tensor<float, 5> input(40, 35, 3, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device)
+                .filterSize({7, 7})
+                .numFilters(4)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 5> expected = evaluate("cntk");
+    Eigen::Tensor<float, 5> actual = evaluate("fft");
+
+    // Assert
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-3f);
+    }
+}
+
+TEST(Conv2DLayer, fused_nonlinearities_match_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 7, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(3, 3, 3, 4);
+    Eigen::Tensor<float, 5> input(9, 7, 3, 1, 2);
+    W.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm, const std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> & nonLinearity) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device)
+                .filterSize({3, 3})
+                .numFilters(4)
+                .W(W)
+                .nonLinearity(nonLinearity)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (auto nonLinearity : {
+            &Chianti::Nonlinearities::sigmoid,
+            &Chianti::Nonlinearities::tanh,
+            &Chianti::Nonlinearities::elu,
+            &Chianti::Nonlinearities::gelu,
+            &Chianti::Nonlinearities::swish})
+    {
+        // Act
+        Eigen::Tensor<float, 5> expected = evaluate("cntk", nonLinearity);
+        Eigen::Tensor<float, 5> actual = evaluate("im2col", nonLinearity);
+
+        // Assert
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f);
+        }
+    }
+}
+
+TEST(Conv2DLayer, global_pooling_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 8, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(3, 3, 3, 6);
+    Eigen::Tensor<float, 3> b(1, 1, 6);
+    Eigen::Tensor<float, 5> input(9, 8, 3, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm, const std::string & pooling, const std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> & nonLinearity) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device)
+                .numFilters(6)
+                .W(W)
+                .b(b)
+                .nonLinearity(nonLinearity)
+                .algorithm(algorithm)
+                .globalPooling(pooling);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // The leaky ReLU cannot be fused, hence, it exercises the unfused pooling
+    const std::vector<std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)>> nonLinearities = {
+            Chianti::Nonlinearities::rectify,
+            Chianti::Nonlinearities::leakyRectify()};
+
+    for (const std::string pooling : {"average", "max"})
+    {
+        for (const auto & nonLinearity : nonLinearities)
+        {
+            // Act
+            Eigen::Tensor<float, 5> expected = evaluate("cntk", pooling, nonLinearity);
+            Eigen::Tensor<float, 5> actual = evaluate("direct", pooling, nonLinearity);
+
+            // Assert
+            ASSERT_EQ(6 * 2, expected.size());
+            ASSERT_EQ(expected.size(), actual.size());
+            for (long i = 0; i < expected.size(); i++)
+            {
+                ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f) << pooling;
+            }
+        }
+    }
+}
+
+TEST(Conv2DLayer, algorithm_unsupported)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 7, 3 }, CNTK::DataType::Float);
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Layers::Conv2DLayer(X, device).filterSize({5, 5}).algorithm("winograd").build(), Chianti::Exception::IllegalArgumentException);
+    ASSERT_THROW(Chianti::Layers::Conv2DLayer(X, device).algorithm("unknown").build(), Chianti::Exception::IllegalArgumentException);
+}
+
+TEST(Conv1DLayer, direct_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 50, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> W(3, 3, 4);
+    Eigen::Tensor<float, 2> b(1, 4);
+    Eigen::Tensor<float, 4> input(50, 3, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm, const std::string & pad, uint64_t stride, uint64_t dilation) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv1DLayer(X, device)
+                .filterSize(3)
+                .numFilters(4)
+                .pad(pad)
+                .stride(stride)
+                .dilation(dilation)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 4> output(Chianti::Util::convertShape<4>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (const std::string pad : {"same", "valid", "full"})
+    {
+        for (uint64_t stride : {1, 2})
+        {
+            for (uint64_t dilation : {1, 3})
+            {
+                // Act
+                Eigen::Tensor<float, 4> expected = evaluate("cntk", pad, stride, dilation);
+                Eigen::Tensor<float, 4> actual = evaluate("direct", pad, stride, dilation);
+
+                // Assert
+                ASSERT_EQ(expected.size(), actual.size());
+                for (long i = 0; i < expected.size(); i++)
+                {
+                    ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f) << pad << " " << stride << " " << dilation;
+                }
+            }
+        }
+    }
+}
+
+TEST(Conv3DLayer, im2col_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 8, 6, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> W(3, 3, 3, 3, 4);
+    Eigen::Tensor<float, 4> b(1, 1, 1, 4);
+    Eigen::Tensor<float, 6> input(9, 8, 6, 3, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm, const std::string & pad) {
+        CNTK::FunctionPtr network = Chianti::Layers::Conv3DLayer(X, device)
+                .numFilters(4)
+                .pad(pad)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 6> output(Chianti::Util::convertShape<6>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (const std::string pad : {"same", "valid"})
+    {
+        // Act
+        Eigen::Tensor<float, 6> expected = evaluate("cntk", pad);
+        Eigen::Tensor<float, 6> actual = evaluate("im2col", pad);
+
+        // Assert
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f) << pad;
+        }
+    }
+}
+
 TEST(MaxPool2DLayer, pad_0)
 {
     // Arrange
@@ -888,6 +1189,63 @@ TEST(MaxPool2DLayer, value)
     ASSERT_FLOAT_EQ(15.0f, output(1, 1, 0, 0, 0));
 }
 
+TEST(MaxPool2DLayer, algorithms_match_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 45, 38, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> input(45, 38, 3, 1, 2);
+    input.setRandom();
+
+    // The padding modes are "auto", "none", explicit, true and false
+    auto evaluate = [&](const std::string & algorithm, size_t padding) {
+        Chianti::Layers::MaxPool2DLayer layer(X, device);
+        layer.poolSize({13, 13}).stride({2, 3}).algorithm(algorithm);
+        switch (padding)
+        {
+            case 1:
+                layer.pad("none");
+                break;
+            case 2:
+                layer.pad({5, 7});
+                break;
+            case 3:
+                layer.pad(true);
+                break;
+            case 4:
+                layer.pad(false);
+                break;
+        }
+        CNTK::FunctionPtr network = layer;
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (size_t padding = 0; padding < 5; padding++)
+    {
+        for (const std::string algorithm : {"direct", "vanherk", "auto"})
+        {
+            // Act
+            Eigen::Tensor<float, 5> expected = evaluate("cntk", padding);
+            Eigen::Tensor<float, 5> actual = evaluate(algorithm, padding);
+
+            // Assert
+            ASSERT_EQ(expected.size(), actual.size());
+            for (long i = 0; i < expected.size(); i++)
+            {
+                ASSERT_EQ(expected.data()[i], actual.data()[i]) << algorithm << " with padding mode " << padding;
+            }
+        }
+    }
+}
+
 TEST(AveragePool2DLayer, value)
 {
     // Arrange
@@ -935,6 +1293,255 @@ TEST(AveragePool2DLayer, value)
     ASSERT_FLOAT_EQ(50.0f / 4.0f, output(1, 1, 0, 0, 0));
 }
 
+TEST(AveragePool2DLayer, integral_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 45, 38, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> input(45, 38, 3, 1, 2);
+    input.setRandom();
+
+    // The padding modes are "auto", "none", explicit, true and false
+    auto evaluate = [&](const std::string & algorithm, size_t padding) {
+        Chianti::Layers::AveragePool2DLayer layer(X, device);
+        layer.poolSize({16, 16}).stride({4, 3}).algorithm(algorithm);
+        switch (padding)
+        {
+            case 1:
+                layer.pad("none");
+                break;
+            case 2:
+                layer.pad({5, 7});
+                break;
+            case 3:
+                layer.pad(true);
+                break;
+            case 4:
+                layer.pad(false);
+                break;
+        }
+        CNTK::FunctionPtr network = layer;
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (size_t padding = 0; padding < 5; padding++)
+    {
+        // Act
+        Eigen::Tensor<float, 5> expected = evaluate("cntk", padding);
+        Eigen::Tensor<float, 5> actual = evaluate("integral", padding);
+
+        // Assert
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-5f) << "padding mode " << padding;
+        }
+    }
+}
+
+TEST(Pool3DLayer, separable_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 11, 8, 7, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 6> input(11, 8, 7, 3, 1, 2);
+    input.setRandom();
+
+    auto evaluate = [&](bool max, const std::string & algorithm) {
+        CNTK::FunctionPtr network;
+        if (max)
+        {
+            network = Chianti::Layers::MaxPool3DLayer(X, device).poolSize({3, 3, 3}).stride({2, 2, 2}).algorithm(algorithm);
+        }
+        else
+        {
+            network = Chianti::Layers::AveragePool3DLayer(X, device).poolSize({3, 3, 3}).stride({2, 2, 2}).algorithm(algorithm);
+        }
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 6> output(Chianti::Util::convertShape<6>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (bool max : {true, false})
+    {
+        // Act
+        Eigen::Tensor<float, 6> expected = evaluate(max, "cntk");
+        Eigen::Tensor<float, 6> actual = evaluate(max, "separable");
+
+        // Assert
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-5f);
+        }
+    }
+}
+
+TEST(GlobalAveragePool2DLayer, shape)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 7, 5, 16 }, CNTK::DataType::Float);
+    CNTK::FunctionPtr network;
+
+    // Act
+    network = Chianti::Layers::GlobalAveragePool2DLayer(X, device);
+    auto outputShape = network->Output().Shape();
+
+    // Assert
+    ASSERT_EQ(3, outputShape.Rank());
+    ASSERT_EQ(1, outputShape[0]);
+    ASSERT_EQ(1, outputShape[1]);
+    ASSERT_EQ(16, outputShape[2]);
+}
+
+TEST(GlobalPool2DLayer, reduce_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 7, 5, 16 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> input(7, 5, 16, 1, 3);
+    input.setRandom();
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 3})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 5> expectedAverage = evaluate(Chianti::Layers::GlobalAveragePool2DLayer(X, device));
+    Eigen::Tensor<float, 5> actualAverage = evaluate(Chianti::Layers::GlobalAveragePool2DLayer(X, device).algorithm("reduce"));
+    Eigen::Tensor<float, 5> expectedMax = evaluate(Chianti::Layers::GlobalMaxPool2DLayer(X, device));
+    Eigen::Tensor<float, 5> actualMax = evaluate(Chianti::Layers::GlobalMaxPool2DLayer(X, device).algorithm("reduce"));
+
+    // Assert
+    ASSERT_EQ(expectedAverage.size(), actualAverage.size());
+    ASSERT_EQ(expectedMax.size(), actualMax.size());
+    for (long i = 0; i < expectedAverage.size(); i++)
+    {
+        ASSERT_NEAR(expectedAverage.data()[i], actualAverage.data()[i], 1e-5f);
+        ASSERT_EQ(expectedMax.data()[i], actualMax.data()[i]);
+    }
+}
+
+TEST(MaxPool2DLayer, arg_max_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 9, 8, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> input(9, 8, 3, 1, 2);
+    input.setRandom();
+
+    CNTK::FunctionPtr expectedNetwork = Chianti::Layers::MaxPool2DLayer(X, device)
+            .poolSize({3, 3})
+            .stride({2, 2});
+    CNTK::FunctionPtr actualNetwork = Chianti::Layers::MaxPool2DLayer(X, device)
+            .poolSize({3, 3})
+            .stride({2, 2})
+            .argMax(true);
+
+    auto expectedVar = expectedNetwork->Output();
+    auto actualVar = actualNetwork->Outputs()[0];
+    Eigen::Tensor<float, 5> expected(Chianti::Util::convertShape<5>(expectedVar.Shape().AppendShape({1, 2})));
+    Eigen::Tensor<float, 5> actual(Chianti::Util::convertShape<5>(actualVar.Shape().AppendShape({1, 2})));
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> expectedOutputs = {{expectedVar, Chianti::Util::tensorToValue(expected)}};
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> actualOutputs = {{actualVar, Chianti::Util::tensorToValue(actual)}};
+
+    // Act
+    expectedNetwork->Forward({{X, Chianti::Util::tensorToValue(input)}}, expectedOutputs, device);
+    actualNetwork->Forward({{X, Chianti::Util::tensorToValue(input)}}, actualOutputs, device);
+
+    // Assert
+    ASSERT_EQ(2, actualNetwork->Outputs().size());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected.data()[i], actual.data()[i]);
+    }
+}
+
+TEST(MaxUnpool2DLayer, restores_maxima)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 8, 6, 2 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 5> input(8, 6, 2, 1, 1);
+    input.setRandom();
+
+    CNTK::FunctionPtr pool = Chianti::Layers::MaxPool2DLayer(X, device)
+            .poolSize({2, 2})
+            .stride({2, 2})
+            .argMax(true);
+
+    CNTK::FunctionPtr network = Chianti::Layers::MaxUnpool2DLayer(pool->Outputs()[0], device)
+            .pool(pool);
+
+    auto outputVar = network->Output();
+    Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 1})));
+    auto inputValue = Chianti::Util::tensorToValue(input);
+    auto outputValue = Chianti::Util::tensorToValue(output);
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+
+    // Act
+    network->Forward({{X, inputValue}}, outputs, device);
+
+    // Assert
+    ASSERT_EQ(8, outputVar.Shape()[0]);
+    ASSERT_EQ(6, outputVar.Shape()[1]);
+    ASSERT_EQ(2, outputVar.Shape()[2]);
+    for (int c = 0; c < 2; c++)
+    {
+        for (int y = 0; y < 6; y++)
+        {
+            for (int x = 0; x < 8; x++)
+            {
+                const int x0 = x - x % 2;
+                const int y0 = y - y % 2;
+                float maximum = input(x0, y0, c, 0, 0);
+                maximum = std::max(maximum, input(x0 + 1, y0, c, 0, 0));
+                maximum = std::max(maximum, input(x0, y0 + 1, c, 0, 0));
+                maximum = std::max(maximum, input(x0 + 1, y0 + 1, c, 0, 0));
+
+                const float expected = input(x, y, c, 0, 0) == maximum ? maximum : 0.0f;
+                ASSERT_EQ(expected, output(x, y, c, 0, 0));
+            }
+        }
+    }
+}
+
+TEST(MaxUnpool2DLayer, requires_arg_max)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 8, 6, 2 }, CNTK::DataType::Float);
+    CNTK::FunctionPtr pool = Chianti::Layers::MaxPool2DLayer(X, device);
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Layers::MaxUnpool2DLayer(pool, device).pool(pool).build(), Chianti::Exception::IllegalArgumentException);
+}
+
 TEST(Upscale2DLayer, scaleFactor_2_2)
 {
     // Arrange
@@ -1430,3 +2037,666 @@ TEST(DenseLayer, weight_initializer_bias_initializer)
     ASSERT_FLOAT_EQ(1, output(1, 0, 4));
 }
 
+
+TEST(DenseLayer, per_pixel_algorithms_match_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 6, 5, 4 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(3, 4);
+    Eigen::Tensor<float, 1> b(3);
+    Eigen::Tensor<float, 5> input(6, 5, 4, 1, 2);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm) {
+        CNTK::FunctionPtr network = Chianti::Layers::DenseLayer(X, device)
+                .numUnits(3)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 5> expected = evaluate("cntk");
+
+    // Assert
+    ASSERT_EQ(6, expected.dimension(0));
+    ASSERT_EQ(5, expected.dimension(1));
+    ASSERT_EQ(3, expected.dimension(2));
+
+    for (const std::string algorithm : {"gemm1x1", "direct", "auto"})
+    {
+        Eigen::Tensor<float, 5> actual = evaluate(algorithm);
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f) << algorithm;
+        }
+    }
+}
+
+TEST(DenseLayer, packed_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 37 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(21, 37);
+    Eigen::Tensor<float, 1> b(21);
+    Eigen::Tensor<float, 3> input(37, 1, 6);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](const std::string & algorithm, size_t numSamples) {
+        CNTK::FunctionPtr network = Chianti::Layers::DenseLayer(X, device)
+                .numUnits(21)
+                .W(W)
+                .b(b)
+                .algorithm(algorithm);
+
+        Eigen::Tensor<float, 3> batch = input.slice(Eigen::array<long, 3>({0, 0, 0}), Eigen::array<long, 3>({37, 1, static_cast<long>(numSamples)}));
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, numSamples})));
+        auto inputValue = Chianti::Util::tensorToValue(batch);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (size_t numSamples : {1, 6})
+    {
+        // Act
+        Eigen::Tensor<float, 3> expected = evaluate("cntk", numSamples);
+        Eigen::Tensor<float, 3> actual = evaluate("packed", numSamples);
+
+        // Assert
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f);
+        }
+    }
+}
+
+TEST(EmbeddingLayer, gather_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::CPUDevice();
+    auto X = CNTK::InputVariable({ 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(5, 40);
+    Eigen::Tensor<float, 3> input(3, 1, 4);
+    W.setRandom();
+    for (long i = 0; i < input.size(); i++)
+    {
+        input.data()[i] = static_cast<float>((i * 17) % 40);
+    }
+
+    auto evaluate = [&](const std::string & algorithm) {
+        CNTK::FunctionPtr network = Chianti::Layers::EmbeddingLayer(X, device)
+                .numRows(40)
+                .numUnits(5)
+                .W(W)
+                .algorithm(algorithm);
+
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 4> output(Chianti::Util::convertShape<4>(outputVar.Shape().AppendShape({1, 4})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 4> expected = evaluate("cntk");
+    Eigen::Tensor<float, 4> actual = evaluate("gather");
+
+    // Assert
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected.data()[i], actual.data()[i]);
+    }
+}
+
+TEST(EmbeddingLayer, sgd_updates_touched_rows)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::CPUDevice();
+    auto X = CNTK::InputVariable({ 1 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(4, 10);
+    Eigen::Tensor<float, 3> input(1, 1, 3);
+    Eigen::Tensor<float, 3> rootGradient(4, 1, 3);
+    W.setRandom();
+    input.setValues({{{2, 7, 2}}});
+    rootGradient.setConstant(1.0f);
+
+    CNTK::FunctionPtr network = Chianti::Layers::EmbeddingLayer(X, device)
+            .numRows(10)
+            .numUnits(4)
+            .W(W)
+            .algorithm("gather")
+            .update("sgd")
+            .learningRate(0.5f);
+    CNTK::Parameter table(network->RootFunction()->Inputs()[1]);
+
+    // Act
+    auto outputVar = network->Output();
+    Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 3})));
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, Chianti::Util::tensorToValue(output)}};
+    auto state = network->Forward({{X, Chianti::Util::tensorToValue(input)}}, outputs, device, {outputVar});
+
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> gradients = {{table, nullptr}};
+    network->Backward(state, {{outputVar, Chianti::Util::tensorToValue(rootGradient)}}, gradients);
+
+    // Assert
+    const float * updated = table.Value()->DataBuffer<float>();
+    const float * gradient = gradients[table]->Data()->DataBuffer<float>();
+    for (long row = 0; row < 10; row++)
+    {
+        const float lookups = row == 2 ? 2.0f : (row == 7 ? 1.0f : 0.0f);
+        for (long u = 0; u < 4; u++)
+        {
+            ASSERT_NEAR(W(u, row) - 0.5f * lookups, updated[row * 4 + u], 1e-6f);
+            ASSERT_EQ(lookups, gradient[row * 4 + u]);
+        }
+    }
+}
+
+TEST(EmbeddingLayer, trigger_updates_without_dense_gradient)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::CPUDevice();
+    auto X = CNTK::InputVariable({ 1 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(4, 10);
+    Eigen::Tensor<float, 3> input(1, 1, 3);
+    Eigen::Tensor<float, 3> rootGradient(4, 1, 3);
+    W.setRandom();
+    input.setValues({{{2, 7, 2}}});
+    rootGradient.setConstant(1.0f);
+
+    CNTK::FunctionPtr network = Chianti::Layers::EmbeddingLayer(X, device)
+            .numRows(10)
+            .numUnits(4)
+            .W(W)
+            .algorithm("gather")
+            .update("sgd")
+            .learningRate(0.5f);
+    CNTK::Parameter table(network->RootFunction()->Inputs()[1]);
+    auto trigger = Chianti::Functions::EmbeddingFunction::updateTrigger(network);
+
+    // Act
+    auto outputVar = network->Output();
+    Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 3})));
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, Chianti::Util::tensorToValue(output)}};
+    auto state = network->Forward({{X, Chianti::Util::tensorToValue(input)}}, outputs, device, {outputVar});
+
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> gradients = {{trigger, nullptr}};
+    network->Backward(state, {{outputVar, Chianti::Util::tensorToValue(rootGradient)}}, gradients);
+
+    // Assert
+    ASSERT_EQ(1u, gradients.size());
+    ASSERT_EQ(0.0f, gradients[trigger]->Data()->DataBuffer<float>()[0]);
+
+    const float * updated = table.Value()->DataBuffer<float>();
+    for (long row = 0; row < 10; row++)
+    {
+        const float lookups = row == 2 ? 2.0f : (row == 7 ? 1.0f : 0.0f);
+        for (long u = 0; u < 4; u++)
+        {
+            ASSERT_NEAR(W(u, row) - 0.5f * lookups, updated[row * 4 + u], 1e-6f);
+        }
+    }
+}
+
+TEST(SoftmaxLayer, fused_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 37 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(37, 1, 4);
+    input.setRandom();
+    input = input * 50.0f;
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 4})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 3> expected = evaluate(Chianti::Layers::SoftmaxLayer(X, device));
+    Eigen::Tensor<float, 3> actual = evaluate(Chianti::Layers::SoftmaxLayer(X, device).algorithm("fused"));
+    Eigen::Tensor<float, 3> top = evaluate(Chianti::Layers::SoftmaxLayer(X, device).topK(3));
+
+    // Assert
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-6f);
+    }
+
+    ASSERT_EQ(3, top.dimension(0));
+    for (long n = 0; n < 4; n++)
+    {
+        std::vector<long> classes(37);
+        for (long c = 0; c < 37; c++)
+        {
+            classes[c] = c;
+        }
+        std::stable_sort(classes.begin(), classes.end(), [&](long a, long b) { return input(a, 0, n) > input(b, 0, n); });
+
+        for (long i = 0; i < 3; i++)
+        {
+            ASSERT_EQ(classes[i], static_cast<long>(top(i, 0, n)));
+        }
+    }
+}
+
+TEST(SoftmaxLayer, top_k_requires_float_class_indices)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ (1 << 24) + 1 }, CNTK::DataType::Float);
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Layers::SoftmaxLayer(X, device).topK(3).build(), Chianti::Exception::IllegalArgumentException);
+    ASSERT_NO_THROW(Chianti::Layers::SoftmaxLayer(X, device).algorithm("fused").build());
+}
+
+TEST(SoftmaxCrossEntropyLayer, fused_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 37 }, CNTK::DataType::Float);
+    auto Y = CNTK::InputVariable({ 37 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(37, 1, 4);
+    Eigen::Tensor<float, 3> labels(37, 1, 4);
+    input.setRandom();
+    input = input * 50.0f;
+    labels.setZero();
+    for (long n = 0; n < 4; n++)
+    {
+        labels((n * 11) % 37, 0, n) = 1.0f;
+    }
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 4})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto labelValue = Chianti::Util::tensorToValue(labels);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}, {Y, labelValue}}, outputs, device);
+        return output;
+    };
+
+    // Act
+    Eigen::Tensor<float, 3> expected = evaluate(Chianti::Layers::SoftmaxCrossEntropyLayer(X, Y, device));
+    Eigen::Tensor<float, 3> actual = evaluate(Chianti::Layers::SoftmaxCrossEntropyLayer(X, Y, device).algorithm("fused"));
+
+    // Assert
+    ASSERT_EQ(4, expected.size());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-3f);
+    }
+}
+
+TEST(SampledSoftmaxLayer, full_matches_dense_softmax)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 6 }, CNTK::DataType::Float);
+    auto Y = CNTK::InputVariable({ 40 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 2> W(40, 6);
+    Eigen::Tensor<float, 1> b(40);
+    Eigen::Tensor<float, 3> input(6, 1, 3);
+    W.setRandom();
+    b.setRandom();
+    input.setRandom();
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 3})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    CNTK::FunctionPtr logits = Chianti::Layers::DenseLayer(X, device)
+            .numUnits(40)
+            .W(W)
+            .b(b)
+            .nonLinearity(Chianti::Nonlinearities::linear);
+
+    // Act
+    Eigen::Tensor<float, 3> expected = evaluate(Chianti::Layers::SoftmaxLayer(logits, device));
+    Eigen::Tensor<float, 3> expectedTop = evaluate(Chianti::Layers::SoftmaxLayer(logits, device).topK(5));
+    Eigen::Tensor<float, 3> actual = evaluate(Chianti::Layers::SampledSoftmaxLayer(X, Y, device).numUnits(40).W(W).b(b).mode("full"));
+    Eigen::Tensor<float, 3> actualTop = evaluate(Chianti::Layers::SampledSoftmaxLayer(X, Y, device).numUnits(40).W(W).b(b).mode("full").topK(5).algorithm("auto"));
+
+    // Assert
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-6f);
+    }
+    ASSERT_EQ(expectedTop.size(), actualTop.size());
+    for (long i = 0; i < expectedTop.size(); i++)
+    {
+        ASSERT_EQ(expectedTop.data()[i], actualTop.data()[i]);
+    }
+}
+
+TEST(SampledSoftmaxLayer, sampled_loss_uses_dense_parameters)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 6 }, CNTK::DataType::Float);
+    auto Y = CNTK::InputVariable({ 1000 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(6, 1, 4);
+    Eigen::Tensor<float, 3> labels(1000, 1, 4);
+    input.setRandom();
+    labels.setZero();
+    for (long n = 0; n < 4; n++)
+    {
+        labels(n * 7, 0, n) = 1.0f;
+    }
+
+    // Act
+    CNTK::FunctionPtr network = Chianti::Layers::SampledSoftmaxLayer(X, Y, device)
+            .numUnits(1000)
+            .numSampled(20);
+
+    auto outputVar = network->Output();
+    Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 4})));
+    auto inputValue = Chianti::Util::tensorToValue(input);
+    auto labelValue = Chianti::Util::tensorToValue(labels);
+    auto outputValue = Chianti::Util::tensorToValue(output);
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+    network->Forward({{X, inputValue}, {Y, labelValue}}, outputs, device);
+
+    // Assert
+    ASSERT_EQ(CNTK::NDShape({ 1 }), outputVar.Shape());
+
+    auto parameters = network->Parameters();
+    ASSERT_EQ(2, parameters.size());
+    for (const auto & parameter : parameters)
+    {
+        ASSERT_TRUE(parameter.Shape() == CNTK::NDShape({ 1000, 6 }) || parameter.Shape() == CNTK::NDShape({ 1000 }));
+    }
+
+    ASSERT_EQ(4, output.size());
+    for (long i = 0; i < output.size(); i++)
+    {
+        ASSERT_TRUE(std::isfinite(output.data()[i]));
+        ASSERT_GE(output.data()[i], 0.0f);
+    }
+}
+
+TEST(SampledSoftmaxLayer, clones_draw_own_streams)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 6 }, CNTK::DataType::Float);
+    auto Y = CNTK::InputVariable({ 1000 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(6, 1, 4);
+    Eigen::Tensor<float, 3> labels(1000, 1, 4);
+    Eigen::Tensor<float, 2> W(1000, 6);
+    input.setRandom();
+    W.setRandom();
+    labels.setZero();
+    for (long n = 0; n < 4; n++)
+    {
+        labels(n * 7, 0, n) = 1.0f;
+    }
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({1, 4})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto labelValue = Chianti::Util::tensorToValue(labels);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}, {Y, labelValue}}, outputs, device);
+        return output;
+    };
+
+    auto build = [&]() -> CNTK::FunctionPtr {
+        return Chianti::Layers::SampledSoftmaxLayer(X, Y, device)
+                .numUnits(1000)
+                .numSampled(20)
+                .W(W)
+                .b(false)
+                .seed(5);
+    };
+
+    // Act
+    auto first = build();
+    auto second = build();
+    std::vector<Eigen::Tensor<float, 3>> firstClones, secondClones;
+    for (int i = 0; i < 2; i++)
+    {
+        firstClones.push_back(evaluate(first->Clone(CNTK::ParameterCloningMethod::Share)));
+        secondClones.push_back(evaluate(second->Clone(CNTK::ParameterCloningMethod::Share)));
+    }
+
+    // Assert: The streams only depend on the seed and the order of cloning
+    bool different = false;
+    for (long i = 0; i < firstClones[0].size(); i++)
+    {
+        ASSERT_EQ(firstClones[0].data()[i], secondClones[0].data()[i]);
+        ASSERT_EQ(firstClones[1].data()[i], secondClones[1].data()[i]);
+        different = different || firstClones[0].data()[i] != firstClones[1].data()[i];
+    }
+    ASSERT_TRUE(different);
+}
+
+TEST(SampledSoftmaxLayer, rejects_zero_class_weights)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 6 }, CNTK::DataType::Float);
+    auto Y = CNTK::InputVariable({ 4 }, CNTK::DataType::Float);
+
+    auto layer = Chianti::Layers::SampledSoftmaxLayer(X, Y, device)
+            .numUnits(4)
+            .numSampled(2);
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Layers::SampledSoftmaxLayer(layer).classWeights({1.0, 0.0, 2.0, 1.0}).build(), Chianti::Exception::IllegalArgumentException);
+    ASSERT_NO_THROW(Chianti::Layers::SampledSoftmaxLayer(layer).classWeights({1.0, 0.5, 2.0, 1.0}).build());
+}
+
+TEST(RecurrentLayer, fused_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 5 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(5, 6, 2);
+    input.setRandom();
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({6, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    for (size_t numGates : {4, 3})
+    {
+        Eigen::Tensor<float, 2> W(numGates * 7, 5);
+        Eigen::Tensor<float, 2> H(numGates * 7, 7);
+        Eigen::Tensor<float, 1> b(numGates * 7);
+        W.setRandom();
+        H.setRandom();
+        b.setRandom();
+
+        auto layer = [&](const std::string & algorithm) -> CNTK::FunctionPtr {
+            if (numGates == 4)
+            {
+                return Chianti::Layers::LSTMLayer(X, device).numUnits(7).W(W).H(H).b(b).algorithm(algorithm);
+            }
+            return Chianti::Layers::GRULayer(X, device).numUnits(7).W(W).H(H).b(b).algorithm(algorithm);
+        };
+
+        // Act
+        Eigen::Tensor<float, 3> expected = evaluate(layer("cntk"));
+        Eigen::Tensor<float, 3> actual = evaluate(layer("fused"));
+
+        // Assert
+        ASSERT_EQ(7 * 6 * 2, expected.size());
+        ASSERT_EQ(expected.size(), actual.size());
+        for (long i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-5f);
+        }
+    }
+}
+
+TEST(CausalConv1DLayer, direct_matches_cntk)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 5 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(5, 9, 2);
+    Eigen::Tensor<float, 3> W(4, 5, 3);
+    Eigen::Tensor<float, 1> b(4);
+    input.setRandom();
+    W.setRandom();
+    b.setRandom();
+
+    auto evaluate = [&](CNTK::FunctionPtr network) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({9, 2})));
+        auto inputValue = Chianti::Util::tensorToValue(input);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{X, inputValue}}, outputs, device);
+        return output;
+    };
+
+    auto layer = [&](const std::string & algorithm) -> CNTK::FunctionPtr {
+        return Chianti::Layers::CausalConv1DLayer(X, device).numFilters(4).filterSize(3).dilation(2).W(W).b(b).algorithm(algorithm);
+    };
+
+    // Act
+    Eigen::Tensor<float, 3> expected = evaluate(layer("cntk"));
+    Eigen::Tensor<float, 3> actual = evaluate(layer("direct"));
+
+    // Assert
+    ASSERT_EQ(4 * 9 * 2, expected.size());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-5f);
+    }
+}
+
+TEST(StreamingLayers, chunks_match_offline)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 5 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 3> input(5, 8, 2);
+    Eigen::Tensor<float, 2> W(4 * 7, 5);
+    Eigen::Tensor<float, 2> H(4 * 7, 7);
+    Eigen::Tensor<float, 3> K(4, 5, 3);
+    input.setRandom();
+    W.setRandom();
+    H.setRandom();
+    K.setRandom();
+
+    auto evaluate = [&](CNTK::FunctionPtr network, const Eigen::Tensor<float, 3> & chunk) {
+        auto outputVar = network->Output();
+        Eigen::Tensor<float, 3> output(Chianti::Util::convertShape<3>(outputVar.Shape().AppendShape({static_cast<size_t>(chunk.dimension(1)), 2})));
+        auto inputValue = Chianti::Util::tensorToValue(chunk);
+        auto outputValue = Chianti::Util::tensorToValue(output);
+        std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+        network->Forward({{network->Arguments()[0], inputValue}}, outputs, device);
+        return output;
+    };
+
+    auto layer = [&](int type, bool streaming) -> CNTK::FunctionPtr {
+        if (type == 0)
+        {
+            return Chianti::Layers::LSTMLayer(X, device).numUnits(7).W(W).H(H).b(false).streaming(streaming);
+        }
+        if (type == 1)
+        {
+            Eigen::array<long, 2> offsets = {{0, 0}};
+            Eigen::array<long, 2> extents = {{3 * 7, 5}};
+            Eigen::array<long, 2> recurrentExtents = {{3 * 7, 7}};
+            Eigen::Tensor<float, 2> gruW = W.slice(offsets, extents);
+            Eigen::Tensor<float, 2> gruH = H.slice(offsets, recurrentExtents);
+            return Chianti::Layers::GRULayer(X, device).numUnits(7).W(gruW).H(gruH).b(false).streaming(streaming);
+        }
+        return Chianti::Layers::CausalConv1DLayer(X, device).numFilters(4).filterSize(3).dilation(2).W(K).b(false).streaming(streaming);
+    };
+
+    for (int type = 0; type < 3; type++)
+    {
+        Eigen::Tensor<float, 3> expected = evaluate(layer(type, false), input);
+        Chianti::Inference::Session session(layer(type, true), device);
+
+        for (int repetition = 0; repetition < 2; repetition++)
+        {
+            // Act
+            session.reset();
+            Eigen::array<long, 3> firstOffsets = {{0, 0, 0}};
+            Eigen::array<long, 3> firstExtents = {{5, 3, 2}};
+            Eigen::array<long, 3> secondOffsets = {{0, 3, 0}};
+            Eigen::array<long, 3> secondExtents = {{5, 5, 2}};
+            Eigen::Tensor<float, 3> first = evaluate(session.sessionNetwork(), input.slice(firstOffsets, firstExtents));
+            Eigen::Tensor<float, 3> second = evaluate(session.sessionNetwork(), input.slice(secondOffsets, secondExtents));
+
+            // Assert
+            for (long n = 0; n < 2; n++)
+            {
+                for (long t = 0; t < 8; t++)
+                {
+                    for (long c = 0; c < expected.dimension(0); c++)
+                    {
+                        const float actual = t < 3 ? first(c, t, n) : second(c, t - 3, n);
+                        ASSERT_NEAR(expected(c, t, n), actual, 1e-5f);
+                    }
+                }
+            }
+        }
+    }
+}
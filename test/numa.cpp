@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "chianti/chianti.h"
+#include "chianti/numa.h"
+
+#include <algorithm>
+#include <set>
+
+TEST(Topology, emulate_partitions_cpus)
+{
+    // Arrange
+    const auto cpus = Chianti::Numa::allowedCpus();
+
+    // Act
+    auto topology = Chianti::Numa::Topology::emulate(2);
+
+    // Assert
+    ASSERT_TRUE(topology.emulated());
+    ASSERT_EQ(2, topology.nodes().size());
+    std::set<int> covered;
+    for (const auto & node : topology.nodes())
+    {
+        ASSERT_FALSE(node.cpus.empty());
+        covered.insert(node.cpus.begin(), node.cpus.end());
+    }
+    ASSERT_EQ(std::set<int>(cpus.begin(), cpus.end()), covered);
+}
+
+TEST(Topology, run_on_node_pins_thread)
+{
+    // Arrange
+    auto topology = Chianti::Numa::Topology::emulate(2);
+    int cpu = -1;
+
+    // Act
+    topology.runOnNode(1, false, [&]() {
+        cpu = sched_getcpu();
+    });
+
+    // Assert
+    const auto & cpus = topology.nodes()[1].cpus;
+    ASSERT_NE(cpus.end(), std::find(cpus.begin(), cpus.end(), cpu));
+}
+
+TEST(ReplicatedModel, replicates_parameters_per_node)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 8, 8, 3 }, CNTK::DataType::Float);
+    CNTK::FunctionPtr network = Chianti::Layers::Conv2DLayer(X, device).filterSize({3, 3}).numFilters(4);
+    auto topology = Chianti::Numa::Topology::emulate(2);
+
+    Chianti::Numa::ReplicatedModel replicated(network, device, topology);
+    Chianti::Numa::ReplicatedModel interleaved(network, device, topology);
+    interleaved.placement("interleave");
+
+    Eigen::Tensor<float, 5> input(8, 8, 3, 1, 2);
+    input.setRandom();
+    auto expected = Chianti::Inference::Model(network, device).evaluate(input);
+
+    // Act
+    auto first = replicated.evaluate(input, 0);
+    auto second = replicated.evaluate(input, 1);
+
+    // Assert
+    const size_t singleBytes = Chianti::Inference::parameterBytes({network});
+    ASSERT_EQ(2 * singleBytes, Chianti::Inference::parameterBytes(replicated.networks()));
+    ASSERT_EQ(singleBytes, Chianti::Inference::parameterBytes(interleaved.networks()));
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_FLOAT_EQ(expected.data()[i], first.data()[i]);
+        ASSERT_FLOAT_EQ(expected.data()[i], second.data()[i]);
+    }
+}
@@ -0,0 +1,355 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/pool2d.h"
+#include "util.h"
+
+#include <limits>
+#include <random>
+
+namespace
+{
+    /*!
+     * Computes the average pooling by summing every window.
+     */
+    std::vector<float> referenceAveragePool(const Chianti::Kernels::Pool2DConfig & c, const std::vector<float> & input, size_t numSamples)
+    {
+        std::vector<float> output(c.outputSize() * numSamples);
+        for (size_t plane = 0; plane < numSamples * c.channels; plane++)
+        {
+            for (size_t oy = 0; oy < c.outputHeight; oy++)
+            {
+                for (size_t ox = 0; ox < c.outputWidth; ox++)
+                {
+                    double sum = 0.0;
+                    size_t count = 0;
+                    for (size_t ky = 0; ky < c.poolHeight; ky++)
+                    {
+                        for (size_t kx = 0; kx < c.poolWidth; kx++)
+                        {
+                            const int64_t x = static_cast<int64_t>(ox * c.strideX + kx) - c.padX;
+                            const int64_t y = static_cast<int64_t>(oy * c.strideY + ky) - c.padY;
+                            if (x >= 0 && y >= 0 && x < static_cast<int64_t>(c.inputWidth) && y < static_cast<int64_t>(c.inputHeight))
+                            {
+                                sum += input[plane * c.inputWidth * c.inputHeight + x + c.inputWidth * y];
+                                count++;
+                            }
+                        }
+                    }
+                    output[plane * c.outputWidth * c.outputHeight + ox + c.outputWidth * oy] = count > 0 ? static_cast<float>(sum / count) : 0.0f;
+                }
+            }
+        }
+        return output;
+    }
+
+    /*!
+     * Computes the max pooling by comparing every pixel of every window.
+     */
+    std::vector<float> referenceMaxPool(const Chianti::Kernels::Pool2DConfig & c, const std::vector<float> & input, size_t numSamples)
+    {
+        std::vector<float> output(c.outputSize() * numSamples);
+        for (size_t plane = 0; plane < numSamples * c.channels; plane++)
+        {
+            for (size_t oy = 0; oy < c.outputHeight; oy++)
+            {
+                for (size_t ox = 0; ox < c.outputWidth; ox++)
+                {
+                    float result = std::numeric_limits<float>::lowest();
+                    for (size_t ky = 0; ky < c.poolHeight; ky++)
+                    {
+                        for (size_t kx = 0; kx < c.poolWidth; kx++)
+                        {
+                            const int64_t x = static_cast<int64_t>(ox * c.strideX + kx) - c.padX;
+                            const int64_t y = static_cast<int64_t>(oy * c.strideY + ky) - c.padY;
+                            if (x >= 0 && y >= 0 && x < static_cast<int64_t>(c.inputWidth) && y < static_cast<int64_t>(c.inputHeight))
+                            {
+                                result = std::max(result, input[plane * c.inputWidth * c.inputHeight + x + c.inputWidth * y]);
+                            }
+                        }
+                    }
+                    output[plane * c.outputWidth * c.outputHeight + ox + c.outputWidth * oy] = result;
+                }
+            }
+        }
+        return output;
+    }
+
+    /*!
+     * Runs both max pooling kernels and checks that they reproduce the reference exactly.
+     */
+    void checkMaxPool(const Chianti::Kernels::Pool2DConfig & config, size_t numSamples)
+    {
+        const auto input = TestUtil::randomVector(config.inputSize() * numSamples, 42);
+        const auto expected = referenceMaxPool(config, input, numSamples);
+
+        std::vector<float> direct(config.outputSize() * numSamples);
+        std::vector<float> vanHerk(config.outputSize() * numSamples);
+        Chianti::Kernels::DirectMaxPool2DPlan(config).run(input.data(), direct.data(), numSamples);
+        Chianti::Kernels::VanHerkMaxPool2DPlan(config).run(input.data(), vanHerk.data(), numSamples);
+
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_EQ(expected[i], direct[i]) << "output " << i << " of " << config.key();
+            ASSERT_EQ(expected[i], vanHerk[i]) << "output " << i << " of " << config.key();
+        }
+    }
+
+    /*!
+     * Runs the integral image kernel and compares it to the reference.
+     */
+    void checkIntegralAveragePool(const Chianti::Kernels::Pool2DConfig & config, size_t numSamples)
+    {
+        const auto input = TestUtil::randomVector(config.inputSize() * numSamples, 42);
+        const auto expected = referenceAveragePool(config, input, numSamples);
+
+        std::vector<float> actual(config.outputSize() * numSamples);
+        Chianti::Kernels::IntegralAveragePool2DPlan(config).run(input.data(), actual.data(), numSamples);
+
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected[i], actual[i], 1e-6f) << "output " << i << " of " << config.key();
+        }
+    }
+}
+
+TEST(Pool2DConfig, auto_padding)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(9, 8, 3, 3, 3, 2, 2, true);
+
+    // Assert
+    ASSERT_EQ(5, config.outputWidth);
+    ASSERT_EQ(4, config.outputHeight);
+    ASSERT_EQ(1, config.padX);
+    ASSERT_EQ(1, config.padY);
+}
+
+TEST(Pool2DConfig, no_padding)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(8, 8, 1, 3, 3, 2, 2, false);
+
+    // Assert
+    ASSERT_EQ(3, config.outputWidth);
+    ASSERT_EQ(3, config.outputHeight);
+    ASSERT_EQ(0, config.padX);
+    ASSERT_EQ(0, config.padY);
+}
+
+TEST(IntegralAveragePool2DPlan, auto_padding)
+{
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 3, 3, 2, 2, true), 2);
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 2, 2, 2, 2, true), 2);
+}
+
+TEST(IntegralAveragePool2DPlan, large_windows)
+{
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(64, 48, 2, 16, 16, 1, 1, true), 1);
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(64, 64, 2, 32, 32, 16, 16, false), 1);
+}
+
+TEST(IntegralAveragePool2DPlan, explicit_padding)
+{
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(10, 7, 2, 4, 3, 3, 2, false, {2, 1}, {2, 1}), 3);
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(5, 5, 1, 3, 3, 1, 1, false, {4, 4}, {4, 4}), 1);
+}
+
+TEST(IntegralAveragePool2DPlan, rectangular_window)
+{
+    checkIntegralAveragePool(Chianti::Kernels::makePool2DConfig(31, 17, 4, 9, 2, 1, 3, true), 2);
+}
+
+TEST(IntegralAveragePool2DPlan, constant_input)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(200, 200, 1, 32, 32, 8, 8, true);
+    std::vector<float> input(config.inputSize(), 1000.0f);
+    std::vector<float> output(config.outputSize());
+
+    // Act
+    Chianti::Kernels::IntegralAveragePool2DPlan(config).run(input.data(), output.data(), 1);
+
+    // Assert
+    for (float value : output)
+    {
+        ASSERT_FLOAT_EQ(1000.0f, value);
+    }
+}
+
+TEST(Pool2DConfig, negative_auto_padding)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(16, 16, 1, 3, 3, 8, 8, true);
+
+    // Assert
+    ASSERT_EQ(2, config.outputWidth);
+    ASSERT_EQ(-2, config.padX);
+}
+
+TEST(MaxPool2DPlan, small_windows)
+{
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 2, 2, 2, 2, true), 2);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 3, 3, 1, 1, true), 2);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 3, 3, 2, 2, false), 2);
+}
+
+TEST(MaxPool2DPlan, large_windows)
+{
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(64, 48, 2, 16, 16, 1, 1, true), 1);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(64, 64, 2, 32, 32, 16, 16, false), 1);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(50, 41, 2, 13, 13, 3, 5, true), 1);
+}
+
+TEST(MaxPool2DPlan, explicit_padding)
+{
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(10, 7, 2, 4, 3, 3, 2, false, {2, 1}, {2, 1}), 3);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(5, 5, 1, 3, 3, 1, 1, false, {4, 4}, {4, 4}), 1);
+}
+
+TEST(MaxPool2DPlan, negative_auto_padding)
+{
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(16, 16, 2, 3, 3, 8, 8, true), 1);
+}
+
+TEST(MaxPool2DPlan, rectangular_window)
+{
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(31, 17, 4, 9, 2, 1, 3, true), 2);
+    checkMaxPool(Chianti::Kernels::makePool2DConfig(31, 17, 4, 1, 7, 1, 1, true), 2);
+}
+
+TEST(VanHerkMaxPool2DPlan, preferred)
+{
+    ASSERT_FALSE(Chianti::Kernels::VanHerkMaxPool2DPlan::preferred(Chianti::Kernels::makePool2DConfig(64, 64, 16, 2, 2, 2, 2, true)));
+    ASSERT_FALSE(Chianti::Kernels::VanHerkMaxPool2DPlan::preferred(Chianti::Kernels::makePool2DConfig(64, 64, 16, 16, 16, 16, 16, true)));
+    ASSERT_TRUE(Chianti::Kernels::VanHerkMaxPool2DPlan::preferred(Chianti::Kernels::makePool2DConfig(64, 64, 16, 5, 5, 1, 1, true)));
+    ASSERT_TRUE(Chianti::Kernels::VanHerkMaxPool2DPlan::preferred(Chianti::Kernels::makePool2DConfig(64, 64, 16, 16, 16, 2, 2, true)));
+}
+
+TEST(GlobalPool2DPlan, average)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makeGlobalPool2DConfig(7, 9, 5);
+    const auto input = TestUtil::randomVector(config.inputSize() * 3, 42);
+    std::vector<float> actual(config.outputSize() * 3);
+
+    // Act
+    Chianti::Kernels::GlobalPool2DPlan(config, Chianti::Kernels::GlobalPooling::Average).run(input.data(), actual.data(), 3);
+
+    // Assert
+    const auto expected = referenceAveragePool(config, input, 3);
+    ASSERT_EQ(15, expected.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected[i], actual[i], 1e-6f);
+    }
+}
+
+TEST(GlobalPool2DPlan, max)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makeGlobalPool2DConfig(56, 56, 4);
+    const auto input = TestUtil::randomVector(config.inputSize() * 2, 42);
+    std::vector<float> actual(config.outputSize() * 2);
+
+    // Act
+    Chianti::Kernels::GlobalPool2DPlan(config, Chianti::Kernels::GlobalPooling::Max).run(input.data(), actual.data(), 2);
+
+    // Assert
+    const auto expected = referenceMaxPool(config, input, 2);
+    ASSERT_EQ(8, expected.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected[i], actual[i]);
+    }
+}
+
+namespace
+{
+    /*!
+     * Runs the pooling with positions, checks the pooled values and that every position points to its maximum.
+     */
+    void checkArgMaxPool(const Chianti::Kernels::Pool2DConfig & c, size_t numSamples)
+    {
+        const auto input = TestUtil::randomVector(c.inputSize() * numSamples, 42);
+        const auto expected = referenceMaxPool(c, input, numSamples);
+
+        Chianti::Kernels::ArgMaxPool2DPlan plan(c);
+        std::vector<float> output(c.outputSize() * numSamples);
+        std::vector<float> indices(plan.indexSize() * numSamples);
+        plan.run(input.data(), output.data(), indices.data(), numSamples);
+
+        std::vector<float> unpooled(c.inputSize() * numSamples);
+        plan.unpool(output.data(), indices.data(), unpooled.data(), numSamples);
+
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_EQ(expected[i], output[i]) << "output " << i << " of " << c.key();
+        }
+
+        // Every maximum of an input pixel is restored, all other pixels are zero
+        std::vector<bool> isMaximum(input.size(), false);
+        for (size_t plane = 0; plane < numSamples * c.channels; plane++)
+        {
+            for (size_t oy = 0; oy < c.outputHeight; oy++)
+            {
+                for (size_t ox = 0; ox < c.outputWidth; ox++)
+                {
+                    for (size_t ky = 0; ky < c.poolHeight; ky++)
+                    {
+                        for (size_t kx = 0; kx < c.poolWidth; kx++)
+                        {
+                            const int64_t x = static_cast<int64_t>(ox * c.strideX + kx) - c.padX;
+                            const int64_t y = static_cast<int64_t>(oy * c.strideY + ky) - c.padY;
+                            const size_t o = plane * c.outputWidth * c.outputHeight + ox + c.outputWidth * oy;
+                            const size_t i = plane * c.inputWidth * c.inputHeight + x + c.inputWidth * y;
+                            if (x >= 0 && y >= 0 && x < static_cast<int64_t>(c.inputWidth) && y < static_cast<int64_t>(c.inputHeight) && input[i] == output[o])
+                            {
+                                isMaximum[i] = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            ASSERT_EQ(isMaximum[i] ? input[i] : 0.0f, unpooled[i]) << "pixel " << i << " of " << c.key();
+        }
+    }
+}
+
+TEST(ArgMaxPool2DPlan, byte_indices)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(8, 8, 3, 2, 2, 2, 2, true);
+    Chianti::Kernels::ArgMaxPool2DPlan plan(config);
+
+    // Assert
+    ASSERT_EQ(1, plan.bytesPerIndex());
+    ASSERT_EQ(12, plan.indexSize());
+    checkArgMaxPool(config, 2);
+}
+
+TEST(ArgMaxPool2DPlan, short_indices)
+{
+    // Arrange
+    auto config = Chianti::Kernels::makePool2DConfig(40, 37, 2, 17, 17, 17, 17, true);
+    Chianti::Kernels::ArgMaxPool2DPlan plan(config);
+
+    // Assert
+    ASSERT_EQ(2, plan.bytesPerIndex());
+    ASSERT_EQ(9, plan.indexSize());
+    checkArgMaxPool(config, 3);
+}
+
+TEST(ArgMaxPool2DPlan, overlapping_windows)
+{
+    checkArgMaxPool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 3, 3, 2, 2, true), 2);
+    checkArgMaxPool(Chianti::Kernels::makePool2DConfig(13, 11, 3, 3, 3, 1, 1, false), 2);
+}
+
+TEST(ArgMaxPool2DPlan, explicit_padding)
+{
+    checkArgMaxPool(Chianti::Kernels::makePool2DConfig(10, 7, 2, 4, 3, 3, 2, false, {2, 1}, {2, 1}), 3);
+    checkArgMaxPool(Chianti::Kernels::makePool2DConfig(16, 16, 2, 3, 3, 8, 8, true), 1);
+}
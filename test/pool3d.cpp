@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/pool3d.h"
+#include "util.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+    /*!
+     * Computes the pooling by visiting every voxel of every window.
+     */
+    std::vector<float> referencePool(const Chianti::Kernels::Pool3DConfig & c, bool average, const std::vector<float> & input, size_t numSamples)
+    {
+        const size_t inputVolume = c.inputWidth * c.inputHeight * c.inputDepth;
+        const size_t outputVolume = c.outputWidth * c.outputHeight * c.outputDepth;
+        std::vector<float> output(c.outputSize() * numSamples);
+        for (size_t volume = 0; volume < numSamples * c.channels; volume++)
+        {
+            for (size_t oz = 0; oz < c.outputDepth; oz++)
+            {
+                for (size_t oy = 0; oy < c.outputHeight; oy++)
+                {
+                    for (size_t ox = 0; ox < c.outputWidth; ox++)
+                    {
+                        double sum = 0.0;
+                        float maximum = std::numeric_limits<float>::lowest();
+                        size_t count = 0;
+                        for (size_t kz = 0; kz < c.poolDepth; kz++)
+                        {
+                            for (size_t ky = 0; ky < c.poolHeight; ky++)
+                            {
+                                for (size_t kx = 0; kx < c.poolWidth; kx++)
+                                {
+                                    const int64_t x = static_cast<int64_t>(ox * c.strideX + kx) - c.padX;
+                                    const int64_t y = static_cast<int64_t>(oy * c.strideY + ky) - c.padY;
+                                    const int64_t z = static_cast<int64_t>(oz * c.strideZ + kz) - c.padZ;
+                                    if (x < 0 || y < 0 || z < 0 || x >= static_cast<int64_t>(c.inputWidth) || y >= static_cast<int64_t>(c.inputHeight) || z >= static_cast<int64_t>(c.inputDepth))
+                                    {
+                                        continue;
+                                    }
+                                    const float value = input[volume * inputVolume + x + c.inputWidth * (y + c.inputHeight * z)];
+                                    sum += value;
+                                    maximum = std::max(maximum, value);
+                                    count++;
+                                }
+                            }
+                        }
+                        const float result = average ? (count > 0 ? static_cast<float>(sum / count) : 0.0f) : maximum;
+                        output[volume * outputVolume + ox + c.outputWidth * (oy + c.outputHeight * oz)] = result;
+                    }
+                }
+            }
+        }
+        return output;
+    }
+}
+
+TEST(Pool3DPlan, matches_reference)
+{
+    // Arrange
+    struct Case
+    {
+        std::vector<size_t> poolSize, stride;
+        bool autoPadding;
+        std::vector<size_t> lowerPad, upperPad;
+    };
+    const std::vector<Case> cases = {
+        {{2, 2, 2}, {2, 2, 2}, true, {0, 0, 0}, {0, 0, 0}},
+        {{3, 3, 3}, {1, 1, 1}, true, {0, 0, 0}, {0, 0, 0}},
+        {{3, 2, 5}, {2, 1, 3}, true, {0, 0, 0}, {0, 0, 0}},
+        {{2, 3, 2}, {2, 2, 1}, false, {0, 0, 0}, {0, 0, 0}},
+        {{3, 3, 3}, {2, 2, 2}, false, {2, 1, 2}, {1, 2, 2}}
+    };
+
+    for (const auto & t : cases)
+    {
+        const auto config = Chianti::Kernels::makePool3DConfig(11, 8, 7, 3, t.poolSize, t.stride, t.autoPadding, t.lowerPad, t.upperPad);
+        const auto input = TestUtil::randomVector(config.inputSize() * 2, 42);
+        std::vector<float> maxOutput(config.outputSize() * 2);
+        std::vector<float> averageOutput(config.outputSize() * 2);
+
+        // Act
+        Chianti::Kernels::MaxPool3DPlan(config).run(input.data(), maxOutput.data(), 2);
+        Chianti::Kernels::AveragePool3DPlan(config).run(input.data(), averageOutput.data(), 2);
+
+        // Assert
+        const auto expectedMax = referencePool(config, false, input, 2);
+        const auto expectedAverage = referencePool(config, true, input, 2);
+        for (size_t i = 0; i < expectedMax.size(); i++)
+        {
+            ASSERT_EQ(expectedMax[i], maxOutput[i]);
+            ASSERT_NEAR(expectedAverage[i], averageOutput[i], 1e-5f);
+        }
+    }
+}
+
+TEST(Pool3DPlan, depth_one_matches_pool2d)
+{
+    // Arrange
+    const auto config = Chianti::Kernels::makePool3DConfig(15, 10, 1, 4, {3, 3, 1}, {2, 2, 1}, true);
+    const auto config2D = Chianti::Kernels::makePool2DConfig(15, 10, 4, 3, 3, 2, 2, true);
+    const auto input = TestUtil::randomVector(config.inputSize() * 1, 42);
+    std::vector<float> output(config.outputSize());
+    std::vector<float> expected(config2D.outputSize());
+
+    // Act
+    Chianti::Kernels::MaxPool3DPlan(config).run(input.data(), output.data(), 1);
+    Chianti::Kernels::DirectMaxPool2DPlan(config2D).run(input.data(), expected.data(), 1);
+
+    // Assert
+    ASSERT_EQ(expected.size(), output.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected[i], output[i]);
+    }
+}
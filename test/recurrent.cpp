@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/recurrent.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    double sigmoid(double x)
+    {
+        return 1.0 / (1.0 + std::exp(-x));
+    }
+
+    /*!
+     * Computes a recurrent layer unit by unit and gate by gate in double precision.
+     */
+    std::vector<float> referenceRecurrent(
+            const Chianti::Kernels::RecurrentConfig & c,
+            const std::vector<float> & input,
+            const std::vector<float> & inputWeights,
+            const std::vector<float> & recurrentWeights,
+            const std::vector<float> & bias,
+            size_t length,
+            size_t numSequences)
+    {
+        const size_t rows = c.numGates() * c.numUnits;
+        std::vector<float> output(c.numUnits * length * numSequences);
+
+        for (size_t n = 0; n < numSequences; n++)
+        {
+            std::vector<double> h(c.numUnits, 0.0);
+            std::vector<double> cell(c.numUnits, 0.0);
+
+            for (size_t t = 0; t < length; t++)
+            {
+                const float * x = input.data() + (n * length + t) * c.inputSize;
+                std::vector<double> gatesX(rows), gatesH(rows);
+                for (size_t r = 0; r < rows; r++)
+                {
+                    gatesX[r] = bias[r];
+                    gatesH[r] = 0.0;
+                    for (size_t k = 0; k < c.inputSize; k++)
+                    {
+                        gatesX[r] += inputWeights[r + k * rows] * x[k];
+                    }
+                    for (size_t k = 0; k < c.numUnits; k++)
+                    {
+                        gatesH[r] += recurrentWeights[r + k * rows] * h[k];
+                    }
+                }
+
+                const size_t u = c.numUnits;
+                std::vector<double> next(u);
+                for (size_t j = 0; j < u; j++)
+                {
+                    if (c.cell == Chianti::Kernels::RecurrentCell::LSTM)
+                    {
+                        const double i = sigmoid(gatesX[j] + gatesH[j]);
+                        const double f = sigmoid(gatesX[u + j] + gatesH[u + j]);
+                        const double g = std::tanh(gatesX[2 * u + j] + gatesH[2 * u + j]);
+                        const double o = sigmoid(gatesX[3 * u + j] + gatesH[3 * u + j]);
+                        cell[j] = f * cell[j] + i * g;
+                        next[j] = o * std::tanh(cell[j]);
+                    }
+                    else
+                    {
+                        const double z = sigmoid(gatesX[j] + gatesH[j]);
+                        const double r = sigmoid(gatesX[u + j] + gatesH[u + j]);
+                        const double candidate = std::tanh(gatesX[2 * u + j] + r * gatesH[2 * u + j]);
+                        next[j] = (1.0 - z) * candidate + z * h[j];
+                    }
+                }
+
+                h = next;
+                for (size_t j = 0; j < u; j++)
+                {
+                    output[(n * length + t) * u + j] = static_cast<float>(h[j]);
+                }
+            }
+        }
+
+        return output;
+    }
+
+    void expectMatchesReference(Chianti::Kernels::RecurrentCell cell, bool withBias)
+    {
+        // Arrange
+        const Chianti::Kernels::RecurrentConfig config = { 7, 13, cell };
+        const size_t rows = config.numGates() * config.numUnits;
+        const size_t length = 9;
+        const size_t numSequences = 5;
+
+        const auto input = TestUtil::randomVector(config.inputSize * length * numSequences, 1, 1.0f);
+        const auto inputWeights = TestUtil::randomVector(rows * config.inputSize, 2, 0.5f);
+        const auto recurrentWeights = TestUtil::randomVector(rows * config.numUnits, 3, 0.5f);
+        const auto bias = withBias ? TestUtil::randomVector(rows, 4, 0.5f) : std::vector<float>(rows, 0.0f);
+        std::vector<float> output(config.numUnits * length * numSequences);
+
+        Chianti::Kernels::RecurrentPlan plan(config, inputWeights.data(), recurrentWeights.data());
+
+        // Act
+        plan.run(input.data(), withBias ? bias.data() : nullptr, output.data(), length, numSequences);
+
+        // Assert
+        const auto expected = referenceRecurrent(config, input, inputWeights, recurrentWeights, bias, length, numSequences);
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            ASSERT_NEAR(expected[i], output[i], 1e-5f);
+        }
+    }
+}
+
+TEST(RecurrentPlan, lstm_matches_reference)
+{
+    expectMatchesReference(Chianti::Kernels::RecurrentCell::LSTM, true);
+}
+
+TEST(RecurrentPlan, lstm_without_bias)
+{
+    expectMatchesReference(Chianti::Kernels::RecurrentCell::LSTM, false);
+}
+
+TEST(RecurrentPlan, gru_matches_reference)
+{
+    expectMatchesReference(Chianti::Kernels::RecurrentCell::GRU, true);
+}
+
+TEST(RecurrentPlan, streaming_matches_offline)
+{
+    for (auto cell : {Chianti::Kernels::RecurrentCell::LSTM, Chianti::Kernels::RecurrentCell::GRU})
+    {
+        // Arrange
+        const Chianti::Kernels::RecurrentConfig config = { 5, 11, cell };
+        const size_t rows = config.numGates() * config.numUnits;
+        const size_t length = 17;
+        const size_t numSequences = 3;
+
+        const auto input = TestUtil::randomVector(config.inputSize * length * numSequences, 1, 1.0f);
+        const auto inputWeights = TestUtil::randomVector(rows * config.inputSize, 2, 0.5f);
+        const auto recurrentWeights = TestUtil::randomVector(rows * config.numUnits, 3, 0.5f);
+        const auto bias = TestUtil::randomVector(rows, 4, 0.5f);
+
+        Chianti::Kernels::RecurrentPlan plan(config, inputWeights.data(), recurrentWeights.data());
+        std::vector<float> expected(config.numUnits * length * numSequences);
+        plan.run(input.data(), bias.data(), expected.data(), length, numSequences);
+
+        // Act
+        Chianti::Kernels::RecurrentState state;
+        std::vector<float> actual(expected.size());
+        size_t first = 0;
+        for (size_t chunk : {1, 4, 0, 7, 5})
+        {
+            // The chunks of all sequences are stored consecutively
+            std::vector<float> chunkInput(config.inputSize * chunk * numSequences);
+            std::vector<float> chunkOutput(config.numUnits * chunk * numSequences);
+            for (size_t n = 0; n < numSequences; n++)
+            {
+                std::copy_n(input.data() + (n * length + first) * config.inputSize, chunk * config.inputSize, chunkInput.data() + n * chunk * config.inputSize);
+            }
+
+            plan.run(chunkInput.data(), bias.data(), chunkOutput.data(), chunk, numSequences, &state);
+
+            for (size_t n = 0; n < numSequences; n++)
+            {
+                std::copy_n(chunkOutput.data() + n * chunk * config.numUnits, chunk * config.numUnits, actual.data() + (n * length + first) * config.numUnits);
+            }
+            first += chunk;
+        }
+
+        // Assert
+        ASSERT_EQ(length, first);
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_NEAR(expected[i], actual[i], 1e-6f);
+        }
+    }
+}
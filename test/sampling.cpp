@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/sampling.h"
+
+#include <cmath>
+#include <random>
+
+TEST(AliasSampler, matches_distribution)
+{
+    // Arrange
+    const auto weights = Chianti::Kernels::logUniformWeights(50);
+    Chianti::Kernels::AliasSampler sampler(weights);
+    std::mt19937_64 generator(42);
+    const size_t numDraws = 2000000;
+    std::vector<size_t> counts(weights.size(), 0);
+
+    // Act
+    for (size_t i = 0; i < numDraws; i++)
+    {
+        counts[sampler(generator)]++;
+    }
+
+    // Assert
+    double total = 0.0;
+    for (double weight : weights)
+    {
+        total += weight;
+    }
+    for (size_t c = 0; c < weights.size(); c++)
+    {
+        const double p = weights[c] / total;
+        ASSERT_NEAR(p, sampler.probability(c), 1e-12);
+
+        // Five standard deviations of the binomial distribution
+        ASSERT_NEAR(p * numDraws, static_cast<double>(counts[c]), 5.0 * std::sqrt(numDraws * p * (1.0 - p)));
+    }
+}
+
+TEST(AliasSampler, never_draws_impossible_classes)
+{
+    // Arrange
+    Chianti::Kernels::AliasSampler sampler({0.0, 3.0, 0.0, 1.0, 0.0});
+    std::mt19937_64 generator(42);
+    std::vector<size_t> counts(5, 0);
+
+    // Act
+    for (size_t i = 0; i < 100000; i++)
+    {
+        counts[sampler(generator)]++;
+    }
+
+    // Assert
+    ASSERT_EQ(0, counts[0]);
+    ASSERT_EQ(0, counts[2]);
+    ASSERT_EQ(0, counts[4]);
+    ASSERT_NEAR(0.75, counts[1] / 100000.0, 0.01);
+}
+
+TEST(AliasSampler, rejects_invalid_weights)
+{
+    // Arrange, Act & Assert
+    ASSERT_THROW(Chianti::Kernels::AliasSampler(std::vector<double>()), Chianti::Exception::IllegalArgumentException);
+    ASSERT_THROW(Chianti::Kernels::AliasSampler({0.0, 0.0}), Chianti::Exception::IllegalArgumentException);
+    ASSERT_THROW(Chianti::Kernels::AliasSampler({1.0, -1.0}), Chianti::Exception::IllegalArgumentException);
+}
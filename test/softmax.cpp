@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "chianti/kernels/softmax.h"
+#include "util.h"
+
+#include <cmath>
+#include <random>
+
+TEST(Softmax, matches_reference)
+{
+    // Arrange
+    const size_t numClasses = 1000;
+    const size_t numSamples = 3;
+    const auto logits = TestUtil::randomVector(numClasses * numSamples, 42, 10.0f);
+    std::vector<float> probabilities(logits.size());
+
+    // Act
+    Chianti::Kernels::softmax(logits.data(), probabilities.data(), numClasses, numSamples);
+
+    // Assert
+    for (size_t n = 0; n < numSamples; n++)
+    {
+        double sum = 0.0;
+        for (size_t c = 0; c < numClasses; c++)
+        {
+            sum += std::exp(static_cast<double>(logits[c + numClasses * n]));
+        }
+        for (size_t c = 0; c < numClasses; c++)
+        {
+            const double expected = std::exp(static_cast<double>(logits[c + numClasses * n])) / sum;
+            ASSERT_NEAR(1.0, probabilities[c + numClasses * n] / expected, 1e-5);
+        }
+    }
+}
+
+TEST(Softmax, large_scores_do_not_overflow)
+{
+    // Arrange
+    const std::vector<float> logits = { 1000.0f, 1000.0f, -1000.0f, 999.0f };
+    std::vector<float> probabilities(logits.size());
+
+    // Act
+    Chianti::Kernels::softmax(logits.data(), probabilities.data(), 4, 1);
+    const float lse = Chianti::Kernels::logSumExp(logits.data(), logits.size());
+
+    // Assert
+    const double e = std::exp(-1.0);
+    ASSERT_NEAR(1.0 / (2.0 + e), probabilities[0], 1e-6);
+    ASSERT_NEAR(1.0 / (2.0 + e), probabilities[1], 1e-6);
+    ASSERT_EQ(0.0f, probabilities[2]);
+    ASSERT_NEAR(e / (2.0 + e), probabilities[3], 1e-6);
+    ASSERT_NEAR(1000.0 + std::log(2.0 + e), lse, 1e-3);
+}
+
+TEST(SoftmaxCrossEntropy, one_hot_labels)
+{
+    // Arrange
+    const size_t numClasses = 100000;
+    const size_t numSamples = 2;
+    const auto logits = TestUtil::randomVector(numClasses * numSamples, 42, 20.0f);
+    std::vector<float> labels(logits.size(), 0.0f);
+    labels[17] = 1.0f;
+    labels[numClasses + 99999] = 1.0f;
+    std::vector<float> loss(numSamples);
+
+    // Act
+    Chianti::Kernels::softmaxCrossEntropy(logits.data(), labels.data(), loss.data(), numClasses, numSamples);
+
+    // Assert
+    const size_t targets[] = { 17, 99999 };
+    for (size_t n = 0; n < numSamples; n++)
+    {
+        double maximum = logits[numClasses * n];
+        for (size_t c = 0; c < numClasses; c++)
+        {
+            maximum = std::max<double>(maximum, logits[c + numClasses * n]);
+        }
+        double sum = 0.0;
+        for (size_t c = 0; c < numClasses; c++)
+        {
+            sum += std::exp(logits[c + numClasses * n] - maximum);
+        }
+        const double expected = maximum + std::log(sum) - logits[targets[n] + numClasses * n];
+        ASSERT_NEAR(expected, loss[n], 1e-3 * std::abs(expected));
+    }
+}
+
+TEST(SoftmaxCrossEntropy, soft_labels)
+{
+    // Arrange
+    const std::vector<float> logits = { 2.0f, -1.0f, 0.5f };
+    const std::vector<float> labels = { 0.25f, 0.25f, 0.5f };
+    float loss;
+
+    // Act
+    Chianti::Kernels::softmaxCrossEntropy(logits.data(), labels.data(), &loss, 3, 1);
+
+    // Assert
+    double sum = 0.0;
+    for (float x : logits)
+    {
+        sum += std::exp(static_cast<double>(x));
+    }
+    double expected = 0.0;
+    for (size_t c = 0; c < 3; c++)
+    {
+        expected -= labels[c] * std::log(std::exp(static_cast<double>(logits[c])) / sum);
+    }
+    ASSERT_NEAR(expected, loss, 1e-5);
+}
+
+TEST(TopK, matches_sorting)
+{
+    // Arrange
+    const size_t numClasses = 5000;
+    const size_t numSamples = 4;
+    const size_t k = 10;
+    const auto logits = TestUtil::randomVector(numClasses * numSamples, 42, 1.0f);
+    std::vector<size_t> classes(k * numSamples);
+
+    // Act
+    Chianti::Kernels::topK(logits.data(), classes.data(), numClasses, k, numSamples);
+
+    // Assert
+    for (size_t n = 0; n < numSamples; n++)
+    {
+        std::vector<size_t> expected(numClasses);
+        for (size_t c = 0; c < numClasses; c++)
+        {
+            expected[c] = c;
+        }
+        const float * x = logits.data() + n * numClasses;
+        std::stable_sort(expected.begin(), expected.end(), [&](size_t a, size_t b) { return x[a] > x[b]; });
+
+        for (size_t i = 0; i < k; i++)
+        {
+            ASSERT_EQ(expected[i], classes[i + k * n]);
+        }
+    }
+}
+
+TEST(TopK, ties_prefer_lower_classes)
+{
+    // Arrange
+    const std::vector<float> logits = { 1.0f, 3.0f, 3.0f, 0.0f, 3.0f, 2.0f };
+    std::vector<size_t> best(1);
+    std::vector<size_t> classes(4);
+
+    // Act
+    Chianti::Kernels::topK(logits.data(), best.data(), 6, 1, 1);
+    Chianti::Kernels::topK(logits.data(), classes.data(), 6, 4, 1);
+
+    // Assert
+    ASSERT_EQ(1, best[0]);
+    ASSERT_EQ(1, classes[0]);
+    ASSERT_EQ(2, classes[1]);
+    ASSERT_EQ(4, classes[2]);
+    ASSERT_EQ(5, classes[3]);
+}
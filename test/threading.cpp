@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include "chianti/threading.h"
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+TEST(Context, covers_range)
+{
+    // Arrange
+    Chianti::Threading::Context context(4);
+    std::vector<int> visits(1000, 0);
+
+    // Act
+    context.parallelFor(visits.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            visits[i]++;
+        }
+    });
+
+    // Assert
+    for (int count : visits)
+    {
+        ASSERT_EQ(1, count);
+    }
+}
+
+TEST(Context, rethrows_exceptions)
+{
+    // Arrange
+    Chianti::Threading::Context context(3);
+
+    // Act & Assert
+    ASSERT_THROW(context.parallelFor(9, 3, [&](size_t begin, size_t) {
+        if (begin > 0)
+        {
+            throw std::runtime_error("failure");
+        }
+    }), std::runtime_error);
+}
+
+TEST(Scope, limits_threads)
+{
+    // Arrange
+    Chianti::Threading::Context context(8);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+
+    // Act
+    {
+        Chianti::Threading::Scope scope(context, 2);
+        Chianti::Threading::parallelFor(64, [&](size_t, size_t) {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        });
+    }
+
+    // Assert
+    ASSERT_LE(threads.size(), 2);
+    ASSERT_EQ(&Chianti::Threading::currentContext(), Chianti::Threading::Context::global().get());
+}
+
+TEST(Scope, nested_loops_complete)
+{
+    // Arrange
+    Chianti::Threading::Context context(4);
+    std::atomic<int> count(0);
+
+    // Act
+    Chianti::Threading::Scope scope(context);
+    Chianti::Threading::parallelFor(8, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            Chianti::Threading::parallelFor(8, [&](size_t innerBegin, size_t innerEnd) {
+                count += static_cast<int>(innerEnd - innerBegin);
+            });
+        }
+    });
+
+    // Assert
+    ASSERT_EQ(64, count.load());
+}
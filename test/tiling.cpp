@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "chianti/chianti.h"
+#include "chianti/tiling.h"
+
+TEST(AxisGeometry, conv_pool_upscale)
+{
+    // Arrange
+    Chianti::Tiling::AxisGeometry geometry;
+
+    // Act
+    geometry.addWindow(3, 1, 1, 1);
+    geometry.addWindow(2, 2, 0, 1);
+    geometry.addWindow(3, 1, 1, 1);
+    geometry.addUpscale(2);
+
+    // Assert
+    ASSERT_EQ(1, geometry.numerator);
+    ASSERT_EQ(1, geometry.denominator);
+    ASSERT_EQ(2, geometry.alignment);
+    ASSERT_DOUBLE_EQ(5.0, geometry.lower);
+    ASSERT_DOUBLE_EQ(4.0, geometry.upper);
+}
+
+TEST(planAxis, covers_output)
+{
+    // Arrange
+    Chianti::Tiling::AxisGeometry geometry;
+    geometry.addWindow(3, 1, 1, 1);
+    geometry.addWindow(2, 2, 0, 1);
+
+    // Act
+    auto tiles = Chianti::Tiling::planAxis(geometry, 37, 19, 8);
+
+    // Assert
+    int64_t next = 0;
+    for (const auto & tile : tiles)
+    {
+        ASSERT_EQ(next, tile.outputBegin);
+        ASSERT_EQ(0, tile.inputBegin % 2);
+        ASSERT_LE(tile.inputEnd, 37);
+        next = tile.outputEnd;
+    }
+    ASSERT_EQ(19, next);
+}
+
+TEST(TiledInference, equals_whole_image)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+
+    Eigen::Tensor<float, 4> W1(3, 3, 2, 4);
+    Eigen::Tensor<float, 4> W2(3, 3, 4, 4);
+    Eigen::Tensor<float, 4> W3(1, 1, 4, 3);
+    W1.setRandom();
+    W2.setRandom();
+    W3.setRandom();
+
+    auto factory = [&](CNTK::Variable X, Chianti::Tiling::Geometry & geometry) -> CNTK::FunctionPtr {
+        CNTK::FunctionPtr network = X;
+        network = geometry.record(Chianti::Layers::Conv2DLayer(network, device).filterSize({3, 3}).numFilters(4).W(W1));
+        network = geometry.record(Chianti::Layers::MaxPool2DLayer(network, device).poolSize({2, 2}).stride({2, 2}));
+        network = geometry.record(Chianti::Layers::Conv2DLayer(network, device).filterSize({3, 3}).numFilters(4).W(W2));
+        network = geometry.record(Chianti::Layers::Upscale2DLayer(network, device).scaleFactor({2, 2}));
+        network = geometry.record(Chianti::Layers::Conv2DLayer(network, device).filterSize({1, 1}).numFilters(3).W(W3).nonLinearity(Chianti::Nonlinearities::linear));
+        return network;
+    };
+
+    Eigen::Tensor<float, 3> image(22, 17, 2);
+    image.setRandom();
+
+    // Compute the reference on the whole image
+    Chianti::Tiling::Geometry geometry;
+    auto X = CNTK::InputVariable({ 22, 17, 2 }, CNTK::DataType::Float);
+    CNTK::FunctionPtr network = factory(X, geometry);
+    auto outputVar = network->Output();
+
+    Eigen::Tensor<float, 5> input = image.reshape(Eigen::array<long int, 5>{22, 17, 2, 1, 1});
+    Eigen::Tensor<float, 5> expected(Chianti::Util::convertShape<5>(outputVar.Shape().AppendShape({1, 1})));
+    auto inputValue = Chianti::Util::tensorToValue(input);
+    auto outputValue = Chianti::Util::tensorToValue(expected);
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+    network->Forward({{X, inputValue}}, outputs, device);
+
+    // Act
+    auto actual = Chianti::Tiling::TiledInference(factory, device)
+            .tileSize({6, 4})
+            .batchSize(3)
+            .numThreads(4)
+            .run(image);
+
+    // Assert
+    ASSERT_EQ(expected.dimension(0), actual.dimension(0));
+    ASSERT_EQ(expected.dimension(1), actual.dimension(1));
+    ASSERT_EQ(expected.dimension(2), actual.dimension(2));
+    for (long i = 0; i < actual.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-4f);
+    }
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include "chianti/chianti.h"
+#include "chianti/transforms.h"
+
+/*!
+ * Runs a network on a single image and returns the output.
+ */
+static Eigen::Tensor<float, 5> forward(CNTK::FunctionPtr network, CNTK::Variable X, Eigen::Tensor<float, 5> & input, const CNTK::DeviceDescriptor & device)
+{
+    auto outputVar = network->Output();
+    auto outputShape = outputVar.Shape().AppendShape({1, 1});
+    Eigen::Tensor<float, 5> output(Chianti::Util::convertShape<5>(outputShape));
+
+    auto inputValue = Chianti::Util::tensorToValue(input);
+    auto outputValue = Chianti::Util::tensorToValue(output);
+
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = {{outputVar, outputValue}};
+    network->Forward({{X, inputValue}}, outputs, device);
+
+    return output;
+}
+
+/*!
+ * Compares a convolution on normalized inputs with its folded counterpart on raw inputs.
+ */
+static void assertFoldingMatches(
+        const Chianti::Values::CompositeValue<Chianti::Values::ArrayValue<uint64_t, 2>, std::string> & pad,
+        const Chianti::Values::ArrayValue<uint64_t, 2> & stride,
+        const std::string & globalPooling = "none",
+        const std::function<CNTK::FunctionPtr(CNTK::FunctionPtr)> & nonLinearity = Chianti::Nonlinearities::linear)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 7, 6, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(3, 3, 3, 2);
+    W.setRandom();
+    Eigen::Tensor<float, 3> b(1, 1, 2);
+    b.setRandom();
+
+    std::vector<float> mean = {0.485f, 0.456f, 0.406f};
+    std::vector<float> std = {0.229f, 0.224f, 0.225f};
+    const float inputScale = 1.0f / 255.0f;
+
+    Eigen::Tensor<float, 5> raw(7, 6, 3, 1, 1);
+    raw.setRandom();
+    raw = raw * 255.0f;
+
+    Eigen::Tensor<float, 5> normalized(7, 6, 3, 1, 1);
+    for (int c = 0; c < 3; c++)
+    {
+        normalized.chip(c, 2) = (raw.chip(c, 2) * inputScale - mean[c]) / std[c];
+    }
+
+    auto layer = Chianti::Layers::Conv2DLayer(X, device)
+            .filterSize({3, 3})
+            .pad(pad)
+            .stride(stride)
+            .numFilters(2)
+            .W(W)
+            .b(b)
+            .nonLinearity(nonLinearity)
+            .globalPooling(globalPooling);
+
+    // Act
+    auto folded = Chianti::Transforms::foldInputNormalization(layer, mean, std, inputScale, device);
+    auto expected = forward(layer, X, normalized, device);
+    auto actual = forward(folded, X, raw, device);
+
+    // Assert
+    ASSERT_TRUE(folded.exact());
+    ASSERT_EQ(expected.size(), actual.size());
+    for (long i = 0; i < expected.size(); i++)
+    {
+        ASSERT_NEAR(expected.data()[i], actual.data()[i], 1e-3f);
+    }
+}
+
+TEST(foldInputNormalization, pad_valid)
+{
+    assertFoldingMatches("valid", {1, 1});
+}
+
+TEST(foldInputNormalization, pad_same)
+{
+    assertFoldingMatches("same", {1, 1});
+}
+
+TEST(foldInputNormalization, pad_explicit_stride_2)
+{
+    assertFoldingMatches({1, 2}, {2, 2});
+}
+
+TEST(foldInputNormalization, pad_full)
+{
+    assertFoldingMatches("full", {1, 1});
+}
+
+TEST(foldInputNormalization, global_average_pooling)
+{
+    // The border correction and the non-linearity have to be applied before the pooling
+    assertFoldingMatches("same", {1, 1}, "average", Chianti::Nonlinearities::rectify);
+}
+
+TEST(foldInputNormalization, global_max_pooling)
+{
+    assertFoldingMatches("full", {1, 1}, "max", Chianti::Nonlinearities::rectify);
+}
+
+TEST(foldInputNormalization, pad_same_stride_2_not_exact)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 7, 6, 3 }, CNTK::DataType::Float);
+
+    Eigen::Tensor<float, 4> W(3, 3, 3, 2);
+    W.setRandom();
+
+    auto layer = Chianti::Layers::Conv2DLayer(X, device)
+            .filterSize({3, 3})
+            .pad("same")
+            .stride({2, 2})
+            .numFilters(2)
+            .W(W)
+            .b(false);
+
+    // Act
+    auto folded = Chianti::Transforms::foldInputNormalization(layer, {0.5f, 0.5f, 0.5f}, {0.2f, 0.2f, 0.2f}, 1.0f, device);
+
+    // Assert
+    ASSERT_FALSE(folded.exact());
+    ASSERT_EQ(0, folded.borderCorrection().size());
+}
+
+TEST(foldInputNormalization, W_initializer)
+{
+    // Arrange
+    auto device = CNTK::DeviceDescriptor::GPUDevice(0);
+    auto X = CNTK::InputVariable({ 7, 6, 3 }, CNTK::DataType::Float);
+
+    auto layer = Chianti::Layers::Conv2DLayer(X, device)
+            .filterSize({3, 3})
+            .numFilters(2);
+
+    // Act & Assert
+    ASSERT_THROW(Chianti::Transforms::foldInputNormalization(layer, {0.5f, 0.5f, 0.5f}, {0.2f, 0.2f, 0.2f}, 1.0f, device), Chianti::Exception::IllegalArgumentException);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+namespace TestUtil
+{
+    /*!
+     * Creates random values in [-scale, scale].
+     *
+     * @param size The number of values
+     * @param generator The random number generator
+     * @param scale The largest magnitude
+     * @return The values
+     */
+    inline std::vector<float> randomVector(size_t size, std::mt19937 & generator, float scale = 1.0f)
+    {
+        std::uniform_real_distribution<float> distribution(-scale, scale);
+        std::vector<float> result(size);
+        for (auto & value : result)
+        {
+            value = distribution(generator);
+        }
+        return result;
+    }
+
+    /*!
+     * Creates random values in [-scale, scale] with a generator of its own.
+     *
+     * @param size The number of values
+     * @param seed The seed of the generator
+     * @param scale The largest magnitude
+     * @return The values
+     */
+    inline std::vector<float> randomVector(size_t size, unsigned seed, float scale = 1.0f)
+    {
+        std::mt19937 generator(seed);
+        return randomVector(size, generator, scale);
+    }
+}